@@ -1,87 +1,549 @@
-#include <stdlib.h>     // malloc, free
+#include <stdlib.h>     // malloc, aligned_alloc, realloc, free
 #include <string.h>     // memset
-
-#include <search.h>     // insque, remque, tsearch
+#include <stdint.h>     // uint*_t, SIZE_MAX
+#include <stdatomic.h>  // atomic_*
+#include <pthread.h>    // pthread_mutex_*
+#include <assert.h>     // assert
 
 #include "cache.h"
 
-struct zseek_cached_frame {
-    struct zseek_cached_frame *next;
-    struct zseek_cached_frame *prev;
-
+// Upper bound on the number of shards a cache is split into
+#define CACHE_MAX_SHARDS_LOG 4  // 16 shards
+// Don't shard below this many frames per shard, to keep eviction meaningful
+#define CACHE_MIN_SHARD_CAPACITY 4
+// Initial number of slots allocated per shard (grown on demand)
+#define CACHE_SHARD_START_SLOTS 4
+// Shards are aligned to this, to avoid false sharing of their locks
+#define CACHE_LINE_SIZE 64
+// 2Q: keep at most this fraction of a shard's entries on probation (A1in)
+#define CACHE_2Q_COLD_DIV 4
+// TinyLFU: counters of the frequency sketch per hash bucket (at least
+// SKETCH_MIN_COUNTERS in all), and hash rows
+#define SKETCH_COUNTERS_PER_BUCKET 4
+#define SKETCH_MIN_COUNTERS 256
+#define SKETCH_DEPTH 4
+#define SKETCH_COUNTER_MAX 15
+// TinyLFU: halve all counters after this many increments per counter
+#define SKETCH_PERIOD_PER_COUNTER 2
+
+#define SLOT_NONE SIZE_MAX
+
+typedef struct {
     zseek_frame_t frame;
-};
-typedef struct zseek_cached_frame zseek_cached_frame_t;
+    size_t next;        // Next slot in the same hash chain (or SLOT_NONE)
+    size_t pins;        // Outstanding zseek_cache_pin() references
+    bool referenced;    // CLOCK second-chance bit
+    bool hot;           // 2Q: in the main (Am) rather than probation queue
+} zseek_cache_slot_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+
+    // Hash table of chains (heads), indexing into slots below
+    size_t *buckets;
+    size_t nb_buckets;  // Always a power of 2
+
+    // The actual cache entries. The first size of them are in use. Once full,
+    // entries are replaced in place (the CLOCK victim). Evicting to respect
+    // a byte budget moves the last entry in the place of the victim.
+    zseek_cache_slot_t *slots;
+    size_t nb_slots;    // Allocated slots
+    size_t size;
+    size_t capacity;
+    size_t hand;        // CLOCK hand
+
+    // 2Q: number of hot entries, and the indices (plus one, 0 if none) of
+    // entries recently evicted from probation (A1out), direct-mapped by hash
+    // bucket (nb_buckets of them)
+    size_t nb_hot;
+    size_t *ghosts;
+
+    // TinyLFU: count-min sketch of access frequencies (sketch_width()
+    // counters), and increments since it was last aged
+    uint8_t *sketch;
+    size_t sketch_adds;
+} zseek_cache_shard_t;
 
 struct zseek_cache {
-    // TODO OPT: Lock independently from zseek_reader
+    zseek_cache_shard_t *shards;
+    size_t nb_shards;   // Always a power of 2
+    unsigned shard_bits;
+    zseek_cache_policy_t policy;
+    size_t max_bytes;   // Budget for entries_memory, 0 if none
+    zseek_cache_release_t release;
+    void *release_arg;
+
+    atomic_size_t size;
+    atomic_size_t entries_memory;
+    atomic_size_t slots_memory;
+};
+
+static inline uint64_t hash_idx(size_t frame_idx)
+{
+    // Fibonacci hashing: spreads both sequential and strided indices
+    return (uint64_t)frame_idx * UINT64_C(0x9E3779B97F4A7C15);
+}
 
-    // BST with nodes linking to the list below
-    void *root;
+static inline zseek_cache_shard_t *shard_of(zseek_cache_t *cache, uint64_t h)
+{
+    if (cache->shard_bits == 0)
+        return &cache->shards[0];
+    return &cache->shards[h >> (64 - cache->shard_bits)];
+}
 
-    // Linked list containing the actual cache entries (head is LRU, tail is
-    // MRU)
-    zseek_cached_frame_t *head;
-    zseek_cached_frame_t *tail;
+static inline size_t bucket_of(const zseek_cache_shard_t *shard, uint64_t h)
+{
+    // Use bits disjoint from those selecting the shard
+    return (size_t)(h >> 24) & (shard->nb_buckets - 1);
+}
 
-    size_t size;
-    size_t capacity;
-    size_t entries_memory;
-};
+static size_t shard_lookup(zseek_cache_shard_t *shard, uint64_t h,
+    size_t frame_idx)
+{
+    for (size_t s = shard->buckets[bucket_of(shard, h)]; s != SLOT_NONE;
+        s = shard->slots[s].next) {
+
+        if (shard->slots[s].frame.idx == frame_idx)
+            return s;
+    }
+    return SLOT_NONE;
+}
+
+static void shard_unlink(zseek_cache_shard_t *shard, size_t slot)
+{
+    uint64_t h = hash_idx(shard->slots[slot].frame.idx);
+    size_t *link = &shard->buckets[bucket_of(shard, h)];
+    while (*link != slot)
+        link = &shard->slots[*link].next;
+    *link = shard->slots[slot].next;
+}
+
+static void shard_link(zseek_cache_shard_t *shard, size_t slot)
+{
+    uint64_t h = hash_idx(shard->slots[slot].frame.idx);
+    size_t b = bucket_of(shard, h);
+    shard->slots[slot].next = shard->buckets[b];
+    shard->buckets[b] = slot;
+}
+
+/**
+ * Record the eviction of frame @p frame_idx from probation in the ghosts of
+ * (2Q) @p shard
+ */
+static void ghost_add(zseek_cache_shard_t *shard, size_t frame_idx)
+{
+    shard->ghosts[bucket_of(shard, hash_idx(frame_idx))] = frame_idx + 1;
+}
+
+/**
+ * Look up (and forget) frame @p frame_idx, with hash @p h, in the ghosts of
+ * (2Q) @p shard. Returns whether it was recently evicted from probation.
+ */
+static bool ghost_take(zseek_cache_shard_t *shard, uint64_t h,
+    size_t frame_idx)
+{
+    size_t *ghost = &shard->ghosts[bucket_of(shard, h)];
+    if (*ghost != frame_idx + 1)
+        return false;
+    *ghost = 0;
+    return true;
+}
 
-static int compare(const void *pa, const void *pb)
+static inline size_t sketch_width(size_t nb_buckets)
 {
-    const zseek_cached_frame_t *a = pa;
-    const zseek_cached_frame_t *b = pb;
+    size_t width = SKETCH_COUNTERS_PER_BUCKET * nb_buckets;
+    return width < SKETCH_MIN_COUNTERS ? SKETCH_MIN_COUNTERS : width;
+}
 
-    if (a->frame.idx < b->frame.idx)
-        return -1;
-    if (a->frame.idx > b->frame.idx)
-        return 1;
-    return 0;
+static inline size_t sketch_pos(const zseek_cache_shard_t *shard, uint64_t h,
+    unsigned row)
+{
+    static const uint64_t seeds[SKETCH_DEPTH] = {
+        UINT64_C(0xC3A5C85C97CB3127), UINT64_C(0xB492B66FBE98F273),
+        UINT64_C(0x9AE16A3B2F90404F), UINT64_C(0xCBF29CE484222325),
+    };
+    uint64_t x = (h ^ (h >> 29)) * seeds[row];
+    return (size_t)(x >> 32) & (sketch_width(shard->nb_buckets) - 1);
 }
 
-static void free_node(void *nodep)
+/**
+ * Estimate the access frequency of the frame with hash @p h in (TinyLFU)
+ * @p shard
+ */
+static unsigned sketch_estimate(const zseek_cache_shard_t *shard, uint64_t h)
 {
-    // Free corresponding list element
-    zseek_cached_frame_t *f = nodep;
-    free(f->frame.data);
-    free(f);
+    unsigned min = SKETCH_COUNTER_MAX;
+    for (unsigned r = 0; r < SKETCH_DEPTH; r++) {
+        unsigned c = shard->sketch[sketch_pos(shard, h, r)];
+        if (c < min)
+            min = c;
+    }
+    return min;
 }
 
-static void evict_lru(zseek_cache_t *cache)
+/**
+ * Count an access to the frame with hash @p h in (TinyLFU) @p shard, halving
+ * all counters once per period, so that past popularity fades
+ */
+static void sketch_add(zseek_cache_shard_t *shard, uint64_t h)
 {
-    // Remove from list
-    zseek_cached_frame_t *lru = cache->head;
-    if (!lru)
+    // Conservative update: only raise the counters at the minimum
+    unsigned min = sketch_estimate(shard, h);
+    if (min < SKETCH_COUNTER_MAX) {
+        for (unsigned r = 0; r < SKETCH_DEPTH; r++) {
+            uint8_t *c = &shard->sketch[sketch_pos(shard, h, r)];
+            if (*c == min)
+                (*c)++;
+        }
+    }
+
+    size_t width = sketch_width(shard->nb_buckets);
+    if (++shard->sketch_adds < SKETCH_PERIOD_PER_COUNTER * width)
         return;
-    if (cache->head == cache->tail) {
-        // Single item
-        cache->head = NULL;
-        cache->tail = NULL;
-    } else {
-        cache->head = cache->head->next;
-        remque(lru);
+    for (size_t c = 0; c < width; c++)
+        shard->sketch[c] >>= 1;
+    shard->sketch_adds /= 2;
+}
+
+/**
+ * Note an access to the frame with hash @p h in @p shard of @p cache, for
+ * policies that track frequency
+ */
+static inline void shard_note_access(const zseek_cache_t *cache,
+    zseek_cache_shard_t *shard, uint64_t h)
+{
+    if (cache->policy == ZSEEK_CACHE_TINYLFU)
+        sketch_add(shard, h);
+}
+
+/**
+ * Double the per-bucket policy state (ghosts, sketch) of @p shard, currently
+ * sized for @p nb_buckets, into @p ghosts and @p sketch (if not @a NULL).
+ * Since positions are hash bits masked by size, the upper half starts as a
+ * copy of the lower one, keeping all lookups valid.
+ */
+static void shard_double_policy(zseek_cache_shard_t *shard, size_t nb_buckets,
+    size_t *ghosts, uint8_t *sketch)
+{
+    if (ghosts) {
+        memcpy(ghosts, shard->ghosts, nb_buckets * sizeof(ghosts[0]));
+        memcpy(ghosts + nb_buckets, ghosts, nb_buckets * sizeof(ghosts[0]));
+        free(shard->ghosts);
+        shard->ghosts = ghosts;
+    }
+    if (sketch) {
+        size_t width = sketch_width(nb_buckets);
+        memcpy(sketch, shard->sketch, width);
+        memcpy(sketch + width, sketch, width);
+        free(shard->sketch);
+        shard->sketch = sketch;
+    }
+}
+
+/**
+ * Grow the slots (and, if needed, the hash table) of @p shard, so that one more
+ * entry fits, accounting for allocated bytes in @p memory. Returns @a false on
+ * error.
+ */
+static bool shard_grow(zseek_cache_shard_t *shard, atomic_size_t *memory)
+{
+    if (shard->size == shard->nb_slots) {
+        size_t nb_slots = 2 * shard->nb_slots;
+        if (nb_slots < CACHE_SHARD_START_SLOTS)
+            nb_slots = CACHE_SHARD_START_SLOTS;
+        if (nb_slots > shard->capacity)
+            nb_slots = shard->capacity;
+        zseek_cache_slot_t *slots = realloc(shard->slots,
+            nb_slots * sizeof(slots[0]));
+        if (!slots)
+            return false;
+        atomic_fetch_add_explicit(memory,
+            (nb_slots - shard->nb_slots) * sizeof(slots[0]),
+            memory_order_relaxed);
+        shard->slots = slots;
+        shard->nb_slots = nb_slots;
     }
 
-    // Remove from BST
-    (void*)tdelete(lru, &cache->root, compare);
+    if (shard->size + 1 > shard->nb_buckets) {
+        // Keep load factor <= 1
+        size_t nb_buckets = 2 * shard->nb_buckets;
+        size_t *buckets = malloc(nb_buckets * sizeof(buckets[0]));
+        if (!buckets)
+            return false;
+        size_t *ghosts = NULL;
+        uint8_t *sketch = NULL;
+        if (shard->ghosts) {
+            ghosts = malloc(nb_buckets * sizeof(ghosts[0]));
+            if (!ghosts) {
+                free(buckets);
+                return false;
+            }
+        }
+        size_t sketch_growth = shard->sketch ?
+            sketch_width(nb_buckets) - sketch_width(shard->nb_buckets) : 0;
+        if (sketch_growth > 0) {
+            sketch = malloc(sketch_width(nb_buckets));
+            if (!sketch) {
+                free(buckets);
+                return false;
+            }
+        }
+        shard_double_policy(shard, shard->nb_buckets, ghosts, sketch);
+        atomic_fetch_add_explicit(memory,
+            (nb_buckets - shard->nb_buckets) * (sizeof(buckets[0]) +
+            (ghosts ? sizeof(ghosts[0]) : 0)) + sketch_growth,
+            memory_order_relaxed);
+        for (size_t b = 0; b < nb_buckets; b++)
+            buckets[b] = SLOT_NONE;
+        free(shard->buckets);
+        shard->buckets = buckets;
+        shard->nb_buckets = nb_buckets;
+        // Rehash
+        for (size_t s = 0; s < shard->size; s++)
+            shard_link(shard, s);
+    }
+
+    return true;
+}
+
+/**
+ * Advance the CLOCK hand of (full) @p shard until an unpinned entry without a
+ * second chance is found and return its slot, or SLOT_NONE if all entries are
+ * pinned. Unless @p commit, the hand and second chances are left as they were,
+ * only finding the entry that would be chosen.
+ */
+static size_t shard_victim_clock(zseek_cache_shard_t *shard, bool commit)
+{
+    size_t hand = shard->hand;
+    size_t victim = SLOT_NONE;
+    // Two sweeps clear every second chance, so give up after that
+    for (size_t step = 0; step < 2 * shard->size; step++) {
+        size_t s = hand;
+        hand = (hand + 1) % shard->size;
+        zseek_cache_slot_t *slot = &shard->slots[s];
+        if (slot->pins > 0)
+            continue;
+        // NOTE: The first sweep clears (or would clear) every second chance
+        if (!slot->referenced || step >= shard->size) {
+            victim = s;
+            break;
+        }
+        if (commit)
+            slot->referenced = false;
+    }
+    if (commit)
+        shard->hand = hand;
+    return victim;
+}
+
+/**
+ * Like shard_victim_clock(), for 2Q: while more than 1/CACHE_2Q_COLD_DIV of
+ * the entries are on probation, the oldest of them (in CLOCK order) is chosen
+ * regardless of hits, so that a scan only ever displaces its own frames.
+ * Otherwise, hot entries are chosen by CLOCK. A last sweep takes any unpinned
+ * entry.
+ */
+static size_t shard_victim_2q(zseek_cache_shard_t *shard, bool commit)
+{
+    size_t cold_max = shard->size / CACHE_2Q_COLD_DIV;
+    bool evict_cold = shard->size - shard->nb_hot > cold_max;
+    size_t hand = shard->hand;
+    size_t victim = SLOT_NONE;
+    for (size_t step = 0; step < 3 * shard->size; step++) {
+        size_t s = hand;
+        hand = (hand + 1) % shard->size;
+        zseek_cache_slot_t *slot = &shard->slots[s];
+        if (slot->pins > 0)
+            continue;
+        bool last_sweep = step >= 2 * shard->size;
+        if (!slot->hot) {
+            if (evict_cold || last_sweep) {
+                victim = s;
+                break;
+            }
+            continue;
+        }
+        if (evict_cold && !last_sweep)
+            // Not a candidate, so its second chance is left alone
+            continue;
+        // NOTE: As for CLOCK, the first sweep clears every second chance
+        if (slot->referenced && step < shard->size) {
+            if (commit)
+                slot->referenced = false;
+            continue;
+        }
+        victim = s;
+        break;
+    }
+    if (commit)
+        shard->hand = hand;
+    return victim;
+}
+
+/**
+ * Choose the entry of (full) @p shard to evict, according to the policy of
+ * @p cache. Returns its slot, or SLOT_NONE if all entries are pinned. Unless
+ * @p commit, nothing changes, see shard_victim_clock().
+ */
+static size_t shard_victim(const zseek_cache_t *cache,
+    zseek_cache_shard_t *shard, bool commit)
+{
+    if (cache->policy == ZSEEK_CACHE_2Q)
+        return shard_victim_2q(shard, commit);
+    return shard_victim_clock(shard, commit);
+}
+
+/**
+ * Update the policy state of @p shard for the eviction of the entry in
+ * @p slot (before its removal)
+ */
+static void shard_note_evict(zseek_cache_shard_t *shard, size_t slot)
+{
+    if (!shard->ghosts)
+        return;
+    if (shard->slots[slot].hot)
+        shard->nb_hot--;
+    else
+        ghost_add(shard, shard->slots[slot].frame.idx);
+}
+
+/**
+ * Whether to admit a frame with hash @p h in (full, or over budget)
+ * @p shard of @p cache. TinyLFU only admits frames accessed more often than
+ * the victim they would replace, so that frames read once (e.g. by a scan)
+ * don't displace popular ones. Finding the victim changes nothing, so a
+ * rejected frame leaves @p shard as it was, and an admitted one evicts that
+ * same victim.
+ */
+static bool shard_admit(const zseek_cache_t *cache, zseek_cache_shard_t *shard,
+    uint64_t h)
+{
+    if (cache->policy != ZSEEK_CACHE_TINYLFU || shard->size == 0)
+        return true;
+
+    size_t s = shard_victim(cache, shard, false);
+    if (s == SLOT_NONE)
+        return true;
+    uint64_t victim_h = hash_idx(shard->slots[s].frame.idx);
+    return sketch_estimate(shard, h) > sketch_estimate(shard, victim_h);
+}
 
-    cache->size--;
-    cache->entries_memory -= lru->frame.len;
+/**
+ * Release the data of @p frame, evicted from @p cache
+ */
+static void frame_release(const zseek_cache_t *cache, zseek_frame_t frame)
+{
+    if (cache->release)
+        cache->release(frame, cache->release_arg);
+    else
+        free(frame.data);
+}
 
-    free(lru->frame.data);
-    free(lru);
+/**
+ * Remove the entry in @p slot of @p shard, moving the last entry in its place
+ */
+static void shard_remove(zseek_cache_shard_t *shard, size_t slot)
+{
+    shard_unlink(shard, slot);
+    size_t last = --shard->size;
+    if (slot != last) {
+        shard_unlink(shard, last);
+        shard->slots[slot] = shard->slots[last];
+        shard_link(shard, slot);
+    }
+    if (shard->hand >= shard->size)
+        shard->hand = 0;
 }
 
-static void make_mru(zseek_cache_t *cache, zseek_cached_frame_t *f)
+/**
+ * Evict entries of (locked) @p shard until @p len more bytes fit in the byte
+ * budget of @p cache. Returns @a false if they don't, with nothing left to
+ * evict.
+ */
+static bool shard_make_room(zseek_cache_t *cache, zseek_cache_shard_t *shard,
+    size_t len)
 {
-    remque(f);
+    while (atomic_load_explicit(&cache->entries_memory, memory_order_relaxed) +
+        len > cache->max_bytes) {
+
+        size_t s = shard_victim(cache, shard, true);
+        if (s == SLOT_NONE)
+            return false;
+        zseek_frame_t victim = shard->slots[s].frame;
+        shard_note_evict(shard, s);
+        shard_remove(shard, s);
+        atomic_fetch_sub_explicit(&cache->size, 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&cache->entries_memory, victim.len,
+            memory_order_relaxed);
+        frame_release(cache, victim);
+    }
+    return true;
+}
 
-    if (!cache->tail)
-        cache->head = f;
-    insque(f, cache->tail);
-    cache->tail = f;
+/**
+ * Evict entries of @p cache from shards other than @p skip, until within its
+ * byte budget
+ */
+static void cache_trim(zseek_cache_t *cache, const zseek_cache_shard_t *skip)
+{
+    for (size_t s = 0; s < cache->nb_shards; s++) {
+        zseek_cache_shard_t *shard = &cache->shards[s];
+        if (shard == skip)
+            continue;
+        pthread_mutex_lock(&shard->lock);
+        bool done = shard_make_room(cache, shard, 0);
+        pthread_mutex_unlock(&shard->lock);
+        if (done)
+            return;
+    }
+}
+
+static bool shard_init(zseek_cache_shard_t *shard, size_t capacity,
+    zseek_cache_policy_t policy)
+{
+    memset(shard, 0, sizeof(*shard));
+    shard->capacity = capacity;
+
+    shard->nb_buckets = 1;
+    shard->buckets = malloc(sizeof(shard->buckets[0]));
+    if (!shard->buckets)
+        goto fail;
+    shard->buckets[0] = SLOT_NONE;
+
+    if (policy == ZSEEK_CACHE_2Q) {
+        shard->ghosts = calloc(1, sizeof(shard->ghosts[0]));
+        if (!shard->ghosts)
+            goto fail_w_buckets;
+    } else if (policy == ZSEEK_CACHE_TINYLFU) {
+        shard->sketch = calloc(SKETCH_MIN_COUNTERS, 1);
+        if (!shard->sketch)
+            goto fail_w_buckets;
+    }
+
+    if (pthread_mutex_init(&shard->lock, NULL))
+        goto fail_w_policy;
+
+    return true;
+
+fail_w_policy:
+    free(shard->ghosts);
+    free(shard->sketch);
+fail_w_buckets:
+    free(shard->buckets);
+fail:
+    return false;
+}
+
+static void shard_destroy(const zseek_cache_t *cache,
+    zseek_cache_shard_t *shard)
+{
+    for (size_t s = 0; s < shard->size; s++)
+        frame_release(cache, shard->slots[s].frame);
+    free(shard->slots);
+    free(shard->buckets);
+    free(shard->ghosts);
+    free(shard->sketch);
+    pthread_mutex_destroy(&shard->lock);
 }
 
 zseek_cache_t *zseek_cache_new(size_t capacity)
@@ -89,14 +551,71 @@ zseek_cache_t *zseek_cache_new(size_t capacity)
     if (capacity == 0)
         return NULL;
 
+    return zseek_cache_new_full(capacity, 0, ZSEEK_CACHE_CLOCK, NULL, NULL);
+}
+
+zseek_cache_t *zseek_cache_new_full(size_t capacity, size_t max_bytes,
+    zseek_cache_policy_t policy, zseek_cache_release_t release,
+    void *release_arg)
+{
+    if (capacity == 0 && max_bytes == 0)
+        goto fail;
+    if (policy != ZSEEK_CACHE_CLOCK && policy != ZSEEK_CACHE_2Q &&
+        policy != ZSEEK_CACHE_TINYLFU)
+        goto fail;
+    if (capacity == 0)
+        capacity = SIZE_MAX;
+
     zseek_cache_t *cache = malloc(sizeof(*cache));
     if (!cache)
-        return NULL;
+        goto fail;
     memset(cache, 0, sizeof(*cache));
-
-    cache->capacity = capacity;
+    cache->policy = policy;
+    cache->max_bytes = max_bytes;
+    cache->release = release;
+    cache->release_arg = release_arg;
+
+    unsigned shard_bits = 0;
+    while (shard_bits < CACHE_MAX_SHARDS_LOG &&
+        (capacity >> (shard_bits + 1)) >= CACHE_MIN_SHARD_CAPACITY)
+        shard_bits++;
+    cache->shard_bits = shard_bits;
+    cache->nb_shards = (size_t)1 << shard_bits;
+
+    cache->shards = aligned_alloc(CACHE_LINE_SIZE,
+        cache->nb_shards * sizeof(cache->shards[0]));
+    if (!cache->shards)
+        goto fail_w_cache;
+
+    size_t s = 0;
+    for (; s < cache->nb_shards; s++) {
+        // Distribute capacity exactly
+        size_t shard_capacity = capacity / cache->nb_shards +
+            (s < capacity % cache->nb_shards ? 1 : 0);
+        if (!shard_init(&cache->shards[s], shard_capacity, policy))
+            goto fail_w_shards;
+    }
+    size_t policy_memory = 0;
+    if (policy == ZSEEK_CACHE_2Q)
+        policy_memory = sizeof(cache->shards[0].ghosts[0]);
+    else if (policy == ZSEEK_CACHE_TINYLFU)
+        policy_memory = SKETCH_MIN_COUNTERS;
+    atomic_init(&cache->size, 0);
+    atomic_init(&cache->entries_memory, 0);
+    atomic_init(&cache->slots_memory, cache->nb_shards *
+        (sizeof(cache->shards[0]) + sizeof(cache->shards[0].buckets[0]) +
+        policy_memory));
 
     return cache;
+
+fail_w_shards:
+    while (s-- > 0)
+        shard_destroy(cache, &cache->shards[s]);
+    free(cache->shards);
+fail_w_cache:
+    free(cache);
+fail:
+    return NULL;
 }
 
 void zseek_cache_free(zseek_cache_t *cache)
@@ -104,67 +623,173 @@ void zseek_cache_free(zseek_cache_t *cache)
     if (!cache)
         return;
 
-    tdestroy(cache->root, free_node);
+    for (size_t s = 0; s < cache->nb_shards; s++)
+        shard_destroy(cache, &cache->shards[s]);
+    free(cache->shards);
 
     free(cache);
 }
 
 zseek_frame_t zseek_cache_find(zseek_cache_t *cache, size_t frame_idx)
 {
+    zseek_frame_t frame = {NULL, 0, 0};
     if (!cache)
-        return (zseek_frame_t){NULL, 0, 0};
+        return frame;
 
-    zseek_cached_frame_t key;
-    key.frame.idx = frame_idx;
-    zseek_cached_frame_t **found = tfind(&key, &cache->root, compare);
-    if (!found)
-        return (zseek_frame_t){NULL, 0, 0};
+    uint64_t h = hash_idx(frame_idx);
+    zseek_cache_shard_t *shard = shard_of(cache, h);
 
-    make_mru(cache, *found);
+    pthread_mutex_lock(&shard->lock);
+    size_t s = shard_lookup(shard, h, frame_idx);
+    if (s != SLOT_NONE) {
+        shard->slots[s].referenced = true;
+        frame = shard->slots[s].frame;
+        shard_note_access(cache, shard, h);
+    }
+    pthread_mutex_unlock(&shard->lock);
 
-    return (*found)->frame;
+    return frame;
 }
 
-bool zseek_cache_insert(zseek_cache_t *cache, zseek_frame_t frame)
+static bool cache_insert(zseek_cache_t *cache, zseek_frame_t frame, bool pin)
 {
     if (!cache)
         return false;
+    if (cache->max_bytes && frame.len > cache->max_bytes)
+        return false;
 
-    if (cache->size == cache->capacity)
-        evict_lru(cache);
+    uint64_t h = hash_idx(frame.idx);
+    zseek_cache_shard_t *shard = shard_of(cache, h);
+
+    pthread_mutex_lock(&shard->lock);
+
+    if (shard_lookup(shard, h, frame.idx) != SLOT_NONE)
+        // Already cached
+        goto fail_w_lock;
+
+    // Misses count as accesses too
+    shard_note_access(cache, shard, h);
+    bool full = shard->size >= shard->capacity || (cache->max_bytes &&
+        atomic_load_explicit(&cache->entries_memory, memory_order_relaxed) +
+        frame.len > cache->max_bytes);
+    if (full && !shard_admit(cache, shard, h))
+        goto fail_w_lock;
+
+    // Grow first, as it may fail, so that a failed insert evicts nothing.
+    // Failing that, a frame over the byte budget can still take the slot of
+    // an entry evicted for it.
+    bool grown = shard->size >= shard->capacity ||
+        shard_grow(shard, &cache->slots_memory);
+    if (!grown && !full)
+        goto fail_w_lock;
+
+    // NOTE: If this shard runs out of victims, others are trimmed once this
+    // one is unlocked, to keep to one shard lock at a time
+    size_t size = shard->size;
+    bool over_budget = cache->max_bytes &&
+        !shard_make_room(cache, shard, frame.len);
+    if (!grown && shard->size == size)
+        // Nothing evicted (all pinned)
+        goto fail_w_lock;
+
+    size_t s;
+    if (shard->size < shard->capacity) {
+        assert(shard->size < shard->nb_slots);
+        s = shard->size++;
+        atomic_fetch_add_explicit(&cache->size, 1, memory_order_relaxed);
+    } else {
+        // Evict
+        s = shard_victim(cache, shard, true);
+        if (s == SLOT_NONE)
+            // All pinned
+            goto fail_w_lock;
+        shard_note_evict(shard, s);
+        shard_unlink(shard, s);
+        atomic_fetch_sub_explicit(&cache->entries_memory,
+            shard->slots[s].frame.len, memory_order_relaxed);
+        frame_release(cache, shard->slots[s].frame);
+    }
 
-    // Insert to BST
-    zseek_cached_frame_t *f = malloc(sizeof(*f));
-    if (!f)
-        goto fail;
-    f->frame = frame;
-    if (!tsearch(f, &cache->root, compare))
-        goto fail_w_f;
+    shard->slots[s].frame = frame;
+    shard->slots[s].pins = pin ? 1 : 0;
+    shard->slots[s].referenced = false;
+    // 2Q: frames start on probation, unless evicted from it recently
+    shard->slots[s].hot = shard->ghosts && ghost_take(shard, h, frame.idx);
+    if (shard->slots[s].hot)
+        shard->nb_hot++;
+    shard_link(shard, s);
+    atomic_fetch_add_explicit(&cache->entries_memory, frame.len,
+        memory_order_relaxed);
 
-    // Insert to list
-    if (!cache->tail)
-        cache->head = f;
-    insque(f, cache->tail);
-    cache->tail = f;
+    pthread_mutex_unlock(&shard->lock);
 
-    cache->size++;
-    cache->entries_memory += frame.len;
+    if (over_budget)
+        cache_trim(cache, shard);
 
     return true;
 
-fail_w_f:
-    free(f);
-fail:
+fail_w_lock:
+    pthread_mutex_unlock(&shard->lock);
     return false;
 }
 
+bool zseek_cache_insert(zseek_cache_t *cache, zseek_frame_t frame)
+{
+    return cache_insert(cache, frame, false);
+}
+
+bool zseek_cache_insert_pinned(zseek_cache_t *cache, zseek_frame_t frame)
+{
+    return cache_insert(cache, frame, true);
+}
+
+zseek_frame_t zseek_cache_pin(zseek_cache_t *cache, size_t frame_idx)
+{
+    zseek_frame_t frame = {NULL, 0, 0};
+    if (!cache)
+        return frame;
+
+    uint64_t h = hash_idx(frame_idx);
+    zseek_cache_shard_t *shard = shard_of(cache, h);
+
+    pthread_mutex_lock(&shard->lock);
+    size_t s = shard_lookup(shard, h, frame_idx);
+    if (s != SLOT_NONE) {
+        shard->slots[s].pins++;
+        shard->slots[s].referenced = true;
+        frame = shard->slots[s].frame;
+        shard_note_access(cache, shard, h);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return frame;
+}
+
+void zseek_cache_unpin(zseek_cache_t *cache, size_t frame_idx)
+{
+    if (!cache)
+        return;
+
+    uint64_t h = hash_idx(frame_idx);
+    zseek_cache_shard_t *shard = shard_of(cache, h);
+
+    pthread_mutex_lock(&shard->lock);
+    size_t s = shard_lookup(shard, h, frame_idx);
+    // BUG if not pinned
+    assert(s != SLOT_NONE && shard->slots[s].pins > 0);
+    if (s != SLOT_NONE)
+        shard->slots[s].pins--;
+    pthread_mutex_unlock(&shard->lock);
+}
+
 size_t zseek_cache_memory_usage(const zseek_cache_t *cache)
 {
     if (!cache)
         return 0;
 
-    return sizeof(*cache) + cache->size * sizeof(*(cache->head)) +
-        cache->entries_memory;
+    return sizeof(*cache) +
+        atomic_load_explicit(&cache->slots_memory, memory_order_relaxed) +
+        atomic_load_explicit(&cache->entries_memory, memory_order_relaxed);
 }
 
 size_t zseek_cache_entries(const zseek_cache_t *cache)
@@ -172,5 +797,5 @@ size_t zseek_cache_entries(const zseek_cache_t *cache)
     if (!cache)
         return 0;
 
-    return cache->size;
+    return atomic_load_explicit(&cache->size, memory_order_relaxed);
 }
@@ -4,6 +4,8 @@
 #include <stdbool.h>    // bool
 #include <stddef.h>     // size_t
 
+#include "zseek.h"
+
 typedef struct zseek_cache zseek_cache_t;
 
 typedef struct {
@@ -12,10 +14,33 @@ typedef struct {
     size_t len;
 } zseek_frame_t;
 
+/**
+ * Releases the data of @p frame, evicted from a cache. See
+ * zseek_cache_new_full().
+ */
+typedef void (*zseek_cache_release_t)(zseek_frame_t frame, void *arg);
+
 /**
  * Creates a new cache with a capacity of @p capacity frames.
+ *
+ * The cache is split in shards by frame index, each with its own lock, and uses
+ * CLOCK (second-chance) replacement within each shard.
  */
 zseek_cache_t *zseek_cache_new(size_t capacity);
+/**
+ * Like zseek_cache_new(), with a capacity of @p capacity frames (0 for no
+ * limit) and @p max_bytes bytes of frame data (0 for no limit), at least one
+ * of them set, and the eviction policy @p policy (see zseek_cache_policy_t),
+ * applied within each shard. Frame data is released with @p release (called
+ * with @p release_arg), or free (3) if @a NULL.
+ *
+ * The byte budget is shared by all shards: inserting evicts from the same
+ * shard first, then from the others (one shard locked at a time), so it may
+ * be exceeded briefly by concurrent inserts.
+ */
+zseek_cache_t *zseek_cache_new_full(size_t capacity, size_t max_bytes,
+    zseek_cache_policy_t policy, zseek_cache_release_t release,
+    void *release_arg);
 /**
  * Frees the cache pointed to by @p cache.
  */
@@ -24,18 +49,43 @@ void zseek_cache_free(zseek_cache_t *cache);
  * Searches for the frame at index @p frame_idx in @p cache. If not found,
  * zseek_frame_t.data of the return value will be @a NULL.
  *
- * @attention Not safe to call concurrently (unlocked).
+ * @note Safe to call concurrently. However, the returned zseek_frame_t.data may
+ * be freed by a concurrent zseek_cache_insert() evicting it, so it should only
+ * be used as a presence check. Use zseek_cache_pin() to access the data.
  */
 zseek_frame_t zseek_cache_find(zseek_cache_t *cache, size_t frame_idx);
 /**
- * Inserts @p frame in @p cache as MRU (most recently used). Might evict LRU.
- * Returns @a false on error.
+ * Like zseek_cache_find(), but also pins the frame found, so that it's not
+ * evicted until a matching zseek_cache_unpin(). Frames may be pinned multiple
+ * times.
  *
- * @note Assumes ownership of @p frame.data
+ * @note Safe to call concurrently
+ */
+zseek_frame_t zseek_cache_pin(zseek_cache_t *cache, size_t frame_idx);
+/**
+ * Drops a pin on the frame at index @p frame_idx, taken by zseek_cache_pin() or
+ * zseek_cache_insert_pinned().
+ *
+ * @note Safe to call concurrently
+ */
+void zseek_cache_unpin(zseek_cache_t *cache, size_t frame_idx);
+/**
+ * Inserts @p frame in @p cache. Might evict the frame chosen by the policy in
+ * the same shard (or more, to respect a byte budget); pinned frames are never
+ * evicted. Returns @a false on error, if a frame with the same index is
+ * already cached, if the shard is full of pinned frames, if the frame alone
+ * exceeds the byte budget, or if the policy doesn't admit it.
+ *
+ * @note Assumes ownership of @p frame.data, on success
  *
- * @attention Not safe to call concurrently (unlocked).
+ * @note Safe to call concurrently
  */
 bool zseek_cache_insert(zseek_cache_t *cache, zseek_frame_t frame);
+/**
+ * Like zseek_cache_insert(), but the inserted frame starts out pinned once, as
+ * if by zseek_cache_pin().
+ */
+bool zseek_cache_insert_pinned(zseek_cache_t *cache, zseek_frame_t frame);
 /**
  * Returns the memory usage (total heap allocation) of @p cache in bytes.
  */
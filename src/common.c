@@ -1,6 +1,12 @@
 #include <string.h>     // strerror_r
 #include <stdio.h>      // snprintf
 #include <stdarg.h>
+#include <time.h>       // clock_gettime
+#include <errno.h>      // errno
+#include <stdint.h>     // uint8_t
+
+#include <unistd.h>     // pread
+#include <sys/stat.h>   // fstat
 
 #include "zseek.h"      // ZSEEK_ERRBUF_SIZE
 
@@ -52,3 +58,83 @@ void set_error(char errbuf[ZSEEK_ERRBUF_SIZE], const char *message, ...)
     vsnprintf(errbuf, ZSEEK_ERRBUF_SIZE, message, arg_ptr);
     va_end(arg_ptr);
 }
+
+uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void histogram_add(histogram_t *h, uint64_t value)
+{
+    unsigned b = value > 0 ? 63 - __builtin_clzll(value) : 0;
+    if (b >= ZSEEK_HISTOGRAM_BUCKETS)
+        b = ZSEEK_HISTOGRAM_BUCKETS - 1;
+
+    atomic_fetch_add_explicit(&h->buckets[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+}
+
+void histogram_read(histogram_t *h, zseek_histogram_t *out)
+{
+    out->count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    out->sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+    for (size_t b = 0; b < ZSEEK_HISTOGRAM_BUCKETS; b++)
+        out->buckets[b] = atomic_load_explicit(&h->buckets[b],
+            memory_order_relaxed);
+}
+
+ssize_t file_pread(void *data, size_t size, size_t offset,
+    void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    FILE *fin = user_data;
+    int fd = fileno(fin);
+    if (fd == -1) {
+        // perror("get file descriptor");
+        return -1;
+    }
+
+    // Use pread(2) instead of seeking the shared FILE, since it may be called
+    // concurrently
+    size_t _read = 0;
+    while (_read < size) {
+        ssize_t r = pread(fd, (uint8_t*)data + _read, size - _read,
+            offset + _read);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            // perror("read from file");
+            return -1;
+        }
+        if (r == 0)
+            // EOF
+            break;
+        _read += r;
+    }
+
+    return _read;
+}
+
+ssize_t file_fsize(void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    FILE *f = user_data;
+    int fd = fileno(f);
+    if (fd == -1) {
+        // perror("get file descriptor");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        // perror("get file size");
+        return -1;
+    }
+
+    return st.st_size;
+}
@@ -2,6 +2,9 @@
 #define COMMON_H
 
 #include <stddef.h>     // size_t
+#include <stdint.h>     // uint64_t
+#include <stdatomic.h>  // atomic_*
+#include <sys/types.h>  // ssize_t
 
 /**
  * Return in @p errbuf the equivalent of using perror with @p msg and errno set
@@ -16,5 +19,43 @@ void set_error_with_errno(char errbuf[ZSEEK_ERRBUF_SIZE], const char *msg, int e
  */
 void set_error(char errbuf[ZSEEK_ERRBUF_SIZE], const char *message, ...) __attribute__ ((format(printf, 2, 3)));
 
+/**
+ * Return the time of the monotonic clock in nanoseconds.
+ */
+uint64_t monotonic_ns(void);
+
+/**
+ * A zseek_histogram_t updated concurrently
+ */
+typedef struct {
+    atomic_uint_least64_t count;
+    atomic_uint_least64_t sum;
+    atomic_uint_least64_t buckets[ZSEEK_HISTOGRAM_BUCKETS];
+} histogram_t;
+
+/**
+ * Add @p value to @p h.
+ *
+ * @note Safe to call concurrently
+ */
+void histogram_add(histogram_t *h, uint64_t value);
+
+/**
+ * Copy @p h into @p out. Concurrent updates may be seen in part.
+ */
+void histogram_read(histogram_t *h, zseek_histogram_t *out);
+
+/**
+ * Default read handler, for a FILE pointed to by @p user_data. Uses pread (2),
+ * so that it may be called concurrently.
+ */
+ssize_t file_pread(void *data, size_t size, size_t offset, void *user_data,
+    void *call_data);
+
+/**
+ * Default file size handler, for a FILE pointed to by @p user_data
+ */
+ssize_t file_fsize(void *user_data, void *call_data);
+
 
 #endif  // COMMON_H
@@ -1,13 +1,19 @@
 #include <stdbool.h>    // bool
 #include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t, SIZE_MAX
+#include <limits.h>     // UINT_MAX
 #include <stdio.h>      // I/O
 #include <stdlib.h>     // malloc, free
 #include <errno.h>      // errno
 #include <string.h>     // memset
-#include <pthread.h>    // pthread_setaffinity_np
+#include <pthread.h>    // pthread_*
 #include <assert.h>     // assert
 
+#include <unistd.h>     // ftruncate
+#include <endian.h>     // le32toh
+
 #include <zstd.h>
+#include <zdict.h>
 #include <lz4.h>
 #include <lz4frame.h>
 
@@ -15,40 +21,1136 @@
 #include "seek_table.h"
 #include "common.h"
 #include "buffer.h"
+#include "thread_pool.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define ZSTD_MAGIC 0xFD2FB528
+#define LZ4_MAGIC 0x184D2204
+
+// Default maximum size of a trained dictionary (as the zstd CLI)
+#define DICT_MAX_SIZE_DEFAULT (110 << 10)   // 110 KiB
+// Upper bound on dictionary sizes, to fit in a trailer
+#define DICT_SIZE_MAX (1U << 31)
+// Upper bound on the entries of the sub-block index, to fit in a trailer
+#define SUB_INDEX_MAX (1U << 29)
+// Default bounds on adaptive compression levels
+#define ZSTD_ADAPT_MIN_LEVEL 1
+#define ZSTD_ADAPT_MAX_LEVEL 19
+#define LZ4_ADAPT_MIN_LEVEL 0
+#define LZ4_ADAPT_MAX_LEVEL 12
+// Frames compressed at a new adaptive level before adapting again
+#define ADAPT_HOLD_FRAMES 4
+// Factor of the target rate to exceed for raising the adaptive level
+#define ADAPT_UP_HEADROOM 1.5
+
+/**
+ * Compression context of a frame worker
+ */
+typedef struct zseek_cctx {
+    struct zseek_cctx *next;    // Next free context
+    union {
+        ZSTD_CCtx *cctx_zstd;
+        LZ4F_cctx *cctx_lz4;
+    };
+    size_t memory;  // Last known memory usage, updated on release
+    int level;      // Compression level currently set (zstd only)
+    const ZSTD_CDict *cdict;    // Dictionary currently referenced, if any
+} zseek_cctx_t;
+
+/**
+ * A frame compressed by a frame worker
+ */
+typedef struct {
+    zseek_task_t task;
+    struct zseek_writer *writer;
+    zseek_buffer_t *ubuf;
+    zseek_buffer_t *cbuf;
+    zseek_buffer_t *ends;   // Sub-block ends, see zseek_writer.sub_ends
+    enum {
+        JOB_FREE = 0,   // Being filled (if current) or unused
+        JOB_QUEUED,     // Dispatched for compression
+        JOB_DONE,       // Compressed, to be written out
+    } state;
+    bool ok;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    size_t memory;  // Last known memory usage, updated when done
+    int level;      // Compression level, set on dispatch
+    const ZSTD_CDict *cdict;    // Dictionary for level, set on dispatch
+    uint64_t ns;    // Compression time, set when done
+} zseek_frame_job_t;
+
+struct zseek_writer {
+    zseek_write_file_t user_file;
+    zseek_compression_type_t type;
+    union {
+        struct {
+            ZSTD_CCtx *cctx_zstd;
+            bool mt;    // Multi-threaded compression
+        };
+        LZ4F_preferences_t preferences;
+    };
+
+    size_t frame_uc;    // Current frame bytes (uncompressed)
+    size_t frame_cm;    // Current frame bytes (compressed)
+    size_t min_frame_size;
+    bool fixed;         // Frames of exactly min_frame_size bytes
+    // Frames are cut by writes once they reach cut_size bytes: min_frame_size,
+    // or with records (cut by zseek_writer_end_record() instead), the maximum.
+    // Writes are split to hold frames to max_frame_size (if > 0) bytes.
+    bool records;
+    size_t max_frame_size;
+    size_t cut_size;
+    // With records and a maximum frame size, the current record, held back
+    // until it is known whether it fits in the current frame
+    zseek_buffer_t *record;
+    size_t total_cm;    // Total file compressed bytes _excluding_ frame_cm
+    ZSTD_frameLog *fl;
+    zseek_buffer_t *ubuf;
+    zseek_buffer_t *cbuf;
+    size_t reserved;    // Bytes leased by zseek_writer_reserve()
+
+    // Dictionary (zstd only, optional), stored in a trailer at close
+    int compression_level;
+    void *dict;
+    size_t dict_size;
+    ZSTD_CDict *cdict;
+    // With target_rate, the dictionary digested for each other level as it is
+    // adapted to, indexed from min_level (a CDict overrides the context level)
+    ZSTD_CDict **level_cdicts;
+    // Dictionary training (optional). Data is buffered in train until there
+    // are train_size bytes to train on, see train_end().
+    zseek_buffer_t *train;
+    size_t train_size;
+    size_t dict_max_size;
+
+    // Sub-block index (optional), stored in a trailer at close. Frames are
+    // compressed as sub-blocks of sub_size bytes, and the compressed end of
+    // each but the last (relative to the frame) is appended to sub_ends, from
+    // the entry in sub_first of the frame. All uint32_t.
+    size_t sub_size;
+    zseek_buffer_t *sub_first;
+    zseek_buffer_t *sub_ends;
+    zseek_buffer_t *frame_ends; // Of the frame being compressed
+
+    // Compression level of the next frame, adapted to target_rate (if > 0)
+    // by adapt_level() as frames are logged, within [min_level, max_level].
+    // The speed measured (rate) is smoothed, and reset on level changes.
+    int level;
+    size_t target_rate;
+    int min_level;
+    int max_level;
+    double rate;
+    size_t level_hold;
+    size_t level_changes;
+
+    // Instrumentation, see zseek_writer_stats_t. Updated by frame workers too
+    // (asynchronous output).
+    atomic_uint_least64_t compress_ns;
+    atomic_uint_least64_t write_ns;
+    atomic_uint_least64_t flush_ns;
+    histogram_t frame_size;
+    histogram_t frame_compressed_size;
+    histogram_t frame_ratio;
+
+    // Frame-parallel compression (optional). Frames are filled in job_in and
+    // written out from job_out, both counting up (mod nb_jobs).
+    bool parallel;
+    // Asynchronous output (optional, implies parallel). Frames are written out
+    // by the workers, with the call data of open, and job_in, job_out, fl and
+    // total_cm are protected by jobs_lock. Errors stick in failed.
+    bool async;
+    void *call_data;
+    bool draining;  // A worker is writing out frames
+    bool failed;
+    char async_errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_thread_pool_t *workers;
+    pthread_mutex_t jobs_lock;  // Protects job state and free contexts
+    pthread_cond_t jobs_cond;
+    zseek_frame_job_t *jobs;
+    size_t nb_jobs;
+    size_t job_in;
+    size_t job_out;
+    zseek_cctx_t *cctxs;
+    size_t nb_cctxs;
+    zseek_cctx_t *cctx_free;
+};
+
+static bool default_write(const void *data, size_t size, void *user_data,
+    void *call_data)
+{
+    (void)call_data;
+
+    FILE *fout = user_data;
+    if (fwrite(data, 1, size, fout) != size) {
+        // perror("write to file");
+        return false;
+    }
+    return true;
+}
+
+static bool default_truncate(size_t size, void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    FILE *f = user_data;
+    if (fflush(f) != 0 || ftruncate(fileno(f), size) == -1 ||
+        fseeko(f, size, SEEK_SET) == -1) {
+        // perror("truncate file");
+        return false;
+    }
+    return true;
+}
+
+static bool discard_write(const void *data, size_t size, void *user_data,
+    void *call_data)
+{
+    (void)data;
+    (void)size;
+    (void)user_data;
+    (void)call_data;
+
+    return true;
+}
+
+/**
+ * Create a zstd compression context with the given parameters
+ */
+static ZSTD_CCtx *cctx_new_zstd(int compression_level, int strategy,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if (!cctx) {
+        set_error(errbuf, "context creation failed");
+        goto fail;
+    }
+    size_t r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+        compression_level);
+    if (ZSTD_isError(r)) {
+        set_error(errbuf, "%s: %s", "set compression level",
+            ZSTD_getErrorName(r));
+        goto fail_w_cctx;
+    }
+    // TODO OPT: Don't set strategy?
+    r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_strategy, strategy);
+    if (ZSTD_isError(r)) {
+        set_error(errbuf, "%s: %s", "set strategy", ZSTD_getErrorName(r));
+        goto fail_w_cctx;
+    }
+
+    return cctx;
+
+fail_w_cctx:
+    ZSTD_freeCCtx(cctx);
+fail:
+    return NULL;
+}
+
+/**
+ * Make @p cctx compress with @p cdict from its next frame on
+ */
+static bool ref_cdict(ZSTD_CCtx *cctx, const ZSTD_CDict *cdict,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    // NOTE: Only possible at the start of a session (e.g. not after creating
+    // threads, see zseek_writer_open_full_zstd())
+    size_t r = ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+    if (!ZSTD_isError(r))
+        r = ZSTD_CCtx_refCDict(cctx, cdict);
+    if (ZSTD_isError(r)) {
+        set_error(errbuf, "%s: %s", "reference dictionary",
+            ZSTD_getErrorName(r));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Return the dictionary of @p writer digested for compression level @p level,
+ * creating it on first use. Not thread-safe, see adapt_level().
+ */
+static const ZSTD_CDict *level_cdict(zseek_writer_t *writer, int level,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (writer->target_rate == 0 || level == writer->compression_level)
+        return writer->cdict;
+
+    if (!writer->level_cdicts) {
+        size_t nb_levels = writer->max_level - writer->min_level + 1;
+        writer->level_cdicts = calloc(nb_levels,
+            sizeof(writer->level_cdicts[0]));
+        if (!writer->level_cdicts) {
+            set_error_with_errno(errbuf, "allocate level dictionaries",
+                errno);
+            return NULL;
+        }
+    }
+
+    ZSTD_CDict **cdict = &writer->level_cdicts[level - writer->min_level];
+    if (!*cdict) {
+        *cdict = ZSTD_createCDict(writer->dict, writer->dict_size, level);
+        if (!*cdict) {
+            set_error(errbuf, "dictionary creation failed");
+            return NULL;
+        }
+    }
+    return *cdict;
+}
+
+/**
+ * Compress all frames of @p writer from now on with the dictionary @p dict of
+ * @p size bytes, which is copied. No frame may be in progress. Returns
+ * @a false on error, leaving any cleanup to dict_free().
+ */
+static bool use_dict(zseek_writer_t *writer, const void *dict, size_t size,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    writer->dict = malloc(size);
+    if (!writer->dict) {
+        set_error_with_errno(errbuf, "allocate dictionary", errno);
+        return false;
+    }
+    memcpy(writer->dict, dict, size);
+    writer->dict_size = size;
+
+    // NOTE: Digested once, for all contexts and frames
+    writer->cdict = ZSTD_createCDict(dict, size, writer->compression_level);
+    if (!writer->cdict) {
+        set_error(errbuf, "dictionary creation failed");
+        return false;
+    }
+
+    const ZSTD_CDict *cdict = level_cdict(writer, writer->level, errbuf);
+    if (!cdict || !ref_cdict(writer->cctx_zstd, cdict, errbuf))
+        return false;
+    for (size_t c = 0; c < writer->nb_cctxs; c++) {
+        if (!ref_cdict(writer->cctxs[c].cctx_zstd, cdict, errbuf))
+            return false;
+        writer->cctxs[c].cdict = cdict;
+    }
+
+    return true;
+}
+
+/**
+ * Free the dictionary (and any training data) of @p writer, once no context
+ * references it
+ */
+static void dict_free(zseek_writer_t *writer)
+{
+    zseek_buffer_free(writer->train);
+    ZSTD_freeCDict(writer->cdict);
+    if (writer->level_cdicts) {
+        for (int l = writer->min_level; l <= writer->max_level; l++)
+            ZSTD_freeCDict(writer->level_cdicts[l - writer->min_level]);
+        free(writer->level_cdicts);
+    }
+    free(writer->dict);
+}
+
+/**
+ * Set up the sub-block index of @p writer, if enabled in @p zsp. Returns
+ * @a false on error, leaving any cleanup to subs_free().
+ */
+static bool subs_init(zseek_writer_t *writer, zseek_compression_param_t *zsp,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!zsp || zsp->sub_block_size == 0)
+        return true;
+
+    writer->sub_size = zsp->sub_block_size;
+    writer->sub_first = zseek_buffer_new(0);
+    writer->sub_ends = zseek_buffer_new(0);
+    writer->frame_ends = zseek_buffer_new(0);
+    if (!writer->sub_first || !writer->sub_ends || !writer->frame_ends) {
+        set_error(errbuf, "sub-block index creation failed");
+        return false;
+    }
+    return true;
+}
+
+static void subs_free(zseek_writer_t *writer)
+{
+    zseek_buffer_free(writer->sub_first);
+    zseek_buffer_free(writer->sub_ends);
+    zseek_buffer_free(writer->frame_ends);
+}
+
+/**
+ * Append the sub-block @p ends of the frame just logged to the sub-block index
+ * of @p writer, if any
+ */
+static bool log_subs(zseek_writer_t *writer, zseek_buffer_t *ends,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (writer->sub_size == 0)
+        return true;
+
+    size_t nb_frames = zseek_buffer_size(writer->sub_first) / sizeof(uint32_t);
+    size_t nb_ends = zseek_buffer_size(writer->sub_ends) / sizeof(uint32_t);
+    size_t frame_ends = zseek_buffer_size(ends) / sizeof(uint32_t);
+    if (nb_frames + nb_ends + frame_ends >= SUB_INDEX_MAX) {
+        set_error(errbuf, "too many sub-blocks");
+        return false;
+    }
+
+    uint32_t first = nb_ends;
+    if (!zseek_buffer_push(writer->sub_first, &first, sizeof(first)) ||
+        !zseek_buffer_push(writer->sub_ends, zseek_buffer_data(ends),
+        zseek_buffer_size(ends))) {
+        set_error(errbuf, "failed to buffer sub-block index");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Set up adaptive compression levels for @p writer, starting from @p level,
+ * as requested in @p zsp
+ */
+static bool adapt_init(zseek_writer_t *writer, zseek_compression_param_t *zsp,
+    int level, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    writer->level = level;
+    if (!zsp || zsp->target_rate == 0)
+        return true;
+
+    int min_level = zsp->min_level;
+    int max_level = zsp->max_level;
+    if (min_level == 0 && max_level == 0) {
+        min_level = writer->type == ZSEEK_ZSTD ? ZSTD_ADAPT_MIN_LEVEL :
+            LZ4_ADAPT_MIN_LEVEL;
+        max_level = writer->type == ZSEEK_ZSTD ? ZSTD_ADAPT_MAX_LEVEL :
+            LZ4_ADAPT_MAX_LEVEL;
+    }
+    if (min_level > max_level) {
+        set_error(errbuf, "invalid compression level bounds (%d, %d)",
+            min_level, max_level);
+        return false;
+    }
+
+    writer->target_rate = zsp->target_rate;
+    writer->min_level = min_level;
+    writer->max_level = max_level;
+    writer->level = level < min_level ? min_level :
+        level > max_level ? max_level : level;
+    return true;
+}
+
+/**
+ * Set compression level @p level on the (zstd) context @p cctx
+ */
+static bool set_level_zstd(ZSTD_CCtx *cctx, int level,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    if (ZSTD_isError(r)) {
+        set_error(errbuf, "%s: %s", "set compression level",
+            ZSTD_getErrorName(r));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Adapt the compression level of @p writer to the speed of compressing the
+ * @p len bytes of the frame just logged in @p ns nanoseconds, and to whether
+ * all frames in flight were @p saturated. See
+ * zseek_compression_param_t.target_rate.
+ */
+static bool adapt_level(zseek_writer_t *writer, size_t len, uint64_t ns,
+    bool saturated, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (writer->target_rate == 0)
+        return true;
+
+    // Frame workers compress as many frames at a time
+    size_t nb_workers = writer->parallel ? writer->nb_cctxs : 1;
+    double rate = (double)len * 1e9 / (ns > 0 ? ns : 1) * nb_workers;
+    writer->rate = writer->rate > 0 ? (3 * writer->rate + rate) / 4 : rate;
+    if (writer->level_hold > 0) {
+        writer->level_hold--;
+        return true;
+    }
+
+    int level = writer->level;
+    if (saturated || writer->rate < writer->target_rate)
+        level--;
+    else if (writer->rate > writer->target_rate * ADAPT_UP_HEADROOM)
+        level++;
+    if (level < writer->min_level || level > writer->max_level ||
+        level == writer->level)
+        return true;
+
+    // NOTE: A dictionary overrides the context level, so each level has its
+    // own. Frame workers reference it (and set the level) on their own
+    // context, see compress_job_zstd().
+    if (writer->cdict) {
+        const ZSTD_CDict *cdict = level_cdict(writer, level, errbuf);
+        if (!cdict)
+            return false;
+        if (!writer->parallel && !ref_cdict(writer->cctx_zstd, cdict, errbuf))
+            return false;
+    }
+    if (!writer->parallel) {
+        if (writer->type == ZSEEK_ZSTD) {
+            if (!set_level_zstd(writer->cctx_zstd, level, errbuf))
+                return false;
+        } else {
+            writer->preferences.compressionLevel = level;
+        }
+    }
+    writer->level = level;
+    writer->level_changes++;
+    writer->level_hold = ADAPT_HOLD_FRAMES;
+    writer->rate = 0;
+    return true;
+}
+
+/**
+ * Return the bound on the compressed size of a zstd frame of @p len bytes, in
+ * sub-blocks of @p sub_size bytes (0 for none)
+ */
+static size_t frame_bound_zstd(size_t len, size_t sub_size)
+{
+    if (sub_size == 0 || len <= sub_size)
+        return ZSTD_compressBound(len);
+    return (len + sub_size - 1) / sub_size * ZSTD_compressBound(sub_size);
+}
+
+/**
+ * Compress the @p len bytes of @p src into a zstd frame at @p dst (of
+ * @p dst_size bytes) with @p cctx, returning its size in @p csize. With
+ * @p sub_size, it is made of independent sub-blocks of that many bytes, the
+ * compressed ends of all but the last of which are stored in @p ends.
+ */
+static bool compress_subs_zstd(ZSTD_CCtx *cctx, void *dst, size_t dst_size,
+    const void *src, size_t len, size_t sub_size, zseek_buffer_t *ends,
+    size_t *csize, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_buffer_reset(ends);
+
+    size_t pos = 0;
+    size_t off = 0;
+    do {
+        size_t n = sub_size > 0 ? MIN(sub_size, len - off) : len;
+        size_t r = ZSTD_compress2(cctx, (uint8_t*)dst + pos, dst_size - pos,
+            (const uint8_t*)src + off, n);
+        if (ZSTD_isError(r)) {
+            set_error(errbuf, "%s: %s", "compress frame",
+                ZSTD_getErrorName(r));
+            return false;
+        }
+        pos += r;
+        off += n;
+
+        uint32_t end = pos;
+        if (off < len && !zseek_buffer_push(ends, &end, sizeof(end))) {
+            set_error(errbuf, "failed to buffer sub-block ends");
+            return false;
+        }
+    } while (off < len);
+
+    *csize = pos;
+    return true;
+}
+
+/**
+ * Return the bound on the compressed size of an lz4 frame of @p len bytes, in
+ * sub-blocks of @p sub_size bytes (0 for none)
+ */
+static size_t frame_bound_lz4(const LZ4F_preferences_t *preferences,
+    size_t len, size_t sub_size)
+{
+    if (sub_size == 0 || len <= sub_size)
+        return LZ4F_compressFrameBound(len, preferences);
+    return (len + sub_size - 1) / sub_size *
+        LZ4F_compressFrameBound(sub_size, preferences);
+}
+
+/**
+ * Compress the @p len bytes of @p src into a single lz4 frame at @p dst (of
+ * @p dst_size bytes), with @p cctx or a one-shot context if @a NULL. Returns
+ * its size, or an lz4 error code.
+ */
+static size_t compress_one_lz4(LZ4F_cctx *cctx,
+    LZ4F_preferences_t preferences, void *dst, size_t dst_size,
+    const void *src, size_t len)
+{
+    preferences.frameInfo.contentSize = len;
+    if (!cctx)
+        return LZ4F_compressFrame(dst, dst_size, src, len, &preferences);
+
+    uint8_t *out = dst;
+    size_t pos = LZ4F_compressBegin(cctx, out, dst_size, &preferences);
+    if (LZ4F_isError(pos))
+        return pos;
+    size_t r = LZ4F_compressUpdate(cctx, out + pos, dst_size - pos, src, len,
+        NULL);
+    if (LZ4F_isError(r))
+        return r;
+    pos += r;
+    r = LZ4F_compressEnd(cctx, out + pos, dst_size - pos, NULL);
+    if (LZ4F_isError(r))
+        return r;
+    return pos + r;
+}
+
+/**
+ * Like compress_subs_zstd(), as lz4 frames compressed with @p cctx (or one-shot
+ * contexts if @a NULL) and @p preferences
+ */
+static bool compress_subs_lz4(LZ4F_cctx *cctx,
+    const LZ4F_preferences_t *preferences, void *dst, size_t dst_size,
+    const void *src, size_t len, size_t sub_size, zseek_buffer_t *ends,
+    size_t *csize, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_buffer_reset(ends);
+
+    size_t pos = 0;
+    size_t off = 0;
+    do {
+        size_t n = sub_size > 0 ? MIN(sub_size, len - off) : len;
+        size_t r = compress_one_lz4(cctx, *preferences, (uint8_t*)dst + pos,
+            dst_size - pos, (const uint8_t*)src + off, n);
+        if (LZ4F_isError(r)) {
+            set_error(errbuf, "%s: %s", "compress frame",
+                LZ4F_getErrorName(r));
+            return false;
+        }
+        pos += r;
+        off += n;
+
+        uint32_t end = pos;
+        if (off < len && !zseek_buffer_push(ends, &end, sizeof(end))) {
+            set_error(errbuf, "failed to buffer sub-block ends");
+            return false;
+        }
+    } while (off < len);
+
+    *csize = pos;
+    return true;
+}
+
+/**
+ * Initialize frame-parallel compression for @p writer, with the options in
+ * @p zsp. Returns @a false on error, leaving any cleanup to parallel_free().
+ */
+static bool parallel_init(zseek_writer_t *writer, zseek_compression_param_t *zsp,
+    int compression_level, int strategy, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    int nb_workers = zsp->nb_frame_workers;
+    if (nb_workers < 1)
+        nb_workers = 1;
+
+    int pr = pthread_mutex_init(&writer->jobs_lock, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize jobs lock", pr);
+        return false;
+    }
+    pr = pthread_cond_init(&writer->jobs_cond, NULL);
+    if (pr) {
+        pthread_mutex_destroy(&writer->jobs_lock);
+        set_error_with_errno(errbuf, "initialize jobs condition", pr);
+        return false;
+    }
+    writer->parallel = true;
+
+    // One context per worker, since at most that many jobs run at once
+    writer->cctxs = malloc(nb_workers * sizeof(writer->cctxs[0]));
+    if (!writer->cctxs) {
+        set_error_with_errno(errbuf, "allocate contexts", errno);
+        return false;
+    }
+    for (; writer->nb_cctxs < (size_t)nb_workers; writer->nb_cctxs++) {
+        zseek_cctx_t *cctx = &writer->cctxs[writer->nb_cctxs];
+        memset(cctx, 0, sizeof(*cctx));
+        if (writer->type == ZSEEK_ZSTD) {
+            cctx->cctx_zstd = cctx_new_zstd(compression_level, strategy,
+                errbuf);
+            if (!cctx->cctx_zstd)
+                return false;
+            cctx->level = compression_level;
+        } else {
+            LZ4F_errorCode_t r = LZ4F_createCompressionContext(
+                &cctx->cctx_lz4, LZ4F_VERSION);
+            if (LZ4F_isError(r)) {
+                set_error(errbuf, "%s: %s", "context creation failed",
+                    LZ4F_getErrorName(r));
+                return false;
+            }
+        }
+        cctx->next = writer->cctx_free;
+        writer->cctx_free = cctx;
+    }
+
+    // Twice as many jobs as workers, to keep them busy while writing out,
+    // unless the queue depth is given
+    size_t nb_jobs = 2 * nb_workers;
+    if (zsp->async_queue_depth > 0) {
+        nb_jobs = zsp->async_queue_depth;
+        writer->async = true;
+        writer->call_data = call_data;
+    }
+    writer->jobs = malloc(nb_jobs * sizeof(writer->jobs[0]));
+    if (!writer->jobs) {
+        set_error_with_errno(errbuf, "allocate jobs", errno);
+        return false;
+    }
+    for (; writer->nb_jobs < nb_jobs; writer->nb_jobs++) {
+        zseek_frame_job_t *job = &writer->jobs[writer->nb_jobs];
+        memset(job, 0, sizeof(*job));
+        job->writer = writer;
+        job->ubuf = zseek_buffer_new(writer->min_frame_size);
+        if (!job->ubuf) {
+            set_error(errbuf, "input buffer creation failed");
+            return false;
+        }
+        job->cbuf = zseek_buffer_new(0);
+        if (!job->cbuf) {
+            zseek_buffer_free(job->ubuf);
+            set_error(errbuf, "output buffer creation failed");
+            return false;
+        }
+        if (writer->sub_size > 0) {
+            job->ends = zseek_buffer_new(0);
+            if (!job->ends) {
+                zseek_buffer_free(job->cbuf);
+                zseek_buffer_free(job->ubuf);
+                set_error(errbuf, "sub-block ends creation failed");
+                return false;
+            }
+        }
+    }
+
+    size_t cpusetsize = 0;
+    cpu_set_t *cpuset = NULL;
+    if (writer->type == ZSEEK_ZSTD) {
+        cpusetsize = zsp->params.zstd_params.cpusetsize;
+        cpuset = zsp->params.zstd_params.cpuset;
+    } else {
+        cpusetsize = zsp->params.lz4_params.cpusetsize;
+        cpuset = zsp->params.lz4_params.cpuset;
+    }
+    writer->workers = zseek_thread_pool_new(nb_workers, cpusetsize, cpuset,
+        errbuf);
+    if (!writer->workers)
+        return false;
+
+    return true;
+}
+
+/**
+ * Free the frame-parallel compression resources of @p writer, waiting for any
+ * jobs still running.
+ */
+static void parallel_free(zseek_writer_t *writer)
+{
+    if (!writer->parallel)
+        return;
+
+    zseek_thread_pool_free(writer->workers);
+
+    for (size_t j = 0; j < writer->nb_jobs; j++) {
+        zseek_buffer_free(writer->jobs[j].ends);
+        zseek_buffer_free(writer->jobs[j].cbuf);
+        zseek_buffer_free(writer->jobs[j].ubuf);
+    }
+    free(writer->jobs);
+
+    for (size_t c = 0; c < writer->nb_cctxs; c++) {
+        if (writer->type == ZSEEK_ZSTD)
+            ZSTD_freeCCtx(writer->cctxs[c].cctx_zstd);
+        else
+            LZ4F_freeCompressionContext(writer->cctxs[c].cctx_lz4);
+    }
+    free(writer->cctxs);
+
+    pthread_cond_destroy(&writer->jobs_cond);
+    pthread_mutex_destroy(&writer->jobs_lock);
+}
+
+static bool compress_job_zstd(zseek_cctx_t *cctx, zseek_frame_job_t *job)
+{
+    size_t ubuf_len = zseek_buffer_size(job->ubuf);
+    void *ubuf_data = zseek_buffer_data(job->ubuf);
+    size_t sub_size = job->writer->sub_size;
+
+    // Resize output buffer
+    size_t cbuf_len = frame_bound_zstd(ubuf_len, sub_size);
+    if (!zseek_buffer_resize(job->cbuf, cbuf_len)) {
+        set_error(job->errbuf, "resize output buffer failed");
+        return false;
+    }
+    void *cbuf_data = zseek_buffer_data(job->cbuf);
+    assert(cbuf_data);
+
+    if (cctx->level != job->level) {
+        if (!set_level_zstd(cctx->cctx_zstd, job->level, job->errbuf))
+            return false;
+        cctx->level = job->level;
+    }
+    if (cctx->cdict != job->cdict) {
+        if (!ref_cdict(cctx->cctx_zstd, job->cdict, job->errbuf))
+            return false;
+        cctx->cdict = job->cdict;
+    }
+
+    // Compress frame
+    size_t cdata_len;
+    if (!compress_subs_zstd(cctx->cctx_zstd, cbuf_data, cbuf_len, ubuf_data,
+        ubuf_len, sub_size, job->ends, &cdata_len, job->errbuf))
+        return false;
+    // Correct buffer size (shrinks it, should not fail)
+    zseek_buffer_resize(job->cbuf, cdata_len);
+
+    return true;
+}
+
+static bool compress_job_lz4(zseek_writer_t *writer, zseek_cctx_t *cctx,
+    zseek_frame_job_t *job)
+{
+    size_t ubuf_len = zseek_buffer_size(job->ubuf);
+    void *ubuf_data = zseek_buffer_data(job->ubuf);
+
+    LZ4F_preferences_t preferences = writer->preferences;
+    preferences.compressionLevel = job->level;
+
+    // Resize output buffer
+    size_t cbuf_len = frame_bound_lz4(&preferences, ubuf_len,
+        writer->sub_size);
+    if (!zseek_buffer_resize(job->cbuf, cbuf_len)) {
+        set_error(job->errbuf, "resize output buffer failed");
+        return false;
+    }
+    uint8_t *cbuf_data = zseek_buffer_data(job->cbuf);
+    assert(cbuf_data);
 
-struct zseek_writer {
-    zseek_write_file_t user_file;
-    zseek_compression_type_t type;
-    union {
-        struct {
-            ZSTD_CCtx *cctx_zstd;
-            bool mt;    // Multi-threaded compression
-        };
-        LZ4F_preferences_t preferences;
-    };
+    // Compress frame, reusing the context of the worker
+    size_t cdata_len;
+    if (!compress_subs_lz4(cctx->cctx_lz4, &preferences, cbuf_data,
+        cbuf_len, ubuf_data, ubuf_len, writer->sub_size, job->ends,
+        &cdata_len, job->errbuf))
+        return false;
+    // Correct buffer size (shrinks it, should not fail)
+    zseek_buffer_resize(job->cbuf, cdata_len);
 
-    size_t frame_uc;    // Current frame bytes (uncompressed)
-    size_t frame_cm;    // Current frame bytes (compressed)
-    size_t min_frame_size;
-    size_t total_cm;    // Total file compressed bytes _excluding_ frame_cm
-    ZSTD_frameLog *fl;
-    zseek_buffer_t *ubuf;
-    zseek_buffer_t *cbuf;
-};
+    return true;
+}
 
-static bool default_write(const void *data, size_t size, void *user_data,
+/**
+ * Pass the @p len bytes of @p buf to the write handler of @p writer, timing it
+ */
+static bool write_file(zseek_writer_t *writer, const void *buf, size_t len,
     void *call_data)
 {
-    (void)call_data;
+    uint64_t start = monotonic_ns();
+    bool written = writer->user_file.write(buf, len,
+        writer->user_file.user_data, call_data);
+    atomic_fetch_add_explicit(&writer->write_ns, monotonic_ns() - start,
+        memory_order_relaxed);
+    return written;
+}
 
-    FILE *fout = user_data;
-    if (fwrite(data, 1, size, fout) != size) {
-        // perror("write to file");
+/**
+ * Log a frame of @p frame_cm bytes (compressed) and @p frame_uc bytes
+ * (uncompressed), compressed in @p ns, in the seek table and stats of
+ * @p writer. Returns the result of ZSTD_seekable_logFrame().
+ */
+static size_t log_frame(zseek_writer_t *writer, size_t frame_cm,
+    size_t frame_uc, uint64_t ns)
+{
+    size_t r = ZSTD_seekable_logFrame(writer->fl, frame_cm, frame_uc, 0);
+    if (ZSTD_isError(r))
+        return r;
+
+    atomic_fetch_add_explicit(&writer->compress_ns, ns, memory_order_relaxed);
+    histogram_add(&writer->frame_size, frame_uc);
+    histogram_add(&writer->frame_compressed_size, frame_cm);
+    histogram_add(&writer->frame_ratio,
+        (uint64_t)frame_uc * 100 / (frame_cm > 0 ? frame_cm : 1));
+    return r;
+}
+
+/**
+ * Write out the frame compressed by @p job
+ */
+static bool write_job(zseek_writer_t *writer, zseek_frame_job_t *job,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!job->ok) {
+        set_error(errbuf, "%s", job->errbuf);
+        return false;
+    }
+
+    // Write output
+    if (!write_file(writer, zseek_buffer_data(job->cbuf),
+        zseek_buffer_size(job->cbuf), call_data)) {
+
+        // TODO OPT: Use errno if user_file.write sets it
+        set_error(errbuf, "write to file failed");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Log the frame written out by @p job
+ */
+static bool log_job(zseek_writer_t *writer, zseek_frame_job_t *job,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t frame_uc = zseek_buffer_size(job->ubuf);
+    size_t frame_cm = zseek_buffer_size(job->cbuf);
+
+    size_t r = log_frame(writer, frame_cm, frame_uc, job->ns);
+    if (ZSTD_isError(r)) {
+        set_error(errbuf, "%s: %s", "log frame", ZSTD_getErrorName(r));
+        return false;
+    }
+    if (!log_subs(writer, job->ends, errbuf))
+        return false;
+    writer->total_cm += frame_cm;
+
+    // NOTE: With asynchronous output, a full queue blocks the caller
+    bool saturated = writer->async &&
+        writer->job_in - writer->job_out == writer->nb_jobs;
+    return adapt_level(writer, frame_uc, job->ns, saturated, errbuf);
+}
+
+/**
+ * Write out the frame compressed by @p job and log it
+ */
+static bool write_out_job(zseek_writer_t *writer, zseek_frame_job_t *job,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    return write_job(writer, job, call_data, errbuf) &&
+        log_job(writer, job, errbuf);
+}
+
+/**
+ * Write out the frames compressed so far, in order, on a worker (asynchronous
+ * output). Only one worker writes out at a time. Called with jobs_lock held.
+ */
+static void drain_jobs(zseek_writer_t *writer)
+{
+    if (writer->draining)
+        return;
+    writer->draining = true;
+
+    while (writer->job_out < writer->job_in) {
+        zseek_frame_job_t *job = &writer->jobs[writer->job_out %
+            writer->nb_jobs];
+        if (job->state != JOB_DONE)
+            break;
+
+        // Keep going after errors, to recycle all jobs
+        // NOTE: Only the draining worker writes async_errbuf
+        bool ok = !writer->failed;
+        pthread_mutex_unlock(&writer->jobs_lock);
+        if (ok)
+            ok = write_job(writer, job, writer->call_data,
+                writer->async_errbuf);
+        pthread_mutex_lock(&writer->jobs_lock);
+        if (ok)
+            ok = log_job(writer, job, writer->async_errbuf);
+        if (!ok)
+            writer->failed = true;
+
+        zseek_buffer_reset(job->ubuf);
+        zseek_buffer_reset(job->cbuf);
+        job->state = JOB_FREE;
+        writer->job_out++;
+        pthread_cond_broadcast(&writer->jobs_cond);
+    }
+
+    writer->draining = false;
+}
+
+/**
+ * Wait until at most @p nb_pending frames are not written out, and return the
+ * asynchronous output error, if any. Called with jobs_lock held.
+ */
+static bool wait_jobs(zseek_writer_t *writer, size_t nb_pending,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    while (writer->job_in - writer->job_out > nb_pending ||
+        (nb_pending == 0 && writer->draining))
+        pthread_cond_wait(&writer->jobs_cond, &writer->jobs_lock);
+
+    if (writer->failed) {
+        set_error(errbuf, "%s", writer->async_errbuf);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Compress a frame job. Runs on a worker.
+ */
+static void frame_job_run(void *arg)
+{
+    zseek_frame_job_t *job = arg;
+    zseek_writer_t *writer = job->writer;
+
+    pthread_mutex_lock(&writer->jobs_lock);
+    zseek_cctx_t *cctx = writer->cctx_free;
+    // BUG if none, since there are as many contexts as workers
+    assert(cctx);
+    writer->cctx_free = cctx->next;
+    pthread_mutex_unlock(&writer->jobs_lock);
+
+    bool ok;
+    size_t cctx_memory = 0;
+    uint64_t start = monotonic_ns();
+    if (writer->type == ZSEEK_ZSTD) {
+        ok = compress_job_zstd(cctx, job);
+        cctx_memory = ZSTD_sizeof_CCtx(cctx->cctx_zstd);
+    } else {
+        ok = compress_job_lz4(writer, cctx, job);
+    }
+    uint64_t ns = monotonic_ns() - start;
+    size_t memory = zseek_buffer_capacity(job->ubuf) +
+        zseek_buffer_capacity(job->cbuf) + zseek_buffer_capacity(job->ends);
+
+    pthread_mutex_lock(&writer->jobs_lock);
+    cctx->memory = cctx_memory;
+    cctx->next = writer->cctx_free;
+    writer->cctx_free = cctx;
+    job->ok = ok;
+    job->memory = memory;
+    job->ns = ns;
+    job->state = JOB_DONE;
+    pthread_cond_broadcast(&writer->jobs_cond);
+    // NOTE: Output runs on whichever worker completes the oldest frame
+    if (writer->async)
+        drain_jobs(writer);
+    pthread_mutex_unlock(&writer->jobs_lock);
+}
+
+/**
+ * Write out the frames compressed so far, in order, waiting for up to
+ * @p nb_wait of them to be compressed.
+ */
+static bool write_out_jobs(zseek_writer_t *writer, size_t nb_wait,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    bool is_error = false;
+
+    while (writer->job_out < writer->job_in) {
+        zseek_frame_job_t *job = &writer->jobs[writer->job_out %
+            writer->nb_jobs];
+
+        pthread_mutex_lock(&writer->jobs_lock);
+        while (job->state != JOB_DONE && nb_wait > 0)
+            pthread_cond_wait(&writer->jobs_cond, &writer->jobs_lock);
+        bool done = job->state == JOB_DONE;
+        pthread_mutex_unlock(&writer->jobs_lock);
+        if (!done)
+            break;
+        if (nb_wait > 0)
+            nb_wait--;
+
+        // Keep going after errors, to recycle all jobs
+        if (!is_error && !write_out_job(writer, job, call_data, errbuf))
+            is_error = true;
+
+        zseek_buffer_reset(job->ubuf);
+        zseek_buffer_reset(job->cbuf);
+        pthread_mutex_lock(&writer->jobs_lock);
+        job->state = JOB_FREE;
+        pthread_mutex_unlock(&writer->jobs_lock);
+        writer->job_out++;
+    }
+
+    return !is_error;
+}
+
+/**
+ * Dispatch the current frame for compression. Writes out any frames compressed
+ * in the meantime, and waits for the oldest one if out of jobs. With
+ * asynchronous output, only waits for the oldest one to be written out if out
+ * of jobs.
+ */
+static bool end_frame_parallel(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_frame_job_t *job = &writer->jobs[writer->job_in % writer->nb_jobs];
+    job->task = (zseek_task_t){frame_job_run, job, NULL};
+
+    pthread_mutex_lock(&writer->jobs_lock);
+    job->level = writer->level;
+    // Created by adapt_level() (or use_dict()) as the level was set
+    job->cdict = writer->cdict ? level_cdict(writer, writer->level, NULL) :
+        NULL;
+    job->state = JOB_QUEUED;
+    writer->job_in++;
+    pthread_mutex_unlock(&writer->jobs_lock);
+    zseek_thread_pool_submit(writer->workers, &job->task);
+    writer->frame_uc = 0;
+
+    if (writer->async) {
+        pthread_mutex_lock(&writer->jobs_lock);
+        bool ok = wait_jobs(writer, writer->nb_jobs - 1, errbuf);
+        pthread_mutex_unlock(&writer->jobs_lock);
+        return ok;
+    }
+
+    size_t nb_wait = writer->job_in - writer->job_out == writer->nb_jobs;
+    return write_out_jobs(writer, nb_wait, call_data, errbuf);
+}
+
+/**
+ * Dispatch the current frame (if any) and write out all frames
+ */
+static bool flush_parallel(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    bool is_error = false;
+
+    if (writer->frame_uc > 0) {
+        if (!end_frame_parallel(writer, call_data, errbuf))
+            is_error = true;
+    }
+
+    if (writer->async) {
+        pthread_mutex_lock(&writer->jobs_lock);
+        if (!wait_jobs(writer, 0, is_error ? NULL : errbuf))
+            is_error = true;
+        pthread_mutex_unlock(&writer->jobs_lock);
+    } else if (!write_out_jobs(writer, SIZE_MAX, call_data,
+        is_error ? NULL : errbuf)) {
+        is_error = true;
+    }
+
+    return !is_error;
+}
+
+/**
+ * Buffer data for frame-parallel compression
+ */
+static bool zseek_write_parallel(zseek_writer_t *writer, const void *buf,
+    size_t len, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    // NOTE: Always copies, since compression outlives this call
+    // NOTE: Asynchronous output errors are reported at the next frame
+    zseek_frame_job_t *job = &writer->jobs[writer->job_in % writer->nb_jobs];
+    if (!zseek_buffer_push(job->ubuf, buf, len)) {
+        set_error(errbuf, "failed to buffer uncompressed data");
         return false;
     }
+    writer->frame_uc += len;
+
+    if (writer->frame_uc >= writer->cut_size)
+        return end_frame_parallel(writer, call_data, errbuf);
+
     return true;
 }
 
+
 static zseek_writer_t *zseek_writer_open_full_zstd(zseek_write_file_t user_file,
 	zseek_compression_param_t* zsp, size_t min_frame_size, void *call_data,
 	char errbuf[ZSEEK_ERRBUF_SIZE])
@@ -70,28 +1172,64 @@ static zseek_writer_t *zseek_writer_open_full_zstd(zseek_write_file_t user_file,
     memset(writer, 0, sizeof(*writer));
     writer->type = ZSEEK_ZSTD;
 
-    ZSTD_CCtx *cctx = ZSTD_createCCtx();
-    if (!cctx) {
-        set_error(errbuf, "context creation failed");
+    if (zsp && (zsp->nb_frame_workers > 0 || zsp->async_queue_depth > 0) &&
+        zsp->params.zstd_params.nb_workers > 1) {
+        set_error(errbuf,
+            "nb_workers is exclusive with nb_frame_workers and async_queue_depth");
         goto fail_w_writer;
     }
-    size_t r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
-        compression_level);
-    if (ZSTD_isError(r)) {
-        set_error(errbuf, "%s: %s", "set compression level",
-            ZSTD_getErrorName(r));
-        goto fail_w_cctx;
+
+    if (zsp && zsp->sub_block_size > 0 &&
+        zsp->params.zstd_params.nb_workers > 1) {
+        set_error(errbuf, "sub_block_size is exclusive with nb_workers");
+        goto fail_w_writer;
     }
-    // TODO OPT: Don't set strategy?
-    r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_strategy, strategy);
-    if (ZSTD_isError(r)) {
-        set_error(errbuf, "%s: %s", "set strategy", ZSTD_getErrorName(r));
-        goto fail_w_cctx;
+
+    if (zsp && zsp->params.zstd_params.dict) {
+        if (zsp->params.zstd_params.dict_train_frames > 0) {
+            set_error(errbuf, "dict is exclusive with dict_train_frames");
+            goto fail_w_writer;
+        }
+        size_t dict_size = zsp->params.zstd_params.dict_size;
+        if (dict_size == 0 || dict_size > DICT_SIZE_MAX) {
+            set_error(errbuf, "invalid dictionary size (%zu)", dict_size);
+            goto fail_w_writer;
+        }
+    } else if (zsp && zsp->params.zstd_params.dict_train_frames > 0) {
+        size_t train_frames = zsp->params.zstd_params.dict_train_frames;
+        if (min_frame_size == 0 || train_frames > UINT_MAX ||
+            train_frames > SIZE_MAX / min_frame_size) {
+            set_error(errbuf, "invalid dictionary training frames (%zu)",
+                train_frames);
+            goto fail_w_writer;
+        }
+        if (zsp->params.zstd_params.dict_max_size > DICT_SIZE_MAX) {
+            set_error(errbuf, "invalid dictionary size (%zu)",
+                zsp->params.zstd_params.dict_max_size);
+            goto fail_w_writer;
+        }
+    }
+
+    if (zsp && zsp->target_rate > 0 &&
+        zsp->params.zstd_params.nb_workers > 1) {
+        set_error(errbuf, "target_rate is exclusive with nb_workers");
+        goto fail_w_writer;
     }
+    // NOTE: Level 0 stands for the default
+    if (!adapt_init(writer, zsp, compression_level != 0 ? compression_level :
+        ZSTD_CLEVEL_DEFAULT, errbuf))
+        goto fail_w_writer;
+    compression_level = writer->level;
+
+    ZSTD_CCtx *cctx = cctx_new_zstd(compression_level, strategy, errbuf);
+    if (!cctx)
+        goto fail_w_writer;
+    size_t r;
 
     // Declared here to be in scope at fail_w_cpuset
     pthread_t self_tid = pthread_self();
     cpu_set_t prev_cpuset;
+    bool cpuset_saved = false;
 
     if (zsp && zsp->params.zstd_params.nb_workers > 1) {
         r = ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers,
@@ -110,6 +1248,7 @@ static zseek_writer_t *zseek_writer_open_full_zstd(zseek_write_file_t user_file,
                 set_error_with_errno(errbuf, "get thread affinity", pr);
                 goto fail_w_cctx;
             }
+            cpuset_saved = true;
 
             // Set requested cpu set
             pthread_setaffinity_np(self_tid, zsp->params.zstd_params.cpusetsize,
@@ -141,13 +1280,17 @@ static zseek_writer_t *zseek_writer_open_full_zstd(zseek_write_file_t user_file,
     }
     writer->cctx_zstd = cctx;
 
-    zseek_buffer_t *ubuf = zseek_buffer_new(min_frame_size);
+    // Frame workers buffer their own input
+    bool parallel = zsp && (zsp->nb_frame_workers > 0 ||
+        zsp->async_queue_depth > 0);
+    zseek_buffer_t *ubuf = zseek_buffer_new(parallel ? 0 : min_frame_size);
     if (!ubuf) {
         set_error(errbuf, "input buffer creation failed");
         goto fail_w_cctx;
     }
     writer->ubuf = ubuf;
     writer->min_frame_size = min_frame_size;
+    writer->cut_size = min_frame_size;
 
     ZSTD_frameLog *fl = ZSTD_seekable_createFrameLog(0);
     if (!fl) {
@@ -164,16 +1307,48 @@ static zseek_writer_t *zseek_writer_open_full_zstd(zseek_write_file_t user_file,
     }
     writer->cbuf = cbuf;
 
+    if (!subs_init(writer, zsp, errbuf))
+        goto fail_w_parallel;
+    if (parallel) {
+        if (!parallel_init(writer, zsp, compression_level, strategy,
+            call_data, errbuf))
+            goto fail_w_parallel;
+    }
+
+    writer->compression_level = compression_level;
+    if (zsp && zsp->params.zstd_params.dict) {
+        if (!use_dict(writer, zsp->params.zstd_params.dict,
+            zsp->params.zstd_params.dict_size, errbuf))
+            goto fail_w_dict;
+    } else if (zsp && zsp->params.zstd_params.dict_train_frames > 0) {
+        writer->train = zseek_buffer_new(0);
+        if (!writer->train) {
+            set_error(errbuf, "training buffer creation failed");
+            goto fail_w_dict;
+        }
+        writer->train_size = zsp->params.zstd_params.dict_train_frames *
+            min_frame_size;
+        writer->dict_max_size = zsp->params.zstd_params.dict_max_size;
+        if (writer->dict_max_size == 0)
+            writer->dict_max_size = DICT_MAX_SIZE_DEFAULT;
+    }
+
     writer->user_file = user_file;
 
     return writer;
 
+fail_w_dict:
+    dict_free(writer);
+fail_w_parallel:
+    parallel_free(writer);
+    subs_free(writer);
+    zseek_buffer_free(cbuf);
 fail_w_fl:
     ZSTD_seekable_freeFrameLog(fl);
 fail_w_ubuf:
     zseek_buffer_free(ubuf);
 fail_w_cpuset:
-    if (zsp && zsp->params.zstd_params.cpuset)
+    if (cpuset_saved)
         pthread_setaffinity_np(self_tid, sizeof(prev_cpuset), &prev_cpuset);
 fail_w_cctx:
     ZSTD_freeCCtx(cctx);
@@ -200,19 +1375,25 @@ static zseek_writer_t *zseek_writer_open_full_lz4(zseek_write_file_t user_file,
     }
     memset(writer, 0, sizeof(*writer));
     writer->type = ZSEEK_LZ4;
-    writer->preferences.compressionLevel = compression_level;
+    if (!adapt_init(writer, zsp, compression_level, errbuf))
+        goto fail_w_writer;
+    writer->preferences.compressionLevel = writer->level;
     // Avoid unnecessary copies since we compress all at once anyway
     writer->preferences.autoFlush = 1;
     // Use smaller block sizes to reduce buffering
     writer->preferences.frameInfo.blockSizeID = LZ4F_max64KB;
 
-    zseek_buffer_t *ubuf = zseek_buffer_new(min_frame_size);
+    // Frame workers buffer their own input
+    bool parallel = zsp && (zsp->nb_frame_workers > 0 ||
+        zsp->async_queue_depth > 0);
+    zseek_buffer_t *ubuf = zseek_buffer_new(parallel ? 0 : min_frame_size);
     if (!ubuf) {
         set_error(errbuf, "input buffer creation failed");
         goto fail_w_writer;
     }
     writer->ubuf = ubuf;
     writer->min_frame_size = min_frame_size;
+    writer->cut_size = min_frame_size;
 
     ZSTD_frameLog *fl = ZSTD_seekable_createFrameLog(0);
     if (!fl) {
@@ -230,10 +1411,21 @@ static zseek_writer_t *zseek_writer_open_full_lz4(zseek_write_file_t user_file,
     }
     writer->cbuf = cbuf;
 
+    if (!subs_init(writer, zsp, errbuf))
+        goto fail_w_parallel;
+    if (parallel) {
+        if (!parallel_init(writer, zsp, 0, 0, call_data, errbuf))
+            goto fail_w_parallel;
+    }
+
     writer->user_file = user_file;
 
     return writer;
 
+fail_w_parallel:
+    parallel_free(writer);
+    subs_free(writer);
+    zseek_buffer_free(cbuf);
 fail_w_fl:
     ZSTD_seekable_freeFrameLog(fl);
 fail_w_ubuf:
@@ -254,25 +1446,275 @@ zseek_writer_t *zseek_writer_open_full(zseek_write_file_t user_file,
             call_data, errbuf);
     }
 
+    if (zsp->fixed_frame_size &&
+        (min_frame_size == 0 || min_frame_size > UINT32_MAX)) {
+        set_error(errbuf, "invalid fixed frame size (%zu)", min_frame_size);
+        return NULL;
+    }
+    if (zsp->sub_block_size > UINT32_MAX) {
+        set_error(errbuf, "invalid sub-block size (%zu)", zsp->sub_block_size);
+        return NULL;
+    }
+    if (zsp->max_frame_size > 0 && (zsp->fixed_frame_size ||
+        zsp->max_frame_size < min_frame_size)) {
+        set_error(errbuf, "invalid max frame size (%zu)", zsp->max_frame_size);
+        return NULL;
+    }
+    if (zsp->record_aligned && (zsp->fixed_frame_size ||
+        (zsp->type == ZSEEK_ZSTD &&
+        zsp->params.zstd_params.dict_train_frames > 0))) {
+        set_error(errbuf, "record_aligned is exclusive with fixed_frame_size "
+            "and dict_train_frames");
+        return NULL;
+    }
+
+    zseek_buffer_t *record = NULL;
+    if (zsp->record_aligned && zsp->max_frame_size > 0) {
+        record = zseek_buffer_new(0);
+        if (!record) {
+            set_error(errbuf, "failed to allocate record buffer");
+            return NULL;
+        }
+    }
+
+    zseek_writer_t *writer;
     switch (zsp->type) {
     case ZSEEK_ZSTD:
-        return zseek_writer_open_full_zstd(user_file, zsp, min_frame_size,
+        writer = zseek_writer_open_full_zstd(user_file, zsp, min_frame_size,
             call_data, errbuf);
+        break;
     case ZSEEK_LZ4:
-        return zseek_writer_open_full_lz4(user_file, zsp, min_frame_size,
+        writer = zseek_writer_open_full_lz4(user_file, zsp, min_frame_size,
             call_data, errbuf);
+        break;
     default:
         set_error(errbuf, "wrong compression type (%d)", zsp->type);
-        return NULL;
+        writer = NULL;
+        break;
+    }
+    if (!writer)
+        zseek_buffer_free(record);
+    if (writer) {
+        writer->fixed = zsp->fixed_frame_size;
+        writer->records = zsp->record_aligned;
+        writer->max_frame_size = writer->fixed ? min_frame_size :
+            zsp->max_frame_size;
+        if (writer->records)
+            writer->cut_size = writer->max_frame_size > 0 ?
+                writer->max_frame_size : SIZE_MAX;
+        writer->record = record;
+        if (zsp->extended_seek_table)
+            framelog_set_extended(writer->fl);
+    }
+
+    return writer;
+}
+
+zseek_writer_t *zseek_writer_open(FILE *cfile, zseek_compression_param_t *zsp,
+    size_t min_frame_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_write_file_t user_file = {cfile, default_write, NULL};
+    return zseek_writer_open_full(user_file, zsp, min_frame_size, call_data,
+        errbuf);
+}
+
+/**
+ * Check that @p zsp (with defaults if @a NULL) can go on from the frames of
+ * @p st, with type @p type. Returns the dictionary of @p st in @p dict (to be
+ * freed by the caller), if any.
+ */
+static bool append_check(ZSTD_seekTable *st, zseek_compression_type_t type,
+    const zseek_compression_param_t *zsp, size_t min_frame_size, void **dict,
+    size_t *dict_size, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t nb_frames = seek_table_entries(st);
+    zseek_compression_type_t want = zsp ? zsp->type : ZSEEK_ZSTD;
+    if (nb_frames > 0 && type != want) {
+        set_error(errbuf, "compression type mismatch (%d, file %d)", want,
+            type);
+        return false;
+    }
+
+    bool fixed = zsp && zsp->fixed_frame_size;
+    if (fixed && nb_frames > 0 &&
+        (seek_table_frame_size(st) != min_frame_size ||
+        frame_size_d(st, nb_frames - 1) != min_frame_size)) {
+        set_error(errbuf, "fixed frame size mismatch (%zu, file %zu)",
+            min_frame_size, seek_table_frame_size(st));
+        return false;
+    }
+
+    const uint32_t *first, *ends;
+    size_t sub_size = seek_table_sub_blocks(st, &first, &ends);
+    size_t want_sub = zsp ? zsp->sub_block_size : 0;
+    if (sub_size && nb_frames > 0 && want_sub != sub_size) {
+        set_error(errbuf, "sub-block size mismatch (%zu, file %zu)", want_sub,
+            sub_size);
+        return false;
+    }
+
+    *dict = seek_table_take_dict(st, dict_size);
+    bool want_dict = want == ZSEEK_ZSTD && zsp &&
+        (zsp->params.zstd_params.dict ||
+        zsp->params.zstd_params.dict_train_frames > 0);
+    if (want_dict) {
+        if (nb_frames > 0) {
+            set_error(errbuf, *dict ? "the dictionary of the file is reused" :
+                "file frames are compressed without a dictionary");
+            free(*dict);
+            *dict = NULL;
+            return false;
+        }
+        // Nothing compressed with it
+        free(*dict);
+        *dict = NULL;
+    }
+
+    return true;
+}
+
+/**
+ * Log the frames of @p st to @p writer, as if it had written them
+ */
+static bool append_seed(zseek_writer_t *writer, ZSTD_seekTable *st,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t nb_frames = seek_table_entries(st);
+    for (size_t f = 0; f < nb_frames; f++) {
+        size_t r = ZSTD_seekable_logFrame(writer->fl, frame_size_c(st, f),
+            frame_size_d(st, f), 0);
+        if (ZSTD_isError(r)) {
+            set_error(errbuf, "%s: %s", "log frame", ZSTD_getErrorName(r));
+            return false;
+        }
+        writer->total_cm += frame_size_c(st, f);
+    }
+
+    if (writer->sub_size == 0)
+        return true;
+
+    // Frames of a file without an index have no sub-block ends
+    const uint32_t *first, *ends;
+    bool indexed = seek_table_sub_blocks(st, &first, &ends) > 0;
+    for (size_t f = 0; f < nb_frames; f++) {
+        uint32_t frame_first = indexed ? first[f] : 0;
+        if (!zseek_buffer_push(writer->sub_first, &frame_first,
+            sizeof(frame_first))) {
+            set_error(errbuf, "failed to buffer sub-block index");
+            return false;
+        }
+    }
+    if (indexed && !zseek_buffer_push(writer->sub_ends, ends,
+        first[nb_frames] * sizeof(ends[0]))) {
+        set_error(errbuf, "failed to buffer sub-block index");
+        return false;
+    }
+
+    return true;
+}
+
+zseek_writer_t *zseek_writer_open_append_full(zseek_read_file_t read_file,
+    zseek_write_file_t user_file, zseek_compression_param_t *zsp,
+    size_t min_frame_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!user_file.truncate) {
+        set_error(errbuf, "appending needs a truncate handler");
+        goto fail;
+    }
+
+    ZSTD_seekTable *st = read_seek_table(read_file, false, call_data);
+    if (!st) {
+        set_error(errbuf, "read seek table failed");
+        goto fail;
+    }
+    size_t nb_frames = seek_table_entries(st);
+    size_t end_c = 0;
+    zseek_compression_type_t type = zsp ? zsp->type : ZSEEK_ZSTD;
+    if (nb_frames > 0) {
+        end_c = frame_offset_c(st, nb_frames - 1) +
+            frame_size_c(st, nb_frames - 1);
+
+        uint32_t magic_le;
+        ssize_t _read = read_file.pread(&magic_le, sizeof(magic_le), 0,
+            read_file.user_data, call_data);
+        if (_read != (ssize_t)sizeof(magic_le)) {
+            set_error(errbuf, "read file failed");
+            goto fail_w_st;
+        }
+        switch (le32toh(magic_le)) {
+        case ZSTD_MAGIC:
+            type = ZSEEK_ZSTD;
+            break;
+        case LZ4_MAGIC:
+            type = ZSEEK_LZ4;
+            break;
+        default:
+            set_error(errbuf, "unrecognized file format");
+            goto fail_w_st;
+        }
+    }
+
+    void *dict;
+    size_t dict_size;
+    if (!append_check(st, type, zsp, min_frame_size, &dict, &dict_size,
+        errbuf))
+        goto fail_w_st;
+
+    // Go on with the dictionary of the file
+    zseek_compression_param_t param;
+    if (dict) {
+        if (zsp) {
+            param = *zsp;
+        } else {
+            param = (zseek_compression_param_t){.type = ZSEEK_ZSTD};
+            param.params.zstd_params.compression_level = ZSTD_CLEVEL_DEFAULT;
+            param.params.zstd_params.strategy = ZSTD_fast;
+        }
+        param.params.zstd_params.dict = dict;
+        param.params.zstd_params.dict_size = dict_size;
+        zsp = &param;
+    }
+
+    zseek_writer_t *writer = zseek_writer_open_full(user_file, zsp,
+        min_frame_size, call_data, errbuf);
+    free(dict);
+    if (!writer)
+        goto fail_w_st;
+    // Keep the format of the file
+    if (seek_table_extended(st))
+        framelog_set_extended(writer->fl);
+    if (!append_seed(writer, st, errbuf))
+        goto fail_w_writer;
+
+    // NOTE: Last, so that the file is left untouched on any other error
+    if (!user_file.truncate(end_c, user_file.user_data, call_data)) {
+        // TODO OPT: Use errno if user_file.truncate sets it
+        set_error(errbuf, "truncate file failed");
+        goto fail_w_writer;
     }
+
+    seek_table_free(st);
+
+    return writer;
+
+fail_w_writer:
+    // NOTE: Nothing was written yet, and nothing is while closing
+    writer->user_file = (zseek_write_file_t){NULL, discard_write, NULL};
+    zseek_writer_close(writer, NULL, NULL);
+fail_w_st:
+    seek_table_free(st);
+fail:
+    return NULL;
 }
 
-zseek_writer_t *zseek_writer_open(FILE *cfile, zseek_compression_param_t *zsp,
-    size_t min_frame_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+zseek_writer_t *zseek_writer_open_append(FILE *cfile,
+    zseek_compression_param_t *zsp, size_t min_frame_size, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    zseek_write_file_t user_file = {cfile, default_write};
-    return zseek_writer_open_full(user_file, zsp, min_frame_size, call_data,
-        errbuf);
+    zseek_read_file_t read_file = {cfile, file_pread, file_fsize, NULL, NULL};
+    zseek_write_file_t user_file = {cfile, default_write, default_truncate};
+    return zseek_writer_open_append_full(read_file, user_file, zsp,
+        min_frame_size, call_data, errbuf);
 }
 
 /**
@@ -296,8 +1738,11 @@ static bool end_frame_zstd_mt(zseek_writer_t *writer, void *call_data)
     do {
         // Flush and end frame
         ZSTD_outBuffer buffout = {cbuf_data, cbuf_len, 0};
+        uint64_t start = monotonic_ns();
         rem = ZSTD_compressStream2(writer->cctx_zstd, &buffout, &buffin,
             ZSTD_e_end);
+        atomic_fetch_add_explicit(&writer->flush_ns, monotonic_ns() - start,
+            memory_order_relaxed);
         if (ZSTD_isError(rem)) {
             // fprintf(stderr, "compress: %s\n", ZSTD_getErrorName(rem));
             return false;
@@ -307,9 +1752,7 @@ static bool end_frame_zstd_mt(zseek_writer_t *writer, void *call_data)
         writer->frame_cm += buffout.pos;
 
         // Write output
-        if (!writer->user_file.write(buffout.dst, buffout.pos,
-            writer->user_file.user_data, call_data)) {
-
+        if (!write_file(writer, buffout.dst, buffout.pos, call_data)) {
             // TODO OPT: Use errno if user_file.write sets it
             // fprintf(stderr, "write to file failed");
             return false;
@@ -317,8 +1760,8 @@ static bool end_frame_zstd_mt(zseek_writer_t *writer, void *call_data)
     } while (rem > 0);
 
     // Log frame
-    size_t r = ZSTD_seekable_logFrame(writer->fl, writer->frame_cm,
-        writer->frame_uc, 0);
+    // NOTE: Compression time was accounted for as it was dispatched
+    size_t r = log_frame(writer, writer->frame_cm, writer->frame_uc, 0);
     if (ZSTD_isError(r)) {
         // fprintf(stderr, "log frame: %s\n", ZSTD_getErrorName(r));
         return false;
@@ -347,7 +1790,7 @@ static bool end_frame_zstd(zseek_writer_t *writer, void *call_data)
     assert(ubuf_data);
 
     // Resize output buffer
-    size_t cbuf_len = ZSTD_compressBound(ubuf_len);
+    size_t cbuf_len = frame_bound_zstd(ubuf_len, writer->sub_size);
     if (!zseek_buffer_resize(writer->cbuf, cbuf_len)) {
         // fprintf(stderr, "resize output buffer failed");
         return false;
@@ -356,32 +1799,33 @@ static bool end_frame_zstd(zseek_writer_t *writer, void *call_data)
     assert(cbuf_data);
 
     // Compress frame
-    size_t cdata_len = ZSTD_compress2(writer->cctx_zstd, cbuf_data, cbuf_len,
-        ubuf_data, ubuf_len);
-    if (ZSTD_isError(cdata_len)) {
-        // fprintf(stderr, "%s: %s", "compress", ZSTD_getErrorName(cdata_len));
+    uint64_t start = monotonic_ns();
+    size_t cdata_len;
+    if (!compress_subs_zstd(writer->cctx_zstd, cbuf_data, cbuf_len, ubuf_data,
+        ubuf_len, writer->sub_size, writer->frame_ends, &cdata_len, NULL))
         return false;
-    }
+    uint64_t ns = monotonic_ns() - start;
     // Correct buffer size (shrinks it, should not fail)
     assert(zseek_buffer_resize(writer->cbuf, cdata_len));
     writer->frame_cm += cdata_len;
 
     // Write output
-    if (!writer->user_file.write(cbuf_data, cdata_len,
-        writer->user_file.user_data, call_data)) {
-
+    if (!write_file(writer, cbuf_data, cdata_len, call_data)) {
         // TODO OPT: Use errno if user_file.write sets it
         // fprintf(stderr, "write to file failed");
         return false;
     }
 
     // Log frame
-    size_t r = ZSTD_seekable_logFrame(writer->fl, writer->frame_cm,
-        writer->frame_uc, 0);
+    size_t r = log_frame(writer, writer->frame_cm, writer->frame_uc, ns);
     if (ZSTD_isError(r)) {
         // fprintf(stderr, "log frame: %s\n", ZSTD_getErrorName(r));
         return false;
     }
+    if (!log_subs(writer, writer->frame_ends, NULL))
+        return false;
+    if (!adapt_level(writer, writer->frame_uc, ns, false, NULL))
+        return false;
 
     // Reset buffers and counters
     writer->total_cm += writer->frame_cm;
@@ -393,14 +1837,93 @@ static bool end_frame_zstd(zseek_writer_t *writer, void *call_data)
     return true;
 }
 
+/**
+ * Return the size of the trailers of @p writer
+ */
+static size_t trailers_size(const zseek_writer_t *writer)
+{
+    size_t size = 0;
+    if (writer->fixed)
+        size += trailer_size(8);
+    if (writer->dict)
+        size += trailer_size(writer->dict_size);
+    if (writer->sub_size)
+        size += trailer_size(trailer_sub_blocks_payload_size(
+            zseek_buffer_size(writer->sub_first) / sizeof(uint32_t),
+            zseek_buffer_size(writer->sub_ends) / sizeof(uint32_t)));
+    return size;
+}
+
+/**
+ * Encode the trailers of @p writer into @p dst (of trailers_size() bytes)
+ */
+static void encode_trailers(const zseek_writer_t *writer, void *dst)
+{
+    size_t size = 0;
+    if (writer->fixed)
+        size += trailer_encode_frame_size((uint8_t *)dst + size,
+            writer->min_frame_size);
+    if (writer->dict)
+        size += trailer_encode((uint8_t *)dst + size, TRAILER_DICTIONARY,
+            writer->dict, writer->dict_size);
+    if (writer->sub_size)
+        size += trailer_encode_sub_blocks((uint8_t *)dst + size,
+            writer->sub_size, zseek_buffer_data(writer->sub_first),
+            zseek_buffer_size(writer->sub_first) / sizeof(uint32_t),
+            zseek_buffer_data(writer->sub_ends),
+            zseek_buffer_size(writer->sub_ends) / sizeof(uint32_t));
+    assert(size == trailers_size(writer));
+}
+
+/**
+ * Write the trailers of @p writer, right before its seek table
+ */
+static bool write_trailers(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t size = trailers_size(writer);
+    if (size == 0)
+        return true;
+
+    uint8_t *trailers = malloc(size);
+    if (!trailers) {
+        set_error_with_errno(errbuf, "allocate trailers", errno);
+        return false;
+    }
+    encode_trailers(writer, trailers);
+    bool written = write_file(writer, trailers, size, call_data);
+    free(trailers);
+    if (!written) {
+        // TODO OPT: Use errno if user_file.write sets it
+        set_error(errbuf, "write to file failed");
+        return false;
+    }
+    return true;
+}
+
+static bool train_end(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+static bool record_write(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 static bool zseek_writer_close_zstd(zseek_writer_t *writer,
     void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
     bool is_error = false;
 
-    if (writer->frame_uc > 0) {
+    if (writer->train && !train_end(writer, call_data, errbuf))
+        is_error = true;
+    if (!record_write(writer, call_data, is_error ? NULL : errbuf))
+        is_error = true;
+
+    if (writer->parallel) {
+        // Write out all frames
+        if (!flush_parallel(writer, call_data, is_error ? NULL : errbuf))
+            is_error = true;
+        parallel_free(writer);
+    } else if (writer->frame_uc > 0) {
         // End final frame
-        if (!end_frame_zstd(writer, call_data)) {
+        if (!end_frame_zstd(writer, call_data) && !is_error) {
             set_error(errbuf, "end_frame_zstd failed");
             is_error = true;
         }
@@ -416,6 +1939,9 @@ static bool zseek_writer_close_zstd(zseek_writer_t *writer,
     void *cbuf_data = zseek_buffer_data(writer->cbuf);
     assert(cbuf_data);
 
+    if (!write_trailers(writer, call_data, is_error ? NULL : errbuf))
+        is_error = true;
+
     // Write seek table
     size_t rem = 0;
     do {
@@ -427,8 +1953,7 @@ static bool zseek_writer_close_zstd(zseek_writer_t *writer,
             is_error = true;
         }
 
-        bool written = writer->user_file.write(buffout.dst, buffout.pos,
-            writer->user_file.user_data, call_data);
+        bool written = write_file(writer, buffout.dst, buffout.pos, call_data);
         if (!written && !is_error) {
             // TODO OPT: Use errno if user_file.write sets it
             set_error(errbuf, "write to file failed");
@@ -445,12 +1970,15 @@ static bool zseek_writer_close_zstd(zseek_writer_t *writer,
     }
 
     zseek_buffer_free(writer->ubuf);
+    zseek_buffer_free(writer->record);
+    subs_free(writer);
 
     r = ZSTD_freeCCtx(writer->cctx_zstd);
     if (ZSTD_isError(r) && !is_error) {
         set_error(errbuf, "%s: %s", "free context", ZSTD_getErrorName(r));
         is_error = true;
     }
+    dict_free(writer);
 
     free(writer);
 
@@ -469,9 +1997,8 @@ static bool end_frame_lz4(zseek_writer_t *writer, void *call_data)
     assert(ubuf_data);
 
     // Resize output buffer
-    writer->preferences.frameInfo.contentSize = writer->frame_uc;
-    size_t cbuf_len = LZ4F_compressFrameBound(writer->frame_uc,
-        &writer->preferences);
+    size_t cbuf_len = frame_bound_lz4(&writer->preferences, ubuf_len,
+        writer->sub_size);
     if (!zseek_buffer_resize(writer->cbuf, cbuf_len)) {
         // fprintf(stderr, "resize output buffer failed");
         return false;
@@ -480,32 +2007,34 @@ static bool end_frame_lz4(zseek_writer_t *writer, void *call_data)
     assert(cbuf_data);
 
     // Compress frame
-    size_t cdata_len = LZ4F_compressFrame(cbuf_data, cbuf_len, ubuf_data,
-        ubuf_len, &writer->preferences);
-    if (LZ4F_isError(cdata_len)) {
-        // fprintf(stderr, "%s: %s", "compress", LZ4F_getErrorName(cdata_len));
+    uint64_t start = monotonic_ns();
+    size_t cdata_len;
+    if (!compress_subs_lz4(NULL, &writer->preferences, cbuf_data, cbuf_len,
+        ubuf_data, ubuf_len, writer->sub_size, writer->frame_ends, &cdata_len,
+        NULL))
         return false;
-    }
+    uint64_t ns = monotonic_ns() - start;
     // Correct buffer size (shrinks it, should not fail)
     assert(zseek_buffer_resize(writer->cbuf, cdata_len));
     writer->frame_cm += cdata_len;
 
     // Write output
-    if (!writer->user_file.write(cbuf_data, cdata_len,
-        writer->user_file.user_data, call_data)) {
-
+    if (!write_file(writer, cbuf_data, cdata_len, call_data)) {
         // TODO OPT: Use errno if user_file.write sets it
         // fprintf(stderr, "write to file failed");
         return false;
     }
 
     // Log frame
-    size_t r = ZSTD_seekable_logFrame(writer->fl, writer->frame_cm,
-        writer->frame_uc, 0);
+    size_t r = log_frame(writer, writer->frame_cm, writer->frame_uc, ns);
     if (ZSTD_isError(r)) {
         // fprintf(stderr, "log frame: %s\n", ZSTD_getErrorName(r));
         return false;
     }
+    if (!log_subs(writer, writer->frame_ends, NULL))
+        return false;
+    if (!adapt_level(writer, writer->frame_uc, ns, false, NULL))
+        return false;
 
     // Reset buffers and counters
     writer->total_cm += writer->frame_cm;
@@ -522,7 +2051,15 @@ static bool zseek_writer_close_lz4(zseek_writer_t *writer,
 {
     bool is_error = false;
 
-    if (writer->frame_uc > 0) {
+    if (!record_write(writer, call_data, errbuf))
+        is_error = true;
+
+    if (writer->parallel) {
+        // Write out all frames
+        if (!flush_parallel(writer, call_data, is_error ? NULL : errbuf))
+            is_error = true;
+        parallel_free(writer);
+    } else if (writer->frame_uc > 0) {
         // End final frame
         if (!end_frame_lz4(writer, call_data)) {
             set_error(errbuf, "end_frame_lz4 failed");
@@ -540,6 +2077,9 @@ static bool zseek_writer_close_lz4(zseek_writer_t *writer,
     void *cbuf_data = zseek_buffer_data(writer->cbuf);
     assert(cbuf_data);
 
+    if (!write_trailers(writer, call_data, is_error ? NULL : errbuf))
+        is_error = true;
+
     // Write seek table
     size_t rem = 0;
     do {
@@ -551,8 +2091,7 @@ static bool zseek_writer_close_lz4(zseek_writer_t *writer,
             is_error = true;
         }
 
-        bool written = writer->user_file.write(buffout.dst, buffout.pos,
-            writer->user_file.user_data, call_data);
+        bool written = write_file(writer, buffout.dst, buffout.pos, call_data);
         if (!written && !is_error) {
             // TODO OPT: Use errno if user_file.write sets it
             set_error(errbuf, "write to file failed");
@@ -569,6 +2108,8 @@ static bool zseek_writer_close_lz4(zseek_writer_t *writer,
     }
 
     zseek_buffer_free(writer->ubuf);
+    zseek_buffer_free(writer->record);
+    subs_free(writer);
 
     free(writer);
 
@@ -599,7 +2140,7 @@ bool zseek_writer_close(zseek_writer_t *writer,  void *call_data,
 static bool zseek_write_zstd_mt(zseek_writer_t *writer, const void *buf,
     size_t len, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    if (writer->frame_uc >= writer->min_frame_size) {
+    if (writer->frame_uc >= writer->cut_size) {
         // End current frame
         // NOTE: This blocks, flushing data dispatched for compression in
         // previous calls.
@@ -622,8 +2163,11 @@ static bool zseek_write_zstd_mt(zseek_writer_t *writer, const void *buf,
     do {
         // Dispatch for compression
         ZSTD_outBuffer buffout = {cbuf_data, cbuf_len, 0};
+        uint64_t start = monotonic_ns();
         size_t rem = ZSTD_compressStream2(writer->cctx_zstd, &buffout, &buffin,
             ZSTD_e_continue);
+        atomic_fetch_add_explicit(&writer->compress_ns, monotonic_ns() - start,
+            memory_order_relaxed);
         if (ZSTD_isError(rem)) {
             set_error(errbuf, "%s: %s", "compress", ZSTD_getErrorName(rem));
             return false;
@@ -633,8 +2177,7 @@ static bool zseek_write_zstd_mt(zseek_writer_t *writer, const void *buf,
         writer->frame_cm += buffout.pos;
 
         // Write output
-        if (!writer->user_file.write(buffout.dst, buffout.pos,
-                writer->user_file.user_data, call_data)) {
+        if (!write_file(writer, buffout.dst, buffout.pos, call_data)) {
             // TODO OPT: Use errno if user_file.write sets it
             set_error(errbuf, "write to file failed");
             return false;
@@ -654,8 +2197,7 @@ static bool compress_frame_zstd(zseek_writer_t *writer, const void *buf,
     size_t len, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
     // Resize output buffer
-    writer->preferences.frameInfo.contentSize = writer->frame_uc;
-    size_t max_cdata_len = ZSTD_compressBound(len);
+    size_t max_cdata_len = frame_bound_zstd(len, writer->sub_size);
     if (!zseek_buffer_resize(writer->cbuf, max_cdata_len)) {
         set_error(errbuf, "failed to resize output buffer");
         return false;
@@ -663,34 +2205,34 @@ static bool compress_frame_zstd(zseek_writer_t *writer, const void *buf,
     void *cbuf_data = zseek_buffer_data(writer->cbuf);
     assert(cbuf_data);
     // Compress frame
-    size_t cdata_len = ZSTD_compress2(writer->cctx_zstd, cbuf_data,
-        max_cdata_len, buf, len);
-    if (ZSTD_isError(cdata_len)) {
-        set_error(errbuf, "%s: %s", "compress frame",
-            ZSTD_getErrorName(cdata_len));
+    uint64_t start = monotonic_ns();
+    size_t cdata_len;
+    if (!compress_subs_zstd(writer->cctx_zstd, cbuf_data, max_cdata_len, buf,
+        len, writer->sub_size, writer->frame_ends, &cdata_len, errbuf))
         return false;
-    }
+    uint64_t ns = monotonic_ns() - start;
     // Correct buffer size (shrinks it, should not fail)
     assert(zseek_buffer_resize(writer->cbuf, cdata_len));
     writer->frame_uc += len;
     writer->frame_cm += cdata_len;
 
     // Write output
-    if (!writer->user_file.write(cbuf_data, cdata_len,
-        writer->user_file.user_data, call_data)) {
-
+    if (!write_file(writer, cbuf_data, cdata_len, call_data)) {
         // TODO OPT: Use errno if user_file.write sets it
         set_error(errbuf, "write to file failed");
         return false;
     }
 
     // Log frame
-    size_t r = ZSTD_seekable_logFrame(writer->fl, writer->frame_cm,
-        writer->frame_uc, 0);
+    size_t r = log_frame(writer, writer->frame_cm, writer->frame_uc, ns);
     if (ZSTD_isError(r)) {
         set_error(errbuf, "log frame: %s\n", ZSTD_getErrorName(r));
         return false;
     }
+    if (!log_subs(writer, writer->frame_ends, errbuf))
+        return false;
+    if (!adapt_level(writer, writer->frame_uc, ns, false, errbuf))
+        return false;
 
     // Reset buffers and counters
     writer->total_cm += writer->frame_cm;
@@ -707,7 +2249,7 @@ static bool zseek_write_zstd(zseek_writer_t *writer, const void *buf,
     if (writer->mt)
         return zseek_write_zstd_mt(writer, buf, len, call_data, errbuf);
 
-    if (writer->frame_cm == 0 && len >= writer->min_frame_size) {
+    if (writer->frame_uc == 0 && len >= writer->cut_size) {
         // Compress frame directly from buf, to avoid copying
         // TODO OPT: Reuse end_frame_zstd for this
         return compress_frame_zstd(writer, buf, len, call_data, errbuf);
@@ -720,7 +2262,7 @@ static bool zseek_write_zstd(zseek_writer_t *writer, const void *buf,
     }
     writer->frame_uc += len;
 
-    if (writer->frame_uc >= writer->min_frame_size) {
+    if (writer->frame_uc >= writer->cut_size) {
         // End current frame
         if (!end_frame_zstd(writer, call_data)) {
             set_error(errbuf, "end_frame_zstd failed");
@@ -738,8 +2280,8 @@ static bool compress_frame_lz4(zseek_writer_t *writer, const void *buf,
     size_t len, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
     // Resize output buffer
-    writer->preferences.frameInfo.contentSize = writer->frame_uc;
-    size_t max_cdata_len = LZ4F_compressFrameBound(len, &writer->preferences);
+    size_t max_cdata_len = frame_bound_lz4(&writer->preferences, len,
+        writer->sub_size);
     if (!zseek_buffer_resize(writer->cbuf, max_cdata_len)) {
         set_error(errbuf, "failed to resize output buffer");
         return false;
@@ -747,34 +2289,35 @@ static bool compress_frame_lz4(zseek_writer_t *writer, const void *buf,
     void *cbuf_data = zseek_buffer_data(writer->cbuf);
     assert(cbuf_data);
     // Compress frame
-    size_t cdata_len = LZ4F_compressFrame(cbuf_data, max_cdata_len, buf, len,
-        &writer->preferences);
-    if (LZ4F_isError(cdata_len)) {
-        set_error(errbuf, "%s: %s", "compress frame",
-            LZ4F_getErrorName(cdata_len));
+    uint64_t start = monotonic_ns();
+    size_t cdata_len;
+    if (!compress_subs_lz4(NULL, &writer->preferences, cbuf_data,
+        max_cdata_len, buf, len, writer->sub_size, writer->frame_ends,
+        &cdata_len, errbuf))
         return false;
-    }
+    uint64_t ns = monotonic_ns() - start;
     // Correct buffer size (shrinks it, should not fail)
     assert(zseek_buffer_resize(writer->cbuf, cdata_len));
     writer->frame_uc += len;
     writer->frame_cm += cdata_len;
 
     // Write output
-    if (!writer->user_file.write(cbuf_data, cdata_len,
-        writer->user_file.user_data, call_data)) {
-
+    if (!write_file(writer, cbuf_data, cdata_len, call_data)) {
         // TODO OPT: Use errno if user_file.write sets it
         set_error(errbuf, "write to file failed");
         return false;
     }
 
     // Log frame
-    size_t r = ZSTD_seekable_logFrame(writer->fl, writer->frame_cm,
-        writer->frame_uc, 0);
+    size_t r = log_frame(writer, writer->frame_cm, writer->frame_uc, ns);
     if (ZSTD_isError(r)) {
         set_error(errbuf, "log frame: %s\n", ZSTD_getErrorName(r));
         return false;
     }
+    if (!log_subs(writer, writer->frame_ends, errbuf))
+        return false;
+    if (!adapt_level(writer, writer->frame_uc, ns, false, errbuf))
+        return false;
 
     // Reset buffers and counters
     writer->total_cm += writer->frame_cm;
@@ -788,7 +2331,7 @@ static bool compress_frame_lz4(zseek_writer_t *writer, const void *buf,
 static bool zseek_write_lz4(zseek_writer_t *writer, const void *buf, size_t len,
     void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    if (writer->frame_cm == 0 && len >= writer->min_frame_size) {
+    if (writer->frame_uc == 0 && len >= writer->cut_size) {
         // Compress frame directly from buf, to avoid copying
         // TODO OPT: Reuse end_frame_lz4 for this
         return compress_frame_lz4(writer, buf, len, call_data, errbuf);
@@ -801,7 +2344,7 @@ static bool zseek_write_lz4(zseek_writer_t *writer, const void *buf, size_t len,
     }
     writer->frame_uc += len;
 
-    if (writer->frame_uc >= writer->min_frame_size) {
+    if (writer->frame_uc >= writer->cut_size) {
         // End current frame
         if (!end_frame_lz4(writer, call_data)) {
             set_error(errbuf, "end_frame_lz4 failed");
@@ -812,13 +2355,63 @@ static bool zseek_write_lz4(zseek_writer_t *writer, const void *buf, size_t len,
     return true;
 }
 
-bool zseek_write(zseek_writer_t *writer, const void *buf, size_t len,
-    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+/**
+ * End the current frame, in any mode
+ */
+static bool end_frame(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    if (!writer) {
-        set_error(errbuf, "invalid writer");
+    if (writer->parallel)
+        return end_frame_parallel(writer, call_data, errbuf);
+
+    switch (writer->type) {
+    case ZSEEK_ZSTD:
+        if (!(writer->mt ? end_frame_zstd_mt(writer, call_data) :
+            end_frame_zstd(writer, call_data))) {
+            set_error(errbuf, "end_frame_zstd failed");
+            return false;
+        }
+        return true;
+    case ZSEEK_LZ4:
+        if (!end_frame_lz4(writer, call_data)) {
+            set_error(errbuf, "end_frame_lz4 failed");
+            return false;
+        }
+        return true;
+    default:
+        // BUG
+        assert(false);
         return false;
     }
+}
+
+/**
+ * Return the number of bytes that fit in the current frame of @p writer, with
+ * a maximum frame size (or fixed-size frames). With records, the number of
+ * bytes the current record can grow by without being split.
+ */
+static size_t frame_room(const zseek_writer_t *writer)
+{
+    if (writer->record)
+        // The record moves to the next frame if it does not fit
+        return writer->max_frame_size - zseek_buffer_size(writer->record);
+
+    // NOTE: In multi-threaded zstd mode, a full frame ends on the next write
+    size_t fill = writer->frame_uc;
+    if (writer->train)
+        // Training data is cut into frames from its start, see train_end()
+        fill = zseek_buffer_size(writer->train);
+    return writer->max_frame_size - fill % writer->max_frame_size;
+}
+
+/**
+ * Write @p len bytes of @p buf, in any mode
+ */
+static bool write_any(zseek_writer_t *writer, const void *buf, size_t len,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (writer->parallel)
+        return zseek_write_parallel(writer, buf, len, call_data, errbuf);
 
     switch (writer->type) {
     case ZSEEK_ZSTD:
@@ -832,6 +2425,302 @@ bool zseek_write(zseek_writer_t *writer, const void *buf, size_t len,
     }
 }
 
+/**
+ * Write the record held back by @p writer (if any) to the current frame
+ */
+static bool record_write(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t len = writer->record ? zseek_buffer_size(writer->record) : 0;
+    if (len == 0)
+        return true;
+
+    bool ok = write_any(writer, zseek_buffer_data(writer->record), len,
+        call_data, errbuf);
+    zseek_buffer_reset(writer->record);
+    return ok;
+}
+
+/**
+ * Make room in the current frame of @p writer for the record held back: end
+ * the frame before the record if the record does not fit, and write out full
+ * frames of a record longer than max_frame_size. Holds back at most
+ * max_frame_size bytes.
+ */
+static bool record_fit(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t len = zseek_buffer_size(writer->record);
+    size_t max = writer->max_frame_size;
+    if (writer->frame_uc + len <= max)
+        return true;
+
+    if (writer->frame_uc > 0 && !end_frame(writer, call_data, errbuf))
+        return false;
+    if (len <= max)
+        return true;
+
+    // Too long for any frame: split it (frames are cut at max_frame_size)
+    uint8_t *data = zseek_buffer_data(writer->record);
+    size_t off = 0;
+    for (; len - off > max; off += max) {
+        if (!write_any(writer, data + off, max, call_data, errbuf))
+            return false;
+    }
+    memmove(data, data + off, len - off);
+    // Shrinks it, should not fail
+    zseek_buffer_resize(writer->record, len - off);
+
+    return true;
+}
+
+/**
+ * End dictionary training for @p writer: train a dictionary on the first
+ * train_size bytes buffered, cut into frame-sized samples, then compress all
+ * of them in frames of min_frame_size bytes, with the dictionary if training
+ * succeeded.
+ */
+static bool train_end(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_buffer_t *train = writer->train;
+    writer->train = NULL;
+    size_t size = zseek_buffer_size(train);
+    const uint8_t *data = zseek_buffer_data(train);
+    size_t *sizes = NULL;
+    void *dict = NULL;
+    bool ok = false;
+
+    if (size > 0) {
+        size_t train_len = MIN(size, writer->train_size);
+        size_t nb_samples = (train_len + writer->min_frame_size - 1) /
+            writer->min_frame_size;
+        sizes = malloc(nb_samples * sizeof(sizes[0]));
+        dict = malloc(writer->dict_max_size);
+        if (!sizes || !dict) {
+            set_error_with_errno(errbuf, "allocate training buffers", errno);
+            goto out;
+        }
+        for (size_t i = 0; i < nb_samples; i++)
+            sizes[i] = MIN(writer->min_frame_size,
+                train_len - i * writer->min_frame_size);
+
+        // NOTE: Training fails on too little (or too uniform) data, which is
+        // then compressed without a dictionary
+        size_t dict_size = ZDICT_trainFromBuffer(dict, writer->dict_max_size,
+            data, sizes, (unsigned)nb_samples);
+        if (!ZDICT_isError(dict_size) &&
+            !use_dict(writer, dict, dict_size, errbuf))
+            goto out;
+    }
+
+    // Compress buffered data, one frame at a time
+    for (size_t off = 0; off < size; off += writer->min_frame_size) {
+        if (!write_any(writer, data + off,
+            MIN(writer->min_frame_size, size - off), call_data, errbuf))
+            goto out;
+    }
+    ok = true;
+
+out:
+    free(dict);
+    free(sizes);
+    zseek_buffer_free(train);
+    return ok;
+}
+
+bool zseek_write(zseek_writer_t *writer, const void *buf, size_t len,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!writer) {
+        set_error(errbuf, "invalid writer");
+        return false;
+    }
+    writer->reserved = 0;
+
+    if (writer->train) {
+        // Buffer until there is enough to train a dictionary on
+        if (!zseek_buffer_push(writer->train, buf, len)) {
+            set_error(errbuf, "failed to buffer training data");
+            return false;
+        }
+        if (zseek_buffer_size(writer->train) < writer->train_size)
+            return true;
+        return train_end(writer, call_data, errbuf);
+    }
+
+    if (writer->max_frame_size == 0)
+        return write_any(writer, buf, len, call_data, errbuf);
+
+    if (writer->record) {
+        // Hold the record back, a frame's worth at a time
+        while (len > 0) {
+            size_t piece = MIN(len, writer->max_frame_size);
+            if (!zseek_buffer_push(writer->record, buf, piece)) {
+                set_error(errbuf, "failed to buffer record");
+                return false;
+            }
+            if (!record_fit(writer, call_data, errbuf))
+                return false;
+            buf = (const uint8_t *)buf + piece;
+            len -= piece;
+        }
+        return true;
+    }
+
+    // Split at frame boundaries
+    while (len > 0) {
+        size_t piece = MIN(len, frame_room(writer));
+        if (!write_any(writer, buf, piece, call_data, errbuf))
+            return false;
+        buf = (const uint8_t *)buf + piece;
+        len -= piece;
+    }
+
+    return true;
+}
+
+bool zseek_writer_flush(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!writer) {
+        set_error(errbuf, "invalid writer");
+        return false;
+    }
+
+    writer->reserved = 0;
+
+    if (writer->fixed && frame_room(writer) != writer->min_frame_size) {
+        set_error(errbuf, "flush would end a frame short of its fixed size");
+        return false;
+    }
+
+    if (writer->train && !train_end(writer, call_data, errbuf))
+        return false;
+    if (!record_write(writer, call_data, errbuf))
+        return false;
+
+    if (writer->parallel)
+        return flush_parallel(writer, call_data, errbuf);
+
+    if (writer->frame_uc == 0)
+        return true;
+
+    return end_frame(writer, call_data, errbuf);
+}
+
+/**
+ * Returns the buffer the current frame is filled in
+ */
+static zseek_buffer_t *current_ubuf(zseek_writer_t *writer)
+{
+    if (writer->train)
+        return writer->train;
+    if (writer->record)
+        return writer->record;
+    if (writer->parallel)
+        return writer->jobs[writer->job_in % writer->nb_jobs].ubuf;
+    return writer->ubuf;
+}
+
+void *zseek_writer_reserve(zseek_writer_t *writer, size_t size,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!writer) {
+        set_error(errbuf, "invalid writer");
+        return NULL;
+    }
+    writer->reserved = 0;
+
+    if (writer->max_frame_size > 0 && size > frame_room(writer)) {
+        set_error(errbuf, "reservation of %zu bytes crosses a frame boundary",
+            size);
+        return NULL;
+    }
+
+    zseek_buffer_t *ubuf = current_ubuf(writer);
+    size_t ubuf_len = zseek_buffer_size(ubuf);
+    // NOTE: Reserve at least 1 byte, to never return NULL on success
+    if (size >= SIZE_MAX - ubuf_len ||
+        !zseek_buffer_reserve(ubuf, ubuf_len + (size > 0 ? size : 1))) {
+        set_error(errbuf, "failed to reserve uncompressed data");
+        return NULL;
+    }
+    writer->reserved = size;
+
+    return (uint8_t *)zseek_buffer_data(ubuf) + ubuf_len;
+}
+
+bool zseek_writer_commit(zseek_writer_t *writer, size_t used, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!writer) {
+        set_error(errbuf, "invalid writer");
+        return false;
+    }
+
+    if (used > writer->reserved) {
+        set_error(errbuf, "commit of %zu bytes exceeds reservation of %zu",
+            used, writer->reserved);
+        return false;
+    }
+    writer->reserved = 0;
+    if (used == 0)
+        return true;
+
+    zseek_buffer_t *ubuf = current_ubuf(writer);
+    size_t ubuf_len = zseek_buffer_size(ubuf);
+    // Within capacity (reserved), should not fail
+    zseek_buffer_resize(ubuf, ubuf_len + used);
+
+    if (writer->train) {
+        if (zseek_buffer_size(ubuf) < writer->train_size)
+            return true;
+        return train_end(writer, call_data, errbuf);
+    }
+
+    if (writer->record)
+        return record_fit(writer, call_data, errbuf);
+
+    if (writer->type == ZSEEK_ZSTD && writer->mt) {
+        // The input buffer is only scratch space, zstd buffers internally
+        void *data = zseek_buffer_data(ubuf);
+        bool ok = zseek_write_zstd_mt(writer, data, used, call_data, errbuf);
+        zseek_buffer_reset(ubuf);
+        return ok;
+    }
+
+    writer->frame_uc += used;
+    if (writer->frame_uc >= writer->cut_size)
+        return end_frame(writer, call_data, errbuf);
+
+    return true;
+}
+
+bool zseek_writer_end_record(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!writer) {
+        set_error(errbuf, "invalid writer");
+        return false;
+    }
+    writer->reserved = 0;
+
+    if (!writer->records) {
+        set_error(errbuf, "writer not opened with record_aligned");
+        return false;
+    }
+
+    // Fits in the current frame (see record_fit())
+    if (writer->record && !record_write(writer, call_data, errbuf))
+        return false;
+
+    if (writer->frame_uc == 0 || writer->frame_uc < writer->min_frame_size)
+        return true;
+
+    return end_frame(writer, call_data, errbuf);
+}
+
 bool zseek_writer_stats(zseek_writer_t *writer, zseek_writer_stats_t *stats,
     char errbuf[ZSEEK_ERRBUF_SIZE])
 {
@@ -845,17 +2734,30 @@ bool zseek_writer_stats(zseek_writer_t *writer, zseek_writer_stats_t *stats,
         return false;
     }
 
-    size_t frames = framelog_entries(writer->fl);
+    if (writer->parallel)
+        pthread_mutex_lock(&writer->jobs_lock);
+
+    int level = writer->level;
+    size_t level_changes = writer->level_changes;
+
+    // Frames dispatched for compression, but not written out yet
+    size_t pending = writer->job_in - writer->job_out;
     if (writer->frame_uc > 0)
-        frames++;
+        pending++;
 
-    size_t seek_table_size = framelog_size(writer->fl);
-    if (writer->frame_uc > 0) {
-        const size_t SIZE_PER_FRAME = 8; // assume no checksum
-        seek_table_size += SIZE_PER_FRAME;
-    }
+    size_t frames = framelog_entries(writer->fl) + pending;
+    // Data buffered for dictionary training, to be cut into frames
+    size_t train_len = zseek_buffer_size(writer->train);
+    frames += (train_len + writer->min_frame_size - 1) /
+        (writer->min_frame_size > 0 ? writer->min_frame_size : 1);
+
+    const size_t SIZE_PER_FRAME = 8; // assume no checksum
+    size_t seek_table_size = framelog_size(writer->fl) +
+        pending * SIZE_PER_FRAME + trailers_size(writer);
 
-    size_t seek_table_memory = framelog_memory_usage(writer->fl);
+    size_t seek_table_memory = framelog_memory_usage(writer->fl) +
+        zseek_buffer_capacity(writer->sub_first) +
+        zseek_buffer_capacity(writer->sub_ends);
 
     // NOTE: This is an _estimate_ because frame_cm is <= final frame size,
     // since there may be still data to flush from the compressor.
@@ -866,8 +2768,31 @@ bool zseek_writer_stats(zseek_writer_t *writer, zseek_writer_stats_t *stats,
     // buffer too in its context object.
     size_t buffer_size = zseek_buffer_capacity(writer->ubuf);
     buffer_size += zseek_buffer_capacity(writer->cbuf);
-    if (writer->type == ZSEEK_ZSTD)
+    buffer_size += zseek_buffer_capacity(writer->train);
+    buffer_size += zseek_buffer_capacity(writer->frame_ends);
+    if (writer->type == ZSEEK_ZSTD) {
         buffer_size += ZSTD_sizeof_CCtx(writer->cctx_zstd);
+        buffer_size += ZSTD_sizeof_CDict(writer->cdict) + writer->dict_size;
+        if (writer->level_cdicts) {
+            for (int l = writer->min_level; l <= writer->max_level; l++)
+                buffer_size += ZSTD_sizeof_CDict(
+                    writer->level_cdicts[l - writer->min_level]);
+        }
+    }
+    if (writer->parallel) {
+        for (size_t j = 0; j < writer->nb_jobs; j++) {
+            zseek_frame_job_t *job = &writer->jobs[j];
+            if (job->state == JOB_FREE)
+                buffer_size += zseek_buffer_capacity(job->ubuf) +
+                    zseek_buffer_capacity(job->cbuf) +
+                    zseek_buffer_capacity(job->ends);
+            else
+                buffer_size += job->memory;
+        }
+        for (size_t c = 0; c < writer->nb_cctxs; c++)
+            buffer_size += writer->cctxs[c].memory;
+        pthread_mutex_unlock(&writer->jobs_lock);
+    }
 
     *stats = (zseek_writer_stats_t) {
         .seek_table_size = seek_table_size,
@@ -875,7 +2800,19 @@ bool zseek_writer_stats(zseek_writer_t *writer, zseek_writer_stats_t *stats,
         .frames = frames,
         .compressed_size = compressed_size,
         .buffer_size = buffer_size,
+        .compression_level = level,
+        .level_changes = level_changes,
+        .compress_ns = atomic_load_explicit(&writer->compress_ns,
+            memory_order_relaxed),
+        .write_ns = atomic_load_explicit(&writer->write_ns,
+            memory_order_relaxed),
+        .flush_ns = atomic_load_explicit(&writer->flush_ns,
+            memory_order_relaxed),
     };
+    histogram_read(&writer->frame_size, &stats->frame_size);
+    histogram_read(&writer->frame_compressed_size,
+        &stats->frame_compressed_size);
+    histogram_read(&writer->frame_ratio, &stats->frame_ratio);
 
     return true;
 }
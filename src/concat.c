@@ -0,0 +1,499 @@
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t
+#include <stdio.h>      // I/O
+#include <stdlib.h>     // malloc, free
+#include <errno.h>      // errno
+#include <string.h>     // memset, memcmp
+
+#include <unistd.h>     // lseek, copy_file_range
+#include <endian.h>     // le32toh
+
+#include <zstd.h>
+
+#include "zseek.h"
+#include "seek_table.h"
+#include "common.h"
+#include "buffer.h"
+
+#define ZSTD_MAGIC 0xFD2FB528
+#define LZ4_MAGIC 0x184D2204
+
+// Upper bound on the entries of the sub-block index, as in compress.c
+#define SUB_INDEX_MAX (1U << 29)
+
+// Size of the buffer frames are copied through
+#define COPY_BUF_SIZE (1 << 20)     // 1 MiB
+// Size of the buffer the seek table is written through
+#define SEEK_TABLE_BUF_SIZE 4096
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/**
+ * An input of zseek_concat_full()
+ */
+typedef struct {
+    ZSTD_seekTable *st;
+    size_t nb_frames;
+    size_t end_c;       // Compressed end of the frames
+    zseek_compression_type_t type;
+} concat_input_t;
+
+/**
+ * Handler copying @p len bytes at @p offset of input @p i to the output
+ */
+typedef bool (*concat_copy_t)(size_t i, size_t offset, size_t len, void *arg,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Shared state of a zseek_concat_full() call
+ */
+typedef struct {
+    const zseek_read_file_t *inputs;
+    zseek_write_file_t output;
+    void *call_data;
+    uint8_t *buf;   // Of COPY_BUF_SIZE bytes
+} concat_state_t;
+
+/**
+ * Merged trailers of the inputs of zseek_concat_full()
+ */
+typedef struct {
+    size_t frame_size;      // 0 if not all fixed-size alike
+    void *dict;
+    size_t dict_size;
+    size_t sub_size;        // 0 if not all indexed alike
+    zseek_buffer_t *sub_first;
+    zseek_buffer_t *sub_ends;
+} concat_trailers_t;
+
+static bool copy_through_buffer(size_t i, size_t offset, size_t len,
+    void *arg, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    concat_state_t *cs = arg;
+    const zseek_read_file_t *input = &cs->inputs[i];
+
+    while (len > 0) {
+        size_t chunk = MIN(len, COPY_BUF_SIZE);
+        ssize_t _read = input->pread(cs->buf, chunk, offset,
+            input->user_data, cs->call_data);
+        if (_read != (ssize_t)chunk) {
+            if (_read >= 0)
+                set_error(errbuf, "unexpected EOF");
+            else
+                // TODO OPT: Use errno if pread sets it
+                set_error(errbuf, "read file failed");
+            return false;
+        }
+        if (!cs->output.write(cs->buf, chunk, cs->output.user_data,
+            cs->call_data)) {
+            // TODO OPT: Use errno if user_file.write sets it
+            set_error(errbuf, "write to file failed");
+            return false;
+        }
+        offset += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+/**
+ * Read the seek table of @p input into @p ci, along with its compression type
+ */
+static bool input_open(const zseek_read_file_t *input, concat_input_t *ci,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    ci->st = read_seek_table(*input, false, call_data);
+    if (!ci->st) {
+        set_error(errbuf, "read seek table failed");
+        return false;
+    }
+    ci->nb_frames = seek_table_entries(ci->st);
+    if (ci->nb_frames == 0)
+        return true;
+    ci->end_c = frame_offset_c(ci->st, ci->nb_frames - 1) +
+        frame_size_c(ci->st, ci->nb_frames - 1);
+
+    // Same check as zseek_reader_open_param()
+    uint32_t magic_le;
+    ssize_t _read = input->pread(&magic_le, sizeof(magic_le), 0,
+        input->user_data, call_data);
+    if (_read != (ssize_t)sizeof(magic_le)) {
+        if (_read >= 0)
+            set_error(errbuf, "unexpected EOF");
+        else
+            // TODO OPT: Use errno if user_file.pread sets it
+            set_error(errbuf, "read file failed");
+        return false;
+    }
+    switch (le32toh(magic_le)) {
+    case ZSTD_MAGIC:
+        ci->type = ZSEEK_ZSTD;
+        return true;
+    case LZ4_MAGIC:
+        ci->type = ZSEEK_LZ4;
+        return true;
+    default:
+        set_error(errbuf, "unrecognized file format");
+        return false;
+    }
+}
+
+/**
+ * Merge the trailers of the @p n inputs in @p cis into @p ct. Frames need the
+ * dictionary they were compressed with, so all inputs with frames must have
+ * the same one (or none). The other trailers are dropped unless all inputs
+ * agree on them.
+ */
+static bool trailers_merge(concat_input_t *cis, size_t n,
+    concat_trailers_t *ct, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    bool first = true;
+    size_t last_input = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (cis[i].nb_frames == 0)
+            continue;
+
+        size_t dict_size;
+        void *dict = seek_table_take_dict(cis[i].st, &dict_size);
+        const uint32_t *sub_first, *sub_ends;
+        size_t sub_size = seek_table_sub_blocks(cis[i].st, &sub_first,
+            &sub_ends);
+        if (first) {
+            ct->frame_size = seek_table_frame_size(cis[i].st);
+            ct->dict = dict;
+            ct->dict_size = dict_size;
+            ct->sub_size = sub_size;
+            first = false;
+            last_input = i;
+            continue;
+        }
+
+        if (cis[i].type != cis[last_input].type) {
+            free(dict);
+            set_error(errbuf, "compression type mismatch (input %zu)", i);
+            return false;
+        }
+        bool same_dict = dict_size == ct->dict_size &&
+            (!dict || memcmp(dict, ct->dict, dict_size) == 0);
+        free(dict);
+        if (!same_dict) {
+            set_error(errbuf, "dictionary mismatch (input %zu)", i);
+            return false;
+        }
+        // Only the last frame of all may be partial
+        if (seek_table_frame_size(cis[i].st) != ct->frame_size ||
+            frame_size_d(cis[last_input].st,
+            cis[last_input].nb_frames - 1) != ct->frame_size)
+            ct->frame_size = 0;
+        if (sub_size != ct->sub_size)
+            ct->sub_size = 0;
+        last_input = i;
+    }
+    if (ct->sub_size == 0)
+        return true;
+
+    // Rebase each input's sub-block index
+    ct->sub_first = zseek_buffer_new(0);
+    ct->sub_ends = zseek_buffer_new(0);
+    if (!ct->sub_first || !ct->sub_ends) {
+        set_error(errbuf, "sub-block index creation failed");
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t *sub_first, *sub_ends;
+        seek_table_sub_blocks(cis[i].st, &sub_first, &sub_ends);
+        size_t base = zseek_buffer_size(ct->sub_ends) / sizeof(uint32_t);
+        size_t nb_ends = cis[i].nb_frames > 0 ? sub_first[cis[i].nb_frames] :
+            0;
+        if (base + nb_ends > SUB_INDEX_MAX) {
+            set_error(errbuf, "too many sub-blocks");
+            return false;
+        }
+        for (size_t f = 0; f < cis[i].nb_frames; f++) {
+            uint32_t frame_first = base + sub_first[f];
+            if (!zseek_buffer_push(ct->sub_first, &frame_first,
+                sizeof(frame_first))) {
+                set_error(errbuf, "failed to buffer sub-block index");
+                return false;
+            }
+        }
+        if (!zseek_buffer_push(ct->sub_ends, sub_ends,
+            nb_ends * sizeof(sub_ends[0]))) {
+            set_error(errbuf, "failed to buffer sub-block index");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void trailers_free(concat_trailers_t *ct)
+{
+    free(ct->dict);
+    zseek_buffer_free(ct->sub_first);
+    zseek_buffer_free(ct->sub_ends);
+}
+
+/**
+ * Write the merged trailers @p ct, then the seek table of the frames in @p fl
+ */
+static bool write_seek_table(concat_trailers_t *ct, ZSTD_frameLog *fl,
+    zseek_write_file_t output, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t nb_frames = framelog_entries(fl);
+    size_t nb_ends = zseek_buffer_size(ct->sub_ends) / sizeof(uint32_t);
+    size_t size = 0;
+    if (ct->frame_size)
+        size += trailer_size(8);
+    if (ct->dict)
+        size += trailer_size(ct->dict_size);
+    if (ct->sub_size)
+        size += trailer_size(trailer_sub_blocks_payload_size(nb_frames,
+            nb_ends));
+
+    uint8_t *buf = malloc(size > SEEK_TABLE_BUF_SIZE ? size :
+        SEEK_TABLE_BUF_SIZE);
+    if (!buf) {
+        set_error_with_errno(errbuf, "allocate seek table buffer", errno);
+        return false;
+    }
+
+    size_t off = 0;
+    if (ct->frame_size)
+        off += trailer_encode_frame_size(buf + off, ct->frame_size);
+    if (ct->dict)
+        off += trailer_encode(buf + off, TRAILER_DICTIONARY, ct->dict,
+            ct->dict_size);
+    if (ct->sub_size)
+        off += trailer_encode_sub_blocks(buf + off, ct->sub_size,
+            zseek_buffer_data(ct->sub_first), nb_frames,
+            zseek_buffer_data(ct->sub_ends), nb_ends);
+    if (off > 0 && !output.write(buf, off, output.user_data, call_data)) {
+        // TODO OPT: Use errno if user_file.write sets it
+        set_error(errbuf, "write to file failed");
+        goto fail_w_buf;
+    }
+
+    size_t rem = 0;
+    do {
+        ZSTD_outBuffer buffout = {buf, SEEK_TABLE_BUF_SIZE, 0};
+        rem = ZSTD_seekable_writeSeekTable(fl, &buffout);
+        if (ZSTD_isError(rem)) {
+            set_error(errbuf, "%s: %s", "write seek table",
+                ZSTD_getErrorName(rem));
+            goto fail_w_buf;
+        }
+        if (!output.write(buffout.dst, buffout.pos, output.user_data,
+            call_data)) {
+            // TODO OPT: Use errno if user_file.write sets it
+            set_error(errbuf, "write to file failed");
+            goto fail_w_buf;
+        }
+    } while (rem > 0);
+
+    free(buf);
+
+    return true;
+
+fail_w_buf:
+    free(buf);
+    return false;
+}
+
+static bool concat(const zseek_read_file_t *inputs, size_t n,
+    zseek_write_file_t output, concat_copy_t copy, void *copy_arg,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (n > 0 && !inputs) {
+        set_error(errbuf, "invalid inputs");
+        goto fail;
+    }
+
+    concat_input_t *cis = calloc(n > 0 ? n : 1, sizeof(cis[0]));
+    if (!cis) {
+        set_error_with_errno(errbuf, "allocate inputs", errno);
+        goto fail;
+    }
+    concat_trailers_t ct = {0};
+    ZSTD_frameLog *fl = ZSTD_seekable_createFrameLog(0);
+    if (!fl) {
+        set_error(errbuf, "framelog creation failed");
+        goto fail_w_inputs;
+    }
+
+    // Check all inputs before writing anything
+    for (size_t i = 0; i < n; i++) {
+        if (!input_open(&inputs[i], &cis[i], call_data, errbuf))
+            goto fail_w_fl;
+    }
+    if (!trailers_merge(cis, n, &ct, errbuf))
+        goto fail_w_fl;
+    size_t total_frames = 0;
+    bool extended = false;
+    for (size_t i = 0; i < n; i++) {
+        total_frames += cis[i].nb_frames;
+        extended = extended || seek_table_extended(cis[i].st);
+    }
+    if (extended || total_frames > SEEK_TABLE_MAX_FRAMES)
+        framelog_set_extended(fl);
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t f = 0; f < cis[i].nb_frames; f++) {
+            size_t r = ZSTD_seekable_logFrame(fl, frame_size_c(cis[i].st, f),
+                frame_size_d(cis[i].st, f), 0);
+            if (ZSTD_isError(r)) {
+                set_error(errbuf, "%s: %s", "log frame", ZSTD_getErrorName(r));
+                goto fail_w_fl;
+            }
+        }
+        // NOTE: Frames are contiguous from the start of the file, up to the
+        // trailers and seek table
+        if (cis[i].end_c > 0 &&
+            !copy(i, 0, cis[i].end_c, copy_arg, errbuf))
+            goto fail_w_fl;
+    }
+
+    if (!write_seek_table(&ct, fl, output, call_data, errbuf))
+        goto fail_w_fl;
+
+    trailers_free(&ct);
+    ZSTD_seekable_freeFrameLog(fl);
+    for (size_t i = 0; i < n; i++)
+        seek_table_free(cis[i].st);
+    free(cis);
+
+    return true;
+
+fail_w_fl:
+    trailers_free(&ct);
+    ZSTD_seekable_freeFrameLog(fl);
+fail_w_inputs:
+    for (size_t i = 0; i < n; i++)
+        seek_table_free(cis[i].st);
+    free(cis);
+fail:
+    return false;
+}
+
+bool zseek_concat_full(const zseek_read_file_t *inputs, size_t n,
+    zseek_write_file_t output, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    concat_state_t cs = {inputs, output, call_data, NULL};
+    cs.buf = malloc(COPY_BUF_SIZE);
+    if (!cs.buf) {
+        set_error_with_errno(errbuf, "allocate copy buffer", errno);
+        return false;
+    }
+
+    bool ok = concat(inputs, n, output, copy_through_buffer, &cs, call_data,
+        errbuf);
+    free(cs.buf);
+
+    return ok;
+}
+
+/**
+ * State of a zseek_concat() call
+ */
+typedef struct {
+    concat_state_t cs;
+    FILE *const *inputs;
+    FILE *output;
+    bool direct;    // Copy between the files in the kernel
+} concat_files_t;
+
+static bool write_file(const void *data, size_t size, void *user_data,
+    void *call_data)
+{
+    (void)call_data;
+
+    FILE *fout = user_data;
+    if (fwrite(data, 1, size, fout) != size) {
+        // perror("write to file");
+        return false;
+    }
+    return true;
+}
+
+static bool copy_files(size_t i, size_t offset, size_t len, void *arg,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    concat_files_t *cf = arg;
+
+    if (cf->direct) {
+        int fd_in = fileno(cf->inputs[i]);
+        int fd_out = fileno(cf->output);
+        if (fflush(cf->output) != 0) {
+            set_error_with_errno(errbuf, "flush output", errno);
+            return false;
+        }
+        // NOTE: Writes at the file offset of fd_out
+        off_t off_in = offset;
+        while (len > 0) {
+            ssize_t r = copy_file_range(fd_in, &off_in, fd_out, NULL, len, 0);
+            if (r == -1 && errno == EINTR)
+                continue;
+            if (r <= 0) {
+                if (r == 0 || (errno != EXDEV && errno != EINVAL &&
+                    errno != ENOSYS && errno != EOPNOTSUPP &&
+                    errno != EBADF)) {
+                    set_error_with_errno(errbuf, "copy file range",
+                        r == 0 ? EIO : errno);
+                    return false;
+                }
+                // Not supported between these files, copy through userspace
+                cf->direct = false;
+                break;
+            }
+            len -= r;
+        }
+        offset = off_in;
+        // Sync the position of the stream with that of its descriptor
+        off_t pos = lseek(fd_out, 0, SEEK_CUR);
+        if (pos == -1 || fseeko(cf->output, pos, SEEK_SET) == -1) {
+            set_error_with_errno(errbuf, "seek output", errno);
+            return false;
+        }
+        if (len == 0)
+            return true;
+    }
+
+    return copy_through_buffer(i, offset, len, &cf->cs, errbuf);
+}
+
+bool zseek_concat(FILE *const *inputs, size_t n, FILE *output,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (n > 0 && !inputs) {
+        set_error(errbuf, "invalid inputs");
+        return false;
+    }
+
+    zseek_read_file_t *files = malloc((n > 0 ? n : 1) * sizeof(files[0]));
+    if (!files) {
+        set_error_with_errno(errbuf, "allocate inputs", errno);
+        return false;
+    }
+    for (size_t i = 0; i < n; i++)
+        files[i] = (zseek_read_file_t){inputs[i], file_pread, file_fsize,
+            NULL, NULL};
+    zseek_write_file_t out = {output, write_file, NULL};
+
+    concat_files_t cf = {{files, out, call_data, NULL}, inputs, output, true};
+    cf.cs.buf = malloc(COPY_BUF_SIZE);
+    if (!cf.cs.buf) {
+        set_error_with_errno(errbuf, "allocate copy buffer", errno);
+        free(files);
+        return false;
+    }
+
+    bool ok = concat(files, n, out, copy_files, &cf, call_data, errbuf);
+    free(cf.cs.buf);
+    free(files);
+
+    return ok;
+}
@@ -5,10 +5,12 @@
 #include <stdlib.h>     // malloc, free
 #include <errno.h>      // errno
 #include <string.h>     // memset
-#include <pthread.h>    // pthread_mutex*
+#include <stdatomic.h>  // atomic_*
+#include <pthread.h>    // pthread_*
 #include <assert.h>     // assert
 
-#include <sys/stat.h>   // fstat
+#include <unistd.h>     // sysconf
+#include <sys/mman.h>   // mmap, madvise
 #include <endian.h>     // le32toh
 #include <zstd.h>
 #include <lz4frame.h>
@@ -18,171 +20,673 @@
 #include "common.h"
 #include "cache.h"
 #include "buffer.h"
+#include "frame_pool.h"
+#include "thread_pool.h"
+#include "uring.h"
 
 #define ZSTD_MAGIC 0xFD2FB528
 #define LZ4_MAGIC 0x184D2204
 
+// Maximum number of decompression contexts per reader (created on demand)
+#define DCTX_POOL_MAX 16
+// Upper bounds on a run of consecutive frames fetched with a single read
+#define COALESCE_MAX_FRAMES 256
+#define COALESCE_MAX_SIZE (1 << 24)     // 16 MiB (compressed)
+// Initial readahead window, in frames
+#define READAHEAD_START 4
+// Decompressed frame buffers kept for reuse per reader, at most
+#define FRAME_POOL_MAX_FREE 16
+// Frames decompressed ahead of delivery to a sink, per thread
+#define SINK_WINDOW_PER_JOB 2
+
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
-struct zseek_reader {
-    zseek_read_file_t user_file;
-    zseek_compression_type_t type;
+/**
+ * Decompression state for a single operation. Readers keep a pool of these, so
+ * that concurrent misses don't contend for one context.
+ */
+typedef struct zseek_dctx {
+    struct zseek_dctx *next;        // Next free context in the pool
+    struct zseek_dctx *all_next;    // Next context in the pool
+
     union {
-        // TODO: If there's contention, use one dctx per read()
         struct {
             ZSTD_DCtx *dctx_zstd;
             ZSTD_DStream *dstream_zstd;
+            const ZSTD_DDict *ddict;    // Shared, NULL without a dictionary
         };
         LZ4F_dctx *dctx_lz4;
     };
-    pthread_rwlock_t lock;
+    zseek_buffer_t *cbuf;
+    zseek_buffer_t *dbuf;   // discard buffer
+
+    size_t memory;  // Last known memory usage, updated on release
+} zseek_dctx_t;
+
+/**
+ * Sequential progress of the reads of a reader or cursor, and its prefetching,
+ * see readahead_note(). Under its lock, except last, which also serves as an
+ * unlocked hint.
+ */
+typedef struct {
+    struct zseek_reader *reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    // Signaled as prefetching completes
+    atomic_size_t last;     // Frame of the last read
+    size_t window;  // Current window in frames, 0 if not sequential
+    size_t until;   // Frames before this are prefetched (or queued)
+    bool pending;   // task is queued or running
+    size_t first;   // Frames [first, end) to prefetch
+    size_t end;
+    zseek_task_t task;
+} zseek_ra_stream_t;
+
+/**
+ * A cursor over a reader, see zseek_cursor_open()
+ */
+struct zseek_cursor {
+    zseek_reader_t *reader;
+    zseek_dctx_t *ctx;  // Own context, not in the pool of the reader
+    size_t pos;
+    zseek_ra_stream_t ra;
+};
+
+/**
+ * A file mapped by zseek_reader_open_mmap()
+ */
+typedef struct {
+    void *addr;
+    size_t size;
+} zseek_mmap_t;
+
+/**
+ * A frame being fetched by some thread, for other threads missing on the same
+ * frame to wait on.
+ */
+typedef struct zseek_inflight {
+    struct zseek_inflight *next;
+    size_t frame_idx;
+} zseek_inflight_t;
+
+/**
+ * Metrics of a reader, see zseek_reader_stats_ext_t
+ */
+typedef struct {
+    atomic_uint_least64_t hits;
+    atomic_uint_least64_t misses;
+    atomic_uint_least64_t evictions;
+    atomic_uint_least64_t bytes_read;
+    atomic_uint_least64_t bytes_decompressed;
+    atomic_uint_least64_t preads;
+    atomic_uint_least64_t lock_waits;
+    atomic_uint_least64_t compressed_hits;
+    atomic_uint_least64_t compressed_misses;
+    atomic_uint_least64_t compressed_evictions;
+    histogram_t fetch_ns;
+    histogram_t decompress_ns;
+    histogram_t lock_wait_ns;
+} zseek_reader_metrics_t;
+
+/**
+ * A wait for a lock (or condition), timed if contended
+ */
+typedef struct {
+    bool waited;
+    uint64_t start;
+} zseek_wait_t;
+
+struct zseek_reader {
+    zseek_read_file_t user_file;
+    zseek_compression_type_t type;
+
+    // Metrics and events (optional), see note_event()
+    bool metrics;
+    bool timed;     // Events are timed
+    bool closing;   // Frames released by the cache are not evicted
+    zseek_reader_event_handler_t event_handler;
+    void *event_data;
+    zseek_reader_metrics_t m;
+
+    // Pool of decompression contexts
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_cond;
+    zseek_dctx_t *pool_free;
+    zseek_dctx_t *pool_all;
+    size_t pool_size;
+
+    // Frames currently being fetched on a cache miss
+    pthread_mutex_t miss_lock;
+    pthread_cond_t miss_cond;
+    zseek_inflight_t *inflight;
+
+    // Workers for batched reads and readahead (optional)
+    zseek_thread_pool_t *workers;
+
+    // Readahead state, see readahead_note(). Reads through cursors track
+    // their own progress, others share ra.
+    size_t readahead_max;   // 0 if disabled
+    zseek_ra_stream_t ra;
 
     ZSTD_seekTable *st;
+    // Dictionary of the file (zstd only, optional), shared by all contexts
+    ZSTD_DDict *ddict;
+    // Decompressed frame buffers, recycled through evictions
+    zseek_frame_pool_t *frames;
     zseek_cache_t *cache;
-    size_t pos;
-    zseek_buffer_t *cbuf;
-    zseek_buffer_t *dbuf;   // discard buffer
+    // Compressed frames (optional), see fetch_frames()
+    zseek_cache_t *ccache;
+    atomic_size_t pos;          // See zseek_read()
+    atomic_size_t nb_cursors;   // Open cursors, see zseek_cursor_open()
+
+    // Owned mapping, if opened with zseek_reader_open_mmap()
+    zseek_mmap_t *map;
+    // Owned io_uring file, if opened with zseek_reader_open_uring()
+    zseek_uring_t *uring;
 };
 
-static ssize_t default_pread(void *data, size_t size, size_t offset,
+static ssize_t mmap_pread(void *data, size_t size, size_t offset,
     void *user_data, void *call_data)
 {
     (void)call_data;
 
-    FILE *fin = user_data;
+    zseek_mmap_t *map = user_data;
+    if (offset >= map->size)
+        return 0;
+    size = MIN(size, map->size - offset);
+    memcpy(data, (const uint8_t *)map->addr + offset, size);
 
-    // Save current file position
-    long prev_pos = ftell(fin);
-    if (prev_pos == -1) {
-        // perror("get file position");
-        return -1;
-    }
+    return size;
+}
 
-    if (fseek(fin, offset, SEEK_SET) == -1) {
-        // perror("set file position");
-        return -1;
+static ssize_t mmap_fsize(void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    zseek_mmap_t *map = user_data;
+    return map->size;
+}
+
+static const void *mmap_range(size_t size, size_t offset, void *user_data,
+    void *call_data)
+{
+    (void)call_data;
+
+    zseek_mmap_t *map = user_data;
+    if (offset > map->size || size > map->size - offset)
+        return NULL;
+
+    return (const uint8_t *)map->addr + offset;
+}
+
+/**
+ * Advise the kernel on the compressed frames [@p first, @p end) of a mapped
+ * file
+ */
+static void mmap_advise(zseek_reader_t *reader, size_t first, size_t end,
+    int advice)
+{
+    if (!reader->map || first >= end)
+        return;
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t start = frame_offset_c(reader->st, first);
+    size_t stop = frame_offset_c(reader->st, end - 1) +
+        frame_size_c(reader->st, end - 1);
+    start -= start % page_size;
+    // NOTE: Advisory only, so errors are ignored
+    madvise((uint8_t *)reader->map->addr + start, stop - start, advice);
+}
+
+/**
+ * Return the start time of an event of @p reader, or 0 if events are not timed
+ */
+static uint64_t event_start(const zseek_reader_t *reader)
+{
+    return reader->timed ? monotonic_ns() : 0;
+}
+
+/**
+ * Account for an event of @p type of @p reader, started at @p start (see
+ * event_start()) and ending now, and pass it to the event handler.
+ */
+static void note_event(zseek_reader_t *reader, zseek_reader_event_type_t type,
+    size_t frame_idx, size_t size, uint64_t start)
+{
+    if (!reader->metrics && !reader->event_handler)
+        return;
+
+    uint64_t ns = start ? monotonic_ns() - start : 0;
+    if (reader->metrics) {
+        zseek_reader_metrics_t *m = &reader->m;
+        switch (type) {
+        case ZSEEK_EVENT_CACHE_HIT:
+            atomic_fetch_add_explicit(&m->hits, 1, memory_order_relaxed);
+            break;
+        case ZSEEK_EVENT_CACHE_MISS:
+            atomic_fetch_add_explicit(&m->misses, 1, memory_order_relaxed);
+            break;
+        case ZSEEK_EVENT_CACHE_EVICT:
+            atomic_fetch_add_explicit(&m->evictions, 1, memory_order_relaxed);
+            break;
+        case ZSEEK_EVENT_FETCH:
+            atomic_fetch_add_explicit(&m->bytes_read, size,
+                memory_order_relaxed);
+            histogram_add(&m->fetch_ns, ns);
+            break;
+        case ZSEEK_EVENT_DECOMPRESS:
+            atomic_fetch_add_explicit(&m->bytes_decompressed, size,
+                memory_order_relaxed);
+            histogram_add(&m->decompress_ns, ns);
+            break;
+        case ZSEEK_EVENT_LOCK_WAIT:
+            atomic_fetch_add_explicit(&m->lock_waits, 1, memory_order_relaxed);
+            histogram_add(&m->lock_wait_ns, ns);
+            break;
+        case ZSEEK_EVENT_COMPRESSED_HIT:
+            atomic_fetch_add_explicit(&m->compressed_hits, 1,
+                memory_order_relaxed);
+            break;
+        case ZSEEK_EVENT_COMPRESSED_MISS:
+            atomic_fetch_add_explicit(&m->compressed_misses, 1,
+                memory_order_relaxed);
+            break;
+        case ZSEEK_EVENT_COMPRESSED_EVICT:
+            atomic_fetch_add_explicit(&m->compressed_evictions, 1,
+                memory_order_relaxed);
+            break;
+        }
     }
-    size_t _read = fread(data, 1, size, fin);
-    if (_read != size && ferror(fin)) {
-        // perror("read from file");
-        return -1;
+
+    if (reader->event_handler) {
+        zseek_reader_event_t event = {type, frame_idx, size, ns};
+        reader->event_handler(&event, reader->event_data);
     }
+}
 
-    // Restore previous file position
-    if (fseek(fin, prev_pos, SEEK_SET) == -1) {
-        // perror("restore file position");
-        return -1;
+/**
+ * Count @p n read calls to the file of @p reader
+ */
+static void note_preads(zseek_reader_t *reader, size_t n)
+{
+    if (reader->metrics)
+        atomic_fetch_add_explicit(&reader->m.preads, n, memory_order_relaxed);
+}
+
+/**
+ * Mark @p w as waiting, if not already
+ */
+static void wait_begin(const zseek_reader_t *reader, zseek_wait_t *w)
+{
+    if (!w->waited) {
+        w->waited = true;
+        w->start = event_start(reader);
     }
+}
 
-    return _read;
+/**
+ * Account for @p w, if it waited at all (on behalf of the frame at index
+ * @p frame_idx, or SIZE_MAX)
+ */
+static void wait_end(zseek_reader_t *reader, zseek_wait_t *w,
+    size_t frame_idx)
+{
+    if (w->waited)
+        note_event(reader, ZSEEK_EVENT_LOCK_WAIT, frame_idx, 0, w->start);
 }
 
-static ssize_t default_fsize(void *user_data, void *call_data)
+/**
+ * Lock @p lock of @p reader, marking @p w as waiting if contended. Returns
+ * like pthread_mutex_lock (3).
+ */
+static int lock_wait(const zseek_reader_t *reader, pthread_mutex_t *lock,
+    zseek_wait_t *w)
 {
-    (void)call_data;
+    // NOTE: Only contended locks are timed, to keep the common case cheap
+    int pr = pthread_mutex_trylock(lock);
+    if (pr != EBUSY)
+        return pr;
+    wait_begin(reader, w);
+    return pthread_mutex_lock(lock);
+}
 
-    FILE *f = user_data;
-    int fd = fileno(f);
-    if (fd == -1) {
-        // perror("get file descriptor");
-        return -1;
+static bool dctx_free(zseek_compression_type_t type, zseek_dctx_t *ctx,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!ctx)
+        return true;
+
+    bool is_error = false;
+
+    switch (type) {
+    case ZSEEK_ZSTD: {
+        size_t r = ZSTD_freeDStream(ctx->dstream_zstd);
+        if (ZSTD_isError(r) && !is_error) {
+            set_error(errbuf, "%s: %s", "free dstream", ZSTD_getErrorName(r));
+            is_error = true;
+        }
+
+        r = ZSTD_freeDCtx(ctx->dctx_zstd);
+        if (ZSTD_isError(r) && !is_error) {
+            set_error(errbuf, "%s: %s", "free context", ZSTD_getErrorName(r));
+            is_error = true;
+        }
+        break;
+    }
+    case ZSEEK_LZ4: {
+        LZ4F_errorCode_t r = LZ4F_freeDecompressionContext(ctx->dctx_lz4);
+        if (LZ4F_isError(r) && !is_error) {
+            set_error(errbuf, "%s: %s", "free context", LZ4F_getErrorName(r));
+            is_error = true;
+        }
+        break;
+    }
+    default:
+        // BUG
+        assert(false);
     }
 
-    struct stat st;
-    if (fstat(fd, &st) == -1) {
-        // perror("get file size");
-        return -1;
+    zseek_buffer_free(ctx->dbuf);
+    zseek_buffer_free(ctx->cbuf);
+    free(ctx);
+
+    return !is_error;
+}
+
+static size_t dctx_memory_usage(zseek_compression_type_t type,
+    zseek_dctx_t *ctx)
+{
+    // NOTE: This is an _estimate_ because the underlying compression lib may
+    // buffer too in its context object.
+    size_t memory = zseek_buffer_capacity(ctx->cbuf);
+    memory += zseek_buffer_capacity(ctx->dbuf);
+    if (type == ZSEEK_ZSTD) {
+        memory += ZSTD_sizeof_DCtx(ctx->dctx_zstd);
+        memory += ZSTD_sizeof_DStream(ctx->dstream_zstd);
     }
 
-    return st.st_size;
+    return memory;
 }
 
-static zseek_reader_t *zseek_reader_open_full_zstd(zseek_read_file_t user_file,
-    size_t cache_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+static zseek_dctx_t *dctx_new(zseek_compression_type_t type,
+    const ZSTD_DDict *ddict, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    zseek_reader_t *reader = malloc(sizeof(*reader));
-    if (!reader) {
-        set_error_with_errno(errbuf, "allocate reader", errno);
+    zseek_dctx_t *ctx = malloc(sizeof(*ctx));
+    if (!ctx) {
+        set_error_with_errno(errbuf, "allocate context", errno);
         goto fail;
     }
-    memset(reader, 0, sizeof(*reader));
-    reader->type = ZSEEK_ZSTD;
+    memset(ctx, 0, sizeof(*ctx));
+
+    switch (type) {
+    case ZSEEK_ZSTD: {
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        if (!dctx) {
+            set_error(errbuf, "context creation failed");
+            goto fail_w_ctx;
+        }
+        ctx->dctx_zstd = dctx;
 
-    ZSTD_DCtx *dctx = ZSTD_createDCtx();
-    if (!dctx) {
-        set_error(errbuf, "context creation failed");
-        goto fail_w_reader;
+        ZSTD_DStream *dstream = ZSTD_createDStream();
+        if (!dstream) {
+            set_error(errbuf, "dstream creation failed");
+            ZSTD_freeDCtx(dctx);
+            goto fail_w_ctx;
+        }
+        ctx->dstream_zstd = dstream;
+
+        if (ddict) {
+            size_t r = ZSTD_DCtx_refDDict(dstream, ddict);
+            if (ZSTD_isError(r)) {
+                set_error(errbuf, "%s: %s", "reference dictionary",
+                    ZSTD_getErrorName(r));
+                ZSTD_freeDStream(dstream);
+                ZSTD_freeDCtx(dctx);
+                goto fail_w_ctx;
+            }
+        }
+        ctx->ddict = ddict;
+        break;
+    }
+    case ZSEEK_LZ4: {
+        LZ4F_dctx *dctx;
+        LZ4F_errorCode_t r = LZ4F_createDecompressionContext(&dctx,
+            LZ4F_VERSION);
+        if (LZ4F_isError(r)) {
+            set_error(errbuf, "%s: %s", "context creation failed",
+                LZ4F_getErrorName(r));
+            goto fail_w_ctx;
+        }
+        ctx->dctx_lz4 = dctx;
+        break;
+    }
+    default:
+        // BUG
+        assert(false);
+        goto fail_w_ctx;
     }
-    reader->dctx_zstd = dctx;
 
-    ZSTD_DStream *dstream = ZSTD_createDStream();
-    if (!dstream) {
-        set_error(errbuf, "dstream creation failed");
+    ctx->cbuf = zseek_buffer_new(0);
+    if (!ctx->cbuf) {
+        set_error(errbuf, "buffer creation failed");
         goto fail_w_dctx;
     }
-    reader->dstream_zstd = dstream;
 
-    int pr = pthread_rwlock_init(&reader->lock, NULL);
-    if (pr) {
-        set_error_with_errno(errbuf, "initialize lock", pr);
-        goto fail_w_dstream;
+    ctx->dbuf = zseek_buffer_new(0);
+    if (!ctx->dbuf) {
+        set_error(errbuf, "discard buffer creation failed");
+        goto fail_w_dctx;
     }
 
-    reader->user_file = user_file;
+    ctx->memory = dctx_memory_usage(type, ctx);
 
-    ZSTD_seekTable *st = read_seek_table(user_file, call_data);
-    if (!st) {
-        set_error(errbuf, "read_seek_table failed");
-        goto fail_w_lock;
+    return ctx;
+
+fail_w_dctx:
+    dctx_free(type, ctx, NULL);
+    return NULL;
+fail_w_ctx:
+    free(ctx);
+fail:
+    return NULL;
+}
+
+/**
+ * Take a decompression context from the pool of @p reader, creating one if none
+ * is free. Blocks if the pool is exhausted.
+ */
+static zseek_dctx_t *pool_acquire(zseek_reader_t *reader,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_wait_t w = {0};
+    int pr = lock_wait(reader, &reader->pool_lock, &w);
+    if (pr) {
+        set_error_with_errno(errbuf, "lock pool", pr);
+        return NULL;
     }
-    reader->st = st;
 
-    zseek_cache_t *cache = NULL;
-    if (cache_size > 0) {
-        cache = zseek_cache_new(cache_size);
-        if (!cache) {
-            set_error(errbuf, "cache creation failed");
-            goto fail_w_st;
-        }
+    while (!reader->pool_free && reader->pool_size == DCTX_POOL_MAX) {
+        wait_begin(reader, &w);
+        pthread_cond_wait(&reader->pool_cond, &reader->pool_lock);
     }
-    reader->cache = cache;
 
-    zseek_buffer_t *cbuf = zseek_buffer_new(0);
-    if (!cbuf) {
-        set_error(errbuf, "buffer creation failed");
-        goto fail_w_cache;
+    zseek_dctx_t *ctx = reader->pool_free;
+    if (ctx) {
+        reader->pool_free = ctx->next;
+        pthread_mutex_unlock(&reader->pool_lock);
+        wait_end(reader, &w, SIZE_MAX);
+        return ctx;
     }
-    reader->cbuf = cbuf;
 
-    zseek_buffer_t *dbuf = zseek_buffer_new(0);
-    if (!dbuf) {
-        set_error(errbuf, "discard buffer creation failed");
-        goto fail_w_cbuf;
+    // Create a new one, outside the lock
+    reader->pool_size++;
+    pthread_mutex_unlock(&reader->pool_lock);
+    wait_end(reader, &w, SIZE_MAX);
+
+    ctx = dctx_new(reader->type, reader->ddict, errbuf);
+
+    pthread_mutex_lock(&reader->pool_lock);
+    if (ctx) {
+        ctx->all_next = reader->pool_all;
+        reader->pool_all = ctx;
+    } else {
+        reader->pool_size--;
+        pthread_cond_signal(&reader->pool_cond);
     }
-    reader->dbuf = dbuf;
+    pthread_mutex_unlock(&reader->pool_lock);
 
-    return reader;
+    return ctx;
+}
 
-fail_w_cbuf:
-    zseek_buffer_free(cbuf);
-fail_w_cache:
-    zseek_cache_free(cache);
-fail_w_st:
-    seek_table_free(st);
-fail_w_lock:
-    pthread_rwlock_destroy(&reader->lock);
-fail_w_dstream:
-    ZSTD_freeDStream(dstream);
-fail_w_dctx:
-    ZSTD_freeDCtx(dctx);
-fail_w_reader:
+/**
+ * Return @p ctx to the pool of @p reader.
+ */
+static void pool_release(zseek_reader_t *reader, zseek_dctx_t *ctx)
+{
+    size_t memory = dctx_memory_usage(reader->type, ctx);
+
+    zseek_wait_t w = {0};
+    lock_wait(reader, &reader->pool_lock, &w);
+    ctx->memory = memory;
+    ctx->next = reader->pool_free;
+    reader->pool_free = ctx;
+    pthread_cond_signal(&reader->pool_cond);
+    pthread_mutex_unlock(&reader->pool_lock);
+    wait_end(reader, &w, SIZE_MAX);
+}
+
+/**
+ * Take the context @p own (of a cursor) if not @a NULL, or one from the pool of
+ * @p reader.
+ */
+static zseek_dctx_t *ctx_acquire(zseek_reader_t *reader, zseek_dctx_t *own,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    return own ? own : pool_acquire(reader, errbuf);
+}
+
+/**
+ * Release @p ctx, taken with ctx_acquire().
+ */
+static void ctx_release(zseek_reader_t *reader, zseek_dctx_t *own,
+    zseek_dctx_t *ctx)
+{
+    if (ctx != own)
+        pool_release(reader, ctx);
+}
+
+/**
+ * Release handler for frames evicted from the cache of @p arg (the reader),
+ * recycling their buffers through its frame pool
+ */
+static void cache_release(zseek_frame_t frame, void *arg)
+{
+    zseek_reader_t *reader = arg;
+    if (!reader->closing)
+        note_event(reader, ZSEEK_EVENT_CACHE_EVICT, frame.idx, frame.len, 0);
+    zseek_frame_pool_put(reader->frames, frame.data, frame.len);
+}
+
+/**
+ * Release handler for frames evicted from the compressed cache of @p arg (the
+ * reader)
+ */
+static void ccache_release(zseek_frame_t frame, void *arg)
+{
+    zseek_reader_t *reader = arg;
+    if (!reader->closing)
+        note_event(reader, ZSEEK_EVENT_COMPRESSED_EVICT, frame.idx, frame.len,
+            0);
+    free(frame.data);
+}
+
+/**
+ * Initialize readahead stream @p ra for reads of @p reader
+ */
+static bool ra_stream_init(zseek_ra_stream_t *ra, zseek_reader_t *reader,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    memset(ra, 0, sizeof(*ra));
+    ra->reader = reader;
+    // Nothing sequential about the first read
+    atomic_init(&ra->last, SIZE_MAX - 1);
+
+    int pr = pthread_mutex_init(&ra->lock, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize readahead lock", pr);
+        return false;
+    }
+    pr = pthread_cond_init(&ra->cond, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize readahead condition", pr);
+        pthread_mutex_destroy(&ra->lock);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Wait for any prefetching of readahead stream @p ra, which refers to it, and
+ * destroy it
+ */
+static void ra_stream_destroy(zseek_ra_stream_t *ra)
+{
+    pthread_mutex_lock(&ra->lock);
+    while (ra->pending)
+        pthread_cond_wait(&ra->cond, &ra->lock);
+    pthread_mutex_unlock(&ra->lock);
+
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->lock);
+}
+
+static bool reader_free(zseek_reader_t *reader, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    bool is_error = false;
+
+    // BUG if any, since they use the reader
+    assert(atomic_load(&reader->nb_cursors) == 0);
+
+    // Also waits for any readahead
+    zseek_thread_pool_free(reader->workers);
+
+    ra_stream_destroy(&reader->ra);
+    pthread_cond_destroy(&reader->miss_cond);
+    pthread_mutex_destroy(&reader->miss_lock);
+    pthread_cond_destroy(&reader->pool_cond);
+    pthread_mutex_destroy(&reader->pool_lock);
+
+    zseek_dctx_t *ctx = reader->pool_all;
+    while (ctx) {
+        zseek_dctx_t *next = ctx->all_next;
+        if (!dctx_free(reader->type, ctx, is_error ? NULL : errbuf))
+            is_error = true;
+        ctx = next;
+    }
+    ZSTD_freeDDict(reader->ddict);
+
+    reader->closing = true;
+    zseek_cache_free(reader->cache);
+    zseek_cache_free(reader->ccache);
+    zseek_frame_pool_free(reader->frames);
+    seek_table_free(reader->st);
+    if (reader->map) {
+        if (munmap(reader->map->addr, reader->map->size) == -1 &&
+            !is_error) {
+            set_error_with_errno(errbuf, "unmap file", errno);
+            is_error = true;
+        }
+        free(reader->map);
+    }
+    zseek_uring_free(reader->uring);
     free(reader);
-fail:
-    return NULL;
+
+    return !is_error;
 }
 
-static zseek_reader_t *zseek_reader_open_full_lz4(zseek_read_file_t user_file,
-    size_t cache_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+static zseek_reader_t *zseek_reader_open_type(zseek_read_file_t user_file,
+    zseek_compression_type_t type, const zseek_reader_param_t *param,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
     zseek_reader_t *reader = malloc(sizeof(*reader));
     if (!reader) {
@@ -190,77 +694,158 @@ static zseek_reader_t *zseek_reader_open_full_lz4(zseek_read_file_t user_file,
         goto fail;
     }
     memset(reader, 0, sizeof(*reader));
-    reader->type = ZSEEK_LZ4;
+    reader->type = type;
+    reader->metrics = param->metrics;
+    reader->event_handler = param->event_handler;
+    reader->event_data = param->event_data;
+    reader->timed = param->metrics || param->event_handler;
 
-    LZ4F_dctx *dctx;
-    LZ4F_errorCode_t r = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
-    if (LZ4F_isError(r)) {
-        set_error(errbuf, "%s: %s", "context creation failed",
-            LZ4F_getErrorName(r));
+    int pr = pthread_mutex_init(&reader->pool_lock, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize pool lock", pr);
         goto fail_w_reader;
     }
-    reader->dctx_lz4 = dctx;
-
-    int pr = pthread_rwlock_init(&reader->lock, NULL);
+    pr = pthread_cond_init(&reader->pool_cond, NULL);
     if (pr) {
-        set_error_with_errno(errbuf, "initialize lock", pr);
-        goto fail_w_dctx;
+        set_error_with_errno(errbuf, "initialize pool condition", pr);
+        goto fail_w_pool_lock;
+    }
+    pr = pthread_mutex_init(&reader->miss_lock, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize miss lock", pr);
+        goto fail_w_pool_cond;
+    }
+    pr = pthread_cond_init(&reader->miss_cond, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize miss condition", pr);
+        goto fail_w_miss_lock;
     }
+    if (!ra_stream_init(&reader->ra, reader, errbuf))
+        goto fail_w_miss_cond;
 
     reader->user_file = user_file;
 
-    ZSTD_seekTable *st = read_seek_table(user_file, call_data);
+    ZSTD_seekTable *st = read_seek_table(user_file, param->lazy_seek_table,
+        call_data);
     if (!st) {
         set_error(errbuf, "read_seek_table failed");
-        goto fail_w_lock;
+        goto fail_w_reader_free;
     }
     reader->st = st;
 
-    zseek_cache_t *cache = NULL;
-    if (cache_size > 0) {
-        cache = zseek_cache_new(cache_size);
+    size_t dict_size;
+    void *dict = seek_table_take_dict(st, &dict_size);
+    if (dict) {
+        if (type != ZSEEK_ZSTD) {
+            free(dict);
+            set_error(errbuf, "dictionary in a non-zstd file");
+            goto fail_w_reader_free;
+        }
+        // NOTE: Digested once, for all contexts and frames
+        reader->ddict = ZSTD_createDDict(dict, dict_size);
+        free(dict);
+        if (!reader->ddict) {
+            set_error(errbuf, "dictionary creation failed");
+            goto fail_w_reader_free;
+        }
+    }
+
+    // Create one context up front, to catch errors early
+    zseek_dctx_t *ctx = dctx_new(type, reader->ddict, errbuf);
+    if (!ctx)
+        goto fail_w_reader_free;
+    reader->pool_free = ctx;
+    reader->pool_all = ctx;
+    reader->pool_size = 1;
+
+    if (!param->allocator.alloc != !param->allocator.free) {
+        set_error(errbuf, "allocator needs both alloc and free handlers");
+        goto fail_w_reader_free;
+    }
+    reader->frames = zseek_frame_pool_new(&param->allocator,
+        FRAME_POOL_MAX_FREE);
+    if (!reader->frames) {
+        set_error(errbuf, "frame pool creation failed");
+        goto fail_w_reader_free;
+    }
+
+    if (param->cache_policy != ZSEEK_CACHE_CLOCK &&
+        param->cache_policy != ZSEEK_CACHE_2Q &&
+        param->cache_policy != ZSEEK_CACHE_TINYLFU) {
+        set_error(errbuf, "invalid cache policy");
+        goto fail_w_reader_free;
+    }
+    if (param->cache_size > 0 || param->cache_bytes > 0) {
+        zseek_cache_t *cache = zseek_cache_new_full(param->cache_size,
+            param->cache_bytes, param->cache_policy, cache_release, reader);
         if (!cache) {
             set_error(errbuf, "cache creation failed");
-            goto fail_w_st;
+            goto fail_w_reader_free;
         }
+        reader->cache = cache;
     }
-    reader->cache = cache;
 
-    zseek_buffer_t *cbuf = zseek_buffer_new(0);
-    if (!cbuf) {
-        set_error(errbuf, "buffer creation failed");
-        goto fail_w_cache;
+    // NOTE: Ranges are zero-copy already
+    if (param->compressed_cache_bytes > 0 && !user_file.range) {
+        reader->ccache = zseek_cache_new_full(0,
+            param->compressed_cache_bytes, param->cache_policy, ccache_release,
+            reader);
+        if (!reader->ccache) {
+            set_error(errbuf, "compressed cache creation failed");
+            goto fail_w_reader_free;
+        }
     }
-    reader->cbuf = cbuf;
 
-    zseek_buffer_t *dbuf = zseek_buffer_new(0);
-    if (!dbuf) {
-        set_error(errbuf, "discard buffer creation failed");
-        goto fail_w_cbuf;
+    if (param->readahead_max > 0) {
+        if (!reader->cache) {
+            set_error(errbuf, "readahead requires a cache");
+            goto fail_w_reader_free;
+        }
+        reader->readahead_max = param->readahead_max;
+        if (param->cache_size > 0)
+            reader->readahead_max = MIN(reader->readahead_max,
+                param->cache_size);
+    }
+
+    // Readahead needs at least one worker
+    int nb_workers = param->nb_workers;
+    if (reader->readahead_max > 0 && nb_workers < 1)
+        nb_workers = 1;
+    if (nb_workers > 0) {
+        zseek_thread_pool_t *workers = zseek_thread_pool_new(nb_workers,
+            param->cpusetsize, param->cpuset, errbuf);
+        if (!workers)
+            goto fail_w_reader_free;
+        reader->workers = workers;
     }
-    reader->dbuf = dbuf;
 
     return reader;
 
-fail_w_cbuf:
-    zseek_buffer_free(cbuf);
-fail_w_cache:
-    zseek_cache_free(cache);
-fail_w_st:
-    seek_table_free(st);
-fail_w_lock:
-    pthread_rwlock_destroy(&reader->lock);
-fail_w_dctx:
-    LZ4F_freeDecompressionContext(dctx);
+fail_w_reader_free:
+    reader_free(reader, NULL);
+    return NULL;
+fail_w_miss_cond:
+    pthread_cond_destroy(&reader->miss_cond);
+fail_w_miss_lock:
+    pthread_mutex_destroy(&reader->miss_lock);
+fail_w_pool_cond:
+    pthread_cond_destroy(&reader->pool_cond);
+fail_w_pool_lock:
+    pthread_mutex_destroy(&reader->pool_lock);
 fail_w_reader:
     free(reader);
 fail:
     return NULL;
 }
 
-zseek_reader_t *zseek_reader_open_full(zseek_read_file_t user_file,
-    size_t cache_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+zseek_reader_t *zseek_reader_open_param(zseek_read_file_t user_file,
+    const zseek_reader_param_t *param, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
 {
+    zseek_reader_param_t default_param = {0};
+    if (!param)
+        param = &default_param;
+
     // Look for magic number in the file
     uint32_t magic_le;
     ssize_t _read = user_file.pread(&magic_le, sizeof(magic_le), 0,
@@ -276,562 +861,2088 @@ zseek_reader_t *zseek_reader_open_full(zseek_read_file_t user_file,
 
     switch (le32toh(magic_le)) {
     case ZSTD_MAGIC:
-        return zseek_reader_open_full_zstd(user_file, cache_size, call_data,
-            errbuf);
+        return zseek_reader_open_type(user_file, ZSEEK_ZSTD, param,
+            call_data, errbuf);
     case LZ4_MAGIC:
-        return zseek_reader_open_full_lz4(user_file, cache_size, call_data,
-            errbuf);
+        return zseek_reader_open_type(user_file, ZSEEK_LZ4, param,
+            call_data, errbuf);
     default:
         set_error(errbuf, "unrecognized file format");
         return NULL;
     }
 }
 
+zseek_reader_t *zseek_reader_open_full(zseek_read_file_t user_file,
+    size_t cache_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_reader_param_t param = {.cache_size = cache_size};
+    return zseek_reader_open_param(user_file, &param, call_data, errbuf);
+}
+
 zseek_reader_t *zseek_reader_open(FILE *cfile, size_t cache_size,
     void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    zseek_read_file_t user_file = {cfile, default_pread, default_fsize};
+    zseek_read_file_t user_file = {cfile, file_pread, file_fsize, NULL,
+        NULL};
     return zseek_reader_open_full(user_file, cache_size, call_data, errbuf);
 }
 
-static bool zseek_reader_close_zstd(zseek_reader_t *reader,
-    void *call_data __attribute__((unused)), char errbuf[ZSEEK_ERRBUF_SIZE])
+zseek_reader_t *zseek_reader_open_mmap(FILE *cfile,
+    const zseek_reader_param_t *param, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    (void)call_data;
-
-    bool is_error = false;
-
-    int pr = pthread_rwlock_destroy(&reader->lock);
-    if (pr && !is_error) {
-        set_error_with_errno(errbuf, "destroy lock", pr);
-        is_error = true;
+    ssize_t size = file_fsize(cfile, call_data);
+    if (size < 0) {
+        set_error_with_errno(errbuf, "get file size", errno);
+        goto fail;
     }
-
-    size_t r = ZSTD_freeDStream(reader->dstream_zstd);
-    if (ZSTD_isError(r) && !is_error) {
-        set_error(errbuf, "%s: %s", "free dstream", ZSTD_getErrorName(r));
-        is_error = true;
+    if (size == 0) {
+        set_error(errbuf, "unexpected EOF");
+        goto fail;
     }
 
-    r = ZSTD_freeDCtx(reader->dctx_zstd);
-    if (ZSTD_isError(r) && !is_error) {
-        set_error(errbuf, "%s: %s", "free context", ZSTD_getErrorName(r));
-        is_error = true;
+    zseek_mmap_t *map = malloc(sizeof(*map));
+    if (!map) {
+        set_error_with_errno(errbuf, "allocate mapping", errno);
+        goto fail;
     }
+    map->size = size;
+    void *addr = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fileno(cfile),
+        0);
+    if (addr == MAP_FAILED) {
+        set_error_with_errno(errbuf, "map file", errno);
+        goto fail_w_map;
+    }
+    map->addr = addr;
 
-    zseek_buffer_free(reader->dbuf);
-    zseek_buffer_free(reader->cbuf);
-    zseek_cache_free(reader->cache);
-    seek_table_free(reader->st);
-    free(reader);
+    // Readahead advises on the frames it prefetches, see readahead_note()
+    if (!param || param->readahead_max == 0)
+        madvise(addr, map->size, MADV_RANDOM);
 
-    return !is_error;
+    zseek_read_file_t user_file = {map, mmap_pread, mmap_fsize, mmap_range,
+        NULL};
+    zseek_reader_t *reader = zseek_reader_open_param(user_file, param,
+        call_data, errbuf);
+    if (!reader)
+        goto fail_w_mmap;
+    reader->map = map;
+
+    return reader;
+
+fail_w_mmap:
+    munmap(addr, map->size);
+fail_w_map:
+    free(map);
+fail:
+    return NULL;
 }
 
-static bool zseek_reader_close_lz4(zseek_reader_t *reader, void *call_data,
+zseek_reader_t *zseek_reader_open_uring(FILE *cfile,
+    const zseek_reader_param_t *param, unsigned queue_depth, void *call_data,
     char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    (void)call_data;
-
-    bool is_error = false;
-
-    int pr = pthread_rwlock_destroy(&reader->lock);
-    if (pr && !is_error) {
-        set_error_with_errno(errbuf, "destroy lock", pr);
-        is_error = true;
+    int fd = fileno(cfile);
+    if (fd == -1) {
+        set_error_with_errno(errbuf, "get file descriptor", errno);
+        return NULL;
     }
 
-    LZ4F_errorCode_t r = LZ4F_freeDecompressionContext(reader->dctx_lz4);
-    if (LZ4F_isError(r) && !is_error) {
-        set_error(errbuf, "%s: %s", "free context", LZ4F_getErrorName(r));
-        is_error = true;
+    zseek_uring_t *uring = zseek_uring_new(fd, queue_depth, errbuf);
+    if (!uring)
+        return NULL;
+
+    zseek_read_file_t user_file = {uring, zseek_uring_pread, zseek_uring_fsize,
+        NULL, zseek_uring_pread_batch};
+    zseek_reader_t *reader = zseek_reader_open_param(user_file, param,
+        call_data, errbuf);
+    if (!reader) {
+        zseek_uring_free(uring);
+        return NULL;
     }
+    reader->uring = uring;
 
-    zseek_buffer_free(reader->dbuf);
-    zseek_buffer_free(reader->cbuf);
-    zseek_cache_free(reader->cache);
-    seek_table_free(reader->st);
-    free(reader);
-
-    return !is_error;
-}
+    return reader;
+}
 
 bool zseek_reader_close(zseek_reader_t *reader, void *call_data,
     char errbuf[ZSEEK_ERRBUF_SIZE])
 {
+    (void)call_data;
+
     if (!reader)
         return true;
 
-    switch (reader->type) {
-    case ZSEEK_ZSTD:
-        return zseek_reader_close_zstd(reader, call_data, errbuf);
-    case ZSEEK_LZ4:
-        return zseek_reader_close_lz4(reader, call_data, errbuf);
-    default:
-        // BUG
-        assert(false);
+    return reader_free(reader, errbuf);
+}
+
+/**
+ * Read the compressed frames at indices [@p first, @p last] from the file with
+ * a single read, into @p dst.
+ */
+static bool read_frames(zseek_reader_t *reader, void *dst, size_t first,
+    size_t last, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    off_t range_offset = frame_offset_c(reader->st, first);
+    size_t range_csize = frame_offset_c(reader->st, last) - range_offset +
+        frame_size_c(reader->st, last);
+
+    uint64_t start = event_start(reader);
+    ssize_t _read = reader->user_file.pread(dst, range_csize,
+        (size_t)range_offset, reader->user_file.user_data, call_data);
+    note_preads(reader, 1);
+    if (_read != (ssize_t)range_csize) {
+        if (_read >= 0)
+            set_error(errbuf, "unexpected EOF");
+        else
+            // TODO OPT: Use errno if user_file.pread sets it
+            set_error(errbuf, "read file failed");
         return false;
     }
+    note_event(reader, ZSEEK_EVENT_FETCH, first, range_csize, start);
+
+    return true;
 }
 
-static ssize_t zseek_pread_zstd_no_cache(zseek_reader_t *reader, void *buf,
-    size_t count, size_t offset, void *call_data,
+/**
+ * Like read_frames(), through the compressed cache: the frames cached are
+ * copied, and only the span of those that aren't is read (with a single
+ * read). With @p keep, the frames read are then added to the cache.
+ */
+static bool read_frames_cached(zseek_reader_t *reader, uint8_t *dst,
+    size_t first, size_t last, bool keep, void *call_data,
     char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    // TODO OPT: Use the cache, only for reading?
+    off_t first_offset = frame_offset_c(reader->st, first);
+    size_t lo = SIZE_MAX;
+    size_t hi = 0;
+    for (size_t f = first; f <= last; f++) {
+        // Pin the frame, so that it's not evicted while copying
+        zseek_frame_t frame = zseek_cache_pin(reader->ccache, f);
+        if (!frame.data) {
+            note_event(reader, ZSEEK_EVENT_COMPRESSED_MISS, f, 0, 0);
+            lo = MIN(lo, f);
+            hi = f;
+            continue;
+        }
+        memcpy(dst + (frame_offset_c(reader->st, f) - first_offset),
+            frame.data, frame.len);
+        zseek_cache_unpin(reader->ccache, f);
+        note_event(reader, ZSEEK_EVENT_COMPRESSED_HIT, f, frame.len, 0);
+    }
+    if (lo == SIZE_MAX)
+        return true;
 
-    ssize_t frame_idx = offset_to_frame_idx(reader->st, offset);
-    if (frame_idx == -1)
-        return 0;
+    // NOTE: Frames cached between lo and hi are read again, with the others
+    uint8_t *span = dst + (frame_offset_c(reader->st, lo) - first_offset);
+    if (!read_frames(reader, span, lo, hi, call_data, errbuf))
+        return false;
+    if (!keep)
+        return true;
 
-    int pr = pthread_rwlock_wrlock(&reader->lock);
-    if (pr) {
-        set_error_with_errno(errbuf, "lock for writing", pr);
-        goto fail;
+    // Caching frames may fail (e.g. if cached meanwhile), but not the fetch
+    off_t lo_offset = frame_offset_c(reader->st, lo);
+    for (size_t f = lo; f <= hi; f++) {
+        if (zseek_cache_find(reader->ccache, f).data)
+            continue;
+        size_t frame_csize = frame_size_c(reader->st, f);
+        void *copy = malloc(frame_csize);
+        if (!copy)
+            break;
+        memcpy(copy, span + (frame_offset_c(reader->st, f) - lo_offset),
+            frame_csize);
+        zseek_frame_t frame = {copy, f, frame_csize};
+        if (!zseek_cache_insert(reader->ccache, frame))
+            free(copy);
+    }
+
+    return true;
+}
+
+/**
+ * Fetch the compressed frames at indices [@p first, @p last] with a single
+ * read (or none, if in the compressed cache), into the compressed buffer of
+ * @p ctx. With @p keep, the frames read are added to the compressed cache, if
+ * any. Returns a pointer to the compressed data, or @a NULL on error. If the
+ * file provides ranges, points into the file instead, without copying.
+ */
+static const void *fetch_frames(zseek_reader_t *reader, zseek_dctx_t *ctx,
+    size_t first, size_t last, bool keep, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    off_t range_offset = frame_offset_c(reader->st, first);
+    size_t range_csize = frame_offset_c(reader->st, last) - range_offset +
+        frame_size_c(reader->st, last);
+
+    if (reader->user_file.range) {
+        uint64_t start = event_start(reader);
+        const void *range = reader->user_file.range(range_csize,
+            (size_t)range_offset, reader->user_file.user_data, call_data);
+        if (range) {
+            note_event(reader, ZSEEK_EVENT_FETCH, first, range_csize, start);
+            return range;
+        }
+        // Fall back to reading
     }
 
     // Resize compressed buffer
-    size_t frame_csize = frame_size_c(reader->st, frame_idx);
-    if (!zseek_buffer_resize(reader->cbuf, frame_csize)) {
+    if (!zseek_buffer_resize(ctx->cbuf, range_csize)) {
         set_error(errbuf, "resize compressed buffer");
-        goto fail_w_lock;
+        return NULL;
     }
-    void *cbuf_data = zseek_buffer_data(reader->cbuf);
+    void *cbuf_data = zseek_buffer_data(ctx->cbuf);
     assert(cbuf_data);
-    // Read compressed frame
-    off_t frame_offset = frame_offset_c(reader->st, frame_idx);
-    ssize_t _read = reader->user_file.pread(cbuf_data, frame_csize,
-        (size_t)frame_offset, reader->user_file.user_data, call_data);
-    if (_read != (ssize_t)frame_csize) {
-        if (_read >= 0)
-            set_error(errbuf, "unexpected EOF");
-        else
-            // TODO OPT: Use errno if user_file.pread sets it
-            set_error(errbuf, "read file failed");
-        goto fail_w_lock;
+
+    // Read compressed frames
+    bool ok = reader->ccache ?
+        read_frames_cached(reader, cbuf_data, first, last, keep, call_data,
+            errbuf) :
+        read_frames(reader, cbuf_data, first, last, call_data, errbuf);
+
+    return ok ? cbuf_data : NULL;
+}
+
+/**
+ * Return the index of the frame containing @p offset, trying @p hint (a loaded
+ * frame) and the frame after it before searching the seek table. Returns -1 if
+ * out of range or -2 on error, see offset_to_frame_idx().
+ */
+static ssize_t frame_idx_hinted(zseek_reader_t *reader, size_t offset,
+    size_t hint, void *call_data)
+{
+    size_t nb_frames = seek_table_entries(reader->st);
+    for (size_t f = hint; f < nb_frames && f <= hint + 1; f++) {
+        if (!seek_table_load(reader->st, f, f + 1, call_data))
+            break;
+        size_t start = frame_offset_d(reader->st, f);
+        if (offset < start)
+            break;
+        if (offset < start + frame_size_d(reader->st, f))
+            return f;
     }
 
-    size_t r = ZSTD_initDStream(reader->dstream_zstd);
+    return offset_to_frame_idx(reader->st, offset, call_data);
+}
+
+/**
+ * Return the index of the last frame of the run starting at @p first that
+ * should be fetched with a single read, to serve @p count bytes at decompressed
+ * @p offset. With @p frame_ok, frames are only added to the run while it
+ * returns @a true for them. The run ends early if the seek table fails to load.
+ */
+static size_t extend_run(zseek_reader_t *reader, size_t first, size_t count,
+    size_t offset, bool (*frame_ok)(zseek_reader_t*, size_t, void*),
+    void *arg, void *call_data)
+{
+    size_t end = offset + count;
+    size_t nb_frames = seek_table_entries(reader->st);
+    off_t first_offset = frame_offset_c(reader->st, first);
+
+    size_t last = first;
+    while (last + 1 < nb_frames && last + 1 - first < COALESCE_MAX_FRAMES) {
+        size_t next = last + 1;
+        if (!seek_table_load(reader->st, next, next + 1, call_data))
+            break;
+        if ((size_t)frame_offset_d(reader->st, next) >= end)
+            break;
+        size_t run_csize = frame_offset_c(reader->st, next) - first_offset +
+            frame_size_c(reader->st, next);
+        if (run_csize > COALESCE_MAX_SIZE)
+            break;
+        if (frame_ok && !frame_ok(reader, next, arg))
+            break;
+        last = next;
+    }
+
+    return last;
+}
+
+/**
+ * Decompress a whole zstd frame of @p csize bytes from @p src to @p dst.
+ */
+static bool decompress_frame_zstd(zseek_dctx_t *ctx, void *dst, size_t dsize,
+    const void *src, size_t csize, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t r = ZSTD_decompress_usingDDict(ctx->dctx_zstd, dst, dsize, src,
+        csize, ctx->ddict);
+    if (ZSTD_isError(r)) {
+        set_error(errbuf, "%s: %s", "decompress frame", ZSTD_getErrorName(r));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Decompress a whole lz4 frame of @p csize bytes from @p src to @p dst.
+ */
+static bool decompress_frame_lz4(zseek_dctx_t *ctx, void *dst, size_t dsize,
+    const void *src, size_t csize, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t src_offset = 0;
+    size_t dst_offset = 0;
+    size_t r = 0;
+    do {
+        size_t src_size = csize - src_offset;
+        size_t dst_size = dsize - dst_offset;
+        LZ4F_decompressOptions_t opts = { .stableDst = 0 };
+        // NOTE: In theory, LZ4F_decompress may not finish the whole frame in
+        // one call (r > 0). In practice, this does not happen given enough
+        // room in the output buffer (e.g. here).
+        r = LZ4F_decompress(ctx->dctx_lz4,
+            (uint8_t*)dst + dst_offset, &dst_size,
+            (const uint8_t*)src + src_offset, &src_size,
+            &opts); // NOTE: Overwrites dst_size, src_size.
+        if (LZ4F_isError(r)) {
+            set_error(errbuf, "%s: %s", "decompress frame",
+                LZ4F_getErrorName(r));
+            LZ4F_resetDecompressionContext(ctx->dctx_lz4);
+            return false;
+        }
+        src_offset += src_size;
+        dst_offset += dst_size;
+        if (src_size == 0 && dst_size == 0)
+            // More data than fits in dst
+            break;
+        // NOTE: Goes on with the next frame, for those made of sub-blocks
+    } while (src_offset < csize);
+
+    if (r > 0 || src_offset < csize) {
+        set_error(errbuf, "%s: %s", "decompress frame",
+            r > 0 ? "truncated frame" : "frame larger than expected");
+        LZ4F_resetDecompressionContext(ctx->dctx_lz4);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Decompress the whole frame at index @p frame_idx, of @p csize bytes at
+ * @p src, to @p dst.
+ */
+static bool decompress_frame(zseek_reader_t *reader, zseek_dctx_t *ctx,
+    size_t frame_idx, void *dst, size_t dsize, const void *src, size_t csize,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    uint64_t start = event_start(reader);
+    bool ok;
+    switch (reader->type) {
+    case ZSEEK_ZSTD:
+        ok = decompress_frame_zstd(ctx, dst, dsize, src, csize, errbuf);
+        break;
+    case ZSEEK_LZ4:
+        ok = decompress_frame_lz4(ctx, dst, dsize, src, csize, errbuf);
+        break;
+    default:
+        // BUG
+        assert(false);
+        return false;
+    }
+    if (ok)
+        note_event(reader, ZSEEK_EVENT_DECOMPRESS, frame_idx, dsize, start);
+
+    return ok;
+}
+
+/**
+ * Decompress @p len bytes at @p offset_in_frame of the zstd frame of @p csize
+ * bytes at @p src, to @p dst.
+ */
+static bool decompress_partial_zstd(zseek_dctx_t *ctx, void *dst, size_t len,
+    size_t offset_in_frame, const void *src, size_t csize,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    // NOTE: Unlike ZSTD_initDStream(), this keeps the dictionary referenced
+    size_t r = ZSTD_DCtx_reset(ctx->dstream_zstd, ZSTD_reset_session_only);
     if (ZSTD_isError(r)) {
         set_error(errbuf, "%s: %s", "initialize dstream", ZSTD_getErrorName(r));
-        goto fail_w_lock;
+        return false;
     }
     // Discard any excess leading data
-    ZSTD_inBuffer inb = { .src = cbuf_data, .size = frame_csize };
-    size_t offset_in_frame = offset - frame_offset_d(reader->st, frame_idx);
+    ZSTD_inBuffer inb = { .src = src, .size = csize };
     if (offset_in_frame > 0) {
         // Resize discard buffer
-        if (!zseek_buffer_resize(reader->dbuf, offset_in_frame)) {
+        if (!zseek_buffer_resize(ctx->dbuf, offset_in_frame)) {
             set_error(errbuf, "resize discard buffer");
-            goto fail_w_lock;
+            return false;
         }
-        void *dbuf_data = zseek_buffer_data(reader->dbuf);
+        void *dbuf_data = zseek_buffer_data(ctx->dbuf);
         assert(dbuf_data);
         // Decompress discard data
         size_t to_decompress = offset_in_frame;
         ZSTD_outBuffer outb = { .dst = dbuf_data, .size = to_decompress };
         while (outb.pos < outb.size) {
-            r = ZSTD_decompressStream(reader->dstream_zstd, &outb, &inb);
+            r = ZSTD_decompressStream(ctx->dstream_zstd, &outb, &inb);
             if (ZSTD_isError(r)) {
                 set_error(errbuf, "%s: %s", "decompress discard data",
                     ZSTD_getErrorName(r));
-                goto fail_w_lock;
+                return false;
             }
         }
     }
 
     // Decompress user data
-    size_t frame_dsize = frame_size_d(reader->st, frame_idx);
-    size_t to_decompress = MIN(count, frame_dsize - offset_in_frame);
-    ZSTD_outBuffer outb = { .dst = buf, .size = to_decompress };
+    ZSTD_outBuffer outb = { .dst = dst, .size = len };
     while (outb.pos < outb.size) {
-        r = ZSTD_decompressStream(reader->dstream_zstd, &outb, &inb);
+        r = ZSTD_decompressStream(ctx->dstream_zstd, &outb, &inb);
         if (ZSTD_isError(r)) {
             set_error(errbuf, "%s: %s", "decompress user data",
                 ZSTD_getErrorName(r));
-            goto fail_w_lock;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Decompress @p len bytes at @p offset_in_frame of the lz4 frame of @p csize
+ * bytes at @p src, to @p dst.
+ */
+static bool decompress_partial_lz4(zseek_dctx_t *ctx, void *dst, size_t len,
+    size_t offset_in_frame, const void *src, size_t csize,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    const uint8_t *cbuf_data = src;
+
+    // Discard any excess leading data
+    size_t cbuf_offset = 0;
+    if (offset_in_frame > 0) {
+        // Resize discard buffer
+        if (!zseek_buffer_resize(ctx->dbuf, offset_in_frame)) {
+            set_error(errbuf, "resize discard buffer");
+            return false;
+        }
+        void *dbuf_data = zseek_buffer_data(ctx->dbuf);
+        assert(dbuf_data);
+        // Decompress discard data
+        size_t dbuf_offset = 0;
+        size_t to_decompress = offset_in_frame;
+        do {
+            size_t src_size = csize - cbuf_offset;
+            size_t dst_size = to_decompress - dbuf_offset;
+            LZ4F_decompressOptions_t opts = { .stableDst = 0 };
+            size_t r = LZ4F_decompress(ctx->dctx_lz4,
+                (uint8_t*)dbuf_data + dbuf_offset, &dst_size,
+                cbuf_data + cbuf_offset, &src_size,
+                &opts); // NOTE: Overwrites dst_size, src_size.
+            if (LZ4F_isError(r)) {
+                set_error(errbuf, "%s: %s", "decompress discard data",
+                    LZ4F_getErrorName(r));
+                LZ4F_resetDecompressionContext(ctx->dctx_lz4);
+                return false;
+            }
+            cbuf_offset += src_size;
+            dbuf_offset += dst_size;
+        } while (dbuf_offset < to_decompress);
+    }
+
+    // Decompress user data
+    size_t buf_offset = 0;
+    do {
+        size_t src_size = csize - cbuf_offset;
+        size_t dst_size = len - buf_offset;
+        LZ4F_decompressOptions_t opts = { .stableDst = 0 };
+        size_t r = LZ4F_decompress(ctx->dctx_lz4,
+            (uint8_t*)dst + buf_offset, &dst_size,
+            cbuf_data + cbuf_offset, &src_size,
+            &opts); // NOTE: Overwrites dst_size, src_size.
+        if (LZ4F_isError(r)) {
+            set_error(errbuf, "%s: %s", "decompress user data",
+                LZ4F_getErrorName(r));
+            LZ4F_resetDecompressionContext(ctx->dctx_lz4);
+            return false;
         }
+        cbuf_offset += src_size;
+        buf_offset += dst_size;
+    } while (buf_offset < len);
+
+    if (cbuf_offset < csize) {
+        // Did not consume the whole frame, clean up decompression context
+        LZ4F_resetDecompressionContext(ctx->dctx_lz4);
+    }
+
+    return true;
+}
+
+/**
+ * Decompress @p len bytes at @p offset_in_frame of the frame at index
+ * @p frame_idx (or a sub-block of it), of @p csize bytes at @p src, to @p dst.
+ */
+static bool decompress_partial(zseek_reader_t *reader, zseek_dctx_t *ctx,
+    size_t frame_idx, void *dst, size_t len, size_t offset_in_frame,
+    const void *src, size_t csize, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    uint64_t start = event_start(reader);
+    bool ok;
+    switch (reader->type) {
+    case ZSEEK_ZSTD:
+        ok = decompress_partial_zstd(ctx, dst, len, offset_in_frame, src,
+            csize, errbuf);
+        break;
+    case ZSEEK_LZ4:
+        ok = decompress_partial_lz4(ctx, dst, len, offset_in_frame, src,
+            csize, errbuf);
+        break;
+    default:
+        // BUG
+        assert(false);
+        return false;
     }
+    // NOTE: Counts the bytes wanted, not those decompressed to skip to them
+    if (ok)
+        note_event(reader, ZSEEK_EVENT_DECOMPRESS, frame_idx, len, start);
 
-    pr = pthread_rwlock_unlock(&reader->lock);
+    return ok;
+}
+
+/**
+ * Pin the frame at index @p frame_idx in the cache of @p reader, as
+ * zseek_cache_pin(). Counts a hit or a miss, unless a @p retry of a lookup
+ * that missed.
+ */
+static zseek_frame_t cache_lookup(zseek_reader_t *reader, size_t frame_idx,
+    bool retry)
+{
+    zseek_frame_t frame = zseek_cache_pin(reader->cache, frame_idx);
+    if (!retry)
+        note_event(reader, frame.data ? ZSEEK_EVENT_CACHE_HIT :
+            ZSEEK_EVENT_CACHE_MISS, frame_idx, 0, 0);
+    return frame;
+}
+
+/**
+ * Copy from the cached frame at index @p frame_idx into @p buf, if present.
+ * Returns the number of bytes copied, or 0 if the frame is not cached. See
+ * cache_lookup() for @p retry.
+ */
+static size_t copy_cached(zseek_reader_t *reader, void *buf, size_t count,
+    size_t frame_idx, size_t offset_in_frame, bool retry)
+{
+    // Pin the frame, so that it's not evicted while copying
+    zseek_frame_t frame = cache_lookup(reader, frame_idx, retry);
+    if (!frame.data)
+        return 0;
+
+    size_t to_copy = MIN(count, frame.len - offset_in_frame);
+    memcpy(buf, (uint8_t*)frame.data + offset_in_frame, to_copy);
+
+    zseek_cache_unpin(reader->cache, frame_idx);
+
+    return to_copy;
+}
+
+/**
+ * Return the in-flight marker for the frame at index @p frame_idx, or @a NULL.
+ *
+ * @attention Requires miss_lock
+ */
+static zseek_inflight_t *inflight_find(zseek_reader_t *reader,
+    size_t frame_idx)
+{
+    zseek_inflight_t *f = reader->inflight;
+    while (f && f->frame_idx != frame_idx)
+        f = f->next;
+    return f;
+}
+
+/**
+ * Register the calling thread as the one fetching the frame at index
+ * @p frame_idx, via @p marker. If another thread is already fetching it, wait
+ * for it to finish instead.
+ *
+ * Returns 1 if the caller should fetch the frame (and later call
+ * miss_finish()), 0 if the caller should retry looking up the cache, or -1 on
+ * error.
+ */
+static int miss_begin(zseek_reader_t *reader, zseek_inflight_t *marker,
+    size_t frame_idx, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_wait_t w = {0};
+    int pr = lock_wait(reader, &reader->miss_lock, &w);
     if (pr) {
-        set_error_with_errno(errbuf, "unlock", pr);
+        set_error_with_errno(errbuf, "lock misses", pr);
+        return -1;
+    }
+
+    int r = 0;
+    if (inflight_find(reader, frame_idx)) {
+        // Someone else is fetching it, wait for them
+        wait_begin(reader, &w);
+        do {
+            pthread_cond_wait(&reader->miss_cond, &reader->miss_lock);
+        } while (inflight_find(reader, frame_idx));
+    } else if (!zseek_cache_find(reader->cache, frame_idx).data) {
+        // NOTE: The frame may have been inserted by a fetcher finishing
+        // between our lookup and taking miss_lock (inserts happen before
+        // unregistering)
+        marker->frame_idx = frame_idx;
+        marker->next = reader->inflight;
+        reader->inflight = marker;
+        r = 1;
+    }
+
+    pthread_mutex_unlock(&reader->miss_lock);
+    wait_end(reader, &w, frame_idx);
+
+    return r;
+}
+
+/**
+ * Like miss_begin(), but never waits: returns @a false if the frame is cached
+ * or being fetched already.
+ */
+static bool miss_try_begin(zseek_reader_t *reader, zseek_inflight_t *marker,
+    size_t frame_idx)
+{
+    if (pthread_mutex_lock(&reader->miss_lock))
+        return false;
+
+    bool ok = !inflight_find(reader, frame_idx) &&
+        !zseek_cache_find(reader->cache, frame_idx).data;
+    if (ok) {
+        marker->frame_idx = frame_idx;
+        marker->next = reader->inflight;
+        reader->inflight = marker;
+    }
+
+    pthread_mutex_unlock(&reader->miss_lock);
+
+    return ok;
+}
+
+/**
+ * Unregister the fetches registered with the @p nb_markers @p markers and wake
+ * up any waiters.
+ */
+static void miss_finish(zseek_reader_t *reader, zseek_inflight_t *markers,
+    size_t nb_markers)
+{
+    zseek_wait_t w = {0};
+    lock_wait(reader, &reader->miss_lock, &w);
+
+    for (size_t m = 0; m < nb_markers; m++) {
+        zseek_inflight_t **link = &reader->inflight;
+        while (*link != &markers[m])
+            link = &(*link)->next;
+        *link = markers[m].next;
+    }
+
+    pthread_cond_broadcast(&reader->miss_cond);
+    pthread_mutex_unlock(&reader->miss_lock);
+    wait_end(reader, &w, markers[0].frame_idx);
+}
+
+typedef struct {
+    zseek_inflight_t *markers;
+    size_t first;
+} run_markers_t;
+
+static bool run_frame_ok(zseek_reader_t *reader, size_t frame_idx, void *arg)
+{
+    run_markers_t *rm = arg;
+    return miss_try_begin(reader, &rm->markers[frame_idx - rm->first],
+        frame_idx);
+}
+
+/**
+ * Load the frames at indices [@p first, @p last] with a single read, and
+ * decompress each of them into a new buffer, stored in @p dbufs, with the
+ * context @p own (if not @a NULL, see ctx_acquire()). Returns @a false on
+ * error, in which case nothing is allocated.
+ */
+static bool load_frames(zseek_reader_t *reader, zseek_dctx_t *own,
+    size_t first, size_t last, void **dbufs, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    size_t nb_dbufs = 0;
+    zseek_dctx_t *ctx = ctx_acquire(reader, own, errbuf);
+    if (!ctx)
         goto fail;
+
+    const uint8_t *cdata = fetch_frames(reader, ctx, first, last, true,
+        call_data, errbuf);
+    if (!cdata)
+        goto fail_w_ctx;
+    off_t first_offset = frame_offset_c(reader->st, first);
+    for (size_t f = first; f <= last; f++) {
+        size_t frame_dsize = frame_size_d(reader->st, f);
+        void *dbuf = zseek_frame_pool_get(reader->frames, frame_dsize);
+        if (!dbuf) {
+            set_error_with_errno(errbuf, "allocate decompressed buffer",
+                errno);
+            goto fail_w_ctx;
+        }
+        dbufs[nb_dbufs++] = dbuf;
+        if (!decompress_frame(reader, ctx, f, dbuf, frame_dsize,
+            cdata + (frame_offset_c(reader->st, f) - first_offset),
+            frame_size_c(reader->st, f), errbuf))
+            goto fail_w_ctx;
     }
 
-    return to_decompress;
+    ctx_release(reader, own, ctx);
 
-fail_w_lock:
-    pthread_rwlock_unlock(&reader->lock);
+    return true;
+
+fail_w_ctx:
+    ctx_release(reader, own, ctx);
+    for (size_t f = 0; f < nb_dbufs; f++)
+        zseek_frame_pool_put(reader->frames, dbufs[f],
+            frame_size_d(reader->st, first + f));
 fail:
+    return false;
+}
+
+/**
+ * Prefetch the frames selected by readahead_note() for a stream into the
+ * cache. Runs on a worker.
+ */
+static void readahead_task(void *arg)
+{
+    zseek_ra_stream_t *ra = arg;
+    zseek_reader_t *reader = ra->reader;
+
+    pthread_mutex_lock(&ra->lock);
+    size_t f = ra->first;
+    size_t end = ra->end;
+    pthread_mutex_unlock(&ra->lock);
+
+    zseek_inflight_t markers[COALESCE_MAX_FRAMES];
+    void *dbufs[COALESCE_MAX_FRAMES];
+    while (f < end) {
+        // Claim a run of frames no one else has
+        size_t first = f;
+        off_t first_offset = frame_offset_c(reader->st, first);
+        while (f < end && f - first < COALESCE_MAX_FRAMES) {
+            size_t run_csize = frame_offset_c(reader->st, f) - first_offset +
+                frame_size_c(reader->st, f);
+            if (f > first && run_csize > COALESCE_MAX_SIZE)
+                break;
+            if (!miss_try_begin(reader, &markers[f - first], f))
+                break;
+            f++;
+        }
+        size_t nb_frames = f - first;
+        if (nb_frames == 0) {
+            // Already cached, or being fetched
+            f++;
+            continue;
+        }
+
+        // NOTE: The call_data of the read triggering readahead is not valid
+        // here, so NULL is passed. Errors are not reported either; they are
+        // hit again (and reported) by the read that needs the frames.
+        if (load_frames(reader, NULL, first, f - 1, dbufs, NULL, NULL)) {
+            for (size_t i = 0; i < nb_frames; i++) {
+                zseek_frame_t frame = {dbufs[i], first + i,
+                    frame_size_d(reader->st, first + i)};
+                if (!zseek_cache_insert(reader->cache, frame))
+                    zseek_frame_pool_put(reader->frames, frame.data,
+                        frame.len);
+            }
+        }
+        miss_finish(reader, markers, nb_frames);
+    }
+
+    pthread_mutex_lock(&ra->lock);
+    ra->pending = false;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+/**
+ * Track a read of frames [@p first, @p f] for sequential progress in @p ra,
+ * issuing readahead as needed. A read starting on the same or the next frame
+ * as where the previous one (of @p ra) ended is sequential. Like the kernel's
+ * readahead, the window starts small and doubles each time the reads get
+ * within half a window of its end, up to readahead_max. Seek table errors are
+ * left for the read itself to report.
+ */
+static void readahead_note_frames(zseek_reader_t *reader,
+    zseek_ra_stream_t *ra, size_t first, size_t f, void *call_data)
+{
+    size_t nb_frames = seek_table_entries(reader->st);
+
+    pthread_mutex_lock(&ra->lock);
+
+    size_t last = atomic_load_explicit(&ra->last, memory_order_relaxed);
+    bool grow = true;
+    if (first == last + 1 && ra->window == 0) {
+        // Start of a sequential scan
+        ra->window = MIN(READAHEAD_START, reader->readahead_max);
+        ra->until = f + 1;
+        grow = false;
+    } else if (first != last && first != last + 1) {
+        // Random access
+        ra->window = 0;
+    }
+    atomic_store_explicit(&ra->last, f, memory_order_relaxed);
+
+    if (ra->window == 0 || ra->pending)
+        goto out;
+    if (ra->until < f + 1)
+        // Fell behind (e.g. readahead was still pending)
+        ra->until = f + 1;
+    if (ra->until - (f + 1) > ra->window / 2)
+        // Enough ahead already
+        goto out;
+
+    if (grow)
+        ra->window = MIN(2 * ra->window, reader->readahead_max);
+    size_t end = MIN(f + 1 + ra->window, nb_frames);
+    if (ra->until >= end)
+        goto out;
+
+    // Claim the stream's task; the window is loaded without the lock
+    size_t start = ra->until;
+    ra->first = start;
+    ra->end = end;
+    ra->until = end;
+    ra->pending = true;
+    pthread_mutex_unlock(&ra->lock);
+
+    if (!seek_table_load(reader->st, start, end, call_data)) {
+        pthread_mutex_lock(&ra->lock);
+        if (ra->until == end)
+            ra->until = start;
+        ra->pending = false;
+        pthread_cond_broadcast(&ra->cond);
+        pthread_mutex_unlock(&ra->lock);
+        return;
+    }
+
+    mmap_advise(reader, start, end, MADV_WILLNEED);
+    // Only the claimer of pending touches the task
+    ra->task = (zseek_task_t){readahead_task, ra, NULL};
+    zseek_thread_pool_submit(reader->workers, &ra->task);
+    return;
+
+out:
+    pthread_mutex_unlock(&ra->lock);
+}
+
+/**
+ * The frame of @p offset, hinted by the last read of readahead stream @p ra,
+ * see frame_idx_hinted()
+ */
+static ssize_t readahead_frame_idx(zseek_reader_t *reader,
+    zseek_ra_stream_t *ra, size_t offset, void *call_data)
+{
+    // NOTE: Racy, as reads sharing the stream may update it. A stale hint
+    // only costs a search.
+    size_t hint = atomic_load_explicit(&ra->last, memory_order_relaxed);
+    return frame_idx_hinted(reader, offset, hint, call_data);
+}
+
+/**
+ * readahead_note_frames() for a read of [@p offset, @p last_offset]. Resolving
+ * the frames may load the seek table, so is done before taking any lock.
+ */
+static void readahead_note(zseek_reader_t *reader, zseek_ra_stream_t *ra,
+    size_t offset, size_t last_offset, void *call_data)
+{
+    ssize_t frame_idx = readahead_frame_idx(reader, ra, offset, call_data);
+    if (frame_idx < 0)
+        return;
+    size_t first = frame_idx;
+    size_t f = first;
+    if (last_offset > offset) {
+        frame_idx = frame_idx_hinted(reader, last_offset, first, call_data);
+        if (frame_idx == -2)
+            return;
+        // Past EOF, up to the last frame
+        f = frame_idx == -1 ? seek_table_entries(reader->st) - 1 :
+            (size_t)frame_idx;
+    }
+
+    readahead_note_frames(reader, ra, first, f, call_data);
+}
+
+/**
+ * Serve (part of) a read of @p count bytes at @p offset through the cache.
+ * Either copies from the frame containing @p offset if cached, or fetches it,
+ * along with (if @p multi) the following uncached frames the read extends to,
+ * with the context @p own (if not @a NULL, see ctx_acquire()).
+ *
+ * Returns the number of bytes read (0 on EOF), or -1 on error.
+ */
+static ssize_t pread_cached_step(zseek_reader_t *reader, zseek_dctx_t *own,
+    void *buf, size_t count, size_t offset, bool multi, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    ssize_t frame_idx = offset_to_frame_idx(reader->st, offset, call_data);
+    if (frame_idx == -1)
+        return 0;
+    if (frame_idx == -2) {
+        set_error(errbuf, "load seek table failed");
+        return -1;
+    }
+    size_t offset_in_frame = offset - frame_offset_d(reader->st, frame_idx);
+
+    zseek_inflight_t markers[COALESCE_MAX_FRAMES];
+    for (bool retry = false;; retry = true) {
+        size_t copied = copy_cached(reader, buf, count, frame_idx,
+            offset_in_frame, retry);
+        if (copied > 0)
+            return copied;
+
+        int r = miss_begin(reader, &markers[0], frame_idx, errbuf);
+        if (r == -1)
+            return -1;
+        if (r == 1)
+            break;
+    }
+
+    size_t first = frame_idx;
+    size_t last = first;
+    if (multi) {
+        // Extend the run over the following frames, as long as no one else
+        // has them
+        run_markers_t rm = {markers, first};
+        last = extend_run(reader, first, count, offset, run_frame_ok, &rm,
+            call_data);
+    }
+    size_t nb_frames = last - first + 1;
+
+    void *dbufs[COALESCE_MAX_FRAMES];
+    if (!load_frames(reader, own, first, last, dbufs, call_data, errbuf)) {
+        miss_finish(reader, markers, nb_frames);
+        return -1;
+    }
+
+    // Copy out before handing the frames to the cache, which may evict them
+    size_t copied = 0;
+    for (size_t f = 0; f < nb_frames && copied < count; f++) {
+        size_t from = f == 0 ? offset_in_frame : 0;
+        size_t to_copy = MIN(count - copied,
+            frame_size_d(reader->st, first + f) - from);
+        memcpy((uint8_t*)buf + copied, (uint8_t*)dbufs[f] + from, to_copy);
+        copied += to_copy;
+    }
+
+    // Cache frames. Failing to do so (e.g. if all candidate victims are
+    // pinned) doesn't fail the read.
+    for (size_t f = 0; f < nb_frames; f++) {
+        zseek_frame_t frame = {dbufs[f], first + f,
+            frame_size_d(reader->st, first + f)};
+        if (!zseek_cache_insert(reader->cache, frame))
+            zseek_frame_pool_put(reader->frames, frame.data, frame.len);
+    }
+
+    miss_finish(reader, markers, nb_frames);
+
+    return copied;
+}
+
+/**
+ * Serve (part of) a read of @p count bytes at @p offset without a cache,
+ * decompressing directly into @p buf with the context @p own (if not @a NULL,
+ * see ctx_acquire()). With @p multi, the following frames the read extends to
+ * are fetched with the same read. With @p nocache (see ZSEEK_PREAD_NOCACHE),
+ * the cache is only read from, if any, and the frames fetched aren't kept.
+ *
+ * Returns the number of bytes read (0 on EOF), or -1 on error.
+ */
+static ssize_t pread_no_cache_step(zseek_reader_t *reader, zseek_dctx_t *own,
+    void *buf, size_t count, size_t offset, bool multi, bool nocache,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    ssize_t frame_idx = offset_to_frame_idx(reader->st, offset, call_data);
+    if (frame_idx == -1)
+        return 0;
+    if (frame_idx == -2) {
+        set_error(errbuf, "load seek table failed");
+        return -1;
+    }
+    size_t offset_in_frame = offset - frame_offset_d(reader->st, frame_idx);
+
+    if (nocache && reader->cache) {
+        size_t copied = copy_cached(reader, buf, count, frame_idx,
+            offset_in_frame, false);
+        if (copied > 0)
+            return copied;
+    }
+
+    size_t first = frame_idx;
+    size_t last = first;
+    if (multi)
+        last = extend_run(reader, first, count, offset, NULL, NULL,
+            call_data);
+
+    zseek_dctx_t *ctx = ctx_acquire(reader, own, errbuf);
+    if (!ctx)
+        return -1;
+
+    const uint8_t *cdata = fetch_frames(reader, ctx, first, last, !nocache,
+        call_data, errbuf);
+    if (!cdata)
+        goto fail_w_ctx;
+
+    off_t first_offset = frame_offset_c(reader->st, first);
+    size_t copied = 0;
+    for (size_t f = first; f <= last && copied < count; f++) {
+        const uint8_t *src = cdata +
+            (frame_offset_c(reader->st, f) - first_offset);
+        size_t frame_csize = frame_size_c(reader->st, f);
+        size_t frame_dsize = frame_size_d(reader->st, f);
+        size_t from = f == first ? offset_in_frame : 0;
+        size_t len = MIN(count - copied, frame_dsize - from);
+
+        bool ok;
+        if (from == 0 && len == frame_dsize) {
+            // Whole frame wanted
+            ok = decompress_frame(reader, ctx, f, (uint8_t*)buf + copied,
+                len, src, frame_csize, errbuf);
+        } else {
+            // Skip to the sub-block holding from, if indexed
+            size_t sub_c, sub_d;
+            if (frame_sub_block(reader->st, f, from, &sub_c, &sub_d)) {
+                src += sub_c;
+                frame_csize -= sub_c;
+                from -= sub_d;
+            }
+            ok = decompress_partial(reader, ctx, f, (uint8_t*)buf + copied,
+                len, from, src, frame_csize, errbuf);
+        }
+        if (!ok)
+            goto fail_w_ctx;
+        copied += len;
+    }
+
+    ctx_release(reader, own, ctx);
+
+    return copied;
+
+fail_w_ctx:
+    ctx_release(reader, own, ctx);
     return -1;
 }
 
-static ssize_t zseek_pread_zstd(zseek_reader_t *reader, void *buf, size_t count,
-    size_t offset, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+static ssize_t pread_step(zseek_reader_t *reader, zseek_dctx_t *own,
+    void *buf, size_t count, size_t offset, bool multi, bool nocache,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!reader->cache || nocache)
+        return pread_no_cache_step(reader, own, buf, count, offset, multi,
+            nocache, call_data, errbuf);
+
+    return pread_cached_step(reader, own, buf, count, offset, multi,
+        call_data, errbuf);
+}
+
+/**
+ * zseek_pread_flags(), decompressing with the context @p own (if not @a NULL,
+ * see ctx_acquire()), and tracking readahead in @p ra (the reader's if
+ * @a NULL)
+ */
+static ssize_t pread_flags(zseek_reader_t *reader, zseek_dctx_t *own,
+    zseek_ra_stream_t *ra, void *buf, size_t count, size_t offset,
+    unsigned flags, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    bool nocache = flags & ZSEEK_PREAD_NOCACHE;
+    if (reader->readahead_max > 0 && !nocache) {
+        // Without ZSEEK_PREAD_FULL, a read ends in its first frame
+        size_t last_offset = offset;
+        if ((flags & ZSEEK_PREAD_FULL) && count > 0)
+            last_offset = offset + count - 1;
+        readahead_note(reader, ra ? ra : &reader->ra, offset, last_offset,
+            call_data);
+    }
+
+    if (!(flags & ZSEEK_PREAD_FULL))
+        return pread_step(reader, own, buf, count, offset, false, nocache,
+            call_data, errbuf);
+
+    size_t total = 0;
+    while (total < count) {
+        ssize_t r = pread_step(reader, own, (uint8_t*)buf + total,
+            count - total, offset + total, true, nocache, call_data, errbuf);
+        if (r == -1)
+            return -1;
+        if (r == 0)
+            // EOF
+            break;
+        total += r;
+    }
+
+    return total;
+}
+
+ssize_t zseek_pread_flags(zseek_reader_t *reader, void *buf, size_t count,
+    size_t offset, unsigned flags, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!reader) {
+        set_error(errbuf, "invalid reader");
+        return -1;
+    }
+
+    return pread_flags(reader, NULL, NULL, buf, count, offset, flags,
+        call_data, errbuf);
+}
+
+ssize_t zseek_pread(zseek_reader_t *reader, void *buf, size_t count,
+    size_t offset, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    return zseek_pread_flags(reader, buf, count, offset, 0, call_data, errbuf);
+}
+
+/**
+ * The part of a zseek_preadv() request that falls within a single frame
+ */
+typedef struct {
+    size_t frame_idx;
+    size_t offset_in_frame;
+    void *dst;
+    size_t len;
+} preadv_slice_t;
+
+typedef struct {
+    zseek_reader_t *reader;
+    const preadv_slice_t *slices;
+    // Slices of the n-th distinct frame are [groups[n], groups[n + 1])
+    const size_t *groups;
+    void *call_data;
+
+    atomic_bool failed;
+    char *errbuf;
+} preadv_state_t;
+
+static int slice_cmp(const void *a, const void *b)
+{
+    const preadv_slice_t *sa = a;
+    const preadv_slice_t *sb = b;
+    return (sa->frame_idx > sb->frame_idx) - (sa->frame_idx < sb->frame_idx);
+}
+
+static void copy_slices(const preadv_slice_t *slices, size_t nb_slices,
+    const void *frame_data)
+{
+    for (size_t s = 0; s < nb_slices; s++)
+        memcpy(slices[s].dst,
+            (const uint8_t*)frame_data + slices[s].offset_in_frame,
+            slices[s].len);
+}
+
+/**
+ * Report the first error of a zseek_preadv() call
+ */
+static void preadv_fail(preadv_state_t *ps, const char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!atomic_exchange(&ps->failed, true) && ps->errbuf)
+        memcpy(ps->errbuf, errbuf, ZSEEK_ERRBUF_SIZE);
+}
+
+/**
+ * Serve all the slices of the @p group -th distinct frame of a zseek_preadv()
+ * call. See cache_lookup() for @p retry.
+ */
+static void serve_group(preadv_state_t *ps, size_t group, bool retry)
+{
+    zseek_reader_t *reader = ps->reader;
+    const preadv_slice_t *slices = ps->slices + ps->groups[group];
+    size_t nb_slices = ps->groups[group + 1] - ps->groups[group];
+    size_t frame_idx = slices[0].frame_idx;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    if (atomic_load(&ps->failed))
+        return;
+
+    zseek_inflight_t marker;
+    if (reader->cache) {
+        for (;; retry = true) {
+            zseek_frame_t frame = cache_lookup(reader, frame_idx, retry);
+            if (frame.data) {
+                copy_slices(slices, nb_slices, frame.data);
+                zseek_cache_unpin(reader->cache, frame_idx);
+                return;
+            }
+
+            int r = miss_begin(reader, &marker, frame_idx, errbuf);
+            if (r == -1)
+                goto fail;
+            if (r == 1)
+                break;
+        }
+    }
+
+    // TODO OPT: Without a cache, only decompress up to the last slice?
+    void *dbuf;
+    if (!load_frames(reader, NULL, frame_idx, frame_idx, &dbuf, ps->call_data,
+        errbuf))
+        goto fail_w_marker;
+    copy_slices(slices, nb_slices, dbuf);
+
+    if (reader->cache) {
+        zseek_frame_t frame = {dbuf, frame_idx,
+            frame_size_d(reader->st, frame_idx)};
+        if (!zseek_cache_insert(reader->cache, frame))
+            zseek_frame_pool_put(reader->frames, frame.data, frame.len);
+        miss_finish(reader, &marker, 1);
+    } else {
+        zseek_frame_pool_put(reader->frames, dbuf,
+            frame_size_d(reader->st, frame_idx));
+    }
+
+    return;
+
+fail_w_marker:
+    if (reader->cache)
+        miss_finish(reader, &marker, 1);
+fail:
+    // Report the first error only
+    preadv_fail(ps, errbuf);
+}
+
+static void preadv_group(void *arg, size_t group)
+{
+    serve_group(arg, group, false);
+}
+
+/**
+ * A frame of a zseek_preadv() call fetched with a batch read
+ */
+typedef struct {
+    zseek_task_t task;
+    struct preadv_batch *pb;
+    size_t group;
+    zseek_inflight_t marker;
+} preadv_fetch_t;
+
+/**
+ * A batch read of the frames of a zseek_preadv() call. Frames are decompressed
+ * on the workers (if any) as they arrive.
+ */
+typedef struct preadv_batch {
+    preadv_state_t *ps;
+    zseek_read_req_t *reqs;
+    preadv_fetch_t *fetches;
+    // Groups fetched by someone else, served once the batch is done
+    size_t *deferred;
+    size_t nb_deferred;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t pending;     // Fetched and not decompressed yet
+    uint64_t start;     // Of the current batch, see event_start()
+} preadv_batch_t;
+
+/**
+ * Decompress a frame fetched by a batch read, serve its slices and cache it.
+ * Runs on a worker, if any.
+ */
+static void preadv_decompress(void *arg)
+{
+    preadv_fetch_t *fetch = arg;
+    preadv_batch_t *pb = fetch->pb;
+    preadv_state_t *ps = pb->ps;
+    zseek_reader_t *reader = ps->reader;
+    zseek_read_req_t *req = &pb->reqs[fetch - pb->fetches];
+    const preadv_slice_t *slices = ps->slices + ps->groups[fetch->group];
+    size_t nb_slices = ps->groups[fetch->group + 1] - ps->groups[fetch->group];
+    size_t frame_idx = slices[0].frame_idx;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    if (req->result != (ssize_t)req->size) {
+        if (req->result >= 0)
+            set_error(errbuf, "unexpected EOF");
+        else
+            // TODO OPT: Use errno if user_file.pread_batch sets it
+            set_error(errbuf, "read file failed");
+        goto fail;
+    }
+    note_event(reader, ZSEEK_EVENT_FETCH, frame_idx, req->size, pb->start);
+    if (atomic_load(&ps->failed))
+        goto out;
+
+    zseek_dctx_t *ctx = pool_acquire(reader, errbuf);
+    if (!ctx)
+        goto fail;
+    size_t frame_dsize = frame_size_d(reader->st, frame_idx);
+    void *dbuf = zseek_frame_pool_get(reader->frames, frame_dsize);
+    if (!dbuf) {
+        set_error_with_errno(errbuf, "allocate decompressed buffer", errno);
+        pool_release(reader, ctx);
+        goto fail;
+    }
+    bool ok = decompress_frame(reader, ctx, frame_idx, dbuf, frame_dsize,
+        req->data, req->size, errbuf);
+    pool_release(reader, ctx);
+    if (!ok) {
+        zseek_frame_pool_put(reader->frames, dbuf, frame_dsize);
+        goto fail;
+    }
+    copy_slices(slices, nb_slices, dbuf);
+
+    zseek_frame_t frame = {dbuf, frame_idx, frame_dsize};
+    if (!reader->cache || !zseek_cache_insert(reader->cache, frame))
+        zseek_frame_pool_put(reader->frames, dbuf, frame_dsize);
+    // Hand the compressed frame over to the compressed cache, if any
+    zseek_frame_t cframe = {req->data, frame_idx, req->size};
+    if (reader->ccache && zseek_cache_insert(reader->ccache, cframe))
+        req->data = NULL;
+    goto out;
+
+fail:
+    preadv_fail(ps, errbuf);
+out:
+    if (reader->cache)
+        miss_finish(reader, &fetch->marker, 1);
+    free(req->data);
+
+    pthread_mutex_lock(&pb->lock);
+    pb->pending--;
+    pthread_cond_broadcast(&pb->cond);
+    pthread_mutex_unlock(&pb->lock);
+}
+
+/**
+ * Hand a frame fetched by a batch read off for decompression
+ */
+static void preadv_fetched(zseek_read_req_t *req, void *arg)
 {
-    // TODO OPT: Try to return as much as possible (multiple frames), to avoid
-    // the repeated fs read and zseek_read overhead?
+    preadv_batch_t *pb = arg;
+    preadv_fetch_t *fetch = &pb->fetches[req - pb->reqs];
+
+    if (zseek_thread_pool_workers(pb->ps->reader->workers) > 0) {
+        fetch->task = (zseek_task_t){preadv_decompress, fetch, NULL};
+        zseek_thread_pool_submit(pb->ps->reader->workers, &fetch->task);
+    } else {
+        preadv_decompress(fetch);
+    }
+}
 
-    if (!reader->cache)
-        return zseek_pread_zstd_no_cache(reader, buf, count, offset, call_data,
-            errbuf);
+static void preadv_deferred_group(void *arg, size_t d)
+{
+    preadv_batch_t *pb = arg;
+    // NOTE: Looked up already, when deferred
+    serve_group(pb->ps, pb->deferred[d], true);
+}
 
-    ssize_t frame_idx = offset_to_frame_idx(reader->st, offset);
-    if (frame_idx == -1)
-        return 0;
+/**
+ * Serve the @p nb_groups groups of a zseek_preadv() call with batch reads of at
+ * most COALESCE_MAX_FRAMES frames (or COALESCE_MAX_SIZE bytes) each, keeping
+ * the reads in flight and decompressing frames as they arrive.
+ */
+static void preadv_batched(preadv_state_t *ps, size_t nb_groups)
+{
+    zseek_reader_t *reader = ps->reader;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
 
-    int pr = pthread_rwlock_rdlock(&reader->lock);
+    preadv_batch_t pb = {.ps = ps};
+    int pr = pthread_mutex_init(&pb.lock, NULL);
     if (pr) {
-        set_error_with_errno(errbuf, "lock for reading", pr);
+        set_error_with_errno(errbuf, "initialize batch lock", pr);
         goto fail;
     }
+    pr = pthread_cond_init(&pb.cond, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize batch condition", pr);
+        goto fail_w_lock;
+    }
+    size_t max_reqs = MIN(nb_groups, COALESCE_MAX_FRAMES);
+    pb.reqs = malloc(max_reqs * sizeof(pb.reqs[0]));
+    pb.fetches = malloc(max_reqs * sizeof(pb.fetches[0]));
+    pb.deferred = malloc(nb_groups * sizeof(pb.deferred[0]));
+    if (!pb.reqs || !pb.fetches || !pb.deferred) {
+        set_error_with_errno(errbuf, "allocate batch", errno);
+        goto fail_w_batch;
+    }
 
-    void *dbuf = NULL;
-    zseek_frame_t frame = zseek_cache_find(reader->cache, frame_idx);
-    if (!frame.data) {
-        // Upgrade to write lock
-        pr = pthread_rwlock_unlock(&reader->lock);
-        if (pr) {
-            set_error_with_errno(errbuf, "unlock to upgrade", pr);
-            goto fail;
-        }
-        pr = pthread_rwlock_wrlock(&reader->lock);
-        if (pr) {
-            set_error_with_errno(errbuf, "lock for writing", pr);
-            goto fail;
-        }
-
-        frame = zseek_cache_find(reader->cache, frame_idx);
-        if (!frame.data) {
-            // Resize compressed buffer
-            size_t frame_csize = frame_size_c(reader->st, frame_idx);
-            if (!zseek_buffer_resize(reader->cbuf, frame_csize)) {
-                set_error(errbuf, "resize compressed buffer");
-                goto fail_w_lock;
+    size_t g = 0;
+    while (g < nb_groups && !atomic_load(&ps->failed)) {
+        // Claim the frames of the next batch
+        size_t nb_reqs = 0;
+        size_t batch_csize = 0;
+        for (; g < nb_groups && nb_reqs < max_reqs; g++) {
+            size_t frame_idx = ps->slices[ps->groups[g]].frame_idx;
+            size_t csize = frame_size_c(reader->st, frame_idx);
+            if (nb_reqs > 0 && batch_csize + csize > COALESCE_MAX_SIZE)
+                break;
+
+            preadv_fetch_t *fetch = &pb.fetches[nb_reqs];
+            if (reader->cache) {
+                zseek_frame_t frame = cache_lookup(reader, frame_idx, false);
+                if (frame.data) {
+                    const preadv_slice_t *slices = ps->slices + ps->groups[g];
+                    copy_slices(slices, ps->groups[g + 1] - ps->groups[g],
+                        frame.data);
+                    zseek_cache_unpin(reader->cache, frame_idx);
+                    continue;
+                }
+            }
+            if (reader->ccache &&
+                zseek_cache_find(reader->ccache, frame_idx).data) {
+                // Needs no read, served from the compressed cache later
+                pb.deferred[pb.nb_deferred++] = g;
+                continue;
             }
-            void *cbuf_data = zseek_buffer_data(reader->cbuf);
-            assert(cbuf_data);
-
-            // Read compressed frame
-            off_t frame_offset = frame_offset_c(reader->st, frame_idx);
-            ssize_t _read = reader->user_file.pread(cbuf_data, frame_csize,
-                (size_t)frame_offset, reader->user_file.user_data, call_data);
-            if (_read != (ssize_t)frame_csize) {
-                if (_read >= 0)
-                    set_error(errbuf, "unexpected EOF");
-                else
-                    // TODO OPT: Use errno if user_file.pread sets it
-                    set_error(errbuf, "read file failed");
-                goto fail_w_lock;
+            // NOTE: Never wait for others while holding claims
+            if (reader->cache &&
+                !miss_try_begin(reader, &fetch->marker, frame_idx)) {
+                pb.deferred[pb.nb_deferred++] = g;
+                continue;
             }
 
-            // Decompress frame
-            size_t frame_dsize = frame_size_d(reader->st, frame_idx);
-            dbuf = malloc(frame_dsize);
-            if (!dbuf) {
-                set_error_with_errno(errbuf, "allocate decompressed buffer",
+            void *cbuf = malloc(csize);
+            if (!cbuf) {
+                set_error_with_errno(errbuf, "allocate compressed buffer",
                     errno);
-                goto fail_w_lock;
-            }
-            size_t r = ZSTD_decompressDCtx(reader->dctx_zstd, dbuf, frame_dsize,
-                cbuf_data, frame_csize);
-            if (ZSTD_isError(r)) {
-                set_error(errbuf, "%s: %s", "decompress frame",
-                    ZSTD_getErrorName(r));
-                goto fail_w_dbuf;
+                preadv_fail(ps, errbuf);
+                if (reader->cache)
+                    miss_finish(reader, &fetch->marker, 1);
+                break;
             }
+            pb.reqs[nb_reqs] = (zseek_read_req_t){cbuf, csize,
+                frame_offset_c(reader->st, frame_idx), 0};
+            fetch->pb = &pb;
+            fetch->group = g;
+            nb_reqs++;
+            batch_csize += csize;
+        }
 
-            // Cache frame
-            frame.data = dbuf;
-            frame.idx = frame_idx;
-            frame.len = frame_dsize;
-            if (!zseek_cache_insert(reader->cache, frame)) {
-                set_error(errbuf, "frame caching failed");
-                goto fail_w_dbuf;
-            }
+        pthread_mutex_lock(&pb.lock);
+        pb.pending += nb_reqs;
+        pthread_mutex_unlock(&pb.lock);
+        if (nb_reqs > 0) {
+            pb.start = event_start(reader);
+            note_preads(reader, nb_reqs);
+            reader->user_file.pread_batch(pb.reqs, nb_reqs, preadv_fetched,
+                &pb, reader->user_file.user_data, ps->call_data);
         }
+
+        pthread_mutex_lock(&pb.lock);
+        while (pb.pending > 0)
+            pthread_cond_wait(&pb.cond, &pb.lock);
+        pthread_mutex_unlock(&pb.lock);
     }
 
-    size_t offset_in_frame = offset - frame_offset_d(reader->st, frame_idx);
-    size_t to_copy = MIN(count, frame.len - offset_in_frame);
-    memcpy(buf, (uint8_t*)frame.data + offset_in_frame, to_copy);
+    // Frames cached or fetched by others in the meantime
+    zseek_thread_pool_run(reader->workers, pb.nb_deferred,
+        preadv_deferred_group, &pb);
 
-    pr = pthread_rwlock_unlock(&reader->lock);
-    if (pr) {
-        set_error_with_errno(errbuf, "unlock", pr);
-        goto fail;
-    }
+    free(pb.deferred);
+    free(pb.fetches);
+    free(pb.reqs);
+    pthread_cond_destroy(&pb.cond);
+    pthread_mutex_destroy(&pb.lock);
 
-    return to_copy;
+    return;
 
-fail_w_dbuf:
-    free(dbuf);
+fail_w_batch:
+    free(pb.deferred);
+    free(pb.fetches);
+    free(pb.reqs);
+    pthread_cond_destroy(&pb.cond);
 fail_w_lock:
-    pthread_rwlock_unlock(&reader->lock);
+    pthread_mutex_destroy(&pb.lock);
 fail:
-    return -1;
+    preadv_fail(ps, errbuf);
 }
 
-static ssize_t zseek_pread_lz4_no_cache(zseek_reader_t *reader, void *buf,
-    size_t count, size_t offset, void *call_data,
-    char errbuf[ZSEEK_ERRBUF_SIZE])
+ssize_t zseek_preadv(zseek_reader_t *reader, const zseek_iovec_t *reqs,
+    size_t n, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    // TODO OPT: Use the cache, only for reading?
+    if (!reader) {
+        set_error(errbuf, "invalid reader");
+        return -1;
+    }
 
-    ssize_t frame_idx = offset_to_frame_idx(reader->st, offset);
-    if (frame_idx == -1)
+    if (n > 0 && !reqs) {
+        set_error(errbuf, "invalid requests");
+        return -1;
+    }
+
+    // Count the slices, clamping requests to EOF, and load their frames
+    size_t nb_frames = seek_table_entries(reader->st);
+    size_t nb_slices = 0;
+    size_t hint = 0;
+    for (size_t r = 0; r < n; r++) {
+        if (reqs[r].len == 0)
+            continue;
+        ssize_t first = frame_idx_hinted(reader, reqs[r].offset, hint,
+            call_data);
+        if (first == -1)
+            continue;
+        ssize_t last = -2;
+        if (first != -2)
+            last = frame_idx_hinted(reader, reqs[r].offset + reqs[r].len - 1,
+                first, call_data);
+        if (last == -1)
+            last = nb_frames - 1;
+        if (last == -2 ||
+            !seek_table_load(reader->st, first, last + 1, call_data)) {
+            set_error(errbuf, "load seek table failed");
+            goto fail;
+        }
+        nb_slices += last - first + 1;
+        hint = last;
+    }
+    if (nb_slices == 0)
         return 0;
 
-    int pr = pthread_rwlock_wrlock(&reader->lock);
-    if (pr) {
-        set_error_with_errno(errbuf, "lock for writing", pr);
+    // Split requests in slices
+    preadv_slice_t *slices = malloc(nb_slices * sizeof(slices[0]));
+    if (!slices) {
+        set_error_with_errno(errbuf, "allocate slices", errno);
         goto fail;
     }
+    size_t total = 0;
+    size_t s = 0;
+    bool sorted = true;
+    hint = 0;
+    for (size_t r = 0; r < n; r++) {
+        if (reqs[r].len == 0)
+            continue;
+        size_t offset = reqs[r].offset;
+        size_t end = offset + reqs[r].len;
+        uint8_t *dst = reqs[r].buf;
+        ssize_t found = frame_idx_hinted(reader, offset, hint, call_data);
+        // NOTE: The frames are loaded already
+        assert(found != -2);
+        if (found == -1)
+            continue;
+        size_t frame_idx = found;
+        if (s > 0 && frame_idx < slices[s - 1].frame_idx)
+            sorted = false;
+        while (offset < end && frame_idx < nb_frames) {
+            size_t frame_start = frame_offset_d(reader->st, frame_idx);
+            size_t len = MIN(end - offset,
+                frame_start + frame_size_d(reader->st, frame_idx) - offset);
+            slices[s++] = (preadv_slice_t){frame_idx, offset - frame_start,
+                dst, len};
+            dst += len;
+            offset += len;
+            frame_idx++;
+        }
+        total += offset - reqs[r].offset;
+        hint = slices[s - 1].frame_idx;
+    }
+    assert(s == nb_slices);
+
+    // Group by frame
+    if (!sorted)
+        qsort(slices, nb_slices, sizeof(slices[0]), slice_cmp);
+    size_t nb_groups = 1;
+    for (s = 1; s < nb_slices; s++)
+        if (slices[s].frame_idx != slices[s - 1].frame_idx)
+            nb_groups++;
+    size_t *groups = malloc((nb_groups + 1) * sizeof(groups[0]));
+    if (!groups) {
+        set_error_with_errno(errbuf, "allocate slice groups", errno);
+        goto fail_w_slices;
+    }
+    size_t g = 0;
+    groups[g++] = 0;
+    for (s = 1; s < nb_slices; s++)
+        if (slices[s].frame_idx != slices[s - 1].frame_idx)
+            groups[g++] = s;
+    groups[g] = nb_slices;
+
+    // Load each distinct frame once, in parallel if there are workers
+    preadv_state_t ps = {
+        .reader = reader,
+        .slices = slices,
+        .groups = groups,
+        .call_data = call_data,
+        .errbuf = errbuf,
+    };
+    atomic_init(&ps.failed, false);
+    if (reader->user_file.pread_batch)
+        preadv_batched(&ps, nb_groups);
+    else
+        zseek_thread_pool_run(reader->workers, nb_groups, preadv_group, &ps);
+    if (atomic_load(&ps.failed))
+        goto fail_w_groups;
+
+    free(groups);
+    free(slices);
+
+    return total;
+
+fail_w_groups:
+    free(groups);
+fail_w_slices:
+    free(slices);
+fail:
+    return -1;
+}
 
-    // Resize compressed buffer
-    size_t frame_csize = frame_size_c(reader->st, frame_idx);
-    if (!zseek_buffer_resize(reader->cbuf, frame_csize)) {
-        set_error(errbuf, "resize compressed buffer");
-        goto fail_w_lock;
+ssize_t zseek_pread_ref(zseek_reader_t *reader, size_t offset,
+    zseek_frame_ref_t *ref, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!reader) {
+        set_error(errbuf, "invalid reader");
+        return -1;
     }
-    void *cbuf_data = zseek_buffer_data(reader->cbuf);
-    assert(cbuf_data);
-    // Read compressed frame
-    off_t frame_offset = frame_offset_c(reader->st, frame_idx);
-    ssize_t _read = reader->user_file.pread(cbuf_data, frame_csize,
-        (size_t)frame_offset, reader->user_file.user_data, call_data);
-    if (_read != (ssize_t)frame_csize) {
-        if (_read >= 0)
-            set_error(errbuf, "unexpected EOF");
-        else
-            // TODO OPT: Use errno if user_file.pread sets it
-            set_error(errbuf, "read file failed");
-        goto fail_w_lock;
+
+    if (!ref) {
+        set_error(errbuf, "invalid frame reference");
+        return -1;
     }
+    memset(ref, 0, sizeof(*ref));
 
-    // Discard any excess leading data
-    size_t cbuf_offset = 0;
+    ssize_t frame_idx = readahead_frame_idx(reader, &reader->ra, offset,
+        call_data);
+    if (frame_idx == -1)
+        return 0;
+    if (frame_idx == -2) {
+        set_error(errbuf, "load seek table failed");
+        return -1;
+    }
+    if (reader->readahead_max > 0)
+        readahead_note_frames(reader, &reader->ra, frame_idx, frame_idx,
+            call_data);
     size_t offset_in_frame = offset - frame_offset_d(reader->st, frame_idx);
-    if (offset_in_frame > 0) {
-        // Resize discard buffer
-        if (!zseek_buffer_resize(reader->dbuf, offset_in_frame)) {
-            set_error(errbuf, "resize discard buffer");
-            goto fail_w_lock;
-        }
-        void *dbuf_data = zseek_buffer_data(reader->dbuf);
-        assert(dbuf_data);
-        // Decompress discard data
-        size_t dbuf_offset = 0;
-        size_t to_decompress = offset_in_frame;
-        do {
-            size_t csize = frame_csize - cbuf_offset;
-            size_t dsize = to_decompress - dbuf_offset;
-            LZ4F_decompressOptions_t opts = { .stableDst = 0 };
-            size_t r = LZ4F_decompress(reader->dctx_lz4,
-                (uint8_t*)dbuf_data + dbuf_offset, &dsize,
-                (uint8_t*)cbuf_data + cbuf_offset, &csize,
-                &opts); // NOTE: Overwrites dsize, csize.
-            if (LZ4F_isError(r)) {
-                set_error(errbuf, "%s: %s", "decompress discard data",
-                    LZ4F_getErrorName(r));
-                goto fail_w_lock;
+    size_t frame_dsize = frame_size_d(reader->st, frame_idx);
+
+    zseek_inflight_t marker;
+    if (reader->cache) {
+        for (bool retry = false;; retry = true) {
+            zseek_frame_t frame = cache_lookup(reader, frame_idx, retry);
+            if (frame.data) {
+                ref->data = (uint8_t*)frame.data + offset_in_frame;
+                ref->len = frame.len - offset_in_frame;
+                ref->frame_idx = frame_idx;
+                return ref->len;
             }
-            cbuf_offset += csize;
-            dbuf_offset += dsize;
-        } while (dbuf_offset < to_decompress);
-    }
 
-    // Decompress user data
-    size_t buf_offset = 0;
-    size_t frame_dsize = frame_size_d(reader->st, frame_idx);
-    size_t to_decompress = MIN(count, frame_dsize - offset_in_frame);
-    do {
-        size_t csize = frame_csize - cbuf_offset;
-        size_t dsize = to_decompress - buf_offset;
-        LZ4F_decompressOptions_t opts = { .stableDst = 0 };
-        size_t r = LZ4F_decompress(reader->dctx_lz4,
-            (uint8_t*)buf + buf_offset, &dsize,
-            (uint8_t*)cbuf_data + cbuf_offset, &csize,
-            &opts); // NOTE: Overwrites dsize, csize.
-        if (LZ4F_isError(r)) {
-            set_error(errbuf, "%s: %s", "decompress user data",
-                LZ4F_getErrorName(r));
-            goto fail_w_lock;
+            int r = miss_begin(reader, &marker, frame_idx, errbuf);
+            if (r == -1)
+                return -1;
+            if (r == 1)
+                break;
         }
-        cbuf_offset += csize;
-        buf_offset += dsize;
-    } while (buf_offset < to_decompress);
+    }
 
-    if (cbuf_offset < frame_csize) {
-        // Did not consume the whole frame, clean up decompression context
-        LZ4F_resetDecompressionContext(reader->dctx_lz4);
+    void *dbuf;
+    if (!load_frames(reader, NULL, frame_idx, frame_idx, &dbuf, call_data,
+        errbuf))
+        goto fail_w_marker;
+
+    zseek_frame_t frame = {dbuf, frame_idx, frame_dsize};
+    if (!reader->cache || !zseek_cache_insert_pinned(reader->cache, frame))
+        // Not cached, so the reference owns the frame
+        ref->owned = dbuf;
+    if (reader->cache)
+        miss_finish(reader, &marker, 1);
+
+    ref->data = (uint8_t*)dbuf + offset_in_frame;
+    ref->len = frame_dsize - offset_in_frame;
+    ref->frame_idx = frame_idx;
+
+    return ref->len;
+
+fail_w_marker:
+    if (reader->cache)
+        miss_finish(reader, &marker, 1);
+    return -1;
+}
+
+void zseek_frame_release(zseek_reader_t *reader, zseek_frame_ref_t *ref)
+{
+    if (!reader || !ref || !ref->data)
+        return;
+
+    if (ref->owned)
+        zseek_frame_pool_put(reader->frames, ref->owned,
+            frame_size_d(reader->st, ref->frame_idx));
+    else
+        zseek_cache_unpin(reader->cache, ref->frame_idx);
+    memset(ref, 0, sizeof(*ref));
+}
+
+ssize_t zseek_read(zseek_reader_t *reader, void *buf, size_t count,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!reader) {
+        set_error(errbuf, "invalid reader");
+        return -1;
     }
 
-    pr = pthread_rwlock_unlock(&reader->lock);
-    if (pr) {
-        set_error_with_errno(errbuf, "unlock", pr);
+    // NOTE: Concurrent reads may read from the same offset, but all of them
+    // advance it
+    ssize_t ret = pread_flags(reader, NULL, NULL, buf, count,
+        atomic_load(&reader->pos), 0, call_data, errbuf);
+    if (ret > 0)
+        atomic_fetch_add(&reader->pos, ret);
+
+    return ret;
+}
+
+zseek_cursor_t *zseek_cursor_open(zseek_reader_t *reader,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!reader) {
+        set_error(errbuf, "invalid reader");
         goto fail;
     }
 
-    return to_decompress;
-
-fail_w_lock:
-    pthread_rwlock_unlock(&reader->lock);
+    zseek_cursor_t *cursor = malloc(sizeof(*cursor));
+    if (!cursor) {
+        set_error_with_errno(errbuf, "allocate cursor", errno);
+        goto fail;
+    }
+    cursor->reader = reader;
+    cursor->pos = 0;
+    if (!ra_stream_init(&cursor->ra, reader, errbuf))
+        goto fail_w_cursor;
+    cursor->ctx = dctx_new(reader->type, reader->ddict, errbuf);
+    if (!cursor->ctx)
+        goto fail_w_ra;
+    atomic_fetch_add(&reader->nb_cursors, 1);
+
+    return cursor;
+
+fail_w_ra:
+    ra_stream_destroy(&cursor->ra);
+fail_w_cursor:
+    free(cursor);
 fail:
-    return -1;
+    return NULL;
 }
 
-static ssize_t zseek_pread_lz4(zseek_reader_t *reader, void *buf, size_t count,
-    size_t offset, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+bool zseek_cursor_close(zseek_cursor_t *cursor, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    // TODO OPT: Try to return as much as possible (multiple frames), to avoid
-    // the repeated fs read and zseek_read overhead?
+    if (!cursor)
+        return true;
 
-    if (!reader->cache)
-        return zseek_pread_lz4_no_cache(reader, buf, count, offset, call_data,
-            errbuf);
+    zseek_reader_t *reader = cursor->reader;
+    ra_stream_destroy(&cursor->ra);
 
-    ssize_t frame_idx = offset_to_frame_idx(reader->st, offset);
-    if (frame_idx == -1)
-        return 0;
+    bool ok = dctx_free(reader->type, cursor->ctx, errbuf);
+    atomic_fetch_sub(&reader->nb_cursors, 1);
+    free(cursor);
 
-    int pr = pthread_rwlock_rdlock(&reader->lock);
-    if (pr) {
-        set_error_with_errno(errbuf, "lock for reading", pr);
-        goto fail;
+    return ok;
+}
+
+ssize_t zseek_cursor_pread(zseek_cursor_t *cursor, void *buf, size_t count,
+    size_t offset, unsigned flags, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!cursor) {
+        set_error(errbuf, "invalid cursor");
+        return -1;
     }
 
-    void *dbuf = NULL;
-    zseek_frame_t frame = zseek_cache_find(reader->cache, frame_idx);
-    if (!frame.data) {
-        // Upgrade to write lock
-        pr = pthread_rwlock_unlock(&reader->lock);
-        if (pr) {
-            set_error_with_errno(errbuf, "unlock to upgrade", pr);
-            goto fail;
-        }
-        pr = pthread_rwlock_wrlock(&reader->lock);
-        if (pr) {
-            set_error_with_errno(errbuf, "lock for writing", pr);
-            goto fail;
-        }
+    return pread_flags(cursor->reader, cursor->ctx, &cursor->ra, buf, count,
+        offset, flags, call_data, errbuf);
+}
 
-        frame = zseek_cache_find(reader->cache, frame_idx);
-        if (!frame.data) {
-            // Resize compressed buffer
-            size_t frame_csize = frame_size_c(reader->st, frame_idx);
-            if (!zseek_buffer_resize(reader->cbuf, frame_csize)) {
-                set_error(errbuf, "resize compressed buffer");
-                goto fail_w_lock;
-            }
-            void *cbuf_data = zseek_buffer_data(reader->cbuf);
-            assert(cbuf_data);
-
-            // Read compressed frame
-            off_t frame_offset = frame_offset_c(reader->st, frame_idx);
-            ssize_t _read = reader->user_file.pread(cbuf_data, frame_csize,
-                (size_t)frame_offset, reader->user_file.user_data, call_data);
-            if (_read != (ssize_t)frame_csize) {
-                if (_read >= 0)
-                    set_error(errbuf, "unexpected EOF");
-                else
-                    // TODO OPT: Use errno if user_file.pread sets it
-                    set_error(errbuf, "read file failed");
-                goto fail_w_lock;
-            }
+ssize_t zseek_cursor_read(zseek_cursor_t *cursor, void *buf, size_t count,
+    unsigned flags, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    ssize_t ret = zseek_cursor_pread(cursor, buf, count,
+        cursor ? cursor->pos : 0, flags, call_data, errbuf);
+    if (ret > 0)
+        cursor->pos += ret;
 
-            // Decompress frame
-            size_t frame_dsize = frame_size_d(reader->st, frame_idx);
-            dbuf = malloc(frame_dsize);
-            if (!dbuf) {
-                set_error_with_errno(errbuf, "allocate decompressed buffer",
-                    errno);
-                goto fail_w_lock;
-            }
-            size_t cbuf_offset = 0;
-            size_t dbuf_offset = 0;
-            size_t r = 0;
-            do {
-                size_t csize = frame_csize - cbuf_offset;
-                size_t dsize = frame_dsize - dbuf_offset;
-                LZ4F_decompressOptions_t opts = { .stableDst = 0 };
-                // NOTE: In theory, LZ4F_decompress may not finish the whole
-                // frame in one call (r > 0). In practice, this does not happen
-                // given enough room in the output buffer (e.g. here).
-                r = LZ4F_decompress(reader->dctx_lz4,
-                    (uint8_t*)dbuf + dbuf_offset, &dsize,
-                    (uint8_t*)cbuf_data + cbuf_offset, &csize,
-                    &opts); // NOTE: Overwrites dsize, csize.
-                if (LZ4F_isError(r)) {
-                    set_error(errbuf, "%s: %s", "decompress frame",
-                        LZ4F_getErrorName(r));
-                    goto fail_w_dbuf;
-                }
-                cbuf_offset += csize;
-                dbuf_offset += dsize;
-            } while (r > 0);
-
-            // Cache frame
-            frame.data = dbuf;
-            frame.idx = frame_idx;
-            frame.len = frame_dsize;
-            if (!zseek_cache_insert(reader->cache, frame)) {
-                set_error(errbuf, "frame caching failed");
-                goto fail_w_dbuf;
-            }
+    return ret;
+}
+
+void zseek_cursor_seek(zseek_cursor_t *cursor, size_t offset)
+{
+    cursor->pos = offset;
+}
+
+size_t zseek_cursor_tell(const zseek_cursor_t *cursor)
+{
+    return cursor->pos;
+}
+
+/**
+ * Shared state of a zseek_reader_decompress_range() call
+ */
+typedef struct {
+    zseek_reader_t *reader;
+    // Decompressed range [offset, end), in frames [first, last]
+    size_t offset;
+    size_t end;
+    size_t last;
+    uint8_t *buf;
+    zseek_sink_t sink;
+    void *sink_data;
+    void *call_data;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next;        // Next frame to claim
+    // With a sink, frames in [delivered, delivered + nb_window) are claimable,
+    // and held in window (by index modulo nb_window) until delivered
+    size_t delivered;
+    bool delivering;    // Some thread is calling the sink
+    void **window;
+    size_t nb_window;
+
+    atomic_bool failed;
+    char *errbuf;
+} bulk_state_t;
+
+/**
+ * Report the first error of a zseek_reader_decompress_range() call, and wake up
+ * the threads waiting to claim frames
+ */
+static void bulk_fail(bulk_state_t *bs, const char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!atomic_exchange(&bs->failed, true) && bs->errbuf)
+        memcpy(bs->errbuf, errbuf, ZSEEK_ERRBUF_SIZE);
+
+    pthread_mutex_lock(&bs->lock);
+    pthread_cond_broadcast(&bs->cond);
+    pthread_mutex_unlock(&bs->lock);
+}
+
+/**
+ * Return the part of frame @p frame_idx within the range of @p bs, as an
+ * offset in the frame (@p from) and a length
+ */
+static size_t bulk_span(bulk_state_t *bs, size_t frame_idx, size_t *from)
+{
+    size_t start = frame_offset_d(bs->reader->st, frame_idx);
+    size_t end = start + frame_size_d(bs->reader->st, frame_idx);
+    *from = bs->offset > start ? bs->offset - start : 0;
+    return MIN(end, bs->end) - start - *from;
+}
+
+/**
+ * Hand decompressed frame @p frame_idx at @p data over for delivery to the
+ * sink, delivering all frames ready in order unless another thread is at it
+ */
+static void bulk_deliver(bulk_state_t *bs, size_t frame_idx, void *data)
+{
+    zseek_reader_t *reader = bs->reader;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    pthread_mutex_lock(&bs->lock);
+    bs->window[frame_idx % bs->nb_window] = data;
+    if (bs->delivering) {
+        pthread_mutex_unlock(&bs->lock);
+        return;
+    }
+    bs->delivering = true;
+    for (;;) {
+        size_t f = bs->delivered;
+        void **slot = &bs->window[f % bs->nb_window];
+        if (f > bs->last || !*slot || atomic_load(&bs->failed))
+            break;
+        data = *slot;
+        pthread_mutex_unlock(&bs->lock);
+
+        // NOTE: Delivering one at a time keeps the sink calls in order
+        size_t from;
+        size_t len = bulk_span(bs, f, &from);
+        bool ok = bs->sink((const uint8_t*)data + from, len,
+            frame_offset_d(reader->st, f) + from, bs->sink_data);
+        zseek_frame_pool_put(reader->frames, data, frame_size_d(reader->st, f));
+
+        pthread_mutex_lock(&bs->lock);
+        *slot = NULL;
+        bs->delivered++;
+        pthread_cond_broadcast(&bs->cond);
+        if (!ok) {
+            // NOTE: Still delivering, so that no one else calls the sink
+            pthread_mutex_unlock(&bs->lock);
+            set_error(errbuf, "sink failed");
+            bulk_fail(bs, errbuf);
+            return;
         }
     }
+    bs->delivering = false;
+    pthread_mutex_unlock(&bs->lock);
+}
 
-    size_t offset_in_frame = offset - frame_offset_d(reader->st, frame_idx);
-    size_t to_copy = MIN(count, frame.len - offset_in_frame);
-    memcpy(buf, (uint8_t*)frame.data + offset_in_frame, to_copy);
+/**
+ * Claim and decompress frames of a zseek_reader_decompress_range() call until
+ * none are left. Runs on each thread taking part.
+ */
+static void bulk_job(void *arg, size_t job)
+{
+    (void)job;
 
-    pr = pthread_rwlock_unlock(&reader->lock);
-    if (pr) {
-        set_error_with_errno(errbuf, "unlock", pr);
+    bulk_state_t *bs = arg;
+    zseek_reader_t *reader = bs->reader;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    // NOTE: Acquire before claiming, so that claimed frames are never waiting
+    // on a context
+    zseek_dctx_t *ctx = pool_acquire(reader, errbuf);
+    if (!ctx)
         goto fail;
+
+    for (;;) {
+        pthread_mutex_lock(&bs->lock);
+        while (bs->sink && !atomic_load(&bs->failed) && bs->next <= bs->last &&
+            bs->next >= bs->delivered + bs->nb_window)
+            pthread_cond_wait(&bs->cond, &bs->lock);
+        if (atomic_load(&bs->failed) || bs->next > bs->last) {
+            pthread_mutex_unlock(&bs->lock);
+            break;
+        }
+        size_t frame_idx = bs->next++;
+        pthread_mutex_unlock(&bs->lock);
+
+        // NOTE: Streaming through, so not kept in the compressed cache
+        const void *src = fetch_frames(reader, ctx, frame_idx, frame_idx,
+            false, bs->call_data, errbuf);
+        if (!src)
+            goto fail_w_ctx;
+        size_t frame_csize = frame_size_c(reader->st, frame_idx);
+        size_t frame_dsize = frame_size_d(reader->st, frame_idx);
+        size_t from;
+        size_t len = bulk_span(bs, frame_idx, &from);
+        uint8_t *dst = NULL;
+        if (bs->buf)
+            dst = bs->buf + (frame_offset_d(reader->st, frame_idx) + from -
+                bs->offset);
+
+        if (dst && len == frame_dsize) {
+            // Whole frame wanted, straight into place
+            if (!decompress_frame(reader, ctx, frame_idx, dst, frame_dsize,
+                src, frame_csize, errbuf))
+                goto fail_w_ctx;
+            continue;
+        }
+
+        void *dbuf = zseek_frame_pool_get(reader->frames, frame_dsize);
+        if (!dbuf) {
+            set_error_with_errno(errbuf, "allocate decompressed buffer", errno);
+            goto fail_w_ctx;
+        }
+        if (!decompress_frame(reader, ctx, frame_idx, dbuf, frame_dsize, src,
+            frame_csize, errbuf)) {
+            zseek_frame_pool_put(reader->frames, dbuf, frame_dsize);
+            goto fail_w_ctx;
+        }
+        if (dst) {
+            memcpy(dst, (uint8_t*)dbuf + from, len);
+            zseek_frame_pool_put(reader->frames, dbuf, frame_dsize);
+        } else {
+            bulk_deliver(bs, frame_idx, dbuf);
+        }
     }
 
-    return to_copy;
+    pool_release(reader, ctx);
 
-fail_w_dbuf:
-    free(dbuf);
-fail_w_lock:
-    pthread_rwlock_unlock(&reader->lock);
+    return;
+
+fail_w_ctx:
+    pool_release(reader, ctx);
 fail:
-    return -1;
+    bulk_fail(bs, errbuf);
 }
 
-ssize_t zseek_pread(zseek_reader_t *reader, void *buf, size_t count,
-    size_t offset, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+ssize_t zseek_reader_decompress_range(zseek_reader_t *reader, void *buf,
+    size_t count, size_t offset, zseek_sink_t sink, void *sink_data,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
     if (!reader) {
         set_error(errbuf, "invalid reader");
-        return false;
+        return -1;
     }
 
-    switch (reader->type) {
-    case ZSEEK_ZSTD:
-        return zseek_pread_zstd(reader, buf, count, offset, call_data, errbuf);
-    case ZSEEK_LZ4:
-        return zseek_pread_lz4(reader, buf, count, offset, call_data, errbuf);
-    default:
-        // BUG
-        assert(false);
+    if (!buf == !sink) {
+        set_error(errbuf, "invalid destination, need a buffer or a sink");
+        return -1;
+    }
+
+    if (count == 0)
+        return 0;
+
+    // Locate the range, clamping it to EOF
+    size_t nb_frames = seek_table_entries(reader->st);
+    ssize_t first = offset_to_frame_idx(reader->st, offset, call_data);
+    if (first == -1)
+        return 0;
+    size_t end = count > SIZE_MAX - offset ? SIZE_MAX : offset + count;
+    ssize_t last = -2;
+    if (first != -2)
+        last = offset_to_frame_idx(reader->st, end - 1, call_data);
+    if (last == -1)
+        last = nb_frames - 1;
+    if (last == -2 ||
+        !seek_table_load(reader->st, first, last + 1, call_data)) {
+        set_error(errbuf, "load seek table failed");
         return -1;
     }
+    end = MIN(end, (size_t)frame_offset_d(reader->st, last) +
+        frame_size_d(reader->st, last));
+
+    // One job per thread, each holding a context throughout
+    size_t nb_jobs = (size_t)zseek_thread_pool_workers(reader->workers) + 1;
+    nb_jobs = MIN(nb_jobs, DCTX_POOL_MAX);
+    nb_jobs = MIN(nb_jobs, (size_t)(last - first + 1));
+
+    bulk_state_t bs = {
+        .reader = reader,
+        .offset = offset,
+        .end = end,
+        .last = last,
+        .buf = buf,
+        .sink = sink,
+        .sink_data = sink_data,
+        .call_data = call_data,
+        .next = first,
+        .delivered = first,
+        .errbuf = errbuf,
+    };
+    atomic_init(&bs.failed, false);
+    int pr = pthread_mutex_init(&bs.lock, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize bulk lock", pr);
+        goto fail;
+    }
+    pr = pthread_cond_init(&bs.cond, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize bulk condition", pr);
+        goto fail_w_lock;
+    }
+    if (sink) {
+        bs.nb_window = nb_jobs * SINK_WINDOW_PER_JOB;
+        bs.window = calloc(bs.nb_window, sizeof(bs.window[0]));
+        if (!bs.window) {
+            set_error_with_errno(errbuf, "allocate sink window", errno);
+            goto fail_w_cond;
+        }
+    }
+
+    zseek_thread_pool_run(reader->workers, nb_jobs, bulk_job, &bs);
+
+    // Frames left undelivered on error
+    for (size_t w = 0; w < bs.nb_window; w++) {
+        if (!bs.window[w])
+            continue;
+        size_t frame_idx = bs.delivered + (w + bs.nb_window -
+            bs.delivered % bs.nb_window) % bs.nb_window;
+        zseek_frame_pool_put(reader->frames, bs.window[w],
+            frame_size_d(reader->st, frame_idx));
+    }
+    free(bs.window);
+    pthread_cond_destroy(&bs.cond);
+    pthread_mutex_destroy(&bs.lock);
+    if (atomic_load(&bs.failed))
+        return -1;
+
+    return end - offset;
+
+fail_w_cond:
+    pthread_cond_destroy(&bs.cond);
+fail_w_lock:
+    pthread_mutex_destroy(&bs.lock);
+fail:
+    return -1;
 }
 
-ssize_t zseek_read(zseek_reader_t *reader, void *buf, size_t count,
-    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
+ssize_t zseek_reader_decompress_all(zseek_reader_t *reader, zseek_sink_t sink,
+    void *sink_data, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE])
 {
-    ssize_t ret = zseek_pread(reader, buf, count, reader->pos, call_data,
-        errbuf);
-    if (ret > 0)
-        reader->pos += ret;
+    if (!sink) {
+        set_error(errbuf, "invalid sink");
+        return -1;
+    }
 
-    return ret;
+    return zseek_reader_decompress_range(reader, NULL, SIZE_MAX, 0, sink,
+        sink_data, call_data, errbuf);
 }
 
 bool zseek_reader_stats(zseek_reader_t *reader, zseek_reader_stats_t *stats,
@@ -847,36 +2958,38 @@ bool zseek_reader_stats(zseek_reader_t *reader, zseek_reader_stats_t *stats,
         return false;
     }
 
-    int pr = pthread_rwlock_rdlock(&reader->lock);
-    if (pr) {
-        set_error_with_errno(errbuf, "lock for reading", pr);
+    // NOTE: A lazily loaded seek table is scanned to its end for its
+    // decompressed size
+    size_t frames = seek_table_entries(reader->st);
+    if (frames > 0 && !seek_table_load(reader->st, frames - 1, frames, NULL)) {
+        set_error(errbuf, "load seek table failed");
         return false;
     }
 
     size_t seek_table_memory = seek_table_memory_usage(reader->st);
 
-    size_t frames = seek_table_entries(reader->st);
-
     size_t decompressed_size = seek_table_decompressed_size(reader->st);
 
-    size_t cache_memory = zseek_cache_memory_usage(reader->cache);
+    // Includes frame buffers kept for reuse
+    size_t cache_memory = zseek_cache_memory_usage(reader->cache) +
+        zseek_frame_pool_memory_usage(reader->frames);
 
     size_t cached_frames = zseek_cache_entries(reader->cache);
 
-    // NOTE: This is an _estimate_ because the underlying compression lib may
-    // buffer too in its context object.
-    size_t buffer_size = zseek_buffer_capacity(reader->cbuf);
-    buffer_size += zseek_buffer_capacity(reader->dbuf);
-    if (reader->type == ZSEEK_ZSTD) {
-        buffer_size += ZSTD_sizeof_DCtx(reader->dctx_zstd);
-        buffer_size += ZSTD_sizeof_DStream(reader->dstream_zstd);
-    }
+    size_t compressed_cache_memory = zseek_cache_memory_usage(reader->ccache);
+    size_t compressed_cached_frames = zseek_cache_entries(reader->ccache);
 
-    pr = pthread_rwlock_unlock(&reader->lock);
+    // NOTE: This is an _estimate_, see dctx_memory_usage(). Contexts in use
+    // are accounted for as of their last release.
+    int pr = pthread_mutex_lock(&reader->pool_lock);
     if (pr) {
-        set_error_with_errno(errbuf, "unlock", pr);
+        set_error_with_errno(errbuf, "lock pool", pr);
         return false;
     }
+    size_t buffer_size = ZSTD_sizeof_DDict(reader->ddict);
+    for (zseek_dctx_t *ctx = reader->pool_all; ctx; ctx = ctx->all_next)
+        buffer_size += ctx->memory;
+    pthread_mutex_unlock(&reader->pool_lock);
 
     *stats = (zseek_reader_stats_t) {
         .seek_table_memory = seek_table_memory,
@@ -885,7 +2998,48 @@ bool zseek_reader_stats(zseek_reader_t *reader, zseek_reader_stats_t *stats,
         .cache_memory = cache_memory,
         .cached_frames = cached_frames,
         .buffer_size = buffer_size,
+        .compressed_cache_memory = compressed_cache_memory,
+        .compressed_cached_frames = compressed_cached_frames,
     };
 
     return true;
 }
+
+bool zseek_reader_stats_ext(zseek_reader_t *reader,
+    zseek_reader_stats_ext_t *stats, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (!stats) {
+        set_error(errbuf, "invalid stats pointer");
+        return false;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    if (!zseek_reader_stats(reader, &stats->stats, errbuf))
+        return false;
+
+    zseek_reader_metrics_t *m = &reader->m;
+    stats->cache_hits = atomic_load_explicit(&m->hits, memory_order_relaxed);
+    stats->cache_misses = atomic_load_explicit(&m->misses,
+        memory_order_relaxed);
+    stats->cache_evictions = atomic_load_explicit(&m->evictions,
+        memory_order_relaxed);
+    stats->compressed_bytes_read = atomic_load_explicit(&m->bytes_read,
+        memory_order_relaxed);
+    stats->decompressed_bytes = atomic_load_explicit(&m->bytes_decompressed,
+        memory_order_relaxed);
+    stats->pread_calls = atomic_load_explicit(&m->preads,
+        memory_order_relaxed);
+    stats->lock_waits = atomic_load_explicit(&m->lock_waits,
+        memory_order_relaxed);
+    stats->compressed_cache_hits = atomic_load_explicit(&m->compressed_hits,
+        memory_order_relaxed);
+    stats->compressed_cache_misses = atomic_load_explicit(
+        &m->compressed_misses, memory_order_relaxed);
+    stats->compressed_cache_evictions = atomic_load_explicit(
+        &m->compressed_evictions, memory_order_relaxed);
+    histogram_read(&m->fetch_ns, &stats->fetch_ns);
+    histogram_read(&m->decompress_ns, &stats->decompress_ns);
+    histogram_read(&m->lock_wait_ns, &stats->lock_wait_ns);
+
+    return true;
+}
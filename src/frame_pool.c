@@ -0,0 +1,151 @@
+#include <stdlib.h>     // malloc, free
+#include <string.h>     // memset
+#include <stdint.h>     // SIZE_MAX
+#include <pthread.h>    // pthread_mutex_*
+
+#include "frame_pool.h"
+
+// Smallest size class
+#define POOL_MIN_CLASS 16
+
+typedef struct {
+    void *data;
+    size_t size;    // Size class allocated with
+} zseek_free_buf_t;
+
+struct zseek_frame_pool {
+    zseek_allocator_t allocator;
+
+    pthread_mutex_t lock;   // Protects the free list
+    zseek_free_buf_t *free_bufs;
+    size_t nb_free;
+    size_t max_free;
+    size_t free_bytes;
+};
+
+/**
+ * Return the size class of @p size, i.e. @p size rounded up to one of 8 steps
+ * per power of 2
+ */
+static size_t class_size(size_t size)
+{
+    if (size <= POOL_MIN_CLASS)
+        return POOL_MIN_CLASS;
+    if (size > SIZE_MAX / 2)
+        return size;
+    unsigned log = 63 - __builtin_clzll(size - 1);
+    size_t step = (size_t)1 << (log - 3);
+    return (size + step - 1) & ~(step - 1);
+}
+
+static void *default_alloc(size_t size, void *opaque)
+{
+    (void)opaque;
+    return malloc(size);
+}
+
+static void default_free(void *ptr, size_t size, void *opaque)
+{
+    (void)size;
+    (void)opaque;
+    free(ptr);
+}
+
+zseek_frame_pool_t *zseek_frame_pool_new(const zseek_allocator_t *allocator,
+    size_t max_free)
+{
+    zseek_frame_pool_t *pool = malloc(sizeof(*pool));
+    if (!pool)
+        goto fail;
+    memset(pool, 0, sizeof(*pool));
+
+    if (allocator && allocator->alloc) {
+        pool->allocator = *allocator;
+    } else {
+        pool->allocator.alloc = default_alloc;
+        pool->allocator.free = default_free;
+    }
+
+    if (max_free > 0) {
+        pool->free_bufs = malloc(max_free * sizeof(pool->free_bufs[0]));
+        if (!pool->free_bufs)
+            goto fail_w_pool;
+    }
+    pool->max_free = max_free;
+
+    if (pthread_mutex_init(&pool->lock, NULL))
+        goto fail_w_free_bufs;
+
+    return pool;
+
+fail_w_free_bufs:
+    free(pool->free_bufs);
+fail_w_pool:
+    free(pool);
+fail:
+    return NULL;
+}
+
+void zseek_frame_pool_free(zseek_frame_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    for (size_t b = 0; b < pool->nb_free; b++)
+        pool->allocator.free(pool->free_bufs[b].data, pool->free_bufs[b].size,
+            pool->allocator.opaque);
+    free(pool->free_bufs);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+void *zseek_frame_pool_get(zseek_frame_pool_t *pool, size_t size)
+{
+    size_t csize = class_size(size);
+
+    pthread_mutex_lock(&pool->lock);
+    for (size_t b = 0; b < pool->nb_free; b++) {
+        if (pool->free_bufs[b].size != csize)
+            continue;
+        void *data = pool->free_bufs[b].data;
+        pool->free_bufs[b] = pool->free_bufs[--pool->nb_free];
+        pool->free_bytes -= csize;
+        pthread_mutex_unlock(&pool->lock);
+        return data;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return pool->allocator.alloc(csize, pool->allocator.opaque);
+}
+
+void zseek_frame_pool_put(zseek_frame_pool_t *pool, void *data, size_t size)
+{
+    if (!data)
+        return;
+
+    size_t csize = class_size(size);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->nb_free < pool->max_free) {
+        pool->free_bufs[pool->nb_free++] = (zseek_free_buf_t) {data, csize};
+        pool->free_bytes += csize;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pool->allocator.free(data, csize, pool->allocator.opaque);
+}
+
+size_t zseek_frame_pool_memory_usage(zseek_frame_pool_t *pool)
+{
+    if (!pool)
+        return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    size_t free_bytes = pool->free_bytes;
+    pthread_mutex_unlock(&pool->lock);
+
+    return sizeof(*pool) + pool->max_free * sizeof(pool->free_bufs[0]) +
+        free_bytes;
+}
@@ -0,0 +1,47 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stddef.h>     // size_t
+
+#include "zseek.h"
+
+/**
+ * A pool of decompressed frame buffers. Buffers are allocated in size classes
+ * (rounded up by less than 1/8), and those put back are kept on a free list
+ * for later requests of the same class, up to a bound.
+ */
+typedef struct zseek_frame_pool zseek_frame_pool_t;
+
+/**
+ * Creates a new pool, allocating with @p allocator (@a NULL, or with @a NULL
+ * handlers, for malloc (3) and free (3)) and keeping up to @p max_free
+ * buffers for reuse.
+ */
+zseek_frame_pool_t *zseek_frame_pool_new(const zseek_allocator_t *allocator,
+    size_t max_free);
+/**
+ * Frees the pool pointed to by @p pool, along with any buffers kept for reuse.
+ * Buffers still out must not be put back after this.
+ */
+void zseek_frame_pool_free(zseek_frame_pool_t *pool);
+/**
+ * Returns a buffer of at least @p size bytes from @p pool, reusing one if
+ * possible, or @a NULL on error.
+ *
+ * @note Safe to call concurrently
+ */
+void *zseek_frame_pool_get(zseek_frame_pool_t *pool, size_t size);
+/**
+ * Puts back @p data, returned by zseek_frame_pool_get() for @p size bytes, to
+ * @p pool.
+ *
+ * @note Safe to call concurrently
+ */
+void zseek_frame_pool_put(zseek_frame_pool_t *pool, void *data, size_t size);
+/**
+ * Returns the memory usage (total heap allocation) of @p pool in bytes,
+ * counting buffers kept for reuse but not those out.
+ */
+size_t zseek_frame_pool_memory_usage(zseek_frame_pool_t *pool);
+
+#endif  // FRAME_POOL_H
@@ -5,6 +5,8 @@
 #include <stdlib.h>     // malloc, realloc, free
 #include <assert.h>     // assert
 #include <string.h>     // memcpy
+#include <pthread.h>    // pthread_mutex_*
+#include <stdatomic.h>  // atomic_*
 
 #include <endian.h>     // htole32, le32toh
 #include <zstd.h>
@@ -14,7 +16,7 @@
 
 #define ZSTD_seekTableFooterSize 9
 #define ZSTD_SEEKABLE_MAGICNUMBER 0x8F92EAB1
-#define ZSTD_SEEKABLE_MAXFRAMES 0x8000000U
+#define ZSTD_SEEKABLE_MAXFRAMES SEEK_TABLE_MAX_FRAMES
 #define ZSTD_SKIPPABLEHEADERSIZE 8
 
 #define SEEKTABLE_SKIPPABLE_MAGICNUMBER (ZSTD_MAGIC_SKIPPABLE_START | 0xE)
@@ -22,6 +24,20 @@
 #define SEEK_ENTRY_CHECKSUM_SIZE 4
 #define SEEKKTABLE_BUF_SIZE (1 << 12)   // 4KiB
 
+/* Extended seek table: Seek_Table_Descriptor bit, footer with a LE64
+Number_Of_Frames (high half first, for the low half to stay where it is in the
+standard footer), and frames per skippable frame of entries (each but the last
+holding exactly that many) */
+#define SEEK_TABLE_DESC_EXTENDED 0x40
+#define SEEK_TABLE_EXT_FOOTER_SIZE (ZSTD_seekTableFooterSize + 4)
+#define SEEK_TABLE_EXT_CHUNK_FRAMES ((size_t)1 << 28)
+
+#define TRAILER_SKIPPABLE_MAGICNUMBER (ZSTD_MAGIC_SKIPPABLE_START | 0xD)
+#define TRAILER_MAGICNUMBER 0x7A534B54  // "TKSz"
+#define TRAILER_FOOTER_SIZE 12
+// Trailers looked for before the seek table, at most
+#define TRAILERS_MAX 16
+
 #define CHECK_Z(f) { size_t const ret = (f); if (ret != 0) return ret; }
 #define ERROR(name) ((size_t)-ZSTD_error_##name)
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -30,20 +46,86 @@ typedef uint8_t BYTE;
 typedef uint32_t U32;
 typedef uint64_t U64;
 
-/* NOTE: The below two definitions are copied verbatim from
-zstd/contrib/seekable_format/zstdseek_decompress.c @ v1.5.0 */
-
+// Frames per block of the in-memory seek table, at most
+#define SEEK_BLOCK_SHIFT_MAX 6
+// Frames per page of a lazily loaded seek table (4KiB without checksums)
+#define SEEK_PAGE_FRAMES (SEEKKTABLE_BUF_SIZE / SEEK_ENTRY_SIZE_NO_CHECKSUM)
+// Pages never straddle skippable frames of an extended seek table
+_Static_assert(SEEK_TABLE_EXT_CHUNK_FRAMES % SEEK_PAGE_FRAMES == 0,
+    "pages must not straddle seek table chunks");
+
+/**
+ * A page of a lazily loaded seek table. Holds the offsets of its frames and of
+ * the one after them (the page itself is at most SEEK_PAGE_FRAMES frames).
+ */
 typedef struct {
-    U64 cOffset;
-    U64 dOffset;
-    U32 checksum;
-} seekEntry_t;
-
+    U64 c[SEEK_PAGE_FRAMES + 1];
+    U64 d[SEEK_PAGE_FRAMES + 1];
+} st_page_t;
+
+/* NOTE: This replaces the seekEntry_t array of
+zstd/contrib/seekable_format/zstdseek_decompress.c @ v1.5.0 (24 bytes per
+frame) with a compact layout (~8 bytes per frame). */
+
+/**
+ * Frames are grouped in blocks of 2^blockShift. The offsets of frame i (for i
+ * in [0, tableLen], the last one being the end of the file) are
+ * xBase[i >> blockShift] + xRel[i], with blockShift as large as possible (up
+ * to SEEK_BLOCK_SHIFT_MAX) for blocks to span < 4GiB. Lookups search the
+ * decompressed block bases in Eytzinger (BFS) order, then the (at most 64)
+ * relative offsets of the block.
+ */
 struct ZSTD_seekTable_s {
-    seekEntry_t* entries;
+    U64 *cBase;
+    U64 *dBase;
+    U32 *cRel;
+    U32 *dRel;
+    unsigned blockShift;
+
+    // Decompressed bases of the blocks with frames, 1-based, along with their
+    // block index
+    U64 *dEytz;
+    U32 *eytzBlock;
+    size_t nbBlocks;
+
+    U32 *checksums;     // NULL without checksumFlag
     size_t tableLen;
 
     int checksumFlag;
+    bool extended;
+    size_t tableOff;    // Offset of the seek table in the file
+
+    // Fixed-size frames (0 if not), with no decompressed offsets stored
+    U64 frameSizeD;
+    U64 sizeD;          // Decompressed file size, if fixed-size frames
+
+    void *dict;         // Dictionary trailer payload, until taken
+    size_t dictSize;
+
+    // Sub-block index (0 subSize if none): frame i has sub-blocks of subSize
+    // bytes (decompressed), the compressed offsets of all but the first of
+    // which are subEnds[subFirst[i]...subFirst[i + 1]) (relative to the frame)
+    U32 subSize;
+    U32 *subFirst;      // subFrames + 1 entries, followed by subEnds
+    U32 *subEnds;
+    size_t subFrames;
+
+    /*
+     * Lazy loading (pages is NULL if loaded eagerly). Pages are loaded on
+     * demand and kept, so accessing a loaded one needs no locking. The start
+     * offsets of pages [0, known) are known, and a page can only be located
+     * after all the previous ones have been scanned.
+     */
+    _Atomic(st_page_t *) *pages;
+    size_t nbPages;
+    U64 *pageC;
+    U64 *pageD;
+    atomic_size_t known;
+    atomic_size_t nbLoaded;
+    zseek_read_file_t userFile;
+    st_page_t *scratch;     // For scanning pages without keeping them
+    size_t scratchPage;     // Index of the page in scratch, if any
+    pthread_mutex_t lock;   // Serializes loading
 };
 
 static inline void MEM_writeLE32(void *memPtr, U32 val32)
@@ -59,118 +141,679 @@ static inline U32 MEM_readLE32(void const *memPtr)
     return le32toh(val32le);
 }
 
-static bool read_st_entries(zseek_read_file_t user_file, size_t entries_off,
-    seekEntry_t *entries, size_t num_entries, bool checksum, void *call_data)
+static inline void MEM_writeLE64(void *memPtr, U64 val64)
 {
-    size_t entry_size = SEEK_ENTRY_SIZE_NO_CHECKSUM +
-        (checksum ? SEEK_ENTRY_CHECKSUM_SIZE : 0);
-    size_t buf_len = SEEKKTABLE_BUF_SIZE -
-        (SEEKKTABLE_BUF_SIZE % entry_size);    // fit whole # of entries
-    void *buf = malloc(buf_len);
+    U64 val64le = htole64(val64);
+    memcpy(memPtr, &val64le, sizeof(val64le));
+}
+
+static inline U64 MEM_readLE64(void const *memPtr)
+{
+    U64 val64le;
+    memcpy(&val64le, memPtr, sizeof(val64le));
+    return le64toh(val64le);
+}
+
+/**
+ * Return the number of skippable frames of a seek table of @p nb_frames
+ * frames, @p extended or not
+ */
+static inline size_t st_chunks(size_t nb_frames, bool extended)
+{
+    if (!extended || nb_frames == 0)
+        return 1;
+    return (nb_frames - 1) / SEEK_TABLE_EXT_CHUNK_FRAMES + 1;
+}
+
+/**
+ * Return the frame size (as in its header) of skippable frame @p chunk of a
+ * seek table of @p nb_frames frames, with @p entry_size bytes per entry,
+ * @p extended or not
+ */
+static size_t st_chunk_size(size_t nb_frames, size_t entry_size,
+    bool extended, size_t chunk)
+{
+    size_t nb_chunks = st_chunks(nb_frames, extended);
+    if (chunk + 1 < nb_chunks)
+        return SEEK_TABLE_EXT_CHUNK_FRAMES * entry_size;
+    size_t first = extended ? chunk * SEEK_TABLE_EXT_CHUNK_FRAMES : 0;
+    return (nb_frames - first) * entry_size + (extended ?
+        SEEK_TABLE_EXT_FOOTER_SIZE : ZSTD_seekTableFooterSize);
+}
+
+/**
+ * Return the total size of a seek table of @p nb_frames frames, with
+ * @p entry_size bytes per entry, @p extended or not
+ */
+static inline size_t st_size(size_t nb_frames, size_t entry_size,
+    bool extended)
+{
+    return st_chunks(nb_frames, extended) * ZSTD_SKIPPABLEHEADERSIZE +
+        nb_frames * entry_size + (extended ? SEEK_TABLE_EXT_FOOTER_SIZE :
+        ZSTD_seekTableFooterSize);
+}
+
+/**
+ * Return the position of entry @p e in a seek table with @p entry_size bytes
+ * per entry, @p extended or not
+ */
+static inline size_t st_entry_pos(size_t e, size_t entry_size, bool extended)
+{
+    size_t chunk = extended ? e / SEEK_TABLE_EXT_CHUNK_FRAMES : 0;
+    return (chunk + 1) * ZSTD_SKIPPABLEHEADERSIZE + e * entry_size;
+}
+
+/**
+ * Return the size of the entries of @p st
+ */
+static inline size_t entry_size(const ZSTD_seekTable *st)
+{
+    return SEEK_ENTRY_SIZE_NO_CHECKSUM +
+        (st->checksumFlag ? SEEK_ENTRY_CHECKSUM_SIZE : 0);
+}
+
+/**
+ * Return the offset in the file of entry @p e of @p st
+ */
+static inline size_t entry_offset(const ZSTD_seekTable *st, size_t e)
+{
+    return st->tableOff + st_entry_pos(e, entry_size(st), st->extended);
+}
+
+/**
+ * Check the decompressed size @p size_d of frame @p frame_idx of @p st against
+ * its fixed frame size, if any
+ */
+static inline bool frame_size_ok(const ZSTD_seekTable *st, size_t frame_idx,
+    U64 size_d)
+{
+    if (!st->frameSizeD)
+        return true;
+    if (frame_idx + 1 < st->tableLen)
+        return size_d == st->frameSizeD;
+    return size_d > 0 && size_d <= st->frameSizeD;
+}
+
+/**
+ * Parse the seek table entries of @p user_file into @p st, whose arrays are
+ * allocated for its block shift. Returns 1 on success, 0 on I/O error (or
+ * inconsistent entries) or -1 if a block spans >= 4GiB.
+ */
+static int read_st_entries(zseek_read_file_t user_file, ZSTD_seekTable *st,
+    void *call_data)
+{
+    bool checksum = st->checksumFlag;
+    size_t num_entries = st->tableLen;
+    size_t e_size = entry_size(st);
+    size_t buf_entries = SEEKKTABLE_BUF_SIZE / e_size;
+    void *buf = malloc(buf_entries * e_size);
     if (!buf)
-        goto fail;
+        return 0;
 
-    size_t c_offset = 0;
-    size_t d_offset = 0;
+    int ret = 1;
+    U64 c_offset = 0;
+    U64 d_offset = 0;
     size_t buf_idx = 0;
-    for (size_t e = 0; e < num_entries; e++) {
-        if (buf_idx == 0 || buf_idx == buf_len) {
-            // Fill buffer
-            size_t to_read = MIN((num_entries - e) * entry_size, buf_len);
-            ssize_t _read = user_file.pread(buf, to_read, entries_off,
+    size_t buf_end = 0;
+    for (size_t e = 0; e <= num_entries; e++) {
+        // Store offsets, relative to the block
+        size_t block = e >> st->blockShift;
+        if ((e & ((1u << st->blockShift) - 1)) == 0) {
+            st->cBase[block] = c_offset;
+            if (!st->frameSizeD)
+                st->dBase[block] = d_offset;
+        }
+        U64 c_rel = c_offset - st->cBase[block];
+        U64 d_rel = st->frameSizeD ? 0 : d_offset - st->dBase[block];
+        if (c_rel > UINT32_MAX || d_rel > UINT32_MAX) {
+            ret = -1;
+            break;
+        }
+        st->cRel[e] = c_rel;
+        if (!st->frameSizeD)
+            st->dRel[e] = d_rel;
+        if (e == num_entries)
+            break;
+
+        if (buf_idx == buf_end) {
+            // Fill buffer, up to the end of the skippable frame
+            size_t nb = MIN(num_entries - e, buf_entries);
+            if (st->extended)
+                nb = MIN(nb, SEEK_TABLE_EXT_CHUNK_FRAMES -
+                    e % SEEK_TABLE_EXT_CHUNK_FRAMES);
+            size_t to_read = nb * e_size;
+            ssize_t _read = user_file.pread(buf, to_read, entry_offset(st, e),
                 user_file.user_data, call_data);
-            if (_read != (ssize_t)to_read)
-                goto fail_w_buf;
-            entries_off += _read;
+            if (_read != (ssize_t)to_read) {
+                ret = 0;
+                break;
+            }
             buf_idx = 0;
+            buf_end = to_read;
         }
 
         // Parse entry
-        entries[e].cOffset = c_offset;
-        entries[e].dOffset = d_offset;
         c_offset += MEM_readLE32((uint8_t*)buf + buf_idx);
         buf_idx += 4;
-        d_offset += MEM_readLE32((uint8_t*)buf + buf_idx);
+        U32 size_d = MEM_readLE32((uint8_t*)buf + buf_idx);
+        if (!frame_size_ok(st, e, size_d)) {
+            ret = 0;
+            break;
+        }
+        d_offset += size_d;
         buf_idx += 4;
         if (checksum) {
-            entries[e].checksum = MEM_readLE32((uint8_t*)buf + buf_idx);
+            st->checksums[e] = MEM_readLE32((uint8_t*)buf + buf_idx);
             buf_idx += 4;
         }
     }
-    entries[num_entries].cOffset = c_offset;
-    entries[num_entries].dOffset = d_offset;
 
     free(buf);
-    return true;
+    return ret;
+}
+
+/**
+ * Fill the Eytzinger layout of @p st from node @p k on, with the blocks from
+ * @p block on (in order). Returns the next block.
+ */
+static size_t eytz_fill(ZSTD_seekTable *st, size_t block, size_t k)
+{
+    if (k <= st->nbBlocks) {
+        block = eytz_fill(st, block, 2 * k);
+        st->dEytz[k] = st->dBase[block];
+        st->eytzBlock[k] = block;
+        block++;
+        block = eytz_fill(st, block, 2 * k + 1);
+    }
+    return block;
+}
+
+static void st_free_arrays(ZSTD_seekTable *st)
+{
+    free(st->cBase);
+    free(st->dBase);
+    free(st->cRel);
+    free(st->dRel);
+    free(st->dEytz);
+    free(st->eytzBlock);
+    free(st->checksums);
+}
+
+static bool st_alloc_arrays(ZSTD_seekTable *st)
+{
+    size_t nb_bases = (st->tableLen >> st->blockShift) + 1;
+    st->cBase = malloc(nb_bases * sizeof(st->cBase[0]));
+    st->cRel = malloc((st->tableLen + 1) * sizeof(st->cRel[0]));
+    st->nbBlocks = st->tableLen > 0 ?
+        ((st->tableLen - 1) >> st->blockShift) + 1 : 0;
+    if (st->checksumFlag)
+        st->checksums = malloc((st->tableLen + 1) *
+            sizeof(st->checksums[0]));
+    if (!st->cBase || !st->cRel || (st->checksumFlag && !st->checksums))
+        return false;
+    if (st->frameSizeD)
+        // Decompressed offsets are computed
+        return true;
+
+    st->dBase = malloc(nb_bases * sizeof(st->dBase[0]));
+    st->dRel = malloc((st->tableLen + 1) * sizeof(st->dRel[0]));
+    st->dEytz = malloc((st->nbBlocks + 1) * sizeof(st->dEytz[0]));
+    st->eytzBlock = malloc((st->nbBlocks + 1) * sizeof(st->eytzBlock[0]));
+    return st->dBase && st->dRel && st->dEytz && st->eytzBlock;
+}
+
+/**
+ * Read the page at index @p page of the lazily loaded @p st into @p out,
+ * starting from compressed offset @p c and decompressed offset @p d
+ */
+static bool page_read(ZSTD_seekTable *st, size_t page, U64 c, U64 d,
+    st_page_t *out, void *call_data)
+{
+    size_t e_size = entry_size(st);
+    size_t first = page * SEEK_PAGE_FRAMES;
+    size_t nb_frames = MIN(SEEK_PAGE_FRAMES, st->tableLen - first);
+    size_t to_read = nb_frames * e_size;
+    uint8_t *buf = malloc(to_read);
+    if (!buf)
+        return false;
+    ssize_t _read = st->userFile.pread(buf, to_read, entry_offset(st, first),
+        st->userFile.user_data, call_data);
+    if (_read != (ssize_t)to_read) {
+        free(buf);
+        return false;
+    }
 
-fail_w_buf:
+    // NOTE: Checksums are not kept
+    for (size_t e = 0; e < nb_frames; e++) {
+        out->c[e] = c;
+        out->d[e] = d;
+        c += MEM_readLE32(buf + e * e_size);
+        U32 size_d = MEM_readLE32(buf + e * e_size + 4);
+        if (!frame_size_ok(st, first + e, size_d)) {
+            free(buf);
+            return false;
+        }
+        d += size_d;
+    }
+    out->c[nb_frames] = c;
+    out->d[nb_frames] = d;
     free(buf);
-fail:
-    return false;
+    return true;
 }
 
-ZSTD_seekTable *read_seek_table(zseek_read_file_t user_file, void *call_data)
+/**
+ * Load the page at index @p page of @p st, whose start offset must be known.
+ * Must be called with the lock held.
+ */
+static st_page_t *page_load(ZSTD_seekTable *st, size_t page, void *call_data)
 {
-    // TODO: Communicate error info?
+    st_page_t *loaded = atomic_load_explicit(&st->pages[page],
+        memory_order_relaxed);
+    if (loaded)
+        return loaded;
+
+    assert(page < atomic_load_explicit(&st->known, memory_order_relaxed));
+    if (st->scratch && st->scratchPage == page) {
+        // Just scanned
+        loaded = st->scratch;
+        st->scratch = NULL;
+    } else {
+        loaded = malloc(sizeof(*loaded));
+        if (!loaded)
+            return NULL;
+        if (!page_read(st, page, st->pageC[page], st->pageD[page], loaded,
+            call_data)) {
+            free(loaded);
+            return NULL;
+        }
+    }
+    atomic_fetch_add_explicit(&st->nbLoaded, 1, memory_order_relaxed);
+    atomic_store_explicit(&st->pages[page], loaded, memory_order_release);
+    return loaded;
+}
+
+/**
+ * Scan the pages of @p st for the start offset of the page after the last one
+ * currently known. The pages scanned are not kept. Must be called with the
+ * lock held.
+ */
+static bool page_scan(ZSTD_seekTable *st, void *call_data)
+{
+    size_t known = atomic_load_explicit(&st->known, memory_order_relaxed);
+    assert(known <= st->nbPages);
+    size_t page = known - 1;
+    size_t nb_frames = MIN(SEEK_PAGE_FRAMES,
+        st->tableLen - page * SEEK_PAGE_FRAMES);
+
+    st_page_t *loaded = atomic_load_explicit(&st->pages[page],
+        memory_order_relaxed);
+    if (!loaded) {
+        if (!st->scratch) {
+            st->scratch = malloc(sizeof(*st->scratch));
+            if (!st->scratch)
+                return false;
+        }
+        st->scratchPage = SIZE_MAX;
+        if (!page_read(st, page, st->pageC[page], st->pageD[page],
+            st->scratch, call_data))
+            return false;
+        st->scratchPage = page;
+        loaded = st->scratch;
+    }
+    st->pageC[known] = loaded->c[nb_frames];
+    st->pageD[known] = loaded->d[nb_frames];
+    atomic_store_explicit(&st->known, known + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Parse the payload of a TRAILER_SUB_BLOCKS trailer into @p st
+ */
+static bool parse_sub_blocks(ZSTD_seekTable *st, const uint8_t *payload,
+    size_t payload_size)
+{
+    if (payload_size < 12 || st->subSize)
+        return false;
+    U32 sub_size = MEM_readLE32(payload);
+    size_t nb_frames = MEM_readLE32(payload + 4);
+    if (sub_size == 0 || (payload_size - 8) / 4 < nb_frames + 1)
+        return false;
+    size_t nb_ends = MEM_readLE32(payload + 8 + 4 * nb_frames);
+    if (payload_size != 8 + 4 * (nb_frames + 1 + nb_ends))
+        return false;
+
+    U32 *index = malloc((nb_frames + 1 + nb_ends) * sizeof(index[0]));
+    if (!index)
+        return false;
+    const uint8_t *in = payload + 8;
+    for (size_t i = 0; i < nb_frames + 1 + nb_ends; i++, in += 4) {
+        index[i] = MEM_readLE32(in);
+        // First ends must be in order, up to nb_ends
+        if (i > 0 && i <= nb_frames && index[i] < index[i - 1]) {
+            free(index);
+            return false;
+        }
+    }
+    if (index[0] != 0) {
+        free(index);
+        return false;
+    }
+
+    st->subSize = sub_size;
+    st->subFirst = index;
+    st->subEnds = index + nb_frames + 1;
+    st->subFrames = nb_frames;
+    return true;
+}
+
+/**
+ * Free the trailer data of @p st
+ */
+static void trailers_free(ZSTD_seekTable *st)
+{
+    free(st->dict);
+    free(st->subFirst);
+}
+
+/**
+ * Parse the payload of the trailer of @p kind into @p st. Unknown kinds are
+ * skipped, for forward compatibility.
+ */
+static bool parse_trailer(ZSTD_seekTable *st, U32 kind, const uint8_t *payload,
+    size_t payload_size)
+{
+    switch (kind) {
+    case TRAILER_FRAME_SIZE:
+        if (payload_size < 8)
+            return false;
+        st->frameSizeD = MEM_readLE64(payload);
+        return st->frameSizeD > 0;
+    case TRAILER_DICTIONARY:
+        if (payload_size == 0 || st->dict)
+            return false;
+        st->dict = malloc(payload_size);
+        if (!st->dict)
+            return false;
+        memcpy(st->dict, payload, payload_size);
+        st->dictSize = payload_size;
+        return true;
+    case TRAILER_SUB_BLOCKS:
+        return parse_sub_blocks(st, payload, payload_size);
+    default:
+        return true;
+    }
+}
+
+/**
+ * Parse the trailers of @p user_file ending at @p end (where the seek table
+ * starts) into @p st, going backwards
+ */
+static bool read_trailers(zseek_read_file_t user_file, ZSTD_seekTable *st,
+    size_t end, void *call_data)
+{
+    for (int t = 0; t < TRAILERS_MAX; t++) {
+        if (end < ZSTD_SKIPPABLEHEADERSIZE + TRAILER_FOOTER_SIZE)
+            break;
+
+        // Check trailer footer
+        uint8_t footer[TRAILER_FOOTER_SIZE];
+        ssize_t _read = user_file.pread(footer, TRAILER_FOOTER_SIZE,
+            end - TRAILER_FOOTER_SIZE, user_file.user_data, call_data);
+        if (_read != TRAILER_FOOTER_SIZE)
+            return false;
+        if (MEM_readLE32(footer + 8) != TRAILER_MAGICNUMBER)
+            break;
+        size_t payload_size = MEM_readLE32(footer);
+        U32 kind = MEM_readLE32(footer + 4);
+        size_t frame_size = payload_size + TRAILER_FOOTER_SIZE;
+        if (end < ZSTD_SKIPPABLEHEADERSIZE + frame_size)
+            break;
+
+        // Check skippable frame header, and read payload along
+        size_t start = end - ZSTD_SKIPPABLEHEADERSIZE - frame_size;
+        size_t to_read = ZSTD_SKIPPABLEHEADERSIZE + payload_size;
+        uint8_t *buf = malloc(to_read);
+        if (!buf)
+            return false;
+        _read = user_file.pread(buf, to_read, start, user_file.user_data,
+            call_data);
+        if (_read != (ssize_t)to_read) {
+            free(buf);
+            return false;
+        }
+        if (MEM_readLE32(buf) != TRAILER_SKIPPABLE_MAGICNUMBER ||
+            MEM_readLE32(buf + 4) != frame_size) {
+            // Frame data happening to end like a trailer
+            free(buf);
+            break;
+        }
+        bool ok = parse_trailer(st, kind, buf + ZSTD_SKIPPABLEHEADERSIZE,
+            payload_size);
+        free(buf);
+        if (!ok)
+            return false;
+
+        end = start;
+    }
+
+    return true;
+}
+
+size_t trailer_size(size_t payload_size)
+{
+    return ZSTD_SKIPPABLEHEADERSIZE + payload_size + TRAILER_FOOTER_SIZE;
+}
+
+size_t trailer_encode(void *dst, trailer_kind_t kind, const void *payload,
+    size_t payload_size)
+{
+    uint8_t *out = dst;
+    MEM_writeLE32(out, TRAILER_SKIPPABLE_MAGICNUMBER);
+    MEM_writeLE32(out + 4, payload_size + TRAILER_FOOTER_SIZE);
+    memcpy(out + ZSTD_SKIPPABLEHEADERSIZE, payload, payload_size);
+    out += ZSTD_SKIPPABLEHEADERSIZE + payload_size;
+    MEM_writeLE32(out, payload_size);
+    MEM_writeLE32(out + 4, kind);
+    MEM_writeLE32(out + 8, TRAILER_MAGICNUMBER);
+    return trailer_size(payload_size);
+}
+
+size_t trailer_encode_frame_size(void *dst, size_t frame_size)
+{
+    uint8_t payload[8];
+    MEM_writeLE64(payload, frame_size);
+    return trailer_encode(dst, TRAILER_FRAME_SIZE, payload, sizeof(payload));
+}
+
+size_t trailer_sub_blocks_payload_size(size_t nb_frames, size_t nb_ends)
+{
+    return 8 + 4 * (nb_frames + 1 + nb_ends);
+}
 
+size_t trailer_encode_sub_blocks(void *dst, size_t sub_size,
+    const uint32_t *first, size_t nb_frames, const uint32_t *ends,
+    size_t nb_ends)
+{
+    size_t payload_size = trailer_sub_blocks_payload_size(nb_frames, nb_ends);
+    uint8_t *out = dst;
+    MEM_writeLE32(out, TRAILER_SKIPPABLE_MAGICNUMBER);
+    MEM_writeLE32(out + 4, payload_size + TRAILER_FOOTER_SIZE);
+    out += ZSTD_SKIPPABLEHEADERSIZE;
+
+    // Encoded in place, rather than copied from a payload
+    MEM_writeLE32(out, sub_size);
+    MEM_writeLE32(out + 4, nb_frames);
+    out += 8;
+    for (size_t i = 0; i < nb_frames; i++, out += 4)
+        MEM_writeLE32(out, first[i]);
+    MEM_writeLE32(out, nb_ends);
+    out += 4;
+    for (size_t i = 0; i < nb_ends; i++, out += 4)
+        MEM_writeLE32(out, ends[i]);
+
+    MEM_writeLE32(out, payload_size);
+    MEM_writeLE32(out + 4, TRAILER_SUB_BLOCKS);
+    MEM_writeLE32(out + 8, TRAILER_MAGICNUMBER);
+    return trailer_size(payload_size);
+}
+
+/**
+ * Parse the footer and headers of the seek table of @p user_file into a new
+ * seek table, without reading its entries
+ */
+static ZSTD_seekTable *seek_table_new(zseek_read_file_t user_file,
+    void *call_data)
+{
     // Get file size
     ssize_t fsize = user_file.fsize(user_file.user_data, call_data);
-    if (fsize < 0)
-        goto fail;
+    if (fsize < SEEK_TABLE_EXT_FOOTER_SIZE)
+        return NULL;
 
-    // Read seek table footer
-    uint8_t footer[ZSTD_seekTableFooterSize];
-    ssize_t _read = user_file.pread(footer, ZSTD_seekTableFooterSize,
-        fsize - ZSTD_seekTableFooterSize, user_file.user_data, call_data);
-    if (_read != ZSTD_seekTableFooterSize)
-        goto fail;
+    // Read seek table footer, extended or not
+    uint8_t footer[SEEK_TABLE_EXT_FOOTER_SIZE];
+    ssize_t _read = user_file.pread(footer, SEEK_TABLE_EXT_FOOTER_SIZE,
+        fsize - SEEK_TABLE_EXT_FOOTER_SIZE, user_file.user_data, call_data);
+    if (_read != SEEK_TABLE_EXT_FOOTER_SIZE)
+        return NULL;
+    const uint8_t *std_footer = footer + SEEK_TABLE_EXT_FOOTER_SIZE -
+        ZSTD_seekTableFooterSize;
     // Check Seekable_Magic_Number
-    if (MEM_readLE32(footer + 5) != ZSTD_SEEKABLE_MAGICNUMBER)
-        goto fail;
+    if (MEM_readLE32(std_footer + 5) != ZSTD_SEEKABLE_MAGICNUMBER)
+        return NULL;
     // Check Seek_Table_Descriptor
-    uint8_t std = footer[4];
-    if (std & 0x7c)
+    uint8_t std = std_footer[4];
+    if (std & 0x7c & ~SEEK_TABLE_DESC_EXTENDED)
         // Some of the reserved bits are set
-        goto fail;
+        return NULL;
     bool checksum = std & 0x80;
-    uint32_t num_frames = MEM_readLE32(footer);
+    bool extended = std & SEEK_TABLE_DESC_EXTENDED;
+    U64 num_frames = MEM_readLE32(std_footer);
+    if (extended)
+        num_frames |= (U64)MEM_readLE32(footer) << 32;
 
-    // Read seek table header
-    long seek_entry_size = SEEK_ENTRY_SIZE_NO_CHECKSUM +
+    // Check seek table size
+    size_t seek_entry_size = SEEK_ENTRY_SIZE_NO_CHECKSUM +
         (checksum ? SEEK_ENTRY_CHECKSUM_SIZE : 0);
-    long seek_frame_size = ZSTD_SKIPPABLEHEADERSIZE +
-        num_frames * seek_entry_size + ZSTD_seekTableFooterSize;
-    uint8_t header[ZSTD_SKIPPABLEHEADERSIZE];
-    _read = user_file.pread(header, ZSTD_SKIPPABLEHEADERSIZE,
-        fsize - seek_frame_size, user_file.user_data, call_data);
-    if (_read != ZSTD_SKIPPABLEHEADERSIZE)
-        goto fail;
-    // Check Skippable_Magic_Number
-    if (MEM_readLE32(header) != SEEKTABLE_SKIPPABLE_MAGICNUMBER)
-        goto fail;
-    // Check Frame_Size
-    if (MEM_readLE32(header + 4) != seek_frame_size - ZSTD_SKIPPABLEHEADERSIZE)
-        goto fail;
+    if (num_frames > (U64)fsize / seek_entry_size)
+        return NULL;
+    size_t seek_table_size = st_size(num_frames, seek_entry_size, extended);
+    if (seek_table_size > (size_t)fsize)
+        return NULL;
+    size_t table_off = fsize - seek_table_size;
+
+    // Read seek table headers
+    size_t nb_chunks = st_chunks(num_frames, extended);
+    for (size_t k = 0; k < nb_chunks; k++) {
+        uint8_t header[ZSTD_SKIPPABLEHEADERSIZE];
+        size_t chunk_off = table_off + k * (ZSTD_SKIPPABLEHEADERSIZE +
+            SEEK_TABLE_EXT_CHUNK_FRAMES * seek_entry_size);
+        _read = user_file.pread(header, ZSTD_SKIPPABLEHEADERSIZE, chunk_off,
+            user_file.user_data, call_data);
+        if (_read != ZSTD_SKIPPABLEHEADERSIZE)
+            return NULL;
+        // Check Skippable_Magic_Number
+        if (MEM_readLE32(header) != SEEKTABLE_SKIPPABLE_MAGICNUMBER)
+            return NULL;
+        // Check Frame_Size
+        if (MEM_readLE32(header + 4) != st_chunk_size(num_frames,
+            seek_entry_size, extended, k))
+            return NULL;
+    }
 
-    // Read seek table
-    seekEntry_t *entries = malloc((num_frames + 1) * sizeof(entries[0]));
-    if (!entries)
-        goto fail;
-    size_t entries_off = fsize - seek_frame_size + ZSTD_SKIPPABLEHEADERSIZE;
-    if (!read_st_entries(user_file, entries_off, entries, num_frames, checksum,
-        call_data))
-        goto fail_w_entries;
     ZSTD_seekTable *st = malloc(sizeof(*st));
     if (!st)
-        goto fail_w_entries;
-    st->entries = entries;
+        return NULL;
+    memset(st, 0, sizeof(*st));
     st->tableLen = num_frames;
     st->checksumFlag = (int)checksum;
+    st->extended = extended;
+    st->tableOff = table_off;
+
+    if (!read_trailers(user_file, st, table_off, call_data))
+        goto fail_w_st;
+    if (st->subSize && st->subFrames != num_frames)
+        goto fail_w_st;
+
+    if (st->frameSizeD && num_frames > 0) {
+        // Read the size of the last frame
+        uint8_t entry[SEEK_ENTRY_SIZE_NO_CHECKSUM];
+        _read = user_file.pread(entry, sizeof(entry),
+            entry_offset(st, num_frames - 1), user_file.user_data,
+            call_data);
+        if (_read != sizeof(entry))
+            goto fail_w_st;
+        U32 last_size_d = MEM_readLE32(entry + 4);
+        if (!frame_size_ok(st, num_frames - 1, last_size_d))
+            goto fail_w_st;
+        st->sizeD = (num_frames - 1) * st->frameSizeD + last_size_d;
+    }
+
+    return st;
+
+fail_w_st:
+    trailers_free(st);
+    free(st);
+    return NULL;
+}
+
+ZSTD_seekTable *read_seek_table(zseek_read_file_t user_file, bool lazy,
+    void *call_data)
+{
+    // TODO: Communicate error info?
+
+    ZSTD_seekTable *st = seek_table_new(user_file, call_data);
+    if (!st)
+        goto fail;
+
+    if (lazy) {
+        st->nbPages = (st->tableLen + SEEK_PAGE_FRAMES - 1) / SEEK_PAGE_FRAMES;
+        st->pages = malloc((st->nbPages + 1) * sizeof(st->pages[0]));
+        st->pageC = malloc((st->nbPages + 1) * sizeof(st->pageC[0]));
+        st->pageD = malloc((st->nbPages + 1) * sizeof(st->pageD[0]));
+        if (!st->pages || !st->pageC || !st->pageD)
+            goto fail_w_lazy;
+        for (size_t p = 0; p < st->nbPages; p++)
+            atomic_init(&st->pages[p], NULL);
+        st->pageC[0] = 0;
+        st->pageD[0] = 0;
+        atomic_init(&st->known, 1);
+        atomic_init(&st->nbLoaded, 0);
+        st->userFile = user_file;
+        if (pthread_mutex_init(&st->lock, NULL))
+            goto fail_w_lazy;
+        return st;
+    }
+
+    // Read seek table, with smaller blocks if they span too much
+    for (int shift = SEEK_BLOCK_SHIFT_MAX; ; shift--) {
+        // NOTE: Cannot overflow with 1 frame per block (32-bit sizes)
+        assert(shift >= 0);
+        st->blockShift = shift;
+        if (!st_alloc_arrays(st))
+            goto fail_w_st;
+        int r = read_st_entries(user_file, st, call_data);
+        if (r == 1)
+            break;
+        if (r == 0)
+            goto fail_w_st;
+        st_free_arrays(st);
+    }
+    if (!st->frameSizeD)
+        eytz_fill(st, 0, 1);
 
     return st;
 
-fail_w_entries:
-    free(entries);
+fail_w_lazy:
+    free(st->pages);
+    free(st->pageC);
+    free(st->pageD);
+    trailers_free(st);
+    free(st);
+    goto fail;
+fail_w_st:
+    st_free_arrays(st);
+    trailers_free(st);
+    free(st);
 fail:
     return NULL;
 }
@@ -180,20 +823,119 @@ void seek_table_free(ZSTD_seekTable *st)
     if (!st)
         return;
 
-    free(st->entries);
+    if (st->pages) {
+        for (size_t p = 0; p < st->nbPages; p++)
+            free(atomic_load_explicit(&st->pages[p], memory_order_relaxed));
+        free(st->pages);
+        free(st->pageC);
+        free(st->pageD);
+        free(st->scratch);
+        pthread_mutex_destroy(&st->lock);
+    }
+    st_free_arrays(st);
+    trailers_free(st);
     free(st);
 }
 
-ssize_t offset_to_frame_idx(ZSTD_seekTable *st, size_t offset)
+size_t seek_table_frame_size(const ZSTD_seekTable *st)
 {
-    if (offset >= st->entries[st->tableLen].dOffset)
-        return -1;
+    return st->frameSizeD;
+}
+
+size_t seek_table_sub_blocks(const ZSTD_seekTable *st, const uint32_t **first,
+    const uint32_t **ends)
+{
+    *first = st->subFirst;
+    *ends = st->subEnds;
+    return st->subSize;
+}
+
+void *seek_table_take_dict(ZSTD_seekTable *st, size_t *size)
+{
+    void *dict = st->dict;
+    *size = st->dictSize;
+    st->dict = NULL;
+    st->dictSize = 0;
+    return dict;
+}
+
+/**
+ * Return the loaded page of frame @p frame_idx of a lazily loaded @p st
+ */
+static inline const st_page_t *page_of(const ZSTD_seekTable *st,
+    size_t frame_idx)
+{
+    const st_page_t *page = atomic_load_explicit(
+        &st->pages[frame_idx / SEEK_PAGE_FRAMES], memory_order_relaxed);
+    assert(page);
+    return page;
+}
+
+static inline U64 offset_c(const ZSTD_seekTable *st, size_t frame_idx)
+{
+    return st->cBase[frame_idx >> st->blockShift] + st->cRel[frame_idx];
+}
+
+static inline U64 offset_d(const ZSTD_seekTable *st, size_t frame_idx)
+{
+    return st->dBase[frame_idx >> st->blockShift] + st->dRel[frame_idx];
+}
+
+bool seek_table_load(ZSTD_seekTable *st, size_t first, size_t end,
+    void *call_data)
+{
+    if (!st->pages || first >= end)
+        return true;
+
+    assert(end <= st->tableLen);
+    size_t last_page = (end - 1) / SEEK_PAGE_FRAMES;
+    for (size_t p = first / SEEK_PAGE_FRAMES; p <= last_page; p++) {
+        if (atomic_load_explicit(&st->pages[p], memory_order_acquire))
+            continue;
+
+        bool ok = true;
+        pthread_mutex_lock(&st->lock);
+        while (ok && atomic_load_explicit(&st->known,
+            memory_order_relaxed) <= p)
+            ok = page_scan(st, call_data);
+        ok = ok && page_load(st, p, call_data);
+        pthread_mutex_unlock(&st->lock);
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Return the index of the last page of a lazily loaded @p st starting at or
+ * before @p offset, scanning pages as needed, or -1 if @p offset is out of
+ * range or -2 on error
+ */
+static ssize_t page_find(ZSTD_seekTable *st, size_t offset, void *call_data)
+{
+    size_t known = atomic_load_explicit(&st->known, memory_order_acquire);
+    if (known <= st->nbPages && st->pageD[known - 1] <= offset) {
+        // Not known yet whether a later page starts before offset
+        pthread_mutex_lock(&st->lock);
+        known = atomic_load_explicit(&st->known, memory_order_relaxed);
+        while (known <= st->nbPages && st->pageD[known - 1] <= offset) {
+            if (!page_scan(st, call_data)) {
+                pthread_mutex_unlock(&st->lock);
+                return -2;
+            }
+            known++;
+        }
+        pthread_mutex_unlock(&st->lock);
+    }
 
+    if (known == st->nbPages + 1 && offset >= st->pageD[st->nbPages])
+        return -1;
     size_t lo = 0;
-    size_t hi = st->tableLen;
+    size_t hi = known - 1;
     while (lo + 1 < hi) {
-        size_t mid = lo + ((hi - lo) / 2);
-        if (st->entries[mid].dOffset <= offset)
+        size_t mid = lo + (hi - lo) / 2;
+        if (st->pageD[mid] <= offset)
             lo = mid;
         else
             hi = mid;
@@ -201,33 +943,165 @@ ssize_t offset_to_frame_idx(ZSTD_seekTable *st, size_t offset)
     return lo;
 }
 
+ssize_t offset_to_frame_idx(ZSTD_seekTable *st, size_t offset,
+    void *call_data)
+{
+    if (st->frameSizeD) {
+        if (offset >= st->sizeD)
+            return -1;
+        size_t frame_idx = offset / st->frameSizeD;
+        if (!seek_table_load(st, frame_idx, frame_idx + 1, call_data))
+            return -2;
+        return frame_idx;
+    }
+
+    if (st->pages) {
+        ssize_t page = page_find(st, offset, call_data);
+        if (page < 0) {
+            // Keep the end of the table loaded, see
+            // seek_table_decompressed_size()
+            if (page == -1 && !seek_table_load(st, st->tableLen - 1,
+                st->tableLen, call_data))
+                return -2;
+            return page;
+        }
+        size_t first = page * SEEK_PAGE_FRAMES;
+        if (!seek_table_load(st, first, first + 1, call_data))
+            return -2;
+
+        const U64 *d = page_of(st, first)->d;
+        size_t lo = 0;
+        size_t len = MIN(SEEK_PAGE_FRAMES, st->tableLen - first);
+        while (len > 1) {
+            size_t half = len / 2;
+            lo += (d[lo + half] <= offset) ? half : 0;
+            len -= half;
+        }
+        return first + lo;
+    }
+
+    if (offset >= offset_d(st, st->tableLen))
+        return -1;
+
+    // Find the first block starting after offset (Eytzinger index k, or 0 if
+    // none), prefetching a few levels down
+    size_t k = 1;
+    while (k <= st->nbBlocks) {
+        __builtin_prefetch(st->dEytz + 8 * k);
+        k = 2 * k + (st->dEytz[k] <= offset);
+    }
+    k >>= __builtin_ffsll(~(long long)k);
+    size_t block = k ? st->eytzBlock[k] - 1 : st->nbBlocks - 1;
+
+    // Find the last frame of the block starting before (or at) offset
+    size_t first = block << st->blockShift;
+    const U32 *rel = st->dRel + first;
+    U32 offset_rel = offset - st->dBase[block];
+    size_t lo = 0;
+    size_t len = MIN((size_t)1 << st->blockShift, st->tableLen - first);
+    while (len > 1) {
+        size_t half = len / 2;
+        // NOTE: Branchless (conditional move), rel[0] == 0 <= offset_rel
+        lo += (rel[lo + half] <= offset_rel) ? half : 0;
+        len -= half;
+    }
+    return first + lo;
+}
+
 off_t frame_offset_c(ZSTD_seekTable *st, size_t frame_idx)
 {
     assert(frame_idx < st->tableLen);
-    return st->entries[frame_idx].cOffset;
+    if (st->pages)
+        return page_of(st, frame_idx)->c[frame_idx % SEEK_PAGE_FRAMES];
+    return offset_c(st, frame_idx);
 }
 
 off_t frame_offset_d(ZSTD_seekTable *st, size_t frame_idx)
 {
     assert(frame_idx < st->tableLen);
-    return st->entries[frame_idx].dOffset;
+    if (st->frameSizeD)
+        return frame_idx * st->frameSizeD;
+    if (st->pages)
+        return page_of(st, frame_idx)->d[frame_idx % SEEK_PAGE_FRAMES];
+    return offset_d(st, frame_idx);
 }
 
 size_t frame_size_c(ZSTD_seekTable *st, size_t frame_idx)
 {
     assert(frame_idx < st->tableLen);
-    return st->entries[frame_idx + 1].cOffset - st->entries[frame_idx].cOffset;
+    if (st->pages) {
+        const U64 *c = page_of(st, frame_idx)->c + frame_idx % SEEK_PAGE_FRAMES;
+        return c[1] - c[0];
+    }
+    return offset_c(st, frame_idx + 1) - offset_c(st, frame_idx);
 }
 
 size_t frame_size_d(ZSTD_seekTable *st, size_t frame_idx)
 {
     assert(frame_idx < st->tableLen);
-    return st->entries[frame_idx + 1].dOffset - st->entries[frame_idx].dOffset;
+    if (st->frameSizeD)
+        return frame_idx + 1 < st->tableLen ? st->frameSizeD :
+            st->sizeD - frame_idx * st->frameSizeD;
+    if (st->pages) {
+        const U64 *d = page_of(st, frame_idx)->d + frame_idx % SEEK_PAGE_FRAMES;
+        return d[1] - d[0];
+    }
+    return offset_d(st, frame_idx + 1) - offset_d(st, frame_idx);
+}
+
+bool frame_sub_block(ZSTD_seekTable *st, size_t frame_idx,
+    size_t offset_in_frame, size_t *sub_c, size_t *sub_d)
+{
+    assert(frame_idx < st->tableLen);
+    if (!st->subSize || offset_in_frame < st->subSize)
+        return false;
+
+    size_t sub = offset_in_frame / st->subSize;
+    const U32 *ends = st->subEnds + st->subFirst[frame_idx];
+    size_t nb_ends = st->subFirst[frame_idx + 1] - st->subFirst[frame_idx];
+    // Sub-block 0 has no entry
+    if (sub > nb_ends || ends[sub - 1] >= frame_size_c(st, frame_idx))
+        // Does not match the seek table
+        return false;
+
+    *sub_c = ends[sub - 1];
+    *sub_d = sub * st->subSize;
+    return true;
 }
 
 size_t seek_table_memory_usage(const ZSTD_seekTable *st)
 {
-    return sizeof(*st) + st->tableLen * sizeof(st->entries[0]);
+    size_t memory = sizeof(*st);
+    if (st->subSize)
+        memory += (st->subFrames + 1 + st->subFirst[st->subFrames]) *
+            sizeof(st->subFirst[0]);
+    if (st->pages) {
+        size_t loaded = atomic_load_explicit(&st->nbLoaded,
+            memory_order_relaxed) + (st->scratch ? 1 : 0);
+        memory += (st->nbPages + 1) *
+            (sizeof(st->pages[0]) + sizeof(st->pageC[0]) +
+            sizeof(st->pageD[0]));
+        memory += loaded * sizeof(st_page_t);
+        return memory;
+    }
+
+    size_t nb_bases = (st->tableLen >> st->blockShift) + 1;
+    memory += nb_bases * sizeof(st->cBase[0]);
+    memory += (st->tableLen + 1) * sizeof(st->cRel[0]);
+    if (!st->frameSizeD) {
+        memory += nb_bases * sizeof(st->dBase[0]);
+        memory += (st->tableLen + 1) * sizeof(st->dRel[0]);
+        memory += (st->nbBlocks + 1) *
+            (sizeof(st->dEytz[0]) + sizeof(st->eytzBlock[0]));
+    }
+    if (st->checksums)
+        memory += (st->tableLen + 1) * sizeof(st->checksums[0]);
+    return memory;
+}
+
+bool seek_table_extended(const ZSTD_seekTable *st)
+{
+    return st->extended;
 }
 
 size_t seek_table_entries(const ZSTD_seekTable *st)
@@ -237,11 +1111,20 @@ size_t seek_table_entries(const ZSTD_seekTable *st)
 
 size_t seek_table_decompressed_size(const ZSTD_seekTable *st)
 {
-    return st->entries[st->tableLen].dOffset;
+    if (st->frameSizeD)
+        return st->sizeD;
+    if (st->pages) {
+        if (st->tableLen == 0)
+            return 0;
+        return page_of(st, st->tableLen - 1)->d[(st->tableLen - 1) %
+            SEEK_PAGE_FRAMES + 1];
+    }
+    return offset_d(st, st->tableLen);
 }
 
-/* NOTE: The below are copied verbatim from
-zstd/contrib/seekable_format/zstdseek_compress.c @ v1.5.0 */
+/* NOTE: The below are copied from
+zstd/contrib/seekable_format/zstdseek_compress.c @ v1.5.0, with 64-bit sizes
+and positions, and the extended format added */
 
 typedef struct {
     U32 cSize;
@@ -251,14 +1134,15 @@ typedef struct {
 
 struct ZSTD_frameLog_s {
     framelogEntry_t* entries;
-    U32 size;
-    U32 capacity;
+    size_t size;
+    size_t capacity;
 
     int checksumFlag;
+    int extended;
 
     /* for use when streaming out the seek table */
-    U32 seekTablePos;
-    U32 seekTableIndex;
+    U64 seekTablePos;
+    size_t seekTableIndex;
 } framelog_t;
 
 static size_t ZSTD_seekable_frameLog_allocVec(ZSTD_frameLog* fl)
@@ -268,7 +1152,7 @@ static size_t ZSTD_seekable_frameLog_allocVec(ZSTD_frameLog* fl)
     fl->entries = (framelogEntry_t*)malloc(
             sizeof(framelogEntry_t) * FRAMELOG_STARTING_CAPACITY);
     if (fl->entries == NULL) return ERROR(memory_allocation);
-    fl->capacity = (U32)FRAMELOG_STARTING_CAPACITY;
+    fl->capacity = FRAMELOG_STARTING_CAPACITY;
     return 0;
 }
 
@@ -289,6 +1173,7 @@ ZSTD_frameLog* ZSTD_seekable_createFrameLog(int checksumFlag)
     }
 
     fl->checksumFlag = checksumFlag;
+    fl->extended = 0;
     fl->seekTablePos = 0;
     fl->seekTableIndex = 0;
     fl->size = 0;
@@ -308,7 +1193,7 @@ size_t ZSTD_seekable_logFrame(ZSTD_frameLog* fl,
                               unsigned decompressedSize,
                               unsigned checksum)
 {
-    if (fl->size == ZSTD_SEEKABLE_MAXFRAMES)
+    if (!fl->extended && fl->size == ZSTD_SEEKABLE_MAXFRAMES)
         return ERROR(frameIndex_tooLarge);
 
     /* grow the buffer if required */
@@ -321,8 +1206,7 @@ size_t ZSTD_seekable_logFrame(ZSTD_frameLog* fl,
         if (newEntries == NULL) return ERROR(memory_allocation);
 
         fl->entries = newEntries;
-        assert(newCapacity <= UINT_MAX);
-        fl->capacity = (U32)newCapacity;
+        fl->capacity = newCapacity;
     }
 
     fl->entries[fl->size] = (framelogEntry_t){
@@ -336,16 +1220,12 @@ size_t ZSTD_seekable_logFrame(ZSTD_frameLog* fl,
 static inline size_t ZSTD_seekable_seekTableSize(const ZSTD_frameLog* fl)
 {
     size_t const sizePerFrame = 8 + (fl->checksumFlag?4:0);
-    size_t const seekTableLen = ZSTD_SKIPPABLEHEADERSIZE +
-                                sizePerFrame * fl->size +
-                                ZSTD_seekTableFooterSize;
-
-    return seekTableLen;
+    return st_size(fl->size, sizePerFrame, fl->extended);
 }
 
 static inline size_t ZSTD_stwrite32(ZSTD_frameLog* fl,
                                     ZSTD_outBuffer* output, U32 const value,
-                                    U32 const offset)
+                                    U64 const offset)
 {
     if (fl->seekTablePos < offset + 4) {
         BYTE tmp[4]; /* so that we can work with buffers too small to write a whole word to */
@@ -355,7 +1235,7 @@ static inline size_t ZSTD_stwrite32(ZSTD_frameLog* fl,
         memcpy((BYTE*)output->dst + output->pos,
                tmp + (fl->seekTablePos - offset), lenWrite);
         output->pos += lenWrite;
-        fl->seekTablePos += (U32)lenWrite;
+        fl->seekTablePos += lenWrite;
 
         if (lenWrite < 4) return ZSTD_seekable_seekTableSize(fl) - fl->seekTablePos;
     }
@@ -373,38 +1253,56 @@ size_t ZSTD_seekable_writeSeekTable(ZSTD_frameLog* fl, ZSTD_outBuffer* output)
 
     size_t const sizePerFrame = 8 + (fl->checksumFlag?4:0);
     size_t const seekTableLen = ZSTD_seekable_seekTableSize(fl);
+    size_t const chunkSize0 = st_chunk_size(fl->size, sizePerFrame,
+                                            fl->extended, 0);
 
     CHECK_Z(ZSTD_stwrite32(fl, output, ZSTD_MAGIC_SKIPPABLE_START | 0xE, 0));
-    assert(seekTableLen <= (size_t)UINT_MAX);
-    CHECK_Z(ZSTD_stwrite32(fl, output, (U32)seekTableLen - ZSTD_SKIPPABLEHEADERSIZE, 4));
+    assert(chunkSize0 <= (size_t)UINT_MAX);
+    CHECK_Z(ZSTD_stwrite32(fl, output, (U32)chunkSize0, 4));
 
     while (fl->seekTableIndex < fl->size) {
-        unsigned long long const start = ZSTD_SKIPPABLEHEADERSIZE + sizePerFrame * fl->seekTableIndex;
-        assert(start + 8 <= UINT_MAX);
+        U64 const start = st_entry_pos(fl->seekTableIndex, sizePerFrame,
+                                       fl->extended);
+        if (fl->extended && fl->seekTableIndex > 0 &&
+            fl->seekTableIndex % SEEK_TABLE_EXT_CHUNK_FRAMES == 0) {
+            /* header of the next skippable frame of entries */
+            size_t const chunkSize = st_chunk_size(fl->size, sizePerFrame, 1,
+                    fl->seekTableIndex / SEEK_TABLE_EXT_CHUNK_FRAMES);
+            CHECK_Z(ZSTD_stwrite32(fl, output,
+                                   ZSTD_MAGIC_SKIPPABLE_START | 0xE,
+                                   start - ZSTD_SKIPPABLEHEADERSIZE));
+            assert(chunkSize <= (size_t)UINT_MAX);
+            CHECK_Z(ZSTD_stwrite32(fl, output, (U32)chunkSize, start - 4));
+        }
+
         CHECK_Z(ZSTD_stwrite32(fl, output,
                                fl->entries[fl->seekTableIndex].cSize,
-                               (U32)start + 0));
+                               start + 0));
 
         CHECK_Z(ZSTD_stwrite32(fl, output,
                                fl->entries[fl->seekTableIndex].dSize,
-                               (U32)start + 4));
+                               start + 4));
 
         if (fl->checksumFlag) {
             CHECK_Z(ZSTD_stwrite32(
                     fl, output, fl->entries[fl->seekTableIndex].checksum,
-                    (U32)start + 8));
+                    start + 8));
         }
 
         fl->seekTableIndex++;
     }
 
-    assert(seekTableLen <= UINT_MAX);
-    CHECK_Z(ZSTD_stwrite32(fl, output, fl->size,
-                           (U32)seekTableLen - ZSTD_seekTableFooterSize));
+    if (fl->extended) {
+        CHECK_Z(ZSTD_stwrite32(fl, output, (U32)((U64)fl->size >> 32),
+                               seekTableLen - SEEK_TABLE_EXT_FOOTER_SIZE));
+    }
+    CHECK_Z(ZSTD_stwrite32(fl, output, (U32)fl->size,
+                           seekTableLen - ZSTD_seekTableFooterSize));
 
     if (output->size - output->pos < 1) return seekTableLen - fl->seekTablePos;
     if (fl->seekTablePos < seekTableLen - 4) {
-        BYTE const sfd = (BYTE)((fl->checksumFlag) << 7);
+        BYTE const sfd = (BYTE)(((fl->checksumFlag) << 7) |
+                (fl->extended ? SEEK_TABLE_DESC_EXTENDED : 0));
 
         ((BYTE*)output->dst)[output->pos] = sfd;
         output->pos++;
@@ -412,12 +1310,18 @@ size_t ZSTD_seekable_writeSeekTable(ZSTD_frameLog* fl, ZSTD_outBuffer* output)
     }
 
     CHECK_Z(ZSTD_stwrite32(fl, output, ZSTD_SEEKABLE_MAGICNUMBER,
-                           (U32)seekTableLen - 4));
+                           seekTableLen - 4));
 
     if (fl->seekTablePos != seekTableLen) return ERROR(GENERIC);
     return 0;
 }
 
+void framelog_set_extended(ZSTD_frameLog *fl)
+{
+    assert(fl->seekTablePos == 0);
+    fl->extended = 1;
+}
+
 size_t framelog_size(const ZSTD_frameLog *fl)
 {
     return ZSTD_seekable_seekTableSize(fl);
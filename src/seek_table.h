@@ -2,6 +2,8 @@
 #define SEEK_TABLE_H
 
 #include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+#include <stdbool.h>    // bool
 #include <sys/types.h>  // off_t
 
 #include "zseek.h"
@@ -14,20 +16,89 @@ size_t ZSTD_seekable_logFrame(ZSTD_frameLog* fl, unsigned compressedSize,
     unsigned decompressedSize, unsigned checksum);
 size_t ZSTD_seekable_writeSeekTable(ZSTD_frameLog* fl, ZSTD_outBuffer* output);
 
+/** Maximum number of frames of a standard (not extended) seek table */
+#define SEEK_TABLE_MAX_FRAMES 0x8000000U
+
+/**
+ * Kinds of trailers. Trailers are skippable frames right before the seek
+ * table, holding file-wide metadata. Each ends with its payload size, kind and
+ * a magic number, so that they can be found going backwards from the seek
+ * table.
+ */
+typedef enum {
+    /** All frames but the last hold the same number of bytes (LE64 payload) */
+    TRAILER_FRAME_SIZE = 1,
+    /** The zstd dictionary all frames are compressed with (raw payload) */
+    TRAILER_DICTIONARY = 2,
+    /**
+     * Frames are made of independently compressed sub-blocks, of a fixed
+     * decompressed size but for the last of each. LE32 payload: sub-block
+     * size, number of frames N, for each frame its first entry in the ends
+     * that follow (and the number of ends), then the compressed offset of
+     * each sub-block but the first of each frame, relative to the frame.
+     */
+    TRAILER_SUB_BLOCKS = 3,
+} trailer_kind_t;
+
+/**
+ * Return the size of a trailer with @p payload_size bytes of payload.
+ */
+size_t trailer_size(size_t payload_size);
+/**
+ * Encode a trailer of @p kind with @p payload_size bytes of @p payload into
+ * @p dst (of trailer_size() bytes). Returns the size of the trailer.
+ */
+size_t trailer_encode(void *dst, trailer_kind_t kind, const void *payload,
+    size_t payload_size);
+/**
+ * Encode a TRAILER_FRAME_SIZE trailer for frames of @p frame_size bytes into
+ * @p dst (of trailer_size(8) bytes). Returns the size of the trailer.
+ */
+size_t trailer_encode_frame_size(void *dst, size_t frame_size);
+/**
+ * Return the payload size of a TRAILER_SUB_BLOCKS trailer for @p nb_frames
+ * frames and @p nb_ends sub-block ends.
+ */
+size_t trailer_sub_blocks_payload_size(size_t nb_frames, size_t nb_ends);
+/**
+ * Encode a TRAILER_SUB_BLOCKS trailer for sub-blocks of @p sub_size bytes
+ * into @p dst (of trailer_size(trailer_sub_blocks_payload_size()) bytes),
+ * with the first sub-block end of each of @p nb_frames frames in @p first and
+ * the @p nb_ends ends in @p ends. Returns the size of the trailer.
+ */
+size_t trailer_encode_sub_blocks(void *dst, size_t sub_size,
+    const uint32_t *first, size_t nb_frames, const uint32_t *ends,
+    size_t nb_ends);
+
 /**
  * Parse and return the seek table found in the last frame contained in @p fin,
- * or NULL on error.
+ * or NULL on error, along with the trailers before it. With @p lazy, only its
+ * footer and header (and trailers) are read, and its
+ * entries are loaded page by page when needed, through @p user_file (which
+ * must outlive it).
+ *
+ * The frames of a lazily loaded seek table must be loaded (see
+ * seek_table_load() and offset_to_frame_idx()) before accessing their
+ * offsets and sizes. They stay loaded.
  */
-ZSTD_seekTable *read_seek_table(zseek_read_file_t user_file, void *call_data);
+ZSTD_seekTable *read_seek_table(zseek_read_file_t user_file, bool lazy,
+    void *call_data);
 /**
  * Free the seek table pointed to by @p st.
  */
 void seek_table_free(ZSTD_seekTable *st);
 /**
- * Return the index of the frame containing decompressed @p offset or -1 if
- * offset is out of range.
+ * Load the frames [@p first, @p end) of @p st, if lazily loaded. Returns false
+ * on error.
+ */
+bool seek_table_load(ZSTD_seekTable *st, size_t first, size_t end,
+    void *call_data);
+/**
+ * Return the index of the frame containing decompressed @p offset (loading it)
+ * or -1 if offset is out of range (loading the last frame) or -2 on error.
  */
-ssize_t offset_to_frame_idx(ZSTD_seekTable *st, size_t offset);
+ssize_t offset_to_frame_idx(ZSTD_seekTable *st, size_t offset,
+    void *call_data);
 /**
  * Return the offset in the compressed file of the frame at index @p frame_idx.
  */
@@ -46,6 +117,42 @@ size_t frame_size_c(ZSTD_seekTable *st, size_t frame_idx);
  */
 size_t frame_size_d(ZSTD_seekTable *st, size_t frame_idx);
 
+/**
+ * Find the sub-block holding @p offset_in_frame in the frame at index
+ * @p frame_idx, if @p st has a sub-block index. Returns its offset within the
+ * frame, compressed in @p sub_c and decompressed in @p sub_d, or @a false if
+ * there's no such index or @p offset_in_frame is in the first sub-block.
+ */
+bool frame_sub_block(ZSTD_seekTable *st, size_t frame_idx,
+    size_t offset_in_frame, size_t *sub_c, size_t *sub_d);
+
+/**
+ * Return the decompressed size of all frames but the last of @p st, if stored
+ * in its trailers (see TRAILER_FRAME_SIZE), or 0.
+ */
+size_t seek_table_frame_size(const ZSTD_seekTable *st);
+
+/**
+ * Return the sub-block size of @p st, or 0 if it has no sub-block index. The
+ * index is returned in @p first (the first end of each frame, and the number
+ * of ends) and @p ends, see TRAILER_SUB_BLOCKS.
+ */
+size_t seek_table_sub_blocks(const ZSTD_seekTable *st, const uint32_t **first,
+    const uint32_t **ends);
+
+/**
+ * Take the dictionary stored in the trailers of @p st, if any. Returns it
+ * (to be freed by the caller) and its size in @p size, or NULL if none.
+ */
+void *seek_table_take_dict(ZSTD_seekTable *st, size_t *size);
+
+/**
+ * Make @p fl write the extended seek table format, with no limit on the
+ * number of frames: a 64-bit frame count in a longer footer, flagged in the
+ * descriptor, and entries spread over several skippable frames, since those
+ * hold at most 4GiB each. Must be called before writing the seek table.
+ */
+void framelog_set_extended(ZSTD_frameLog *fl);
 /**
  * Return the size in bytes that @p fl would take up if written to disk.
  */
@@ -59,6 +166,11 @@ size_t framelog_memory_usage(const ZSTD_frameLog *fl);
  */
 size_t framelog_entries(const ZSTD_frameLog *fl);
 
+/**
+ * Return whether @p st is in the extended format, see framelog_set_extended().
+ */
+bool seek_table_extended(const ZSTD_seekTable *st);
+
 /**
  * Return the memory usage (total heap allocation) of @p st in bytes.
  */
@@ -68,7 +180,8 @@ size_t seek_table_memory_usage(const ZSTD_seekTable *st);
  */
 size_t seek_table_entries(const ZSTD_seekTable *st);
 /**
- * Return the total decompressed size of the frames in @p st.
+ * Return the total decompressed size of the frames in @p st. If lazily loaded
+ * without fixed-size frames, its last frame must be loaded.
  */
 size_t seek_table_decompressed_size(const ZSTD_seekTable *st);
 
@@ -0,0 +1,279 @@
+#include <stdlib.h>     // malloc, free
+#include <string.h>     // memset
+#include <errno.h>      // errno
+#include <stdatomic.h>  // atomic_*
+#include <pthread.h>    // pthread_*
+
+#include "zseek.h"
+#include "common.h"
+#include "thread_pool.h"
+
+struct zseek_thread_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    zseek_task_t *head;
+    zseek_task_t *tail;
+    bool quit;
+
+    pthread_t *threads;
+    int nb_workers;
+};
+
+static void *worker_main(void *arg)
+{
+    zseek_thread_pool_t *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->quit)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (!pool->head)
+            // Quitting, and nothing left to run
+            break;
+
+        zseek_task_t *task = pool->head;
+        pool->head = task->next;
+        if (!pool->head)
+            pool->tail = NULL;
+
+        pthread_mutex_unlock(&pool->lock);
+        task->fn(task->arg);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static void thread_pool_stop(zseek_thread_pool_t *pool, int nb_started)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int t = 0; t < nb_started; t++)
+        pthread_join(pool->threads[t], NULL);
+}
+
+zseek_thread_pool_t *zseek_thread_pool_new(int nb_workers, size_t cpusetsize,
+    const cpu_set_t *cpuset, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    if (nb_workers <= 0) {
+        set_error(errbuf, "invalid number of workers");
+        goto fail;
+    }
+
+    zseek_thread_pool_t *pool = malloc(sizeof(*pool));
+    if (!pool) {
+        set_error_with_errno(errbuf, "allocate thread pool", errno);
+        goto fail;
+    }
+    memset(pool, 0, sizeof(*pool));
+
+    pool->threads = malloc(nb_workers * sizeof(pool->threads[0]));
+    if (!pool->threads) {
+        set_error_with_errno(errbuf, "allocate threads", errno);
+        goto fail_w_pool;
+    }
+
+    int pr = pthread_mutex_init(&pool->lock, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize thread pool lock", pr);
+        goto fail_w_threads;
+    }
+    pr = pthread_cond_init(&pool->cond, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize thread pool condition", pr);
+        goto fail_w_lock;
+    }
+
+    pthread_attr_t attr;
+    pr = pthread_attr_init(&attr);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize thread attributes", pr);
+        goto fail_w_cond;
+    }
+    if (cpuset) {
+        pr = pthread_attr_setaffinity_np(&attr, cpusetsize, cpuset);
+        if (pr) {
+            set_error_with_errno(errbuf, "set thread affinity", pr);
+            goto fail_w_attr;
+        }
+    }
+
+    for (; pool->nb_workers < nb_workers; pool->nb_workers++) {
+        pr = pthread_create(&pool->threads[pool->nb_workers], &attr,
+            worker_main, pool);
+        if (pr) {
+            set_error_with_errno(errbuf, "create worker thread", pr);
+            goto fail_w_workers;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    return pool;
+
+fail_w_workers:
+    thread_pool_stop(pool, pool->nb_workers);
+fail_w_attr:
+    pthread_attr_destroy(&attr);
+fail_w_cond:
+    pthread_cond_destroy(&pool->cond);
+fail_w_lock:
+    pthread_mutex_destroy(&pool->lock);
+fail_w_threads:
+    free(pool->threads);
+fail_w_pool:
+    free(pool);
+fail:
+    return NULL;
+}
+
+void zseek_thread_pool_free(zseek_thread_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    thread_pool_stop(pool, pool->nb_workers);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+int zseek_thread_pool_workers(const zseek_thread_pool_t *pool)
+{
+    return pool ? pool->nb_workers : 0;
+}
+
+void zseek_thread_pool_submit(zseek_thread_pool_t *pool, zseek_task_t *task)
+{
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail)
+        pool->tail->next = task;
+    else
+        pool->head = task;
+    pool->tail = task;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+bool zseek_thread_pool_cancel(zseek_thread_pool_t *pool, zseek_task_t *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&pool->lock);
+    zseek_task_t *prev = NULL;
+    for (zseek_task_t *t = pool->head; t; prev = t, t = t->next) {
+        if (t != task)
+            continue;
+        if (prev)
+            prev->next = t->next;
+        else
+            pool->head = t->next;
+        if (pool->tail == t)
+            pool->tail = prev;
+        found = true;
+        break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return found;
+}
+
+/**
+ * Shared state of a zseek_thread_pool_run() call
+ */
+typedef struct {
+    void (*fn)(void *arg, size_t job);
+    void *arg;
+    size_t nb_jobs;
+    atomic_size_t next_job;
+
+    // Helpers still running
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t running;
+} run_state_t;
+
+static void run_jobs(run_state_t *rs)
+{
+    for (;;) {
+        size_t job = atomic_fetch_add(&rs->next_job, 1);
+        if (job >= rs->nb_jobs)
+            break;
+        rs->fn(rs->arg, job);
+    }
+}
+
+static void run_helper(void *arg)
+{
+    run_state_t *rs = arg;
+    run_jobs(rs);
+
+    pthread_mutex_lock(&rs->lock);
+    if (--rs->running == 0)
+        pthread_cond_signal(&rs->cond);
+    pthread_mutex_unlock(&rs->lock);
+}
+
+void zseek_thread_pool_run(zseek_thread_pool_t *pool, size_t nb_jobs,
+    void (*fn)(void *arg, size_t job), void *arg)
+{
+    run_state_t rs = {.fn = fn, .arg = arg, .nb_jobs = nb_jobs};
+    atomic_init(&rs.next_job, 0);
+    if (nb_jobs == 0)
+        return;
+
+    // One helper per worker at most, and none for the job the caller takes
+    size_t nb_helpers = (size_t)zseek_thread_pool_workers(pool);
+    if (nb_helpers > nb_jobs - 1)
+        nb_helpers = nb_jobs - 1;
+    if (nb_helpers == 0)
+        goto serial;
+
+    // TODO OPT: Avoid the allocation for small runs?
+    zseek_task_t *helpers = malloc(nb_helpers * sizeof(helpers[0]));
+    if (!helpers)
+        goto serial;
+    if (pthread_mutex_init(&rs.lock, NULL))
+        goto serial_w_helpers;
+    if (pthread_cond_init(&rs.cond, NULL))
+        goto serial_w_lock;
+
+    rs.running = nb_helpers;
+    for (size_t h = 0; h < nb_helpers; h++) {
+        helpers[h] = (zseek_task_t){run_helper, &rs, NULL};
+        zseek_thread_pool_submit(pool, &helpers[h]);
+    }
+
+    run_jobs(&rs);
+
+    // Don't wait for helpers stuck behind other tasks, since no jobs are left
+    size_t cancelled = 0;
+    for (size_t h = 0; h < nb_helpers; h++)
+        if (zseek_thread_pool_cancel(pool, &helpers[h]))
+            cancelled++;
+
+    pthread_mutex_lock(&rs.lock);
+    rs.running -= cancelled;
+    while (rs.running > 0)
+        pthread_cond_wait(&rs.cond, &rs.lock);
+    pthread_mutex_unlock(&rs.lock);
+
+    pthread_cond_destroy(&rs.cond);
+    pthread_mutex_destroy(&rs.lock);
+    free(helpers);
+    return;
+
+    // Run on the calling thread alone
+serial_w_lock:
+    pthread_mutex_destroy(&rs.lock);
+serial_w_helpers:
+    free(helpers);
+serial:
+    run_jobs(&rs);
+}
@@ -0,0 +1,63 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <sched.h>      // cpu_set_t
+
+typedef struct zseek_thread_pool zseek_thread_pool_t;
+
+/**
+ * A unit of work for a thread pool. Owned by the submitter, which must keep it
+ * alive until it has run.
+ */
+typedef struct zseek_task {
+    void (*fn)(void *arg);
+    void *arg;
+    struct zseek_task *next;    // Internal (queue link)
+} zseek_task_t;
+
+/**
+ * Creates a new thread pool of @p nb_workers threads. If @p cpuset is not
+ * @a NULL, the workers are confined to it (see pthread_setaffinity_np (3)).
+ */
+zseek_thread_pool_t *zseek_thread_pool_new(int nb_workers, size_t cpusetsize,
+    const cpu_set_t *cpuset, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Frees the thread pool pointed to by @p pool, after running any tasks still
+ * queued.
+ */
+void zseek_thread_pool_free(zseek_thread_pool_t *pool);
+
+/**
+ * Returns the number of worker threads of @p pool (0 for a @a NULL pool).
+ */
+int zseek_thread_pool_workers(const zseek_thread_pool_t *pool);
+
+/**
+ * Queues @p task to run on some worker of @p pool.
+ *
+ * @note Safe to call concurrently
+ */
+void zseek_thread_pool_submit(zseek_thread_pool_t *pool, zseek_task_t *task);
+
+/**
+ * Removes @p task from the queue of @p pool, if it has not started running.
+ * Returns @a true if it was removed, in which case it will not run.
+ *
+ * @note Safe to call concurrently
+ */
+bool zseek_thread_pool_cancel(zseek_thread_pool_t *pool, zseek_task_t *task);
+
+/**
+ * Runs @p fn for each index in [0, @p nb_jobs) and returns once all have run.
+ * The calling thread takes part, so this also works (serially) with a @a NULL
+ * @p pool.
+ *
+ * @note Safe to call concurrently
+ */
+void zseek_thread_pool_run(zseek_thread_pool_t *pool, size_t nb_jobs,
+    void (*fn)(void *arg, size_t job), void *arg);
+
+#endif  // THREAD_POOL_H
@@ -0,0 +1,468 @@
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t
+#include <stdlib.h>     // malloc, free
+#include <string.h>     // memset
+#include <errno.h>      // errno
+#include <stdatomic.h>  // atomic_*
+#include <pthread.h>    // pthread_*
+
+#include <unistd.h>     // pread, close, syscall
+#include <sys/stat.h>   // fstat
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>       // mmap
+#include <sys/syscall.h>    // __NR_io_uring_*
+#include <linux/io_uring.h>
+#endif
+
+#include "zseek.h"
+#include "common.h"
+#include "uring.h"
+
+// Reads in flight per batch, if not specified
+#define QUEUE_DEPTH_DEFAULT 32
+// Upper bound on the size of a single submission (larger reads are split)
+#define READ_MAX (1u << 30)
+// Failed io_uring_enter calls in a row before giving up on a ring
+#define ENTER_RETRIES_MAX 16
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#ifdef HAVE_LINUX_IO_URING_H
+/**
+ * An io_uring instance, used by one batch at a time
+ */
+typedef struct zseek_ring {
+    struct zseek_ring *next;        // Next free ring in the pool
+    struct zseek_ring *all_next;    // Next ring in the pool
+
+    int fd;
+    unsigned entries;
+
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} zseek_ring_t;
+#endif
+
+struct zseek_uring {
+    int fd;
+    unsigned queue_depth;
+
+#ifdef HAVE_LINUX_IO_URING_H
+    // Pool of rings, created on demand
+    pthread_mutex_t lock;
+    zseek_ring_t *free;
+    zseek_ring_t *all;
+#endif
+};
+
+#ifdef HAVE_LINUX_IO_URING_H
+static void ring_free(zseek_ring_t *ring)
+{
+    if (!ring)
+        return;
+
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr)
+        munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+    free(ring);
+}
+
+static zseek_ring_t *ring_new(unsigned entries, char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    zseek_ring_t *ring = malloc(sizeof(*ring));
+    if (!ring) {
+        set_error_with_errno(errbuf, "allocate ring", errno);
+        return NULL;
+    }
+    memset(ring, 0, sizeof(*ring));
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd == -1) {
+        set_error_with_errno(errbuf, "set up io_uring", errno);
+        free(ring);
+        return NULL;
+    }
+    ring->entries = p.sq_entries;
+
+    // Map the rings, once if the kernel supports it (5.4+)
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        if (ring->cq_len > ring->sq_len)
+            ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+    void *ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED) {
+        set_error_with_errno(errbuf, "map submission ring", errno);
+        goto fail;
+    }
+    ring->sq_ptr = ptr;
+    if (single_mmap) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ptr == MAP_FAILED) {
+            set_error_with_errno(errbuf, "map completion ring", errno);
+            goto fail;
+        }
+        ring->cq_ptr = ptr;
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ptr = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED) {
+        set_error_with_errno(errbuf, "map submission entries", errno);
+        goto fail;
+    }
+    ring->sqes = ptr;
+
+    uint8_t *sq = ring->sq_ptr;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    uint8_t *cq = ring->cq_ptr;
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return ring;
+
+fail:
+    ring_free(ring);
+    return NULL;
+}
+
+/**
+ * Take a ring from the pool of @p uring, creating one if none is free. Returns
+ * @a NULL on error.
+ */
+static zseek_ring_t *ring_acquire(zseek_uring_t *uring,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+    pthread_mutex_lock(&uring->lock);
+    zseek_ring_t *ring = uring->free;
+    if (ring)
+        uring->free = ring->next;
+    pthread_mutex_unlock(&uring->lock);
+    if (ring)
+        return ring;
+
+    ring = ring_new(uring->queue_depth, errbuf);
+    if (!ring)
+        return NULL;
+
+    pthread_mutex_lock(&uring->lock);
+    ring->all_next = uring->all;
+    uring->all = ring;
+    pthread_mutex_unlock(&uring->lock);
+
+    return ring;
+}
+
+static void ring_release(zseek_uring_t *uring, zseek_ring_t *ring)
+{
+    pthread_mutex_lock(&uring->lock);
+    ring->next = uring->free;
+    uring->free = ring;
+    pthread_mutex_unlock(&uring->lock);
+}
+
+/**
+ * Remove @p ring (acquired) from the pool of @p uring, and free it
+ */
+static void ring_discard(zseek_uring_t *uring, zseek_ring_t *ring)
+{
+    pthread_mutex_lock(&uring->lock);
+    zseek_ring_t **prev = &uring->all;
+    while (*prev != ring)
+        prev = &(*prev)->all_next;
+    *prev = ring->all_next;
+    pthread_mutex_unlock(&uring->lock);
+
+    ring_free(ring);
+}
+
+/**
+ * Queue the rest of read @p idx of @p reqs (from req->result bytes on)
+ */
+static void ring_queue(zseek_ring_t *ring, int fd, zseek_read_req_t *reqs,
+    size_t idx)
+{
+    zseek_read_req_t *req = &reqs[idx];
+    size_t done = req->result;
+    size_t len = req->size - done;
+    if (len > READ_MAX)
+        // The rest is read on completion, like a short read
+        len = READ_MAX;
+
+    // NOTE: Only this thread writes the tail, the kernel reads it
+    unsigned tail = *ring->sq_tail;
+    unsigned i = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)((uint8_t *)req->data + done);
+    sqe->len = len;
+    sqe->off = req->offset + done;
+    sqe->user_data = idx;
+    ring->sq_array[i] = i;
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, tail + 1,
+        memory_order_release);
+}
+#endif
+
+zseek_uring_t *zseek_uring_new(int fd, unsigned queue_depth,
+    char errbuf[ZSEEK_ERRBUF_SIZE])
+{
+#ifdef HAVE_LINUX_IO_URING_H
+    zseek_uring_t *uring = malloc(sizeof(*uring));
+    if (!uring) {
+        set_error_with_errno(errbuf, "allocate io_uring file", errno);
+        goto fail;
+    }
+    memset(uring, 0, sizeof(*uring));
+    uring->fd = fd;
+    uring->queue_depth = queue_depth > 0 ? queue_depth : QUEUE_DEPTH_DEFAULT;
+
+    int pr = pthread_mutex_init(&uring->lock, NULL);
+    if (pr) {
+        set_error_with_errno(errbuf, "initialize ring pool lock", pr);
+        goto fail_w_uring;
+    }
+
+    // Create one ring up front, to catch errors (e.g. no support) early
+    zseek_ring_t *ring = ring_new(uring->queue_depth, errbuf);
+    if (!ring)
+        goto fail_w_lock;
+    uring->free = ring;
+    uring->all = ring;
+
+    return uring;
+
+fail_w_lock:
+    pthread_mutex_destroy(&uring->lock);
+fail_w_uring:
+    free(uring);
+fail:
+    return NULL;
+#else
+    (void)fd;
+    (void)queue_depth;
+
+    set_error(errbuf, "io_uring not supported");
+    return NULL;
+#endif
+}
+
+void zseek_uring_free(zseek_uring_t *uring)
+{
+    if (!uring)
+        return;
+
+#ifdef HAVE_LINUX_IO_URING_H
+    zseek_ring_t *ring = uring->all;
+    while (ring) {
+        zseek_ring_t *next = ring->all_next;
+        ring_free(ring);
+        ring = next;
+    }
+    pthread_mutex_destroy(&uring->lock);
+#endif
+    free(uring);
+}
+
+ssize_t zseek_uring_pread(void *data, size_t size, size_t offset,
+    void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    zseek_uring_t *uring = user_data;
+    size_t _read = 0;
+    while (_read < size) {
+        ssize_t r = pread(uring->fd, (uint8_t*)data + _read, size - _read,
+            offset + _read);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (r == 0)
+            // EOF
+            break;
+        _read += r;
+    }
+
+    return _read;
+}
+
+ssize_t zseek_uring_fsize(void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    zseek_uring_t *uring = user_data;
+    struct stat st;
+    if (fstat(uring->fd, &st) == -1)
+        return -1;
+
+    return st.st_size;
+}
+
+/**
+ * Serve the rest of read @p req (from req->result bytes on) with pread
+ */
+static void pread_rest(zseek_uring_t *uring, zseek_read_req_t *req)
+{
+    ssize_t r = zseek_uring_pread((uint8_t *)req->data + req->result,
+        req->size - req->result, req->offset + req->result, uring, NULL);
+    req->result = r < 0 ? r : req->result + r;
+}
+
+/**
+ * Serve the reads in @p reqs from index @p first on one at a time, with pread
+ */
+static void pread_batch_sync(zseek_uring_t *uring, zseek_read_req_t *reqs,
+    size_t first, size_t nb_reqs, zseek_read_done_t done, void *done_arg)
+{
+    for (size_t r = first; r < nb_reqs; r++) {
+        reqs[r].result = zseek_uring_pread(reqs[r].data, reqs[r].size,
+            reqs[r].offset, uring, NULL);
+        done(&reqs[r], done_arg);
+    }
+}
+
+void zseek_uring_pread_batch(zseek_read_req_t *reqs, size_t nb_reqs,
+    zseek_read_done_t done, void *done_arg, void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    zseek_uring_t *uring = user_data;
+    for (size_t r = 0; r < nb_reqs; r++)
+        reqs[r].result = 0;
+
+#ifdef HAVE_LINUX_IO_URING_H
+    zseek_ring_t *ring = ring_acquire(uring, NULL);
+    if (!ring) {
+        // Out of resources for another ring, fall back to blocking reads
+        pread_batch_sync(uring, reqs, 0, nb_reqs, done, done_arg);
+        return;
+    }
+
+    // Requests are queued in order, but may be queued again on short reads
+    size_t next = 0;
+    size_t inflight = 0;    // Queued and not completed
+    unsigned to_submit = 0; // Queued and not submitted
+    bool sync = false;      // Serve the rest of the requests with pread
+    unsigned failures = 0;  // Failed io_uring_enter calls in a row
+    while ((next < nb_reqs && !sync) || inflight > 0) {
+        while (next < nb_reqs && !sync && inflight < ring->entries) {
+            ring_queue(ring, uring->fd, reqs, next++);
+            inflight++;
+            to_submit++;
+        }
+
+        int r = syscall(__NR_io_uring_enter, ring->fd, to_submit, 1,
+            IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            bool transient = errno == EAGAIN || errno == EBUSY;
+            failures++;
+            if ((!transient || failures >= ENTER_RETRIES_MAX) && !sync) {
+                // Give up on submitting: take back what was not submitted,
+                // and serve it (and any rest of what completes) with pread
+                // NOTE: Reads already submitted can't be abandoned, since the
+                // kernel may still write to their buffers, so those are
+                // waited for below.
+                unsigned tail = *ring->sq_tail;
+                for (unsigned t = tail - to_submit; t != tail; t++) {
+                    size_t idx = ring->sqes[t & *ring->sq_mask].user_data;
+                    pread_rest(uring, &reqs[idx]);
+                    done(&reqs[idx], done_arg);
+                }
+                atomic_store_explicit((_Atomic unsigned *)ring->sq_tail,
+                    tail - to_submit, memory_order_release);
+                inflight -= to_submit;
+                to_submit = 0;
+                sync = true;
+            }
+            // Back off, then reap whatever completed in the meantime
+            // NOTE: Completions may need this task to enter the kernel, which
+            // sleeping does too
+            usleep(1u << MIN(failures, 10));
+            r = 0;
+        } else {
+            failures = 0;
+        }
+        to_submit -= r;
+
+        // Reap completions
+        unsigned head = *ring->cq_head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned *)ring->cq_tail,
+            memory_order_acquire);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            size_t idx = cqe->user_data;
+            zseek_read_req_t *req = &reqs[idx];
+            bool again = false;
+            if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+                again = true;
+            } else if (cqe->res < 0) {
+                req->result = -1;
+            } else if (cqe->res > 0) {
+                req->result += cqe->res;
+                // Short read
+                again = (size_t)req->result < req->size;
+            }
+            if (again && !sync) {
+                // Queue the rest
+                ring_queue(ring, uring->fd, reqs, idx);
+                to_submit++;
+                continue;
+            }
+            if (again)
+                pread_rest(uring, req);
+            // Complete, or EOF
+            inflight--;
+            done(req, done_arg);
+        }
+        atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head,
+            memory_order_release);
+    }
+
+    // Nothing in flight: a ring that failed is dropped rather than reused
+    if (sync)
+        ring_discard(uring, ring);
+    else
+        ring_release(uring, ring);
+    if (next < nb_reqs)
+        pread_batch_sync(uring, reqs, next, nb_reqs, done, done_arg);
+#else
+    pread_batch_sync(uring, reqs, 0, nb_reqs, done, done_arg);
+#endif
+}
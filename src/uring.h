@@ -0,0 +1,46 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>     // size_t
+#include <sys/types.h>  // ssize_t
+
+#include "zseek.h"
+
+/**
+ * A file read through io_uring, with a pool of rings so that concurrent batches
+ * don't contend for one
+ */
+typedef struct zseek_uring zseek_uring_t;
+
+/**
+ * Creates a new io_uring file for @p fd, with up to @p queue_depth reads in
+ * flight per batch. Fails if io_uring is not supported.
+ */
+zseek_uring_t *zseek_uring_new(int fd, unsigned queue_depth,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Frees the io_uring file pointed to by @p uring. The file descriptor is not
+ * closed.
+ */
+void zseek_uring_free(zseek_uring_t *uring);
+
+/**
+ * Read handler for an io_uring file (@p user_data), see zseek_pread_t
+ */
+ssize_t zseek_uring_pread(void *data, size_t size, size_t offset,
+    void *user_data, void *call_data);
+
+/**
+ * File size handler for an io_uring file (@p user_data), see zseek_fsize_t
+ */
+ssize_t zseek_uring_fsize(void *user_data, void *call_data);
+
+/**
+ * Batch read handler for an io_uring file (@p user_data), see
+ * zseek_pread_batch_t
+ */
+void zseek_uring_pread_batch(zseek_read_req_t *reqs, size_t nb_reqs,
+    zseek_read_done_t done, void *done_arg, void *user_data, void *call_data);
+
+#endif  // URING_H
@@ -22,6 +22,7 @@
 #define ZSEEK_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -55,6 +56,24 @@
 typedef bool (*zseek_write_t)(const void *data, size_t size, void *user_data,
     void *call_data);
 
+/**
+ * Pluggable truncate handler
+ *
+ * @param size
+ *  The size to cut the file down to
+ * @param user_data
+ *  The user-specified file handle
+ * @param call_data
+ *  The user-specified per-call data
+ *
+ * @retval true
+ *  On success. The file is @p size bytes long, and writes go on from there.
+ * @retval false
+ *  On error
+ */
+typedef bool (*zseek_truncate_t)(size_t size, void *user_data,
+    void *call_data);
+
 /**
  * User-defined file supporting writes
  */
@@ -63,6 +82,11 @@ typedef struct {
     void *user_data;
     /** Write function */
     zseek_write_t write;
+    /**
+     * Truncate function (optional). Required by zseek_writer_open_append(),
+     * to cut off the seek table of the file before appending to it.
+     */
+    zseek_truncate_t truncate;
 } zseek_write_file_t;
 
 /**
@@ -84,6 +108,8 @@ typedef struct {
  *  was encountered.
  * @retval <0
  *  On error
+ *
+ * @note May be called concurrently, when the reader is used concurrently
  */
 typedef ssize_t (*zseek_pread_t)(void *data, size_t size, size_t offset,
     void *user_data, void *call_data);
@@ -103,6 +129,81 @@ typedef ssize_t (*zseek_pread_t)(void *data, size_t size, size_t offset,
  */
 typedef ssize_t (*zseek_fsize_t)(void *user_data, void *call_data);
 
+/**
+ * Pluggable range handler, for files that are directly addressable (e.g.
+ * mapped in memory)
+ *
+ * @param size
+ *  The number of bytes in the range
+ * @param offset
+ *  The file offset the range starts at
+ * @param user_data
+ *  The user-specified file handle
+ * @param call_data
+ *  The user-specified per-call data
+ *
+ * @retval ptr
+ *  Pointer to the @p size bytes at @p offset, valid until the reader is closed
+ * @retval NULL
+ *  If not available. The range is read with the pread handler instead.
+ *
+ * @note May be called concurrently, when the reader is used concurrently
+ */
+typedef const void *(*zseek_range_t)(size_t size, size_t offset,
+    void *user_data, void *call_data);
+
+/**
+ * A single read of a batch, see zseek_pread_batch_t
+ */
+typedef struct {
+    /** The destination for the data read */
+    void *data;
+    /** The number of bytes to read */
+    size_t size;
+    /** The file offset to read from */
+    size_t offset;
+    /**
+     * Set by the handler: the number of bytes read (less than @ref size only
+     * on EOF), or <0 on error
+     */
+    ssize_t result;
+} zseek_read_req_t;
+
+/**
+ * Completion notification for a read of a batch
+ *
+ * @param req
+ *  The completed read, with its result set
+ * @param arg
+ *  The argument passed to the batch read handler
+ */
+typedef void (*zseek_read_done_t)(zseek_read_req_t *req, void *arg);
+
+/**
+ * Pluggable batch read handler, for files supporting many reads in flight
+ *
+ * Performs all of the @p nb_reqs reads in @p reqs, possibly concurrently and in
+ * any order, and calls @p done for each one as soon as it completes, on the
+ * calling thread. Returns once all reads have completed.
+ *
+ * @param reqs
+ *  The reads to perform
+ * @param nb_reqs
+ *  The number of reads in @p reqs
+ * @param done
+ *  Function to call exactly once per read, once completed (or failed)
+ * @param done_arg
+ *  Argument to pass to @p done
+ * @param user_data
+ *  The user-specified file handle
+ * @param call_data
+ *  The user-specified per-call data
+ *
+ * @note May be called concurrently, when the reader is used concurrently
+ */
+typedef void (*zseek_pread_batch_t)(zseek_read_req_t *reqs, size_t nb_reqs,
+    zseek_read_done_t done, void *done_arg, void *user_data, void *call_data);
+
 /**
  * User-defined file supporting reads
  */
@@ -113,6 +214,16 @@ typedef struct {
     zseek_pread_t pread;
     /** File size function */
     zseek_fsize_t fsize;
+    /**
+     * Range function (optional). If set, compressed frames are decompressed
+     * from the returned ranges directly, without copying.
+     */
+    zseek_range_t range;
+    /**
+     * Batch read function (optional). If set, zseek_preadv() keeps many frame
+     * fetches in flight, decompressing frames as they arrive.
+     */
+    zseek_pread_batch_t pread_batch;
 } zseek_read_file_t;
 
 /**
@@ -137,6 +248,26 @@ typedef struct {
     int compression_level;
     /** Compression strategy (default = fast)  */
     int strategy;
+    /**
+     * A dictionary to compress all frames with (default = NULL, none), e.g.
+     * one trained with ZDICT_trainFromBuffer() on sample data, or raw
+     * content. It is copied, and stored in the file for readers to load once.
+     * Helps most with small frames. Exclusive with @ref dict_train_frames.
+     */
+    const void *dict;
+    /** The size of @ref dict */
+    size_t dict_size;
+    /**
+     * Train a dictionary on the first that many frames of data, and compress
+     * all frames with it (default = 0, don't). Data is buffered until then
+     * (dict_train_frames * min_frame_size bytes) or until flushed or closed,
+     * then cut into frames of min_frame_size bytes. If training fails (e.g.
+     * too little data), frames are compressed without a dictionary. Requires
+     * min_frame_size > 0.
+     */
+    size_t dict_train_frames;
+    /** Maximum size of a trained dictionary (default = 0, i.e. 110 KiB) */
+    size_t dict_max_size;
 } zseek_zstd_param_t;
 
 /**
@@ -145,6 +276,14 @@ typedef struct {
 typedef struct {
     /** Compression level (default = 0). Values < 0 trigger "acceleration" */
     int compression_level;
+    /** The size of @ref cpuset. See pthread_setaffinity_np (3) */
+    size_t cpusetsize;
+    /**
+     * The CPU set to confine the frame workers to (see
+     * zseek_compression_param_t.nb_frame_workers). See
+     * pthread_setaffinity_np (3)
+     */
+    cpu_set_t *cpuset;
 } zseek_lz4_param_t;
 
 /**
@@ -156,8 +295,354 @@ typedef struct {
         zseek_zstd_param_t zstd_params;
         zseek_lz4_param_t lz4_params;
     } params;
+    /**
+     * Number of worker threads compressing whole frames in parallel, for any
+     * compression type (default = 0, compress on the calling thread). Frames
+     * are still written out in order, from zseek_write() and
+     * zseek_writer_close(). The workers are confined to the cpuset of the
+     * compression type params, if set. Exclusive with
+     * zseek_zstd_param_t.nb_workers.
+     */
+    int nb_frame_workers;
+    /**
+     * Maximum number of frames in flight, being compressed or written out in
+     * the background (default = 0, output from the calling thread). When set,
+     * zseek_write() only buffers data and dispatches full frames, blocking
+     * only when that many frames are in flight. Frames are compressed on
+     * nb_frame_workers threads (at least 1) and written out in order by them,
+     * with the call data given at open. Output errors are reported by a later
+     * zseek_write(), zseek_writer_flush() or zseek_writer_close(). Exclusive
+     * with zseek_zstd_param_t.nb_workers.
+     */
+    int async_queue_depth;
+    /**
+     * Make all frames but the last hold exactly min_frame_size bytes
+     * (uncompressed), splitting writes across frames as needed (default =
+     * false). This is recorded in the file, for readers to map offsets to
+     * frames with a division, without storing decompressed offsets. With it,
+     * zseek_writer_flush() fails unless the current frame is full or empty,
+     * and zseek_writer_reserve() fails for more bytes than are left in the
+     * current frame. Requires 0 < min_frame_size <= UINT32_MAX.
+     */
+    bool fixed_frame_size;
+    /**
+     * Compress each frame as independent sub-blocks of this many bytes
+     * (uncompressed), but the last, and index them in the file (default = 0,
+     * whole frames). Reads without a cache then decompress a frame from the
+     * sub-block holding their offset, instead of from its start, while the
+     * seek table and cache keep the granularity of whole frames. Each
+     * sub-block is a complete zstd or lz4 frame, so the compression ratio is
+     * about that of frames of this size (a zstd dictionary helps). Requires
+     * sub_block_size <= UINT32_MAX. Exclusive with
+     * zseek_zstd_param_t.nb_workers.
+     */
+    size_t sub_block_size;
+    /**
+     * Compression throughput to keep up with, in uncompressed bytes per
+     * second (default = 0, keep the compression level fixed). The level then
+     * starts from the one of the compression type params and is adjusted
+     * between frames within [@ref min_level, @ref max_level]: lowered while
+     * the measured compression speed (times nb_frame_workers) is below the
+     * target, or while async_queue_depth frames are in flight, and raised
+     * while it is well above. Set zseek_zstd_param_t.strategy to 0 for levels
+     * to take full effect; with a dictionary, its parameters mostly prevail.
+     * Exclusive with zseek_zstd_param_t.nb_workers.
+     */
+    size_t target_rate;
+    /**
+     * Lowest compression level with @ref target_rate (default = both this and
+     * @ref max_level 0: 1 to 19 for zstd, 0 to 12 for lz4)
+     */
+    int min_level;
+    /** Highest compression level with @ref target_rate */
+    int max_level;
+    /**
+     * Write the seek table in an extended format, for files of more than
+     * 2^27 frames (default = false, the standard zstd seekable format). The
+     * number of frames is stored in 64 bits and flagged in the seek table
+     * descriptor, and the entries span several skippable frames as needed.
+     * Files with an extended seek table can only be read by this library (of
+     * this version or later). Readers keep the same in-memory index (see
+     * zseek_reader_param_t.lazy_seek_table for huge files).
+     */
+    bool extended_seek_table;
+    /**
+     * Cut frames at record ends only, as marked by zseek_writer_end_record()
+     * (default = false): once a frame holds at least min_frame_size bytes,
+     * it ends with the current record rather than with the write that fills
+     * it, so that records written whole between marks never straddle two
+     * frames, unless longer than @ref max_frame_size. Exclusive with
+     * @ref fixed_frame_size and zseek_zstd_param_t.dict_train_frames.
+     */
+    bool record_aligned;
+    /**
+     * Maximum number of bytes (uncompressed) in a frame (default = 0, no
+     * limit). Writes are split across frames as needed. With
+     * @ref record_aligned, a record that does not fit in the current frame
+     * starts the next one instead (it is held back until then), and only
+     * records longer than max_frame_size are split. Requires max_frame_size
+     * >= min_frame_size. With it, zseek_writer_reserve() fails for more bytes
+     * than are left in the current frame (or, with @ref record_aligned, than
+     * the current record can grow by). Exclusive with @ref fixed_frame_size.
+     */
+    size_t max_frame_size;
 } zseek_compression_param_t;
 
+/**
+ * Handler for decompressed data, see zseek_reader_decompress_range()
+ *
+ * @param data
+ *  The decompressed data, valid during the call only
+ * @param size
+ *  The size of @p data
+ * @param offset
+ *  The offset of @p data in the decompressed data
+ * @param user_data
+ *  The user-specified sink data
+ *
+ * @retval true
+ *  On success
+ * @retval false
+ *  On error, stopping the decompression
+ */
+typedef bool (*zseek_sink_t)(const void *data, size_t size, size_t offset,
+    void *user_data);
+
+/**
+ * A borrowed reference to decompressed data, see zseek_pread_ref()
+ */
+typedef struct {
+    /** Decompressed data at the requested offset */
+    const void *data;
+    /** Number of bytes available at @ref data (up to the end of the frame) */
+    size_t len;
+    /** Internal, do not modify */
+    size_t frame_idx;
+    /** Internal, do not modify */
+    void *owned;
+} zseek_frame_ref_t;
+
+/**
+ * Memory allocation handler, see zseek_allocator_t
+ *
+ * @param size
+ *  Number of bytes to allocate
+ * @param opaque
+ *  The user-specified data of the allocator
+ * @return
+ *  The allocated memory, or @a NULL on error
+ */
+typedef void *(*zseek_alloc_t)(size_t size, void *opaque);
+
+/**
+ * Memory deallocation handler, see zseek_allocator_t
+ *
+ * @param ptr
+ *  Memory returned by the matching zseek_alloc_t
+ * @param size
+ *  The size it was allocated with
+ * @param opaque
+ *  The user-specified data of the allocator
+ */
+typedef void (*zseek_free_t)(void *ptr, size_t size, void *opaque);
+
+/**
+ * A custom memory allocator, e.g. an arena or a hugepage allocator
+ */
+typedef struct {
+    zseek_alloc_t alloc;
+    zseek_free_t free;
+    /** User-specified data passed to @ref alloc and @ref free */
+    void *opaque;
+} zseek_allocator_t;
+
+/**
+ * Number of buckets of a zseek_histogram_t
+ */
+#define ZSEEK_HISTOGRAM_BUCKETS 40
+
+/**
+ * A histogram with power-of-2 buckets: bucket b counts values in
+ * [2^b, 2^(b+1)), with 0 counted in bucket 0 and larger values in the last
+ */
+typedef struct {
+    /** Number of values */
+    uint64_t count;
+    /** Sum of the values */
+    uint64_t sum;
+    uint64_t buckets[ZSEEK_HISTOGRAM_BUCKETS];
+} zseek_histogram_t;
+
+/**
+ * Kinds of reader events, see zseek_reader_event_handler_t
+ */
+typedef enum {
+    /** A read found its frame cached */
+    ZSEEK_EVENT_CACHE_HIT,
+    /** A read found its frame uncached (so fetched it, or waited for it) */
+    ZSEEK_EVENT_CACHE_MISS,
+    /** A frame was evicted from the cache */
+    ZSEEK_EVENT_CACHE_EVICT,
+    /** Compressed frames were fetched from the file (size is compressed) */
+    ZSEEK_EVENT_FETCH,
+    /** A frame was decompressed (size is decompressed) */
+    ZSEEK_EVENT_DECOMPRESS,
+    /** A thread had to wait for a lock, or for another to fetch a frame */
+    ZSEEK_EVENT_LOCK_WAIT,
+    /** A frame to fetch was found in the compressed cache (size is compressed) */
+    ZSEEK_EVENT_COMPRESSED_HIT,
+    /** A frame to fetch was not in the compressed cache */
+    ZSEEK_EVENT_COMPRESSED_MISS,
+    /** A frame was evicted from the compressed cache (size is compressed) */
+    ZSEEK_EVENT_COMPRESSED_EVICT,
+} zseek_reader_event_type_t;
+
+/**
+ * A reader event, see zseek_reader_event_handler_t
+ */
+typedef struct {
+    zseek_reader_event_type_t type;
+    /** Index of the (first) frame concerned, or SIZE_MAX if none */
+    size_t frame_idx;
+    /** Bytes concerned (fetched or decompressed), or 0 */
+    size_t size;
+    /** Duration in nanoseconds (fetches, decompression and waits), or 0 */
+    uint64_t ns;
+} zseek_reader_event_t;
+
+/**
+ * Reader event handler, e.g. for tracing
+ *
+ * Called on the thread the event happened on (possibly a worker), at the end
+ * of it, and possibly with internal locks held: it must be thread-safe, fast,
+ * and must not call back into the reader.
+ *
+ * @param event
+ *  The event, only valid during the call
+ * @param user_data
+ *  The user-specified data of the handler
+ */
+typedef void (*zseek_reader_event_handler_t)(const zseek_reader_event_t *event,
+    void *user_data);
+
+/**
+ * Cache eviction policies, see zseek_reader_param_t.cache_policy
+ */
+typedef enum {
+    /**
+     * CLOCK (second chance), an approximation of LRU: recently read frames
+     * are kept. A scan larger than the cache flushes it.
+     */
+    ZSEEK_CACHE_CLOCK = 0,
+    /**
+     * 2Q: frames start on probation, in a quarter of the cache, and only get
+     * in the main part (managed by CLOCK) if read again after being evicted
+     * from probation. Scans only displace the frames on probation.
+     */
+    ZSEEK_CACHE_2Q,
+    /**
+     * CLOCK with TinyLFU admission: a frame is only cached in place of another
+     * if it was read more often recently (as estimated by a small, aging,
+     * frequency sketch). Frames read once (e.g. by scans) aren't cached once
+     * the cache is full.
+     */
+    ZSEEK_CACHE_TINYLFU,
+} zseek_cache_policy_t;
+
+/**
+ * Reader control options
+ */
+typedef struct {
+    /**
+     * Maximum number of decompressed frames to cache (0 disables caching,
+     * unless @ref cache_bytes is set)
+     */
+    size_t cache_size;
+    /**
+     * Number of worker threads decompressing the frames of zseek_preadv() and
+     * zseek_reader_decompress_range() in parallel (default = 0, decompress on
+     * the calling thread)
+     */
+    int nb_workers;
+    /** The size of @ref cpuset. See pthread_setaffinity_np (3) */
+    size_t cpusetsize;
+    /** The CPU set to confine the workers to. See pthread_setaffinity_np (3) */
+    cpu_set_t *cpuset;
+    /**
+     * Maximum number of frames to prefetch into the cache on sequential reads
+     * (default = 0, no readahead). Requires a cache, and is capped to its
+     * size. The prefetching runs on the workers, with one started if
+     * @ref nb_workers is 0. Its I/O callbacks get @a NULL call_data.
+     */
+    size_t readahead_max;
+    /**
+     * Load the seek table lazily (default = false, read it whole on open).
+     * Opening then only reads its footer and header, and its entries are
+     * loaded in pages as reads need them, and kept. Locating a page requires
+     * scanning the ones before it (without keeping them), so this pays off
+     * for huge files read only in part, mostly near their start.
+     * zseek_reader_stats() scans the whole seek table, with @a NULL call_data.
+     */
+    bool lazy_seek_table;
+    /**
+     * Maximum total size of decompressed frames to cache, in bytes (default =
+     * 0, no limit). Enables caching on its own, with no limit on the number of
+     * frames unless @ref cache_size is set too. Frames larger than this are
+     * not cached.
+     */
+    size_t cache_bytes;
+    /**
+     * Allocator for decompressed frame buffers (default = all NULL, i.e.
+     * malloc (3) and free (3)). Either both or neither handlers must be set,
+     * and they must be thread-safe. Buffers of frames evicted from the cache
+     * (or otherwise done with) are recycled for later misses, a few of them
+     * at a time.
+     */
+    zseek_allocator_t allocator;
+    /**
+     * Collect metrics (default = false), see zseek_reader_stats_ext(). Costs a
+     * few atomic updates per read, and a clock reading around each fetch,
+     * decompression and contended lock.
+     */
+    bool metrics;
+    /**
+     * Handler called on each event (default = NULL, none), e.g. for tracing.
+     * Events are timed as with @ref metrics.
+     */
+    zseek_reader_event_handler_t event_handler;
+    /** User-specified data passed to @ref event_handler */
+    void *event_data;
+    /**
+     * Maximum total size of compressed frames to cache, in bytes (default =
+     * 0, none). This second tier keeps the frames read from the file, on
+     * misses of the (decompressed) cache or without one, including the
+     * neighbouring frames fetched along by multi-frame reads, so that they
+     * are decompressed again later without any I/O. Compressed frames take
+     * about 1/ratio of the memory of decompressed ones, so this pays off
+     * when reads are slow (e.g. remote storage). Frames read by
+     * zseek_reader_decompress_range() are served from it, but not added.
+     * Ignored if the file provides ranges (see zseek_read_file_t.range).
+     */
+    size_t compressed_cache_bytes;
+    /**
+     * Eviction policy of the caches (default = @ref ZSEEK_CACHE_CLOCK). Reads
+     * with @ref ZSEEK_PREAD_NOCACHE bypass caching under any policy.
+     */
+    zseek_cache_policy_t cache_policy;
+} zseek_reader_param_t;
+
+/**
+ * A single read request, see zseek_preadv()
+ */
+typedef struct {
+    /** Offset in the decompressed data to read data from */
+    size_t offset;
+    /** Buffer to store decompressed data */
+    void *buf;
+    /** Size of decompressed data to read */
+    size_t len;
+} zseek_iovec_t;
+
 /**
  * Handle to a compressed file for sequential writes
  */
@@ -168,6 +653,11 @@ typedef struct zseek_writer zseek_writer_t;
  */
 typedef struct zseek_reader zseek_reader_t;
 
+/**
+ * Handle to a position in a compressed file, for reads from a single thread
+ */
+typedef struct zseek_cursor zseek_cursor_t;
+
 /**
  * Collection of writer statistics
  */
@@ -182,6 +672,34 @@ typedef struct {
     size_t compressed_size;
     /** Estimate for buffered data size in bytes. Always <= actual size. */
     size_t buffer_size;
+    /** Compression level of the next frame, see target_rate */
+    int compression_level;
+    /** Number of compression level changes so far, see target_rate */
+    size_t level_changes;
+    /**
+     * Time spent compressing, in nanoseconds. Summed over all frame workers,
+     * so it may exceed the elapsed time.
+     */
+    uint64_t compress_ns;
+    /** Time spent in the write handler, in nanoseconds */
+    uint64_t write_ns;
+    /**
+     * Time spent flushing frames out of zstd worker threads (see
+     * zseek_zstd_param_t.nb_workers), in nanoseconds. Not in compress_ns.
+     */
+    uint64_t flush_ns;
+    /**
+     * Size of frames written in bytes (uncompressed). Excludes the frames of a
+     * file appended to, see zseek_writer_open_append().
+     */
+    zseek_histogram_t frame_size;
+    /** Size of frames written in bytes (compressed) */
+    zseek_histogram_t frame_compressed_size;
+    /**
+     * Compression ratio of frames written, in hundredths (uncompressed over
+     * compressed size, times 100)
+     */
+    zseek_histogram_t frame_ratio;
 } zseek_writer_stats_t;
 
 /**
@@ -200,8 +718,47 @@ typedef struct {
     size_t cached_frames;
     /** Estimate for buffered data size in bytes. Always <= actual size. */
     size_t buffer_size;
+    /** Memory usage of the compressed cache in bytes */
+    size_t compressed_cache_memory;
+    /** Number of frames currently in the compressed cache */
+    size_t compressed_cached_frames;
 } zseek_reader_stats_t;
 
+/**
+ * Collection of reader statistics and metrics, see zseek_reader_stats_ext().
+ * Counters are cumulative since the reader was opened.
+ */
+typedef struct {
+    /** Same as zseek_reader_stats() */
+    zseek_reader_stats_t stats;
+    /** Frame lookups served from the cache */
+    uint64_t cache_hits;
+    /** Frame lookups not served from the cache (at first) */
+    uint64_t cache_misses;
+    /** Frames evicted from the cache */
+    uint64_t cache_evictions;
+    /** Compressed bytes read from the file */
+    uint64_t compressed_bytes_read;
+    /** Decompressed bytes produced */
+    uint64_t decompressed_bytes;
+    /** Read calls to the file (pread, or each read of a batch) */
+    uint64_t pread_calls;
+    /** Waits for a contended lock, or for another thread to fetch a frame */
+    uint64_t lock_waits;
+    /** Latency of fetches from the file, in nanoseconds */
+    zseek_histogram_t fetch_ns;
+    /** Latency of decompressing a frame (or part of it), in nanoseconds */
+    zseek_histogram_t decompress_ns;
+    /** Latency of the waits counted in @ref lock_waits, in nanoseconds */
+    zseek_histogram_t lock_wait_ns;
+    /** Frames to fetch served from the compressed cache */
+    uint64_t compressed_cache_hits;
+    /** Frames to fetch read from the file instead, with a compressed cache */
+    uint64_t compressed_cache_misses;
+    /** Frames evicted from the compressed cache */
+    uint64_t compressed_cache_evictions;
+} zseek_reader_stats_ext_t;
+
 /**
  * Creates a compressed file for sequential writes
  *
@@ -213,7 +770,8 @@ typedef struct {
  * @param min_frame_size
  *	Minimum (uncompressed) frame size
  * @param call_data
- *  The user-specified per-call data to pass to I/O callbacks
+ *  The user-specified per-call data to pass to I/O callbacks. With asynchronous
+ *  output, this is also passed to background writes.
  * @param[out] errbuf
  *	Pointer to error message buffer or @a NULL
  *
@@ -237,7 +795,8 @@ ZSEEK_EXPORT zseek_writer_t *zseek_writer_open_full(zseek_write_file_t user_file
  * @param min_frame_size
  *	Minimum (uncompressed) frame size
  * @param call_data
- *  The user-specified per-call data to pass to I/O callbacks
+ *  The user-specified per-call data to pass to I/O callbacks. With asynchronous
+ *  output, this is also passed to background writes.
  * @param[out] errbuf
  *	Pointer to error message buffer or @a NULL
  *
@@ -249,6 +808,76 @@ ZSEEK_EXPORT zseek_writer_t *zseek_writer_open_full(zseek_write_file_t user_file
 ZSEEK_EXPORT zseek_writer_t *zseek_writer_open(FILE *cfile, zseek_compression_param_t *zsp,
     size_t min_frame_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Reopens a compressed file to append to it
+ *
+ * The frames of the file are kept as they are, and its seek table (and
+ * trailers) are cut off, for new frames to follow them. Closing writes a
+ * seek table for all frames, old and new. Until then, the file is not
+ * readable. Writer statistics cover all frames too.
+ *
+ * The compression type must be that of the file. A dictionary stored in the
+ * file is used for the new frames as well, and no other can be given (nor
+ * trained), unless the file has no frames. A sub-block index is kept if
+ * @p zsp has the same sub_block_size, while one is started if the file has
+ * none (with its frames left unindexed). With fixed_frame_size,
+ * @p min_frame_size must match that of the file, and its last frame be full.
+ *
+ * @param read_file
+ *	File to read the seek table from
+ * @param user_file
+ *	The same file, to write compressed data to. Needs a truncate handler.
+ * @param zsp
+ *	Compression tunables and multi-threading controls.
+ *	If @a NULL defaults are applied
+ * @param min_frame_size
+ *	Minimum (uncompressed) frame size
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks. With asynchronous
+ *  output, this is also passed to background writes.
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval writer
+ *  Handle to perform writes
+ * @retval NULL
+ *  On error, with the file left untouched unless truncating it failed. If not
+ *  @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT zseek_writer_t *zseek_writer_open_append_full(
+    zseek_read_file_t read_file, zseek_write_file_t user_file,
+    zseek_compression_param_t *zsp, size_t min_frame_size, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Reopens a compressed file to append to it, with default file I/O
+ *
+ * See zseek_writer_open_append_full().
+ *
+ * @param cfile
+ *	File to append compressed data to, open for reading and writing (e.g.
+ *	with mode "r+")
+ * @param zsp
+ *	Compression tunables and multi-threading controls.
+ *	If @a NULL defaults are applied
+ * @param min_frame_size
+ *	Minimum (uncompressed) frame size
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks. With asynchronous
+ *  output, this is also passed to background writes.
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval writer
+ *  Handle to perform writes
+ * @retval NULL
+ *  On error, with the file left untouched unless truncating it failed. If not
+ *  @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT zseek_writer_t *zseek_writer_open_append(FILE *cfile,
+    zseek_compression_param_t *zsp, size_t min_frame_size, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 /**
  * Closes a compressed file handle for writes
  *
@@ -276,7 +905,8 @@ ZSEEK_EXPORT bool zseek_writer_close(zseek_writer_t *writer, void *call_data,
  * internally for efficient compression and IO.
  *
  * This is \e not safe to call concurrently. It will not, in general, return
- * immediately.
+ * immediately, unless asynchronous output is enabled (see
+ * zseek_compression_param_t.async_queue_depth).
  *
  * @param writer
  *	Compressed file write handle
@@ -297,6 +927,106 @@ ZSEEK_EXPORT bool zseek_writer_close(zseek_writer_t *writer, void *call_data,
 ZSEEK_EXPORT bool zseek_write(zseek_writer_t *writer, const void *buf, size_t len,
     void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Leases writable space for appending data to a compressed file
+ *
+ * Returns a pointer to @p size bytes of space at the end of the frame being
+ * filled, so that data can be encoded in place rather than passed to
+ * zseek_write(), which copies it. The data is appended by a following
+ * zseek_writer_commit(). Any other call on @p writer drops the lease, without
+ * appending data, and the space must no longer be used.
+ *
+ * This is \e not safe to call concurrently.
+ *
+ * @param writer
+ *	Compressed file write handle
+ * @param size
+ *	Number of bytes to lease
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval ptr
+ *  Pointer to @p size writable bytes, valid until the next call on @p writer
+ * @retval NULL
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT void *zseek_writer_reserve(zseek_writer_t *writer, size_t size,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Appends data written to leased space to a compressed file
+ *
+ * Appends the first @p used bytes of the space returned by the previous
+ * zseek_writer_reserve(), and ends the lease. Frames are cut as with
+ * zseek_write().
+ *
+ * @param writer
+ *	Compressed file write handle
+ * @param used
+ *	Number of bytes to append, at most the size leased
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval true
+ *  On success
+ * @retval false
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT bool zseek_writer_commit(zseek_writer_t *writer, size_t used,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Marks the end of a record in a compressed file
+ *
+ * With zseek_compression_param_t.record_aligned, ends the current frame if it
+ * holds at least min_frame_size bytes, without waiting for asynchronous
+ * output (unlike zseek_writer_flush()). This is \e not safe to call
+ * concurrently.
+ *
+ * @param writer
+ *	Compressed file write handle
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval true
+ *  On success
+ * @retval false
+ *  On error, including if @p writer wasn't opened with
+ *  zseek_compression_param_t.record_aligned. If not @a NULL, @p errbuf is
+ *  populated with an error message.
+ */
+ZSEEK_EXPORT bool zseek_writer_end_record(zseek_writer_t *writer,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Ends the current frame (if any) and writes out all data appended so far
+ *
+ * This is a barrier for asynchronous output (see
+ * zseek_compression_param_t.async_queue_depth): on return, all data appended is
+ * compressed and passed to the write handler. Ending the current frame early
+ * yields a smaller frame. This is \e not safe to call concurrently with other
+ * calls on @p writer.
+ *
+ * @param writer
+ *	Compressed file write handle
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval true
+ *  On success
+ * @retval false
+ *  On error, including an earlier asynchronous output error. If not @a NULL,
+ *  @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT bool zseek_writer_flush(zseek_writer_t *writer, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 /**
  * Returns currently available writer statistics
  *
@@ -315,6 +1045,65 @@ ZSEEK_EXPORT bool zseek_write(zseek_writer_t *writer, const void *buf, size_t le
 ZSEEK_EXPORT bool zseek_writer_stats(zseek_writer_t *writer, zseek_writer_stats_t *stats,
     char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Concatenates compressed files into one, without recompressing them
+ *
+ * The frames of each input are copied as they are, followed by a single seek
+ * table covering them all. The decompressed output is the concatenation of the
+ * decompressed inputs. Inputs with frames must all have the same compression
+ * type and dictionary (or none). A fixed frame size or sub-block index is
+ * kept if all such inputs share it (and, for the former, only the last frame
+ * of all is partial), and dropped otherwise. The seek table is extended (see
+ * zseek_compression_param_t.extended_seek_table) if that of any input is, or
+ * if there are too many frames for the standard one.
+ *
+ * All inputs are checked before anything is written.
+ *
+ * @param inputs
+ *	The @p n files to concatenate, in order
+ * @param n
+ *	Number of inputs
+ * @param output
+ *	File to write the concatenation to, from its current position
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval true
+ *  On success
+ * @retval false
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT bool zseek_concat_full(const zseek_read_file_t *inputs, size_t n,
+    zseek_write_file_t output, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Concatenates compressed files into one, with default file I/O
+ *
+ * See zseek_concat_full(). Frames are copied in the kernel (with
+ * copy_file_range()) where supported, and through a buffer otherwise.
+ *
+ * @param inputs
+ *	The @p n files to concatenate, in order
+ * @param n
+ *	Number of inputs
+ * @param output
+ *	File to write the concatenation to, from its current position
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval true
+ *  On success
+ * @retval false
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT bool zseek_concat(FILE *const *inputs, size_t n, FILE *output,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 /**
  * Creates a reader for random access reads
  *
@@ -335,6 +1124,27 @@ ZSEEK_EXPORT bool zseek_writer_stats(zseek_writer_t *writer, zseek_writer_stats_
 ZSEEK_EXPORT zseek_reader_t *zseek_reader_open_full(zseek_read_file_t user_file,
     size_t cache_size, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Creates a reader for random access reads, with control options
+ *
+ * @param user_file
+ *  File to read compressed data from
+ * @param param
+ *  Reader control options or @a NULL for defaults
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval reader
+ *  Handle to perform reads
+ * @retval NULL
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT zseek_reader_t *zseek_reader_open_param(
+    zseek_read_file_t user_file, const zseek_reader_param_t *param,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 /**
  * Creates a reader for random access reads, with default file I/O
  *
@@ -355,6 +1165,61 @@ ZSEEK_EXPORT zseek_reader_t *zseek_reader_open_full(zseek_read_file_t user_file,
 ZSEEK_EXPORT zseek_reader_t *zseek_reader_open(FILE *cfile, size_t cache_size,
     void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Creates a reader for random access reads, mapping the file in memory
+ *
+ * Compressed frames are decompressed from the mapping directly, without
+ * copying. The kernel is advised of random access, unless readahead is enabled,
+ * in which case it is advised of the frames prefetched.
+ *
+ * @param cfile
+ *  Regular file to read compressed data from. It is mapped once, so it must
+ *  not change while the reader is open.
+ * @param param
+ *  Reader tunables. If @a NULL defaults are applied
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval reader
+ *  Handle to perform reads
+ * @retval NULL
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT zseek_reader_t *zseek_reader_open_mmap(FILE *cfile,
+    const zseek_reader_param_t *param, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Creates a reader for random access reads, with io_uring file I/O
+ *
+ * Like zseek_reader_open_param() with pread for reads, but batch reads (see
+ * zseek_pread_batch_t) are submitted through io_uring, with up to
+ * @p queue_depth reads in flight per batch. Requires Linux with io_uring
+ * support (at build and run time).
+ *
+ * @param cfile
+ *  File to read compressed data from
+ * @param param
+ *  Reader tunables. If @a NULL defaults are applied
+ * @param queue_depth
+ *  Maximum number of reads in flight per batch (0 for the default)
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval reader
+ *  Handle to perform reads
+ * @retval NULL
+ *  On error, including lack of io_uring support. If not @a NULL, @p errbuf is
+ *  populated with an error message.
+ */
+ZSEEK_EXPORT zseek_reader_t *zseek_reader_open_uring(FILE *cfile,
+    const zseek_reader_param_t *param, unsigned queue_depth, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 /**
  * Closes a compressed file handle for reads
  *
@@ -377,6 +1242,12 @@ ZSEEK_EXPORT bool zseek_reader_close(zseek_reader_t *reader, void *call_data,
 /**
  * Reads data from an arbitrary offset of a compressed file
  *
+ * At most the rest of the frame containing @p offset is read (see
+ * zseek_pread_flags() to fill the whole buffer). This is safe to call
+ * concurrently. Cache misses are fetched and decompressed without blocking
+ * concurrent reads of other frames, while concurrent reads of the same frame
+ * wait for a single fetch.
+ *
  * @param reader
  *	Compressed file reader
  * @param[out] buf
@@ -398,10 +1269,135 @@ ZSEEK_EXPORT bool zseek_reader_close(zseek_reader_t *reader, void *call_data,
 ZSEEK_EXPORT ssize_t zseek_pread(zseek_reader_t *reader, void *buf, size_t count,
     size_t offset, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Flags modifying zseek_pread_flags()
+ */
+typedef enum {
+    /**
+     * Keep reading across frames until @p count bytes are read or EOF is
+     * reached. Consecutive frames missing are fetched with a single read.
+     */
+    ZSEEK_PREAD_FULL = 1 << 0,
+    /**
+     * Don't cache the frames read, nor prefetch any: frames already cached are
+     * copied, and the others are decompressed directly into @p buf. For reads
+     * that won't be repeated (e.g. scans), so that they don't evict the
+     * frames of others.
+     */
+    ZSEEK_PREAD_NOCACHE = 1 << 1,
+} zseek_pread_flags_t;
+
+/**
+ * Reads data from an arbitrary offset of a compressed file, with @p flags
+ *
+ * Same as zseek_pread(), which is equivalent to passing no flags.
+ *
+ * @param reader
+ *	Compressed file reader
+ * @param[out] buf
+ *	Buffer to store decompressed data
+ * @param count
+ *	Size of decompressed data to read
+ * @param offset
+ *	Offset in the decompressed data to read data from
+ * @param flags
+ *	Bitwise OR of @ref zseek_pread_flags_t values
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval N>=0
+ *	Number of bytes read. With @ref ZSEEK_PREAD_FULL, less than @p count only
+ *	at EOF.
+ * @retval -1
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT ssize_t zseek_pread_flags(zseek_reader_t *reader, void *buf,
+    size_t count, size_t offset, unsigned flags, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Performs a batch of reads from arbitrary offsets of a compressed file
+ *
+ * The requests are grouped by frame, so that each distinct frame is loaded
+ * once, and the frames are decompressed in parallel if the reader has workers
+ * (see @ref zseek_reader_param_t). Each request is filled completely, unless
+ * it extends past EOF. This is safe to call concurrently.
+ *
+ * @param reader
+ *	Compressed file reader
+ * @param reqs
+ *	Read requests, in any order. Their buffers must not overlap.
+ * @param n
+ *	Number of read requests
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks. May be used
+ *  concurrently from the worker threads.
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval N>=0
+ *	Total number of bytes read
+ * @retval -1
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ *  Request buffers may have been partially filled.
+ */
+ZSEEK_EXPORT ssize_t zseek_preadv(zseek_reader_t *reader,
+    const zseek_iovec_t *reqs, size_t n, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Borrows decompressed data at an arbitrary offset of a compressed file,
+ * without copying it
+ *
+ * On success, @p ref points to the rest of the frame containing @p offset. The
+ * frame stays pinned in the cache (and so valid) until released with
+ * zseek_frame_release(). Pinned frames are not evicted, so holding many
+ * references at once reduces the effective cache size. This is safe to call
+ * concurrently.
+ *
+ * @param reader
+ *	Compressed file reader
+ * @param offset
+ *	Offset in the decompressed data to borrow data from
+ * @param[out] ref
+ *	Reference to the borrowed data
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval N>0
+ *	Number of bytes available at @p ref->data
+ * @retval 0
+ *	On EOF. Releasing @p ref is optional.
+ * @retval -1
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT ssize_t zseek_pread_ref(zseek_reader_t *reader, size_t offset,
+    zseek_frame_ref_t *ref, void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Releases data borrowed with zseek_pread_ref()
+ *
+ * @param reader
+ *	Compressed file reader @p ref was borrowed from
+ * @param ref
+ *	Reference to release. Its data may not be accessed afterwards.
+ *
+ * @note All references must be released before closing @p reader
+ */
+ZSEEK_EXPORT void zseek_frame_release(zseek_reader_t *reader,
+    zseek_frame_ref_t *ref);
+
 /**
  * Reads data from the current offset of a compressed file
  *
- * This is safe to call concurrently
+ * This is safe to call concurrently, but the current offset is shared:
+ * concurrent reads may read the same data, while each one advances the offset.
+ * For concurrent sequential reads, use a cursor per thread (see
+ * zseek_cursor_open()).
  *
  * @param reader
  *	Compressed file reader
@@ -422,6 +1418,188 @@ ZSEEK_EXPORT ssize_t zseek_pread(zseek_reader_t *reader, void *buf, size_t count
 ZSEEK_EXPORT ssize_t zseek_read(zseek_reader_t *reader, void *buf, size_t count,
     void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Opens a cursor over a compressed file
+ *
+ * A cursor has its own current offset, decompression context and readahead
+ * (see zseek_reader_param_t.readahead_max), and shares the seek table, cache
+ * and workers of @p reader. Reads through a cursor are the same as reads
+ * through @p reader, but never wait for a decompression context of @p reader,
+ * and cursors scanning at once each get their sequential reads prefetched.
+ * Different cursors may be used concurrently, each from a single thread at a
+ * time.
+ *
+ * @param reader
+ *	Compressed file reader. Must outlive the cursor.
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval cursor
+ *	On success, a cursor at offset 0
+ * @retval NULL
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT zseek_cursor_t *zseek_cursor_open(zseek_reader_t *reader,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Closes a cursor
+ *
+ * @param cursor
+ *	Cursor to close, or @a NULL
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval true
+ *  On success. The @p cursor is de-allocated and no longer usable.
+ * @retval false
+ *	On error. If not @a NULL, @p errbuf is populated with an error message. The
+ *  @p cursor is de-allocated and no longer usable.
+ */
+ZSEEK_EXPORT bool zseek_cursor_close(zseek_cursor_t *cursor,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Reads data from an arbitrary offset of a compressed file, through a cursor
+ *
+ * Same as zseek_pread_flags() on the reader of @p cursor. Does not change the
+ * current offset of @p cursor.
+ *
+ * @param cursor
+ *	Cursor over a compressed file
+ * @param[out] buf
+ *	Buffer to store decompressed data
+ * @param count
+ *	Size of decompressed data to read
+ * @param offset
+ *	Offset in the decompressed data to read data from
+ * @param flags
+ *	Bitwise OR of @ref zseek_pread_flags_t values
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval N>=0
+ *	Number of bytes read, see zseek_pread_flags()
+ * @retval -1
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT ssize_t zseek_cursor_pread(zseek_cursor_t *cursor, void *buf,
+    size_t count, size_t offset, unsigned flags, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Reads data from the current offset of a cursor, and advances it
+ *
+ * @param cursor
+ *	Cursor over a compressed file
+ * @param[out] buf
+ *	Buffer to store decompressed data
+ * @param count
+ *	Size of decompressed data to read
+ * @param flags
+ *	Bitwise OR of @ref zseek_pread_flags_t values
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval N>=0
+ *	Number of bytes read, see zseek_pread_flags()
+ * @retval -1
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT ssize_t zseek_cursor_read(zseek_cursor_t *cursor, void *buf,
+    size_t count, unsigned flags, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Sets the current offset of a cursor
+ *
+ * @param cursor
+ *	Cursor over a compressed file
+ * @param offset
+ *	Offset in the decompressed data, possibly past EOF
+ */
+ZSEEK_EXPORT void zseek_cursor_seek(zseek_cursor_t *cursor, size_t offset);
+
+/**
+ * Returns the current offset of a cursor
+ *
+ * @param cursor
+ *	Cursor over a compressed file
+ */
+ZSEEK_EXPORT size_t zseek_cursor_tell(const zseek_cursor_t *cursor);
+
+/**
+ * Decompresses a range of a compressed file in bulk, on all threads
+ *
+ * The frames of the range are split across the workers of the reader (see
+ * @ref zseek_reader_param_t) and the calling thread, each with its own
+ * decompression context and input buffer. They are either decompressed into
+ * @p buf (whole frames directly, at their offset from @p offset), or handed to
+ * @p sink in order, one frame (clamped to the range) per call and one call at
+ * a time, from any of these threads. Up to two frames per thread are held
+ * while waiting to be handed over. The cache is bypassed, neither read nor
+ * filled. This is safe to call concurrently.
+ *
+ * @param reader
+ *	Compressed file reader
+ * @param[out] buf
+ *	Buffer to store decompressed data, or @a NULL to use @p sink
+ * @param count
+ *	Size of decompressed data to read (clamped to EOF)
+ * @param offset
+ *	Offset in the decompressed data to read data from
+ * @param sink
+ *	Handler for decompressed data if @p buf is @a NULL, @a NULL otherwise
+ * @param sink_data
+ *	Data to pass to @p sink
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks. May be used
+ *  concurrently from the worker threads.
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval N>=0
+ *	Number of bytes decompressed
+ * @retval -1
+ *  On error, including @p sink failing. If not @a NULL, @p errbuf is populated
+ *  with an error message. @p buf may have been partially filled, and @p sink
+ *  have been handed part of the range.
+ */
+ZSEEK_EXPORT ssize_t zseek_reader_decompress_range(zseek_reader_t *reader,
+    void *buf, size_t count, size_t offset, zseek_sink_t sink, void *sink_data,
+    void *call_data, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
+/**
+ * Decompresses a whole compressed file in bulk, handing it to @p sink in order
+ *
+ * Same as zseek_reader_decompress_range() over the whole file, with a sink.
+ *
+ * @param reader
+ *	Compressed file reader
+ * @param sink
+ *	Handler for decompressed data
+ * @param sink_data
+ *	Data to pass to @p sink
+ * @param call_data
+ *  The user-specified per-call data to pass to I/O callbacks. May be used
+ *  concurrently from the worker threads.
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval N>=0
+ *	Number of bytes decompressed (the decompressed file size)
+ * @retval -1
+ *  On error, including @p sink failing. If not @a NULL, @p errbuf is populated
+ *  with an error message.
+ */
+ZSEEK_EXPORT ssize_t zseek_reader_decompress_all(zseek_reader_t *reader,
+    zseek_sink_t sink, void *sink_data, void *call_data,
+    char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 /**
  * Returns currently available reader statistics
  *
@@ -442,6 +1620,25 @@ ZSEEK_EXPORT ssize_t zseek_read(zseek_reader_t *reader, void *buf, size_t count,
 ZSEEK_EXPORT bool zseek_reader_stats(zseek_reader_t *reader, zseek_reader_stats_t *stats,
     char errbuf[ZSEEK_ERRBUF_SIZE]);
 
+/**
+ * Returns currently available reader statistics, along with the metrics
+ * collected if opened with zseek_reader_param_t.metrics (or zero otherwise)
+ *
+ * @param reader
+ *	Compressed file handle to get stats for
+ * @param[out] stats
+ *  Pointer to stats structure to populate
+ * @param[out] errbuf
+ *	Pointer to error message buffer or @a NULL
+ *
+ * @retval true
+ *  On success
+ * @retval false
+ *  On error. If not @a NULL, @p errbuf is populated with an error message.
+ */
+ZSEEK_EXPORT bool zseek_reader_stats_ext(zseek_reader_t *reader,
+    zseek_reader_stats_ext_t *stats, char errbuf[ZSEEK_ERRBUF_SIZE]);
+
 #endif
 
 /**
@@ -0,0 +1,521 @@
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t
+#include <stdbool.h>    // bool
+#include <stdio.h>      // I/O
+#include <stdlib.h>     // malloc, free
+#include <string.h>     // memset, memcpy, strcmp, strstr
+#include <time.h>       // clock_gettime
+
+#include <pthread.h>    // pthread_*
+#include <zstd.h>
+
+#include "../src/buffer.h"
+#include "../src/cache.h"
+#include "../src/seek_table.h"
+
+// Operations timed per benchmark (roughly)
+#define OPS (1 << 22)
+// Frames of the small and large seek tables
+#define SMALL_TABLE_FRAMES (1 << 16)
+#define LARGE_TABLE_FRAMES (1 << 22)
+// Frames in the caches
+#define CACHE_CAPACITY 4096
+// Threads sharing a cache, in the contended benchmarks
+#define CONTENDED_THREADS 4
+// Total bytes pushed to buffers
+#define PUSH_TOTAL (1 << 26)    // 64 MiB
+
+static bool json = false;
+static const char *filter = NULL;
+// Keeps the compiler from optimizing the benchmarked calls away
+static volatile size_t sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/**
+ * Whether to run benchmark @p name (with @p variant), as selected by the
+ * filter given on the command line (a substring of "name/variant")
+ */
+static bool selected(const char *name, const char *variant)
+{
+    if (!filter)
+        return true;
+    char full[128];
+    snprintf(full, sizeof(full), "%s/%s", name, variant);
+    return strstr(full, filter) != NULL;
+}
+
+/**
+ * Report @p ops operations of benchmark @p name (with @p variant) taking
+ * @p ns nanoseconds, as a CSV row or a JSON object per line
+ */
+static void report(const char *name, const char *variant, size_t ops,
+    uint64_t ns)
+{
+    double ns_per_op = ops > 0 ? (double)ns / ops : 0;
+    if (json)
+        printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"ops\": %zu, "
+            "\"ns_per_op\": %.2lf}\n", name, variant, ops, ns_per_op);
+    else
+        printf("%s,%s,%zu,%.2lf\n", name, variant, ops, ns_per_op);
+    fflush(stdout);
+}
+
+/*
+ * Seek table
+ */
+
+/**
+ * A compressed file holding only a seek table: reads before it return zeros
+ */
+typedef struct {
+    uint8_t *table;
+    size_t table_size;
+    size_t data_size;   // Compressed size of the frames
+    size_t usize;       // Decompressed size of the frames
+} table_file_t;
+
+static ssize_t table_pread(void *data, size_t size, size_t offset,
+    void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    table_file_t *tf = user_data;
+    size_t fsize = tf->data_size + tf->table_size;
+    if (offset >= fsize)
+        return 0;
+    if (size > fsize - offset)
+        size = fsize - offset;
+    size_t zeros = offset < tf->data_size ?
+        (size < tf->data_size - offset ? size : tf->data_size - offset) : 0;
+    memset(data, 0, zeros);
+    if (zeros < size)
+        memcpy((uint8_t *)data + zeros,
+            tf->table + (offset + zeros - tf->data_size), size - zeros);
+    return size;
+}
+
+static ssize_t table_fsize(void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    table_file_t *tf = user_data;
+    return tf->data_size + tf->table_size;
+}
+
+/**
+ * Write a seek table of @p nb_frames frames of varying sizes (around 16 KiB,
+ * compressed to about 4 KiB) to @p tf. Returns false on error.
+ */
+static bool table_file_init(table_file_t *tf, size_t nb_frames)
+{
+    memset(tf, 0, sizeof(*tf));
+    ZSTD_frameLog *fl = ZSTD_seekable_createFrameLog(0);
+    if (!fl)
+        return false;
+
+    uint64_t seed = 42;
+    for (size_t f = 0; f < nb_frames; f++) {
+        unsigned csize = 2048 + xorshift(&seed) % 4096;
+        unsigned dsize = 12288 + xorshift(&seed) % 8192;
+        if (ZSTD_isError(ZSTD_seekable_logFrame(fl, csize, dsize, 0)))
+            goto fail_w_fl;
+        tf->data_size += csize;
+        tf->usize += dsize;
+    }
+
+    tf->table_size = framelog_size(fl);
+    tf->table = malloc(tf->table_size);
+    if (!tf->table)
+        goto fail_w_fl;
+    ZSTD_outBuffer out = {tf->table, tf->table_size, 0};
+    for (;;) {
+        size_t r = ZSTD_seekable_writeSeekTable(fl, &out);
+        if (ZSTD_isError(r))
+            goto fail_w_table;
+        if (r == 0)
+            break;
+    }
+
+    ZSTD_seekable_freeFrameLog(fl);
+    return true;
+
+fail_w_table:
+    free(tf->table);
+fail_w_fl:
+    ZSTD_seekable_freeFrameLog(fl);
+    return false;
+}
+
+static bool bench_seek_table(size_t nb_frames, const char *variant)
+{
+    bool parse = selected("seek_table_parse", variant);
+    bool lazy = selected("seek_table_open_lazy", variant);
+    bool random = selected("offset_to_frame_idx_random", variant);
+    bool seq = selected("offset_to_frame_idx_sequential", variant);
+    bool lazy_random = selected("offset_to_frame_idx_lazy", variant);
+    if (!parse && !lazy && !random && !seq && !lazy_random)
+        return true;
+
+    table_file_t tf;
+    if (!table_file_init(&tf, nb_frames)) {
+        fprintf(stderr, "seek table: failed to write %zu frames\n", nb_frames);
+        return false;
+    }
+    zseek_read_file_t rf = {&tf, table_pread, table_fsize, NULL, NULL};
+    bool ok = false;
+
+    // Parse at least OPS frames in all
+    size_t reps = nb_frames < OPS ? OPS / nb_frames : 1;
+    if (parse) {
+        uint64_t start = now_ns();
+        for (size_t r = 0; r < reps; r++) {
+            ZSTD_seekTable *st = read_seek_table(rf, false, NULL);
+            if (!st)
+                goto out;
+            sink = seek_table_entries(st);
+            seek_table_free(st);
+        }
+        report("seek_table_parse", variant, reps * nb_frames,
+            now_ns() - start);
+    }
+    if (lazy) {
+        uint64_t start = now_ns();
+        for (size_t r = 0; r < reps; r++) {
+            ZSTD_seekTable *st = read_seek_table(rf, true, NULL);
+            if (!st)
+                goto out;
+            sink = seek_table_entries(st);
+            seek_table_free(st);
+        }
+        report("seek_table_open_lazy", variant, reps, now_ns() - start);
+    }
+
+    size_t *offsets = malloc(OPS * sizeof(offsets[0]));
+    if (!offsets)
+        goto out;
+    uint64_t seed = 42;
+    for (size_t i = 0; i < OPS; i++)
+        offsets[i] = xorshift(&seed) % tf.usize;
+
+    ZSTD_seekTable *st = read_seek_table(rf, false, NULL);
+    if (!st)
+        goto out_w_offsets;
+    if (random) {
+        size_t acc = 0;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < OPS; i++)
+            acc += offset_to_frame_idx(st, offsets[i], NULL);
+        uint64_t ns = now_ns() - start;
+        sink = acc;
+        report("offset_to_frame_idx_random", variant, OPS, ns);
+    }
+    if (seq) {
+        size_t stride = tf.usize / OPS + 1;
+        size_t acc = 0;
+        uint64_t start = now_ns();
+        for (size_t off = 0; off < tf.usize; off += stride)
+            acc += offset_to_frame_idx(st, off, NULL);
+        uint64_t ns = now_ns() - start;
+        sink = acc;
+        report("offset_to_frame_idx_sequential", variant,
+            (tf.usize + stride - 1) / stride, ns);
+    }
+    seek_table_free(st);
+
+    if (lazy_random) {
+        // Includes loading pages on first touch
+        st = read_seek_table(rf, true, NULL);
+        if (!st)
+            goto out_w_offsets;
+        size_t acc = 0;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < OPS; i++)
+            acc += offset_to_frame_idx(st, offsets[i], NULL);
+        uint64_t ns = now_ns() - start;
+        sink = acc;
+        seek_table_free(st);
+        report("offset_to_frame_idx_lazy", variant, OPS, ns);
+    }
+    ok = true;
+
+out_w_offsets:
+    free(offsets);
+out:
+    if (!ok)
+        fprintf(stderr, "seek table: failed to read %zu frames\n", nb_frames);
+    free(tf.table);
+    return ok;
+}
+
+/*
+ * Cache
+ */
+
+// Frame data of all cached frames, never freed
+static uint8_t frame_data[1];
+
+static void noop_release(zseek_frame_t frame, void *arg)
+{
+    (void)frame;
+    (void)arg;
+}
+
+/**
+ * Create a cache with @p policy, filled with frames [0, CACHE_CAPACITY)
+ */
+static zseek_cache_t *cache_filled(zseek_cache_policy_t policy)
+{
+    zseek_cache_t *cache = zseek_cache_new_full(CACHE_CAPACITY, 0, policy,
+        noop_release, NULL);
+    if (!cache)
+        return NULL;
+    for (size_t f = 0; f < CACHE_CAPACITY; f++) {
+        zseek_frame_t frame = {frame_data, f, sizeof(frame_data)};
+        zseek_cache_insert(cache, frame);
+    }
+    return cache;
+}
+
+typedef struct {
+    zseek_cache_t *cache;
+    const size_t *hits;     // Indices of cached frames
+    size_t nb_hits;
+    size_t next_idx;        // First index of frames to insert
+    size_t ops;
+    int id;
+} cache_thread_t;
+
+/**
+ * Mixed workload: pin and unpin cached frames, inserting a new one every 16
+ * operations
+ */
+static void *cache_thread(void *arg)
+{
+    cache_thread_t *ct = arg;
+    uint64_t seed = 42 + ct->id;
+    size_t acc = 0;
+    for (size_t i = 0; i < ct->ops; i++) {
+        if (i % 16 == 15) {
+            zseek_frame_t frame = {frame_data, ct->next_idx++,
+                sizeof(frame_data)};
+            acc += zseek_cache_insert(ct->cache, frame);
+            continue;
+        }
+        size_t f = ct->hits[xorshift(&seed) % ct->nb_hits];
+        if (zseek_cache_pin(ct->cache, f).data) {
+            acc++;
+            zseek_cache_unpin(ct->cache, f);
+        }
+    }
+    sink = acc;
+    return NULL;
+}
+
+static bool bench_cache(zseek_cache_policy_t policy, const char *variant)
+{
+    bool hit = selected("cache_find_hit", variant);
+    bool miss = selected("cache_find_miss", variant);
+    bool evict = selected("cache_insert_evict", variant);
+    bool mixed = selected("cache_mixed", variant);
+    bool contended = selected("cache_mixed_contended", variant);
+    if (!hit && !miss && !evict && !mixed && !contended)
+        return true;
+
+    zseek_cache_t *cache = cache_filled(policy);
+    if (!cache)
+        goto fail;
+    // Frames may not all fit, with uneven shards
+    size_t *hits = malloc(CACHE_CAPACITY * sizeof(hits[0]));
+    size_t *lookups = malloc(OPS * sizeof(lookups[0]));
+    if (!hits || !lookups)
+        goto fail_w_buffers;
+    size_t nb_hits = 0;
+    for (size_t f = 0; f < CACHE_CAPACITY; f++) {
+        if (zseek_cache_find(cache, f).data)
+            hits[nb_hits++] = f;
+    }
+    if (nb_hits == 0)
+        goto fail_w_buffers;
+
+    uint64_t seed = 42;
+    if (hit) {
+        for (size_t i = 0; i < OPS; i++)
+            lookups[i] = hits[xorshift(&seed) % nb_hits];
+        size_t acc = 0;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < OPS; i++)
+            acc += zseek_cache_find(cache, lookups[i]).len;
+        uint64_t ns = now_ns() - start;
+        sink = acc;
+        report("cache_find_hit", variant, OPS, ns);
+    }
+    if (miss) {
+        for (size_t i = 0; i < OPS; i++)
+            lookups[i] = CACHE_CAPACITY + xorshift(&seed) % (OPS / 2);
+        size_t acc = 0;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < OPS; i++)
+            acc += zseek_cache_find(cache, lookups[i]).len;
+        uint64_t ns = now_ns() - start;
+        sink = acc;
+        report("cache_find_miss", variant, OPS, ns);
+    }
+    if (evict) {
+        // New frames, each evicting one (or rejected, by admission)
+        size_t acc = 0;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < OPS; i++) {
+            zseek_frame_t frame = {frame_data, CACHE_CAPACITY + i,
+                sizeof(frame_data)};
+            acc += zseek_cache_insert(cache, frame);
+        }
+        uint64_t ns = now_ns() - start;
+        sink = acc;
+        report("cache_insert_evict", variant, OPS, ns);
+    }
+
+    // Reported per operation of all threads, i.e. the inverse of throughput
+    for (int nb_threads = 1; nb_threads <= CONTENDED_THREADS;
+        nb_threads *= CONTENDED_THREADS) {
+
+        const char *name = nb_threads == 1 ? "cache_mixed" :
+            "cache_mixed_contended";
+        if (!(nb_threads == 1 ? mixed : contended))
+            continue;
+        zseek_cache_free(cache);
+        cache = cache_filled(policy);
+        if (!cache)
+            goto fail_w_buffers;
+
+        cache_thread_t cts[CONTENDED_THREADS];
+        pthread_t threads[CONTENDED_THREADS];
+        uint64_t start = now_ns();
+        int t = 0;
+        for (; t < nb_threads; t++) {
+            cts[t] = (cache_thread_t){cache, hits, nb_hits,
+                CACHE_CAPACITY + (size_t)t * OPS, OPS / nb_threads, t};
+            if (pthread_create(&threads[t], NULL, cache_thread, &cts[t]))
+                break;
+        }
+        for (int j = 0; j < t; j++)
+            pthread_join(threads[j], NULL);
+        uint64_t ns = now_ns() - start;
+        if (t < nb_threads)
+            goto fail_w_buffers;
+        report(name, variant, (OPS / nb_threads) * nb_threads, ns);
+    }
+
+    free(lookups);
+    free(hits);
+    zseek_cache_free(cache);
+    return true;
+
+fail_w_buffers:
+    free(lookups);
+    free(hits);
+    zseek_cache_free(cache);
+fail:
+    fprintf(stderr, "cache: benchmark failed\n");
+    return false;
+}
+
+/*
+ * Buffer
+ */
+
+/**
+ * Push @p chunk bytes at a time to a buffer of initial capacity @p capacity,
+ * PUSH_TOTAL bytes in all, resetting it every @p reset bytes (0 for never)
+ */
+static bool bench_push(const char *variant, size_t capacity, size_t chunk,
+    size_t reset)
+{
+    if (!selected("buffer_push", variant))
+        return true;
+
+    uint8_t *data = malloc(chunk);
+    zseek_buffer_t *buffer = zseek_buffer_new(capacity);
+    if (!data || !buffer) {
+        free(data);
+        zseek_buffer_free(buffer);
+        fprintf(stderr, "buffer: allocation failed\n");
+        return false;
+    }
+    memset(data, 'a', chunk);
+
+    size_t ops = PUSH_TOTAL / chunk;
+    bool ok = true;
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < ops && ok; i++) {
+        if (reset > 0 && zseek_buffer_size(buffer) + chunk > reset)
+            zseek_buffer_reset(buffer);
+        ok = zseek_buffer_push(buffer, data, chunk);
+    }
+    uint64_t ns = now_ns() - start;
+    sink = zseek_buffer_size(buffer);
+
+    zseek_buffer_free(buffer);
+    free(data);
+    if (!ok) {
+        fprintf(stderr, "buffer: push failed\n");
+        return false;
+    }
+    report("buffer_push", variant, ops, ns);
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--json] [FILTER]\n"
+        "Runs the micro-benchmarks whose \"name/variant\" contains FILTER "
+        "(all by default),\nreporting ns/op as CSV (or JSON lines)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (argv[i][0] != '-' && !filter) {
+            filter = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!json)
+        printf("benchmark,variant,ops,ns_per_op\n");
+
+    bool ok = true;
+    ok &= bench_seek_table(SMALL_TABLE_FRAMES, "64k_frames");
+    ok &= bench_seek_table(LARGE_TABLE_FRAMES, "4m_frames");
+
+    ok &= bench_cache(ZSEEK_CACHE_CLOCK, "clock");
+    ok &= bench_cache(ZSEEK_CACHE_2Q, "2q");
+    ok &= bench_cache(ZSEEK_CACHE_TINYLFU, "tinylfu");
+
+    // Small appends growing a buffer, as zseek_write() calls of records
+    ok &= bench_push("16b_growing", 0, 16, 0);
+    // Large appends growing a buffer
+    ok &= bench_push("64k_growing", 0, 1 << 16, 0);
+    // Writer-like: a frame's worth of odd-sized writes, then reset
+    ok &= bench_push("3000b_reused", 1 << 20, 3000, 1 << 20);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,634 @@
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t
+#include <stdbool.h>    // bool
+#include <stdio.h>      // I/O
+#include <stdlib.h>     // malloc, free, qsort
+#include <errno.h>      // perror
+#include <string.h>     // memset, memcpy, strcmp
+#include <math.h>       // sqrt, pow
+#include <time.h>       // clock_gettime
+#include <assert.h>     // assert
+
+#include <pthread.h>    // pthread_*
+#include <sys/stat.h>   // stat
+#include <sys/time.h>
+#include <sys/resource.h>   // getrusage
+
+#include <zseek.h>
+
+#define CHUNK_SIZE (1 << 20)  // 1 MiB
+// Reads issued by each thread
+#define READS_PER_THREAD (1 << 16)
+// Skew of the Zipfian access pattern (as YCSB)
+#define ZIPF_THETA 0.99
+// Upper bound on the distinct ranks of the Zipfian access pattern
+#define ZIPF_MAX_RANKS (1 << 22)
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+typedef enum {
+    PATTERN_UNIFORM,
+    PATTERN_ZIPF,
+    PATTERN_SEQUENTIAL,
+} pattern_t;
+
+typedef struct results {
+    off_t usize;
+    off_t csize;
+    size_t bytes_read;
+    struct timespec wt1;
+    struct timespec wt2;
+    struct rusage ru1;
+    struct rusage ru2;
+    double *latencies;
+    size_t num_latencies;
+} results_t;
+
+/**
+ * An in-memory compressed file
+ */
+typedef struct mem_file {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} mem_file_t;
+
+/**
+ * Shared state of the reader threads
+ */
+typedef struct bench {
+    zseek_reader_t *reader;
+    size_t usize;
+    size_t read_size;
+    pattern_t pattern;
+    int nb_threads;
+    double *zipf_cdf;   // Of nb_ranks entries, for PATTERN_ZIPF
+    size_t nb_ranks;
+    results_t *res;
+} bench_t;
+
+/**
+ * State of a reader thread
+ */
+typedef struct thread_arg {
+    bench_t *bench;
+    int id;
+    size_t bytes_read;
+    bool ok;
+} thread_arg_t;
+
+static results_t *results_new(size_t latencies_capacity)
+{
+    double *latencies = malloc(latencies_capacity * sizeof(*latencies));
+    if (!latencies)
+        goto fail;
+
+    results_t *res = malloc(sizeof(*res));
+    if (!res)
+        goto fail_w_latencies;
+    memset(res, 0, sizeof(*res));
+    res->latencies = latencies;
+
+    return res;
+
+fail_w_latencies:
+    free(latencies);
+fail:
+    return NULL;
+}
+
+static void results_free(results_t *res)
+{
+    if (!res)
+        return;
+
+    free(res->latencies);
+    free(res);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Return the @p p quantile of the @p n sorted @p values
+ */
+static double quantile(const double *values, size_t n, double p)
+{
+    size_t i = p * n;
+    return values[MIN(i, n - 1)];
+}
+
+static void report(results_t *r, int nb_threads, bool terse)
+{
+    // Wall time
+    double wt = difftime(r->wt2.tv_sec, r->wt1.tv_sec) +
+        (r->wt2.tv_nsec - r->wt1.tv_nsec) / (1000.0 * 1000 * 1000);
+
+    struct timeval ut1 = r->ru1.ru_utime;
+    struct timeval ut2 = r->ru2.ru_utime;
+    // User time
+    double ut = difftime(ut2.tv_sec, ut1.tv_sec) +
+        (ut2.tv_usec - ut1.tv_usec) / (1000.0 * 1000);
+    struct timeval st1 = r->ru1.ru_stime;
+    struct timeval st2 = r->ru2.ru_stime;
+    // System time
+    double st = difftime(st2.tv_sec, st1.tv_sec) +
+        (st2.tv_usec - st1.tv_usec) / (1000.0 * 1000);
+    // CPU time
+    double ct = ut + st;
+
+    // CPU usage
+    double cu = 100 * (ct / wt);
+
+    // Total throughput
+    double tput_tot = ((double)r->bytes_read / (1 << 20)) / wt;
+
+    // Throughput per thread
+    double tput_pt = tput_tot / nb_threads;
+
+    // Max RSS
+    double mem = (r->ru2.ru_maxrss - r->ru1.ru_maxrss) / (double)(1 << 10);
+
+    // Latency (wall) min, max, mean and standard deviation
+    qsort(r->latencies, r->num_latencies, sizeof(r->latencies[0]),
+        cmp_double);
+    double lat_min = r->latencies[0];
+    double lat_max = r->latencies[r->num_latencies - 1];
+    double sum = 0;
+    for (size_t i = 0; i < r->num_latencies; i++)
+        sum += r->latencies[i];
+    double lat_mean = sum / r->num_latencies;
+    sum = 0;
+    for (size_t i = 0; i < r->num_latencies; i++)
+        sum += (r->latencies[i] - lat_mean) * (r->latencies[i] - lat_mean);
+    double lat_std = sqrt(sum / r->num_latencies);
+
+    // Latency percentiles
+    double lat_p50 = quantile(r->latencies, r->num_latencies, 0.5);
+    double lat_p99 = quantile(r->latencies, r->num_latencies, 0.99);
+    double lat_p999 = quantile(r->latencies, r->num_latencies, 0.999);
+
+    // Compression ratio
+    double cratio = (double)r->usize / r->csize;
+
+
+    // NOTE: Same columns as benchmark, then percentiles, for report.awk
+    if (terse)
+        printf("%.2lf %.2lf %.2lf %.2lf %.0lf %.2lf %.2lf %.0lf %lf %lf %lf %lf %lf %lf %lf %lf\n",
+            wt, ct, ut, st, cu, tput_tot, tput_pt, mem, lat_mean, lat_std,
+            lat_min, lat_max, cratio, lat_p50, lat_p99, lat_p999);
+    else {
+        printf("Wall time (sec): %.2lf\n", wt);
+        printf("CPU time (sec): %.2lf (%.2lf + %.2lf)\n", ct, ut, st);
+        printf("CPU usage: %.0lf%%\n", cu);
+        printf("Throughput (MiB/sec): %.2lf (%.2lf per thread)\n", tput_tot,
+            tput_pt);
+        printf("Max RSS: %.0lf (MiB)\n", mem);
+        printf("zseek_pread() latency (msec): %lf +- %lf [%lf, %lf]\n",
+            lat_mean, lat_std, lat_min, lat_max);
+        printf("zseek_pread() latency percentiles (msec): p50 %lf, p99 %lf, "
+            "p999 %lf\n", lat_p50, lat_p99, lat_p999);
+        printf("Compression ratio: %lf\n", cratio);
+    }
+}
+
+static bool mem_write(const void *data, size_t size, void *user_data,
+    void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    if (mf->size + size > mf->capacity) {
+        size_t capacity = 2 * (mf->size + size);
+        uint8_t *new_data = realloc(mf->data, capacity);
+        if (!new_data)
+            return false;
+        mf->data = new_data;
+        mf->capacity = capacity;
+    }
+    memcpy(mf->data + mf->size, data, size);
+    mf->size += size;
+    return true;
+}
+
+static ssize_t mem_pread(void *data, size_t size, size_t offset,
+    void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    if (offset >= mf->size)
+        return 0;
+    size = MIN(size, mf->size - offset);
+    memcpy(data, mf->data + offset, size);
+    return size;
+}
+
+static ssize_t mem_fsize(void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    return mf->size;
+}
+
+/**
+ * Compress the contents of @p ufilename to @p mf, in memory. Returns the
+ * uncompressed size, or -1 on error.
+ */
+static off_t compress(const char *ufilename, mem_file_t *mf,
+    size_t min_frame_size, zseek_compression_type_t ctype)
+{
+    struct stat st;
+    if (stat(ufilename, &st) == -1) {
+        perror("compress: get uncompressed info");
+        goto fail;
+    }
+    off_t usize = st.st_size;
+
+    FILE *ufile = fopen(ufilename, "rb");
+    if (!ufile) {
+        perror("compress: open uncompressed file");
+        goto fail;
+    }
+
+    void *buf = malloc(CHUNK_SIZE);
+    if (!buf) {
+        perror("compress: allocate buffer");
+        goto fail_w_ufile;
+    }
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_compression_param_t param = {0};
+    switch (ctype) {
+    case ZSEEK_ZSTD:
+        param.type = ZSEEK_ZSTD;
+        param.params.zstd_params.compression_level = 3;
+        param.params.zstd_params.strategy = 1;
+        break;
+    case ZSEEK_LZ4:
+        param.type = ZSEEK_LZ4;
+        param.params.lz4_params.compression_level = 0;
+        break;
+    default:
+        // BUG
+        assert(false);
+        goto fail_w_buf;
+    }
+    zseek_write_file_t zwf = { .user_data = mf, .write = mem_write };
+    zseek_writer_t *writer = zseek_writer_open_full(zwf, &param, min_frame_size,
+        NULL, errbuf);
+    if (!writer) {
+        fprintf(stderr, "compress: zseek_writer_open: %s\n", errbuf);
+        goto fail_w_buf;
+    }
+
+    for (off_t fpos = 0; fpos < usize; fpos += CHUNK_SIZE) {
+        size_t len = MIN(usize - fpos, CHUNK_SIZE);
+        if (fread(buf, 1, len, ufile) != len) {
+            perror("compress: read file");
+            goto fail_w_writer;
+        }
+        if (!zseek_write(writer, buf, len, NULL, errbuf)) {
+            fprintf(stderr, "compress: zseek_write: %s\n", errbuf);
+            goto fail_w_writer;
+        }
+    }
+
+    if (!zseek_writer_close(writer, NULL, errbuf)) {
+        fprintf(stderr, "compress: zseek_writer_close: %s\n", errbuf);
+        goto fail_w_buf;
+    }
+
+    free(buf);
+
+    if (fclose(ufile) == EOF) {
+        perror("compress: close uncompressed file");
+        goto fail;
+    }
+
+    return usize;
+
+fail_w_writer:
+    zseek_writer_close(writer, NULL, errbuf);
+fail_w_buf:
+    free(buf);
+fail_w_ufile:
+    fclose(ufile);
+fail:
+    return -1;
+}
+
+/**
+ * Return the next pseudo-random number of @p state (xorshift64*)
+ */
+static uint64_t next_rand(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Return the CDF of a Zipfian distribution over @p n ranks, or NULL on error
+ */
+static double *zipf_cdf_new(size_t n)
+{
+    double *cdf = malloc(n * sizeof(*cdf));
+    if (!cdf)
+        return NULL;
+
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += 1 / pow(i + 1, ZIPF_THETA);
+        cdf[i] = sum;
+    }
+    for (size_t i = 0; i < n; i++)
+        cdf[i] /= sum;
+
+    return cdf;
+}
+
+/**
+ * Return the offset of the @p i-th read of thread @p id
+ */
+static size_t next_offset(const bench_t *b, int id, size_t i,
+    uint64_t *state)
+{
+    size_t max_offset = b->usize - b->read_size;
+    size_t nb_blocks = b->usize / b->read_size;
+
+    switch (b->pattern) {
+    case PATTERN_UNIFORM:
+        return next_rand(state) % (max_offset + 1);
+    case PATTERN_ZIPF: {
+        double u = (next_rand(state) >> 11) * (1.0 / (1ULL << 53));
+        size_t lo = 0;
+        size_t hi = b->nb_ranks - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (b->zipf_cdf[mid] < u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        // Scatter hot blocks over the file, instead of at its start
+        size_t block = (lo * 2654435761ULL) % nb_blocks;
+        return block * b->read_size;
+    }
+    case PATTERN_SEQUENTIAL: {
+        // Each thread from its own part of the file
+        size_t start = b->usize / b->nb_threads * id;
+        return (start + i * b->read_size) % (max_offset + 1);
+    }
+    default:
+        // BUG
+        assert(false);
+        return 0;
+    }
+}
+
+static void *reader_thread(void *arg)
+{
+    thread_arg_t *ta = arg;
+    bench_t *b = ta->bench;
+    double *latencies = b->res->latencies + (size_t)ta->id * READS_PER_THREAD;
+    uint64_t state = 0x9E3779B97F4A7C15ULL * (ta->id + 1);
+
+    uint8_t *buf = malloc(b->read_size);
+    if (!buf) {
+        perror("read: allocate buffer");
+        return NULL;
+    }
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    for (size_t i = 0; i < READS_PER_THREAD; i++) {
+        size_t offset = next_offset(b, ta->id, i, &state);
+
+        struct timespec t1;
+        if (clock_gettime(CLOCK_MONOTONIC, &t1) == -1) {
+            perror("read: get inside wall time");
+            goto out;
+        }
+
+        ssize_t r = zseek_pread(b->reader, buf, b->read_size, offset, NULL,
+            errbuf);
+        if (r < 0) {
+            fprintf(stderr, "read: zseek_pread: %s\n", errbuf);
+            goto out;
+        }
+        ta->bytes_read += r;
+
+        struct timespec t2;
+        if (clock_gettime(CLOCK_MONOTONIC, &t2) == -1) {
+            perror("read: get inside wall time");
+            goto out;
+        }
+        double lat = difftime(t2.tv_sec, t1.tv_sec) * 1000;    // msec
+        lat += (t2.tv_nsec - t1.tv_nsec) / (1000.0 * 1000);
+        latencies[i] = lat;
+    }
+    ta->ok = true;
+
+out:
+    free(buf);
+    return NULL;
+}
+
+/**
+ * Read @p mf (of @p usize bytes decompressed) from @p nb_threads threads
+ * sharing one reader.
+ */
+static results_t *read_all(mem_file_t *mf, off_t usize, int nb_threads,
+    size_t cache_size, size_t read_size, pattern_t pattern)
+{
+    results_t *res = results_new((size_t)nb_threads * READS_PER_THREAD);
+    if (!res) {
+        perror("read: allocate results");
+        goto fail;
+    }
+    res->usize = usize;
+    res->csize = mf->size;
+
+    bench_t b = {
+        .usize = usize,
+        .read_size = read_size,
+        .pattern = pattern,
+        .nb_threads = nb_threads,
+        .res = res,
+    };
+    if (pattern == PATTERN_ZIPF) {
+        b.nb_ranks = MIN(b.usize / read_size, ZIPF_MAX_RANKS);
+        b.zipf_cdf = zipf_cdf_new(b.nb_ranks);
+        if (!b.zipf_cdf) {
+            perror("read: allocate Zipfian distribution");
+            goto fail_w_res;
+        }
+    }
+
+    thread_arg_t *args = calloc(nb_threads, sizeof(*args));
+    pthread_t *threads = calloc(nb_threads, sizeof(*threads));
+    if (!args || !threads) {
+        perror("read: allocate threads");
+        goto fail_w_threads;
+    }
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t zrf = {
+        .user_data = mf,
+        .pread = mem_pread,
+        .fsize = mem_fsize,
+    };
+    b.reader = zseek_reader_open_full(zrf, cache_size, NULL, errbuf);
+    if (!b.reader) {
+        fprintf(stderr, "read: zseek_reader_open_full: %s\n", errbuf);
+        goto fail_w_threads;
+    }
+
+
+    if (clock_gettime(CLOCK_MONOTONIC, &res->wt1) == -1) {
+        perror("read: get wall time");
+        goto fail_w_reader;
+    }
+    if (getrusage(RUSAGE_SELF, &res->ru1) == -1) {
+        perror("read: get resource usage");
+        goto fail_w_reader;
+    }
+
+    int started = 0;
+    for (; started < nb_threads; started++) {
+        args[started] = (thread_arg_t){ .bench = &b, .id = started };
+        if (pthread_create(&threads[started], NULL, reader_thread,
+            &args[started])) {
+            fprintf(stderr, "read: failed to create thread\n");
+            break;
+        }
+    }
+    bool ok = started == nb_threads;
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+        ok = ok && args[t].ok;
+        res->bytes_read += args[t].bytes_read;
+    }
+    if (!ok)
+        goto fail_w_reader;
+    res->num_latencies = (size_t)nb_threads * READS_PER_THREAD;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &res->wt2) == -1) {
+        perror("read: get wall time");
+        goto fail_w_reader;
+    }
+    if (getrusage(RUSAGE_SELF, &res->ru2) == -1) {
+        perror("read: get resource usage");
+        goto fail_w_reader;
+    }
+
+
+    if (!zseek_reader_close(b.reader, NULL, errbuf)) {
+        fprintf(stderr, "read: zseek_reader_close: %s\n", errbuf);
+        goto fail_w_threads;
+    }
+
+    free(threads);
+    free(args);
+    free(b.zipf_cdf);
+
+    return res;
+
+fail_w_reader:
+    zseek_reader_close(b.reader, NULL, errbuf);
+fail_w_threads:
+    free(threads);
+    free(args);
+    free(b.zipf_cdf);
+fail_w_res:
+    results_free(res);
+fail:
+    return NULL;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s --zstd|--lz4 INFILE nb_threads cache_size "
+        "frame_size (KiB) uniform|zipf|sequential read_size [-t]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 8 || argc > 9) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    zseek_compression_type_t ctype;
+    if (strcmp(argv[1], "--zstd") == 0)
+        ctype = ZSEEK_ZSTD;
+    else if (strcmp(argv[1], "--lz4") == 0)
+        ctype = ZSEEK_LZ4;
+    else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *ufilename = argv[2];
+
+    int nb_threads = atoi(argv[3]);
+    size_t cache_size = atoi(argv[4]);
+    size_t frame_size = atoi(argv[5]) * (1 << 10);
+
+    pattern_t pattern;
+    if (strcmp(argv[6], "uniform") == 0)
+        pattern = PATTERN_UNIFORM;
+    else if (strcmp(argv[6], "zipf") == 0)
+        pattern = PATTERN_ZIPF;
+    else if (strcmp(argv[6], "sequential") == 0)
+        pattern = PATTERN_SEQUENTIAL;
+    else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t read_size = atoi(argv[7]);
+
+    bool terse = false;
+    if (argc > 8) {
+        if (strcmp(argv[8], "-t") == 0)
+            terse = true;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (nb_threads < 1 || read_size == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    mem_file_t mf = {0};
+    off_t usize = compress(ufilename, &mf, frame_size, ctype);
+    if (usize < 0) {
+        free(mf.data);
+        return 1;
+    }
+    if ((size_t)usize < read_size) {
+        fprintf(stderr, "%s: read_size larger than INFILE\n", argv[0]);
+        free(mf.data);
+        return 1;
+    }
+
+    results_t *res = read_all(&mf, usize, nb_threads, cache_size, read_size,
+        pattern);
+    free(mf.data);
+    if (!res)
+        return 1;
+
+    report(res, nb_threads, terse);
+
+    results_free(res);
+}
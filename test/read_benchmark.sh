@@ -0,0 +1,27 @@
+#!/bin/bash
+
+REPS=2
+
+if (( $# < 5 )); then
+    echo "Usage: $0 --zstd|--lz4 INFILE uniform|zipf|sequential READ_SIZE FRAME_SIZE"
+    exit 1
+fi
+
+CTYPE=$1
+INFILE=$2
+PATTERN=$3
+READ_SIZE=$4
+# KiB
+FRAME_SIZE=$5
+
+for w in 1 2 4 8 16; do
+    for c in 0 1 4 16 64 256 1024; do
+        echo "${w} ${c}"
+        for i in $(seq 1 ${REPS}); do
+            # 1 CPU per thread
+            taskset -c 0-$((w - 1)) \
+                ./read_benchmark ${CTYPE} ${INFILE} ${w} ${c} ${FRAME_SIZE} \
+                ${PATTERN} ${READ_SIZE} -t
+        done
+    done
+done
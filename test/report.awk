@@ -1,6 +1,10 @@
 #!/bin/awk -f
 
+# Horizontal axis label (e.g. -v xaxis=c for read_benchmark.sh)
 BEGIN {
+    if (xaxis == "")
+        xaxis = "f"
+
     delete workers
     delete frames
 
@@ -11,6 +15,10 @@ BEGIN {
     delete mem      # Max RSS
     delete lat_mean # Mean nio_archive_write() latency
     delete lat_max  # Max nio_archive_write() latency
+    delete lat_p50  # Latency percentiles (read_benchmark only)
+    delete lat_p99
+    delete lat_p999
+    percentiles = 0
 }
 
 
@@ -29,6 +37,9 @@ NF == 2 {
     msum = 0
     lmean = 0
     lmax = 0
+    l50 = 0
+    l99 = 0
+    l999 = 0
     reps = 0
 }
 
@@ -50,6 +61,16 @@ NF > 2 {
     mem[w,f] = msum / reps
     lat_mean[w,f] = lmean / reps
     lat_max[w,f] = lmax / reps
+
+    if (NF >= 16) {
+        l50 += $14      # p50 latency (msec)
+        l99 += $15      # p99 latency (msec)
+        l999 += $16     # p999 latency (msec)
+        lat_p50[w,f] = l50 / reps
+        lat_p99[w,f] = l99 / reps
+        lat_p999[w,f] = l999 / reps
+        percentiles = 1
+    }
 }
 
 
@@ -64,7 +85,7 @@ function print_horizontal(width,    i, f)
     printf "\n"
 
     # Print horizontal axis
-    printf "%3s | ", "f"
+    printf "%3s | ", xaxis
     for (f in frames)
         printf "%"width"d ", f
     printf "\n"
@@ -168,6 +189,20 @@ function print_lat_max(width,    w, f)
     print_horizontal(width)
 }
 
+function print_lat_pct(width, title, lat,    w, f)
+{
+    printf "%s latency (msec)\n", title
+    printf "%3s\n", "w"
+    for (w in workers) {
+        printf "%3d | ", w
+        for (f in frames)
+            printf "%"width".3f ", lat[w,f]
+        printf "\n"
+    }
+
+    print_horizontal(width)
+}
+
 END {
     print_wall(6)
 
@@ -182,4 +217,15 @@ END {
 
     printf "\n"
     print_mem(6)
+
+    if (percentiles) {
+        printf "\n"
+        print_lat_pct(6, "p50", lat_p50)
+
+        printf "\n"
+        print_lat_pct(6, "p99", lat_p99)
+
+        printf "\n"
+        print_lat_pct(6, "p999", lat_p999)
+    }
 }
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <pthread.h>
 
 #include <check.h>
 
@@ -158,6 +159,470 @@ START_TEST(test_cache_replace)
 }
 END_TEST
 
+START_TEST(test_cache_second_chance)
+{
+    zseek_cache_t *cache = zseek_cache_new(3);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+    zseek_frame_t frames[4];
+    for (int i = 0; i < 3; i++) {
+        frames[i] = (zseek_frame_t){.idx = i, .len = 1024};
+        frames[i].data = malloc(frames[i].len);
+        ck_assert_msg(frames[i].data != NULL, "failed to create frame %d", i);
+        ck_assert_msg(zseek_cache_insert(cache, frames[i]),
+            "failed to insert frame %d", i);
+    }
+
+    // Referenced frames should survive the next eviction
+    ck_assert(zseek_cache_find(cache, 0).data == frames[0].data);
+    frames[3] = (zseek_frame_t){.idx = 3, .len = 1024};
+    frames[3].data = malloc(frames[3].len);
+    ck_assert_msg(frames[3].data != NULL, "failed to create frame 3");
+    ck_assert_msg(zseek_cache_insert(cache, frames[3]),
+        "failed to insert frame 3");
+
+    ck_assert(zseek_cache_find(cache, 0).data == frames[0].data);
+    ck_assert(zseek_cache_find(cache, 1).data == NULL);
+    ck_assert(zseek_cache_find(cache, 2).data == frames[2].data);
+    ck_assert(zseek_cache_find(cache, 3).data == frames[3].data);
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_cache_insert_duplicate)
+{
+    zseek_cache_t *cache = zseek_cache_new(2);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+    zseek_frame_t frame = {.idx = 1, .len = 512};
+    frame.data = malloc(frame.len);
+    ck_assert_msg(frame.data != NULL, "failed to create frame %zu", frame.idx);
+    ck_assert_msg(zseek_cache_insert(cache, frame), "failed to insert frame");
+
+    zseek_frame_t dup = {.idx = 1, .len = 512};
+    dup.data = malloc(dup.len);
+    ck_assert_msg(dup.data != NULL, "failed to create frame %zu", dup.idx);
+    ck_assert(!zseek_cache_insert(cache, dup));
+    ck_assert(zseek_cache_find(cache, 1).data == frame.data);
+    ck_assert(zseek_cache_entries(cache) == 1);
+
+    free(dup.data);
+    zseek_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_cache_pinned)
+{
+    zseek_cache_t *cache = zseek_cache_new(2);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+    for (size_t i = 0; i < 2; i++) {
+        zseek_frame_t frame = {.idx = i, .len = 512};
+        frame.data = malloc(frame.len);
+        ck_assert_msg(frame.data != NULL, "failed to create frame %zu", i);
+        ck_assert_msg(zseek_cache_insert(cache, frame),
+            "failed to insert frame %zu", i);
+    }
+    ck_assert(zseek_cache_pin(cache, 0).data != NULL);
+    ck_assert(zseek_cache_pin(cache, 1).data != NULL);
+    ck_assert(zseek_cache_pin(cache, 2).data == NULL);
+
+    // All pinned, nothing to evict
+    zseek_frame_t frame = {.idx = 2, .len = 512};
+    frame.data = malloc(frame.len);
+    ck_assert_msg(frame.data != NULL, "failed to create frame %zu", frame.idx);
+    ck_assert(!zseek_cache_insert(cache, frame));
+
+    // Only the unpinned frame may be evicted
+    zseek_cache_unpin(cache, 0);
+    ck_assert_msg(zseek_cache_insert_pinned(cache, frame),
+        "failed to insert frame %zu", frame.idx);
+    ck_assert(zseek_cache_find(cache, 0).data == NULL);
+    ck_assert(zseek_cache_find(cache, 1).data != NULL);
+    ck_assert(zseek_cache_find(cache, 2).data == frame.data);
+
+    // Inserted pinned
+    frame.idx = 3;
+    frame.data = malloc(frame.len);
+    ck_assert_msg(frame.data != NULL, "failed to create frame %zu", frame.idx);
+    ck_assert(!zseek_cache_insert(cache, frame));
+    zseek_cache_unpin(cache, 1);
+    zseek_cache_unpin(cache, 2);
+    ck_assert_msg(zseek_cache_insert(cache, frame),
+        "failed to insert frame %zu", frame.idx);
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_cache_sharded)
+{
+    const size_t capacity = 67;
+    zseek_cache_t *cache = zseek_cache_new(capacity);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    for (size_t i = 0; i < 1000; i++) {
+        zseek_frame_t frame = {.idx = i, .len = 16};
+        frame.data = malloc(frame.len);
+        ck_assert_msg(frame.data != NULL, "failed to create frame %zu", i);
+        ck_assert_msg(zseek_cache_insert(cache, frame),
+            "failed to insert frame %zu", i);
+        ck_assert(zseek_cache_entries(cache) <= capacity);
+        // The latest insertion is always present
+        ck_assert(zseek_cache_find(cache, i).data == frame.data);
+    }
+    ck_assert(zseek_cache_entries(cache) <= capacity);
+    ck_assert(zseek_cache_entries(cache) > capacity / 2);
+
+    size_t found = 0;
+    for (size_t i = 0; i < 1000; i++)
+        found += zseek_cache_find(cache, i).data != NULL;
+    ck_assert(found == zseek_cache_entries(cache));
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+#define CONCURRENT_THREADS 8
+#define CONCURRENT_FRAMES 256
+#define CONCURRENT_OPS 20000
+
+static void *concurrent_worker(void *arg)
+{
+    zseek_cache_t *cache = arg;
+    unsigned seed = (unsigned)(size_t)pthread_self();
+
+    for (int op = 0; op < CONCURRENT_OPS; op++) {
+        size_t idx = rand_r(&seed) % CONCURRENT_FRAMES;
+        if (zseek_cache_find(cache, idx).data)
+            continue;
+
+        zseek_frame_t frame = {.idx = idx, .len = 8};
+        frame.data = malloc(frame.len);
+        if (!frame.data)
+            return (void*)1;
+        if (!zseek_cache_insert(cache, frame))
+            // Raced with another thread inserting the same frame
+            free(frame.data);
+    }
+
+    return NULL;
+}
+
+START_TEST(test_cache_concurrent)
+{
+    const size_t capacity = 64;
+    zseek_cache_t *cache = zseek_cache_new(capacity);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    pthread_t threads[CONCURRENT_THREADS];
+    for (int t = 0; t < CONCURRENT_THREADS; t++)
+        ck_assert_msg(pthread_create(&threads[t], NULL, concurrent_worker,
+            cache) == 0, "failed to create thread %d", t);
+    for (int t = 0; t < CONCURRENT_THREADS; t++) {
+        void *ret;
+        ck_assert(pthread_join(threads[t], &ret) == 0);
+        ck_assert(ret == NULL);
+    }
+
+    ck_assert(zseek_cache_entries(cache) <= capacity);
+    size_t found = 0;
+    for (size_t i = 0; i < CONCURRENT_FRAMES; i++)
+        found += zseek_cache_find(cache, i).data != NULL;
+    ck_assert(found == zseek_cache_entries(cache));
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_cache_new_full_null)
+{
+    ck_assert(zseek_cache_new_full(0, 0, ZSEEK_CACHE_CLOCK, NULL, NULL) ==
+        NULL);
+    ck_assert(zseek_cache_new_full(4, 0, (zseek_cache_policy_t)-1, NULL,
+        NULL) == NULL);
+}
+END_TEST
+
+typedef struct {
+    size_t released;
+    size_t bytes;
+} release_count_t;
+
+static void count_release(zseek_frame_t frame, void *arg)
+{
+    release_count_t *count = arg;
+    count->released++;
+    count->bytes += frame.len;
+    free(frame.data);
+}
+
+START_TEST(test_cache_bytes)
+{
+    const size_t max_bytes = 10000;
+    release_count_t count = {0};
+    zseek_cache_t *cache = zseek_cache_new_full(0, max_bytes,
+        ZSEEK_CACHE_CLOCK, count_release, &count);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    size_t inserted = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        zseek_frame_t frame = {.idx = i, .len = 100 + i % 400};
+        frame.data = malloc(frame.len);
+        ck_assert_msg(frame.data != NULL, "failed to create frame %zu", i);
+        ck_assert_msg(zseek_cache_insert(cache, frame),
+            "failed to insert frame %zu", i);
+        inserted += frame.len;
+    }
+    size_t cached = 0;
+    for (size_t i = 0; i < 1000; i++)
+        cached += zseek_cache_find(cache, i).len;
+    ck_assert_uint_le(cached, max_bytes);
+    ck_assert_uint_gt(cached, max_bytes / 2);
+    ck_assert_uint_eq(count.bytes, inserted - cached);
+
+    // Too large in itself
+    zseek_frame_t frame = {.idx = 1000, .len = max_bytes + 1};
+    frame.data = malloc(frame.len);
+    ck_assert_msg(frame.data != NULL, "failed to create frame %zu", frame.idx);
+    ck_assert(!zseek_cache_insert(cache, frame));
+    free(frame.data);
+
+    zseek_cache_free(cache);
+    ck_assert_uint_eq(count.bytes, inserted);
+}
+END_TEST
+
+START_TEST(test_cache_bytes_pinned)
+{
+    const size_t max_bytes = 4096;
+    zseek_cache_t *cache = zseek_cache_new_full(0, max_bytes,
+        ZSEEK_CACHE_CLOCK, NULL, NULL);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    zseek_frame_t pinned = {.idx = 0, .len = max_bytes / 2};
+    pinned.data = malloc(pinned.len);
+    ck_assert_msg(pinned.data != NULL, "failed to create frame");
+    ck_assert(zseek_cache_insert(cache, pinned));
+    ck_assert(zseek_cache_pin(cache, 0).data == pinned.data);
+
+    for (size_t i = 1; i < 100; i++) {
+        zseek_frame_t frame = {.idx = i, .len = max_bytes / 4};
+        frame.data = malloc(frame.len);
+        ck_assert_msg(frame.data != NULL, "failed to create frame %zu", i);
+        ck_assert_msg(zseek_cache_insert(cache, frame),
+            "failed to insert frame %zu", i);
+    }
+    // Still there, alongside at most 2 others
+    ck_assert(zseek_cache_find(cache, 0).data == pinned.data);
+    ck_assert_uint_le(zseek_cache_entries(cache), 3);
+    zseek_cache_unpin(cache, 0);
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_cache_bytes_and_capacity)
+{
+    zseek_cache_t *cache = zseek_cache_new_full(4, 1 << 20,
+        ZSEEK_CACHE_CLOCK, NULL, NULL);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    for (size_t i = 0; i < 100; i++) {
+        zseek_frame_t frame = {.idx = i, .len = 16};
+        frame.data = malloc(frame.len);
+        ck_assert_msg(frame.data != NULL, "failed to create frame %zu", i);
+        ck_assert_msg(zseek_cache_insert(cache, frame),
+            "failed to insert frame %zu", i);
+        ck_assert_uint_le(zseek_cache_entries(cache), 4);
+    }
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+/**
+ * Insert frame @p idx of @p len bytes in @p cache, returning whether it was
+ * (freeing it if not)
+ */
+static bool insert_new(zseek_cache_t *cache, size_t idx, size_t len)
+{
+    zseek_frame_t frame = {.idx = idx, .len = len};
+    frame.data = malloc(frame.len);
+    ck_assert_msg(frame.data != NULL, "failed to create frame %zu", idx);
+    if (zseek_cache_insert(cache, frame))
+        return true;
+    free(frame.data);
+    return false;
+}
+
+/**
+ * Have frame 0 read repeatedly (twice, after being evicted once) in a cache
+ * of 4 frames with @p policy, followed by a scan of 100 frames read once.
+ * Returns whether frame 0 survived the scan.
+ */
+static bool survives_scan(zseek_cache_policy_t policy)
+{
+    zseek_cache_t *cache = zseek_cache_new_full(4, 0, policy, NULL, NULL);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    for (size_t i = 0; i < 5; i++) {
+        insert_new(cache, i, 16);
+        zseek_cache_find(cache, 0);
+    }
+    if (!zseek_cache_find(cache, 0).data)
+        ck_assert(insert_new(cache, 0, 16));
+    zseek_cache_find(cache, 0);
+
+    for (size_t i = 100; i < 200; i++)
+        insert_new(cache, i, 16);
+    bool survived = zseek_cache_find(cache, 0).data != NULL;
+    ck_assert_uint_eq(zseek_cache_entries(cache), 4);
+
+    zseek_cache_free(cache);
+    return survived;
+}
+
+START_TEST(test_cache_policy_scan)
+{
+    ck_assert(!survives_scan(ZSEEK_CACHE_CLOCK));
+    ck_assert(survives_scan(ZSEEK_CACHE_2Q));
+    ck_assert(survives_scan(ZSEEK_CACHE_TINYLFU));
+}
+END_TEST
+
+START_TEST(test_cache_2q_probation)
+{
+    zseek_cache_t *cache = zseek_cache_new_full(4, 0, ZSEEK_CACHE_2Q, NULL,
+        NULL);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    // Hits on probation don't count, only returning after eviction does
+    for (size_t i = 0; i < 4; i++)
+        ck_assert(insert_new(cache, i, 16));
+    ck_assert(zseek_cache_find(cache, 0).data != NULL);
+    ck_assert(insert_new(cache, 4, 16));
+    ck_assert(zseek_cache_find(cache, 0).data == NULL);
+    ck_assert(insert_new(cache, 0, 16));
+    for (size_t i = 5; i < 50; i++) {
+        ck_assert(insert_new(cache, i, 16));
+        ck_assert(zseek_cache_find(cache, 0).data != NULL);
+    }
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_cache_2q_scan_hits)
+{
+    zseek_cache_t *cache = zseek_cache_new_full(4, 0, ZSEEK_CACHE_2Q, NULL,
+        NULL);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    // Make 1 and 2 hot, with a hit on 1
+    for (size_t i = 0; i < 4; i++)
+        ck_assert(insert_new(cache, i, 16));
+    for (size_t i = 10; i < 13; i++)
+        ck_assert(insert_new(cache, i, 16));
+    for (size_t i = 0; i < 3; i++)
+        ck_assert(insert_new(cache, i, 16));
+    ck_assert(zseek_cache_find(cache, 1).data != NULL);
+
+    // A scan only evicts from probation, keeping the hit of 1 for when hot
+    // entries are evicted again (once 107 returns)
+    for (size_t i = 100; i < 110; i++)
+        ck_assert(insert_new(cache, i, 16));
+    ck_assert(insert_new(cache, 107, 16));
+    ck_assert(insert_new(cache, 200, 16));
+    ck_assert(zseek_cache_find(cache, 1).data != NULL);
+    ck_assert(zseek_cache_find(cache, 2).data == NULL);
+
+    zseek_cache_free(cache);
+}
+END_TEST
+
+/**
+ * Fill a TinyLFU cache with popular frames, optionally reject a frame, and
+ * return the frame evicted for a more popular one
+ */
+static size_t tinylfu_evicted(bool reject)
+{
+    zseek_cache_t *cache = zseek_cache_new_full(4, 0, ZSEEK_CACHE_TINYLFU,
+        NULL, NULL);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    for (size_t i = 0; i < 4; i++) {
+        ck_assert(insert_new(cache, i, 16));
+        zseek_cache_find(cache, i);
+    }
+    if (reject)
+        ck_assert(!insert_new(cache, 4, 16));
+    zseek_cache_find(cache, 0);
+    // Admitted once missed more often than the victim is used
+    size_t tries = 1;
+    while (!insert_new(cache, 5, 16))
+        ck_assert_uint_lt(tries++, 10);
+
+    size_t evicted = SIZE_MAX;
+    for (size_t i = 0; i < 4; i++) {
+        if (!zseek_cache_find(cache, i).data)
+            evicted = i;
+    }
+    ck_assert_uint_eq(zseek_cache_entries(cache), 4);
+
+    zseek_cache_free(cache);
+    return evicted;
+}
+
+START_TEST(test_cache_tinylfu_admission)
+{
+    zseek_cache_t *cache = zseek_cache_new_full(4, 0, ZSEEK_CACHE_TINYLFU,
+        NULL, NULL);
+    ck_assert_msg(cache != NULL, "failed to create cache");
+
+    // Admitted freely until full
+    for (size_t i = 0; i < 4; i++) {
+        ck_assert(insert_new(cache, i, 16));
+        zseek_cache_find(cache, i);
+    }
+    // Not in place of more popular frames
+    ck_assert(!insert_new(cache, 4, 16));
+    // Until missed more often
+    ck_assert(!insert_new(cache, 4, 16));
+    ck_assert(insert_new(cache, 4, 16));
+    ck_assert(zseek_cache_find(cache, 4).data != NULL);
+    ck_assert_uint_eq(zseek_cache_entries(cache), 4);
+
+    zseek_cache_free(cache);
+
+    // Rejected frames leave the cache as it was
+    ck_assert_uint_eq(tinylfu_evicted(true), tinylfu_evicted(false));
+}
+END_TEST
+
+START_TEST(test_cache_policy_bytes)
+{
+    const zseek_cache_policy_t policies[] = {ZSEEK_CACHE_2Q,
+        ZSEEK_CACHE_TINYLFU};
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        const size_t max_bytes = 10000;
+        zseek_cache_t *cache = zseek_cache_new_full(0, max_bytes, policies[p],
+            NULL, NULL);
+        ck_assert_msg(cache != NULL, "failed to create cache");
+
+        for (size_t i = 0; i < 1000; i++) {
+            insert_new(cache, i % 300, 100 + i % 400);
+            zseek_cache_find(cache, i % 7);
+        }
+        size_t cached = 0;
+        for (size_t i = 0; i < 300; i++)
+            cached += zseek_cache_find(cache, i).len;
+        ck_assert_uint_le(cached, max_bytes);
+        ck_assert_uint_gt(zseek_cache_entries(cache), 0);
+
+        zseek_cache_free(cache);
+    }
+}
+END_TEST
+
 START_TEST(test_cache_memory_usage_null)
 {
     ck_assert(zseek_cache_memory_usage(NULL) == 0);
@@ -216,6 +681,20 @@ Suite *cache_suite(void)
     tcase_add_test(tc_core, test_cache_find_present);
     tcase_add_test(tc_core, test_cache_find_absent);
     tcase_add_test(tc_core, test_cache_replace);
+    tcase_add_test(tc_core, test_cache_second_chance);
+    tcase_add_test(tc_core, test_cache_insert_duplicate);
+    tcase_add_test(tc_core, test_cache_pinned);
+    tcase_add_test(tc_core, test_cache_sharded);
+    tcase_add_test(tc_core, test_cache_concurrent);
+    tcase_add_test(tc_core, test_cache_new_full_null);
+    tcase_add_test(tc_core, test_cache_bytes);
+    tcase_add_test(tc_core, test_cache_bytes_pinned);
+    tcase_add_test(tc_core, test_cache_bytes_and_capacity);
+    tcase_add_test(tc_core, test_cache_policy_scan);
+    tcase_add_test(tc_core, test_cache_2q_probation);
+    tcase_add_test(tc_core, test_cache_2q_scan_hits);
+    tcase_add_test(tc_core, test_cache_tinylfu_admission);
+    tcase_add_test(tc_core, test_cache_policy_bytes);
     tcase_add_test(tc_core, test_cache_memory_usage_null);
     tcase_add_test(tc_core, test_cache_memory_usage);
     tcase_add_test(tc_core, test_cache_entries_null);
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include <check.h>
+
+#include "../src/frame_pool.h"
+
+/**
+ * An allocator counting its calls
+ */
+typedef struct {
+    atomic_size_t allocs;
+    atomic_size_t frees;
+    atomic_size_t bytes;    // Currently allocated
+} counting_t;
+
+static void *counting_alloc(size_t size, void *opaque)
+{
+    counting_t *c = opaque;
+    atomic_fetch_add(&c->allocs, 1);
+    atomic_fetch_add(&c->bytes, size);
+    return malloc(size);
+}
+
+static void counting_free(void *ptr, size_t size, void *opaque)
+{
+    counting_t *c = opaque;
+    atomic_fetch_add(&c->frees, 1);
+    atomic_fetch_sub(&c->bytes, size);
+    free(ptr);
+}
+
+START_TEST(test_frame_pool_get)
+{
+    zseek_frame_pool_t *pool = zseek_frame_pool_new(NULL, 4);
+    ck_assert(pool != NULL);
+
+    size_t sizes[] = {0, 1, 17, 1000, 4096, 100000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        void *data = zseek_frame_pool_get(pool, sizes[i]);
+        ck_assert(data != NULL);
+        memset(data, 0xAB, sizes[i]);
+        zseek_frame_pool_put(pool, data, sizes[i]);
+    }
+
+    zseek_frame_pool_free(pool);
+}
+END_TEST
+
+START_TEST(test_frame_pool_reuse)
+{
+    counting_t c = {0};
+    zseek_allocator_t allocator = {counting_alloc, counting_free, &c};
+    zseek_frame_pool_t *pool = zseek_frame_pool_new(&allocator, 4);
+    ck_assert(pool != NULL);
+
+    void *data = zseek_frame_pool_get(pool, 1000);
+    ck_assert(data != NULL);
+    ck_assert_uint_ge(atomic_load(&c.bytes), 1000);
+    // Rounded up by less than 1/8
+    ck_assert_uint_lt(atomic_load(&c.bytes), 1000 + 1000 / 8);
+    size_t before = zseek_frame_pool_memory_usage(pool);
+    zseek_frame_pool_put(pool, data, 1000);
+    ck_assert_uint_gt(zseek_frame_pool_memory_usage(pool), before);
+
+    // Same size class
+    ck_assert_ptr_eq(zseek_frame_pool_get(pool, 1010), data);
+    ck_assert_uint_eq(atomic_load(&c.allocs), 1);
+    zseek_frame_pool_put(pool, data, 1010);
+
+    // Another size class
+    void *other = zseek_frame_pool_get(pool, 2000);
+    ck_assert_ptr_ne(other, data);
+    ck_assert_uint_eq(atomic_load(&c.allocs), 2);
+    zseek_frame_pool_put(pool, other, 2000);
+
+    zseek_frame_pool_free(pool);
+    ck_assert_uint_eq(atomic_load(&c.frees), 2);
+    ck_assert_uint_eq(atomic_load(&c.bytes), 0);
+}
+END_TEST
+
+START_TEST(test_frame_pool_max_free)
+{
+    counting_t c = {0};
+    zseek_allocator_t allocator = {counting_alloc, counting_free, &c};
+    zseek_frame_pool_t *pool = zseek_frame_pool_new(&allocator, 2);
+    ck_assert(pool != NULL);
+
+    void *bufs[3];
+    for (size_t i = 0; i < 3; i++)
+        bufs[i] = zseek_frame_pool_get(pool, 512);
+    for (size_t i = 0; i < 3; i++)
+        zseek_frame_pool_put(pool, bufs[i], 512);
+    // Only 2 kept
+    ck_assert_uint_eq(atomic_load(&c.frees), 1);
+
+    zseek_frame_pool_free(pool);
+    ck_assert_uint_eq(atomic_load(&c.frees), 3);
+    ck_assert_uint_eq(atomic_load(&c.bytes), 0);
+
+    // Nothing kept
+    pool = zseek_frame_pool_new(&allocator, 0);
+    ck_assert(pool != NULL);
+    zseek_frame_pool_put(pool, zseek_frame_pool_get(pool, 512), 512);
+    ck_assert_uint_eq(atomic_load(&c.allocs), 4);
+    ck_assert_uint_eq(atomic_load(&c.frees), 4);
+    zseek_frame_pool_free(pool);
+}
+END_TEST
+
+static void *churn(void *arg)
+{
+    zseek_frame_pool_t *pool = arg;
+    for (size_t i = 0; i < 10000; i++) {
+        size_t size = 1000 + i % 64;
+        unsigned char *data = zseek_frame_pool_get(pool, size);
+        ck_assert(data != NULL);
+        data[0] = 1;
+        data[size - 1] = 2;
+        zseek_frame_pool_put(pool, data, size);
+    }
+    return NULL;
+}
+
+START_TEST(test_frame_pool_concurrent)
+{
+    counting_t c = {0};
+    zseek_allocator_t allocator = {counting_alloc, counting_free, &c};
+    zseek_frame_pool_t *pool = zseek_frame_pool_new(&allocator, 8);
+    ck_assert(pool != NULL);
+
+    pthread_t threads[4];
+    for (size_t t = 0; t < 4; t++)
+        ck_assert_int_eq(pthread_create(&threads[t], NULL, churn, pool), 0);
+    for (size_t t = 0; t < 4; t++)
+        pthread_join(threads[t], NULL);
+    // Mostly recycled
+    ck_assert_uint_lt(atomic_load(&c.allocs), 40000 / 2);
+
+    zseek_frame_pool_free(pool);
+    ck_assert_uint_eq(atomic_load(&c.allocs), atomic_load(&c.frees));
+    ck_assert_uint_eq(atomic_load(&c.bytes), 0);
+}
+END_TEST
+
+Suite *frame_pool_suite(void)
+{
+    Suite *s = suite_create("frame_pool");
+    TCase *tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_frame_pool_get);
+    tcase_add_test(tc_core, test_frame_pool_reuse);
+    tcase_add_test(tc_core, test_frame_pool_max_free);
+    tcase_add_test(tc_core, test_frame_pool_concurrent);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    Suite *s = frame_pool_suite();
+    SRunner *sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
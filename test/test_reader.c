@@ -0,0 +1,2005 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "../src/zseek.h"
+
+#define DATA_SIZE (1 << 20)         // 1 MiB
+#define FRAME_SIZE (1 << 14)        // 16 KiB
+#define NB_THREADS 8
+#define READS_PER_THREAD 2000
+#define READ_SIZE 1000
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/**
+ * An in-memory compressed file, counting reads.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    atomic_size_t preads;
+    atomic_size_t ranges;
+} mem_file_t;
+
+static bool mem_write(const void *data, size_t size, void *user_data,
+    void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    if (size == 0)
+        return true;
+    if (mf->size + size > mf->capacity) {
+        size_t capacity = 2 * (mf->size + size);
+        uint8_t *new_data = realloc(mf->data, capacity);
+        if (!new_data)
+            return false;
+        mf->data = new_data;
+        mf->capacity = capacity;
+    }
+    memcpy(mf->data + mf->size, data, size);
+    mf->size += size;
+    return true;
+}
+
+static ssize_t mem_pread(void *data, size_t size, size_t offset,
+    void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    atomic_fetch_add(&mf->preads, 1);
+    if (offset >= mf->size)
+        return 0;
+    if (size > mf->size - offset)
+        size = mf->size - offset;
+    memcpy(data, mf->data + offset, size);
+    return size;
+}
+
+static void mem_pread_batch(zseek_read_req_t *reqs, size_t nb_reqs,
+    zseek_read_done_t done, void *done_arg, void *user_data, void *call_data)
+{
+    // Complete out of order
+    for (size_t r = nb_reqs; r-- > 0;) {
+        reqs[r].result = mem_pread(reqs[r].data, reqs[r].size, reqs[r].offset,
+            user_data, call_data);
+        done(&reqs[r], done_arg);
+    }
+}
+
+static ssize_t mem_fsize(void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    return mf->size;
+}
+
+static const void *mem_range(size_t size, size_t offset, void *user_data,
+    void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    atomic_fetch_add(&mf->ranges, 1);
+    if (offset > mf->size || size > mf->size - offset)
+        return NULL;
+    return mf->data + offset;
+}
+
+static uint8_t *test_data(void)
+{
+    // Compressible, but not trivially so
+    uint8_t *data = malloc(DATA_SIZE);
+    ck_assert_msg(data != NULL, "failed to allocate test data");
+    unsigned seed = 42;
+    for (size_t i = 0; i < DATA_SIZE; i++)
+        data[i] = (i % 7 == 0) ? (uint8_t)rand_r(&seed) : 'a' + i % 13;
+    return data;
+}
+
+static void compress_to(mem_file_t *mf, const uint8_t *data,
+    zseek_compression_type_t type)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_compression_param_t param = {.type = type};
+    if (type == ZSEEK_ZSTD)
+        param.params.zstd_params.compression_level = 3;
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    // Write in odd-sized chunks
+    for (size_t off = 0; off < DATA_SIZE; off += 3000) {
+        size_t len = DATA_SIZE - off < 3000 ? DATA_SIZE - off : 3000;
+        ck_assert_msg(zseek_write(writer, data + off, len, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+    }
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+}
+
+static zseek_reader_t *open_mem(mem_file_t *mf, size_t cache_size)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, cache_size, NULL,
+        errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+    return reader;
+}
+
+// Non-multiple of the seek table block and page sizes
+#define NB_SMALL_FRAMES 3000
+
+/**
+ * Write a file of many small, variable-sized frames of @p data to @p mf, with
+ * the end offset of each in @p ends. With @p fixed, frames hold that many bytes
+ * instead (but the last). Returns the decompressed size.
+ */
+static size_t small_frames_to(mem_file_t *mf, const uint8_t *data,
+    size_t ends[NB_SMALL_FRAMES], size_t fixed)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    // One frame per write, unless fixed
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_compression_param_t param = {
+        .type = ZSEEK_LZ4,
+        .fixed_frame_size = fixed > 0,
+    };
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param,
+        fixed > 0 ? fixed : 1, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    size_t total = fixed > 0 ? (NB_SMALL_FRAMES - 1) * fixed + 7 : SIZE_MAX;
+    size_t size = 0;
+    for (size_t i = 0; size < total && (fixed > 0 || i < NB_SMALL_FRAMES);
+        i++) {
+        size_t len = MIN(1 + i * 7 % 43, total - size);
+        ck_assert_msg(zseek_write(writer, data + size, len, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+        size += len;
+        if (fixed == 0)
+            ends[i] = size;
+    }
+    for (size_t i = 0; fixed > 0 && i < NB_SMALL_FRAMES; i++)
+        ends[i] = MIN((i + 1) * fixed, total);
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+    return size;
+}
+
+/**
+ * Map every offset of a file written by small_frames_to(), in reverse order
+ * with @p reverse
+ */
+static void check_small_frames(zseek_reader_t *reader, const uint8_t *data,
+    const size_t ends[NB_SMALL_FRAMES], bool reverse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    size_t size = ends[NB_SMALL_FRAMES - 1];
+    size_t frame_idx = reverse ? NB_SMALL_FRAMES - 1 : 0;
+    for (size_t i = 0; i < size; i++) {
+        size_t off = reverse ? size - 1 - i : i;
+        if (!reverse && off == ends[frame_idx])
+            frame_idx++;
+        if (reverse && frame_idx > 0 && off < ends[frame_idx - 1])
+            frame_idx--;
+        zseek_frame_ref_t ref;
+        ssize_t r = zseek_pread_ref(reader, off, &ref, NULL, errbuf);
+        ck_assert_msg(r > 0, "zseek_pread_ref: %s", errbuf);
+        ck_assert_uint_eq(ref.frame_idx, frame_idx);
+        ck_assert_uint_eq(ref.len, ends[frame_idx] - off);
+        ck_assert(memcmp(ref.data, data + off, ref.len) == 0);
+        zseek_frame_release(reader, &ref);
+    }
+    zseek_frame_ref_t ref;
+    ck_assert(zseek_pread_ref(reader, size, &ref, NULL, errbuf) == 0);
+}
+
+START_TEST(test_reader_seek_table)
+{
+    uint8_t *data = test_data();
+    size_t ends[NB_SMALL_FRAMES];
+    mem_file_t mf;
+    size_t size = small_frames_to(&mf, data, ends, 0);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_reader_t *reader = open_mem(&mf, 1 << 20);
+    zseek_reader_stats_t stats;
+    ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+        "zseek_reader_stats: %s", errbuf);
+    ck_assert_uint_eq(stats.frames, NB_SMALL_FRAMES);
+    ck_assert_uint_eq(stats.decompressed_size, size);
+    // Well below the 24 bytes per frame of a plain offset array
+    ck_assert_uint_lt(stats.seek_table_memory, 10 * NB_SMALL_FRAMES);
+
+    check_small_frames(reader, data, ends, false);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+static zseek_reader_t *open_mem_lazy(mem_file_t *mf, size_t cache_size)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_param_t param = {
+        .cache_size = cache_size,
+        .lazy_seek_table = true,
+    };
+    zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL,
+        errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    return reader;
+}
+
+START_TEST(test_reader_fixed_frame_size)
+{
+    uint8_t *data = test_data();
+    size_t ends[NB_SMALL_FRAMES];
+    mem_file_t mf;
+    small_frames_to(&mf, data, ends, 0);
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_reader_t *reader = open_mem(&mf, 0);
+    zseek_reader_stats_t var_stats;
+    ck_assert_msg(zseek_reader_stats(reader, &var_stats, errbuf),
+        "zseek_reader_stats: %s", errbuf);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    free(mf.data);
+
+    size_t size = small_frames_to(&mf, data, ends, 22);
+    reader = open_mem(&mf, 1 << 20);
+    zseek_reader_stats_t stats;
+    ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+        "zseek_reader_stats: %s", errbuf);
+    ck_assert_uint_eq(stats.frames, NB_SMALL_FRAMES);
+    ck_assert_uint_eq(stats.decompressed_size, size);
+    // No decompressed offsets stored
+    ck_assert_uint_lt(stats.seek_table_memory,
+        var_stats.seek_table_memory * 6 / 10);
+    check_small_frames(reader, data, ends, false);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    // Lazily, the size is known without scanning
+    reader = open_mem_lazy(&mf, 1 << 20);
+    uint8_t buf[10];
+    ck_assert(zseek_pread(reader, buf, 1, size, NULL, errbuf) == 0);
+    atomic_store(&mf.preads, 0);
+    ck_assert(zseek_pread(reader, buf, sizeof(buf), 0, NULL, errbuf) > 0);
+    ck_assert_uint_eq(atomic_load(&mf.preads), 2);
+    check_small_frames(reader, data, ends, true);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    // Frame sizes are checked against the fixed size
+    mem_file_t bad = mf;
+    bad.data = malloc(mf.size);
+    ck_assert_msg(bad.data != NULL, "failed to allocate file");
+    memcpy(bad.data, mf.data, mf.size);
+    // Seek table footer (9 bytes) after the entry of the last frame
+    size_t last_entry = mf.size - 9 - 8;
+    bad.data[last_entry + 4] = 23;
+    zseek_read_file_t rf = {&bad, mem_pread, mem_fsize, NULL, NULL};
+    ck_assert(zseek_reader_open_full(rf, 0, NULL, errbuf) == NULL);
+    bad.data[last_entry + 4] = 7;
+    bad.data[last_entry - 8 + 4] = 21;
+    ck_assert(zseek_reader_open_full(rf, 0, NULL, errbuf) == NULL);
+    free(bad.data);
+
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+typedef struct {
+    zseek_reader_t *reader;
+    const uint8_t *data;
+    size_t size;
+    unsigned seed;
+} lazy_arg_t;
+
+static void *lazy_reader(void *arg)
+{
+    lazy_arg_t *la = arg;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t buf[100];
+
+    for (int i = 0; i < 200; i++) {
+        size_t offset = rand_r(&la->seed) % la->size;
+        size_t count = MIN(sizeof(buf), la->size - offset);
+        ssize_t r = zseek_pread_flags(la->reader, buf, count, offset,
+            ZSEEK_PREAD_FULL, NULL, errbuf);
+        if (r != (ssize_t)count || memcmp(buf, la->data + offset, count))
+            return (void *)1;
+    }
+    return NULL;
+}
+
+START_TEST(test_reader_lazy_seek_table)
+{
+    uint8_t *data = test_data();
+    size_t ends[NB_SMALL_FRAMES];
+    mem_file_t mf;
+    size_t size = small_frames_to(&mf, data, ends, 0);
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    // Only the magic number, seek table footer and header (and the end of
+    // what's before them, for trailers) are read on open
+    zseek_reader_t *reader = open_mem_lazy(&mf, 1 << 20);
+    ck_assert_uint_le(atomic_load(&mf.preads), 4);
+    zseek_reader_t *eager = open_mem(&mf, 0);
+    ck_assert_uint_gt(atomic_load(&mf.preads), 6);
+    ck_assert_msg(zseek_reader_close(eager, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    // Reading the start loads its page only
+    atomic_store(&mf.preads, 0);
+    uint8_t buf[10];
+    ck_assert(zseek_pread(reader, buf, sizeof(buf), 0, NULL, errbuf) > 0);
+    ck_assert_uint_eq(atomic_load(&mf.preads), 2);
+
+    check_small_frames(reader, data, ends, true);
+    check_small_frames(reader, data, ends, false);
+    zseek_reader_stats_t stats;
+    ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+        "zseek_reader_stats: %s", errbuf);
+    ck_assert_uint_eq(stats.frames, NB_SMALL_FRAMES);
+    ck_assert_uint_eq(stats.decompressed_size, size);
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    // The size is only known once the whole table is scanned
+    reader = open_mem_lazy(&mf, 0);
+    uint8_t bufs[3][20];
+    zseek_iovec_t reqs[] = {
+        {size - 10, bufs[0], 20},
+        {size + 10, bufs[1], 20},
+        {5, bufs[2], 20},
+    };
+    ck_assert_int_eq(zseek_preadv(reader, reqs, 3, NULL, errbuf), 30);
+    ck_assert(memcmp(bufs[0], data + size - 10, 10) == 0);
+    ck_assert(memcmp(bufs[2], data + 5, 20) == 0);
+    ck_assert(zseek_pread(reader, buf, 1, size, NULL, errbuf) == 0);
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    // Readahead loads the pages it prefetches
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_param_t param = {
+        .cache_size = 64,
+        .readahead_max = 32,
+        .lazy_seek_table = true,
+    };
+    reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    uint8_t *out = malloc(size);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    for (size_t off = 0; off < size; off += 100) {
+        size_t count = MIN(100, size - off);
+        ck_assert_msg(zseek_pread_flags(reader, out + off, count, off,
+            ZSEEK_PREAD_FULL, NULL, errbuf) == (ssize_t)count,
+            "zseek_pread_flags: %s", errbuf);
+    }
+    ck_assert(memcmp(out, data, size) == 0);
+    free(out);
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    // Also through references
+    reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    check_small_frames(reader, data, ends, false);
+    check_small_frames(reader, data, ends, true);
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    // Concurrent loading
+    reader = open_mem_lazy(&mf, 64);
+    pthread_t threads[NB_THREADS];
+    lazy_arg_t args[NB_THREADS];
+    for (int t = 0; t < NB_THREADS; t++) {
+        args[t] = (lazy_arg_t){reader, data, size, t + 1};
+        ck_assert(pthread_create(&threads[t], NULL, lazy_reader,
+            &args[t]) == 0);
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        void *ret;
+        pthread_join(threads[t], &ret);
+        ck_assert_msg(ret == NULL, "lazy reader %d read wrong data", t);
+    }
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+static void check_sequential(zseek_compression_type_t type, size_t cache_size)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    zseek_reader_t *reader = open_mem(&mf, cache_size);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    size_t offset = 0;
+    while (offset < DATA_SIZE) {
+        ssize_t r = zseek_read(reader, out + offset, 5000, NULL, errbuf);
+        ck_assert_msg(r > 0, "zseek_read: %s", errbuf);
+        offset += r;
+    }
+    ck_assert(zseek_read(reader, out, 1, NULL, errbuf) == 0);
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(out);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_sequential_zstd)
+{
+    check_sequential(ZSEEK_ZSTD, 4);
+    check_sequential(ZSEEK_ZSTD, 0);
+}
+END_TEST
+
+START_TEST(test_reader_sequential_lz4)
+{
+    check_sequential(ZSEEK_LZ4, 4);
+    check_sequential(ZSEEK_LZ4, 0);
+}
+END_TEST
+
+typedef struct {
+    zseek_reader_t *reader;
+    const uint8_t *data;
+    unsigned seed;
+    bool failed;
+} concurrent_arg_t;
+
+static void *concurrent_reader(void *arg)
+{
+    concurrent_arg_t *ca = arg;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t buf[READ_SIZE];
+
+    for (int i = 0; i < READS_PER_THREAD; i++) {
+        size_t offset = rand_r(&ca->seed) % DATA_SIZE;
+        ssize_t r = zseek_pread(ca->reader, buf, READ_SIZE, offset, NULL,
+            errbuf);
+        if (r <= 0 || memcmp(buf, ca->data + offset, r) != 0) {
+            ca->failed = true;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void check_concurrent(zseek_compression_type_t type, size_t cache_size)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    zseek_reader_t *reader = open_mem(&mf, cache_size);
+
+    pthread_t threads[NB_THREADS];
+    concurrent_arg_t args[NB_THREADS];
+    for (int t = 0; t < NB_THREADS; t++) {
+        args[t] = (concurrent_arg_t){reader, data, t + 1, false};
+        ck_assert(pthread_create(&threads[t], NULL, concurrent_reader,
+            &args[t]) == 0);
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        ck_assert(pthread_join(threads[t], NULL) == 0);
+        ck_assert_msg(!args[t].failed, "thread %d read wrong data", t);
+    }
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_concurrent_zstd)
+{
+    check_concurrent(ZSEEK_ZSTD, 4);
+    check_concurrent(ZSEEK_ZSTD, 0);
+}
+END_TEST
+
+START_TEST(test_reader_concurrent_lz4)
+{
+    check_concurrent(ZSEEK_LZ4, 4);
+    check_concurrent(ZSEEK_LZ4, 0);
+}
+END_TEST
+
+static void *same_frame_reader(void *arg)
+{
+    concurrent_arg_t *ca = arg;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t buf[READ_SIZE];
+
+    // All threads scan the frames in the same order, missing together
+    size_t offset = 0;
+    while (offset < DATA_SIZE) {
+        ssize_t r = zseek_pread(ca->reader, buf, READ_SIZE, offset, NULL,
+            errbuf);
+        if (r <= 0 || memcmp(buf, ca->data + offset, r) != 0) {
+            ca->failed = true;
+            break;
+        }
+        offset += r;
+    }
+
+    return NULL;
+}
+
+START_TEST(test_reader_single_flight)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, ZSEEK_ZSTD);
+    // Large enough to never evict
+    zseek_reader_t *reader = open_mem(&mf, 2 * DATA_SIZE / FRAME_SIZE);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_reader_stats_t stats;
+    ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+        "zseek_reader_stats: %s", errbuf);
+    atomic_store(&mf.preads, 0);
+
+    pthread_t threads[NB_THREADS];
+    concurrent_arg_t args[NB_THREADS];
+    for (int t = 0; t < NB_THREADS; t++) {
+        args[t] = (concurrent_arg_t){reader, data, t + 1, false};
+        ck_assert(pthread_create(&threads[t], NULL, same_frame_reader,
+            &args[t]) == 0);
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        ck_assert(pthread_join(threads[t], NULL) == 0);
+        ck_assert_msg(!args[t].failed, "thread %d read wrong data", t);
+    }
+
+    // Each frame fetched exactly once
+    ck_assert_uint_eq(atomic_load(&mf.preads), stats.frames);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+static void check_pread_full(zseek_compression_type_t type, size_t cache_size)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    zseek_reader_t *reader = open_mem(&mf, cache_size);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+
+    // Spanning many frames, starting and ending mid-frame
+    size_t offset = FRAME_SIZE / 3;
+    size_t count = 10 * FRAME_SIZE + 123;
+    atomic_store(&mf.preads, 0);
+    ssize_t r = zseek_pread_flags(reader, out, count, offset, ZSEEK_PREAD_FULL,
+        NULL, errbuf);
+    ck_assert_msg(r == (ssize_t)count, "zseek_pread_flags: %s", errbuf);
+    ck_assert(memcmp(out, data + offset, count) == 0);
+    // All the frames fetched with a single read
+    ck_assert_uint_eq(atomic_load(&mf.preads), 1);
+
+    // Again, partially cached this time
+    r = zseek_pread_flags(reader, out, count, offset + FRAME_SIZE,
+        ZSEEK_PREAD_FULL, NULL, errbuf);
+    ck_assert_msg(r == (ssize_t)count, "zseek_pread_flags: %s", errbuf);
+    ck_assert(memcmp(out, data + offset + FRAME_SIZE, count) == 0);
+
+    // Whole file, and short read at EOF
+    r = zseek_pread_flags(reader, out, DATA_SIZE, 0, ZSEEK_PREAD_FULL, NULL,
+        errbuf);
+    ck_assert_msg(r == DATA_SIZE, "zseek_pread_flags: %s", errbuf);
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+    r = zseek_pread_flags(reader, out, DATA_SIZE, DATA_SIZE - 100,
+        ZSEEK_PREAD_FULL, NULL, errbuf);
+    ck_assert_msg(r == 100, "zseek_pread_flags: %s", errbuf);
+    ck_assert(memcmp(out, data + DATA_SIZE - 100, 100) == 0);
+    r = zseek_pread_flags(reader, out, 1, DATA_SIZE, ZSEEK_PREAD_FULL, NULL,
+        errbuf);
+    ck_assert(r == 0);
+
+    // Without the flag, reads stop at the end of the frame
+    r = zseek_pread_flags(reader, out, count, offset, 0, NULL, errbuf);
+    ck_assert_msg(r > 0 && r < (ssize_t)count, "zseek_pread_flags: %s",
+        errbuf);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(out);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_pread_full_zstd)
+{
+    check_pread_full(ZSEEK_ZSTD, 4);
+    check_pread_full(ZSEEK_ZSTD, 0);
+}
+END_TEST
+
+START_TEST(test_reader_pread_full_lz4)
+{
+    check_pread_full(ZSEEK_LZ4, 4);
+    check_pread_full(ZSEEK_LZ4, 0);
+}
+END_TEST
+
+static void check_pread_ref(zseek_compression_type_t type, size_t cache_size)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    zseek_reader_t *reader = open_mem(&mf, cache_size);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    // Hold more references than the cache fits
+    zseek_frame_ref_t refs[8];
+    size_t offset = 100;
+    for (int i = 0; i < 8; i++) {
+        ssize_t r = zseek_pread_ref(reader, offset, &refs[i], NULL, errbuf);
+        ck_assert_msg(r > 0, "zseek_pread_ref: %s", errbuf);
+        ck_assert(refs[i].len == (size_t)r);
+        offset += r;
+    }
+    // Evict whatever can be evicted
+    uint8_t buf[READ_SIZE];
+    for (size_t off = 0; off < DATA_SIZE; off += FRAME_SIZE)
+        ck_assert(zseek_pread(reader, buf, sizeof(buf), off, NULL, errbuf) > 0);
+    offset = 100;
+    for (int i = 0; i < 8; i++) {
+        ck_assert(memcmp(refs[i].data, data + offset, refs[i].len) == 0);
+        offset += refs[i].len;
+        zseek_frame_release(reader, &refs[i]);
+    }
+
+    zseek_frame_ref_t ref;
+    ck_assert(zseek_pread_ref(reader, DATA_SIZE, &ref, NULL, errbuf) == 0);
+    zseek_frame_release(reader, &ref);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_pread_ref_zstd)
+{
+    check_pread_ref(ZSEEK_ZSTD, 4);
+    check_pread_ref(ZSEEK_ZSTD, 0);
+}
+END_TEST
+
+START_TEST(test_reader_pread_ref_lz4)
+{
+    check_pread_ref(ZSEEK_LZ4, 4);
+    check_pread_ref(ZSEEK_LZ4, 0);
+}
+END_TEST
+
+/**
+ * Read all of @p reader in random order, in reads crossing frames
+ */
+static void check_contents_shuffled(zseek_reader_t *reader,
+    const uint8_t *data)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    const size_t read_size = FRAME_SIZE + 1000;
+    size_t nb_reads = (DATA_SIZE + read_size - 1) / read_size;
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    for (size_t i = 0; i < nb_reads; i++) {
+        // Stride coprime to nb_reads, to visit all in a scattered order
+        size_t r = (i * 7) % nb_reads;
+        size_t offset = r * read_size;
+        size_t count = MIN(read_size, DATA_SIZE - offset);
+        ssize_t n = zseek_pread_flags(reader, out + offset, count, offset,
+            ZSEEK_PREAD_FULL, NULL, errbuf);
+        ck_assert_msg(n == (ssize_t)count, "zseek_pread_flags: %s", errbuf);
+    }
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+    free(out);
+}
+
+/**
+ * Check zseek_preadv() on @p reader, counting reads from @p preads (if not
+ * @a NULL)
+ */
+static void check_preadv_on(zseek_reader_t *reader, const uint8_t *data,
+    atomic_size_t *preads)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    // Unsorted, some spanning frames, some past EOF
+    enum { NB_REQS = 500 };
+    zseek_iovec_t reqs[NB_REQS];
+    uint8_t *out = malloc(NB_REQS * READ_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    unsigned seed = 7;
+    size_t expected = 0;
+    for (int r = 0; r < NB_REQS; r++) {
+        size_t offset = rand_r(&seed) % (DATA_SIZE + READ_SIZE);
+        size_t len = 1 + rand_r(&seed) % READ_SIZE;
+        reqs[r] = (zseek_iovec_t){offset, out + r * READ_SIZE, len};
+        if (offset < DATA_SIZE)
+            expected += DATA_SIZE - offset < len ? DATA_SIZE - offset : len;
+    }
+    ssize_t ret = zseek_preadv(reader, reqs, NB_REQS, NULL, errbuf);
+    ck_assert_msg(ret == (ssize_t)expected, "zseek_preadv: %s", errbuf);
+    for (int r = 0; r < NB_REQS; r++) {
+        if (reqs[r].offset >= DATA_SIZE)
+            continue;
+        size_t len = DATA_SIZE - reqs[r].offset < reqs[r].len ?
+            DATA_SIZE - reqs[r].offset : reqs[r].len;
+        ck_assert_msg(memcmp(reqs[r].buf, data + reqs[r].offset, len) == 0,
+            "request %d read wrong data", r);
+    }
+
+    // Many point reads within the same frame load it once
+    if (preads)
+        atomic_store(preads, 0);
+    for (int r = 0; r < NB_REQS; r++)
+        reqs[r] = (zseek_iovec_t){5 * FRAME_SIZE + r, out + r, 1};
+    ret = zseek_preadv(reader, reqs, NB_REQS, NULL, errbuf);
+    ck_assert_msg(ret == NB_REQS, "zseek_preadv: %s", errbuf);
+    ck_assert(memcmp(out, data + 5 * FRAME_SIZE, NB_REQS) == 0);
+    if (preads)
+        ck_assert(atomic_load(preads) <= 1);
+
+    ck_assert(zseek_preadv(reader, NULL, 0, NULL, errbuf) == 0);
+    free(out);
+}
+
+static void check_preadv(zseek_compression_type_t type, size_t cache_size,
+    int nb_workers, bool batch)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL,
+        batch ? mem_pread_batch : NULL};
+    zseek_reader_param_t param = {
+        .cache_size = cache_size,
+        .nb_workers = nb_workers,
+    };
+    zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+
+    check_preadv_on(reader, data, &mf.preads);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_preadv_batch)
+{
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    for (size_t t = 0; t < 2; t++) {
+        check_preadv(types[t], 0, 0, true);
+        check_preadv(types[t], 4, 0, true);
+        check_preadv(types[t], 0, 4, true);
+        check_preadv(types[t], 16, 4, true);
+    }
+}
+END_TEST
+
+static void check_uring(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+
+    FILE *f = tmpfile();
+    ck_assert(f != NULL);
+    ck_assert_uint_eq(fwrite(mf.data, 1, mf.size, f), mf.size);
+    ck_assert(fflush(f) == 0);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_reader_param_t params[] = {
+        {.cache_size = 0},
+        {.cache_size = 16, .nb_workers = 4},
+    };
+    for (size_t p = 0; p < sizeof(params) / sizeof(params[0]); p++) {
+        // Queue depth lower than the frames per batch
+        zseek_reader_t *reader = zseek_reader_open_uring(f, &params[p], 4,
+            NULL, errbuf);
+        if (!reader) {
+            // No io_uring support (at build or run time)
+            ck_assert(errbuf[0] != '\0');
+            break;
+        }
+        check_preadv_on(reader, data, NULL);
+        check_contents_shuffled(reader, data);
+        ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+            "zseek_reader_close: %s", errbuf);
+    }
+
+    fclose(f);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_uring)
+{
+    check_uring(ZSEEK_ZSTD);
+    check_uring(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_reader_preadv_zstd)
+{
+    check_preadv(ZSEEK_ZSTD, 0, 0, false);
+    check_preadv(ZSEEK_ZSTD, 4, 0, false);
+    check_preadv(ZSEEK_ZSTD, 0, 4, false);
+    check_preadv(ZSEEK_ZSTD, 4, 4, false);
+}
+END_TEST
+
+START_TEST(test_reader_preadv_lz4)
+{
+    check_preadv(ZSEEK_LZ4, 0, 0, false);
+    check_preadv(ZSEEK_LZ4, 4, 0, false);
+    check_preadv(ZSEEK_LZ4, 0, 4, false);
+    check_preadv(ZSEEK_LZ4, 4, 4, false);
+}
+END_TEST
+
+/**
+ * A sink collecting decompressed data, checking it comes in order
+ */
+typedef struct {
+    uint8_t *out;
+    size_t next;        // Offset expected next
+    size_t calls;
+    size_t fail_after;  // Calls to fail after, 0 for never
+    atomic_bool busy;   // In a call
+} collect_t;
+
+static bool collect(const void *data, size_t size, size_t offset,
+    void *user_data)
+{
+    collect_t *c = user_data;
+    ck_assert(!atomic_exchange(&c->busy, true));
+    ck_assert_uint_eq(offset, c->next);
+    memcpy(c->out + offset, data, size);
+    c->next += size;
+    c->calls++;
+    atomic_store(&c->busy, false);
+    return c->fail_after == 0 || c->calls < c->fail_after;
+}
+
+static void check_decompress_range(zseek_compression_type_t type,
+    int nb_workers)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_param_t param = {.nb_workers = nb_workers};
+    zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+
+    // Whole file, in order
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    collect_t c = {.out = out};
+    ssize_t r = zseek_reader_decompress_all(reader, collect, &c, NULL, errbuf);
+    ck_assert_msg(r == DATA_SIZE, "zseek_reader_decompress_all: %s", errbuf);
+    ck_assert_uint_eq(c.next, DATA_SIZE);
+    zseek_reader_stats_t stats;
+    ck_assert(zseek_reader_stats(reader, &stats, errbuf));
+    // One call per frame
+    ck_assert_uint_eq(c.calls, stats.frames);
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+
+    // Unaligned ranges, into a buffer and to a sink, some past EOF
+    size_t ranges[][2] = {
+        {0, 1}, {FRAME_SIZE - 1, 2}, {100, 5 * FRAME_SIZE},
+        {3 * FRAME_SIZE, 4 * FRAME_SIZE}, {DATA_SIZE - 10, 100},
+    };
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        size_t offset = ranges[i][0];
+        size_t len = MIN(ranges[i][1], DATA_SIZE - offset);
+        memset(out, 0, DATA_SIZE);
+        r = zseek_reader_decompress_range(reader, out, len, offset, NULL,
+            NULL, NULL, errbuf);
+        ck_assert_msg(r == (ssize_t)len, "zseek_reader_decompress_range: %s",
+            errbuf);
+        ck_assert(memcmp(out, data + offset, len) == 0);
+
+        c = (collect_t){.out = out - offset, .next = offset};
+        r = zseek_reader_decompress_range(reader, NULL, ranges[i][1], offset,
+            collect, &c, NULL, errbuf);
+        ck_assert_msg(r == (ssize_t)len, "zseek_reader_decompress_range: %s",
+            errbuf);
+        ck_assert_uint_eq(c.next, offset + len);
+        ck_assert(memcmp(out, data + offset, len) == 0);
+    }
+    ck_assert(zseek_reader_decompress_range(reader, out, 1, DATA_SIZE, NULL,
+        NULL, NULL, errbuf) == 0);
+
+    // Failing sink stops it
+    c = (collect_t){.out = out, .fail_after = 3};
+    ck_assert(zseek_reader_decompress_all(reader, collect, &c, NULL,
+        errbuf) == -1);
+    ck_assert_uint_eq(c.calls, 3);
+
+    // A buffer or a sink, not both
+    ck_assert(zseek_reader_decompress_range(reader, out, 1, 0, collect, &c,
+        NULL, errbuf) == -1);
+    ck_assert(zseek_reader_decompress_range(reader, NULL, 1, 0, NULL, NULL,
+        NULL, errbuf) == -1);
+    ck_assert(zseek_reader_decompress_all(reader, NULL, NULL, NULL,
+        errbuf) == -1);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(out);
+
+    // Corrupted first frame (the magic number is only checked on open)
+    reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    memset(mf.data, 0, 4);
+    c = (collect_t){.out = malloc(DATA_SIZE)};
+    ck_assert(c.out != NULL);
+    errbuf[0] = '\0';
+    ck_assert(zseek_reader_decompress_all(reader, collect, &c, NULL,
+        errbuf) == -1);
+    ck_assert(errbuf[0] != '\0');
+    ck_assert_uint_eq(c.calls, 0);
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(c.out);
+
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_decompress_range_zstd)
+{
+    check_decompress_range(ZSEEK_ZSTD, 0);
+    check_decompress_range(ZSEEK_ZSTD, 1);
+    check_decompress_range(ZSEEK_ZSTD, 4);
+}
+END_TEST
+
+START_TEST(test_reader_decompress_range_lz4)
+{
+    check_decompress_range(ZSEEK_LZ4, 0);
+    check_decompress_range(ZSEEK_LZ4, 1);
+    check_decompress_range(ZSEEK_LZ4, 4);
+}
+END_TEST
+
+static zseek_reader_t *open_mem_readahead(mem_file_t *mf, size_t cache_size,
+    size_t readahead_max)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_param_t param = {
+        .cache_size = cache_size,
+        .readahead_max = readahead_max,
+    };
+    zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    return reader;
+}
+
+static void check_readahead(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    zseek_reader_t *reader = open_mem_readahead(&mf, 32, 16);
+
+    // Start a sequential scan over the first two frames
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    size_t offset = 0;
+    for (int i = 0; i < 2; i++) {
+        ssize_t r = zseek_read(reader, out + offset, DATA_SIZE, NULL, errbuf);
+        ck_assert_msg(r > 0, "zseek_read: %s", errbuf);
+        offset += r;
+    }
+
+    // Wait for the initial window to be prefetched
+    zseek_reader_stats_t stats;
+    for (int i = 0; i < 5000; i++) {
+        ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+            "zseek_reader_stats: %s", errbuf);
+        if (stats.cached_frames >= 6)
+            break;
+        usleep(1000);
+    }
+    ck_assert_uint_ge(stats.cached_frames, 6);
+
+    // The next frame is served from the cache, and the rest of the scan works
+    atomic_store(&mf.preads, 0);
+    ssize_t r = zseek_read(reader, out + offset, DATA_SIZE, NULL, errbuf);
+    ck_assert_msg(r > 0, "zseek_read: %s", errbuf);
+    ck_assert_uint_eq(atomic_load(&mf.preads), 0);
+    offset += r;
+    while (offset < DATA_SIZE) {
+        r = zseek_read(reader, out + offset, DATA_SIZE, NULL, errbuf);
+        ck_assert_msg(r > 0, "zseek_read: %s", errbuf);
+        offset += r;
+    }
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    // Readahead alongside concurrent random reads
+    reader = open_mem_readahead(&mf, 8, 8);
+    pthread_t threads[NB_THREADS];
+    concurrent_arg_t args[NB_THREADS];
+    for (int t = 0; t < NB_THREADS; t++) {
+        args[t] = (concurrent_arg_t){reader, data, t + 1, false};
+        ck_assert(pthread_create(&threads[t], NULL,
+            t % 2 ? concurrent_reader : same_frame_reader, &args[t]) == 0);
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        ck_assert(pthread_join(threads[t], NULL) == 0);
+        ck_assert_msg(!args[t].failed, "thread %d read wrong data", t);
+    }
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+
+    free(out);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_readahead_zstd)
+{
+    check_readahead(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_reader_readahead_lz4)
+{
+    check_readahead(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_reader_readahead_no_cache)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, ZSEEK_ZSTD);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_param_t param = {.readahead_max = 4};
+    ck_assert(zseek_reader_open_param(rf, &param, NULL, errbuf) == NULL);
+
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+static void check_range(zseek_compression_type_t type, size_t cache_size)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, mem_range, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, cache_size, NULL,
+        errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+
+    // Frames are never read, only the seek table
+    size_t preads = atomic_load(&mf.preads);
+    check_contents_shuffled(reader, data);
+    ck_assert_uint_eq(atomic_load(&mf.preads), preads);
+    ck_assert(atomic_load(&mf.ranges) > 0);
+
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_range_zstd)
+{
+    check_range(ZSEEK_ZSTD, 0);
+    check_range(ZSEEK_ZSTD, 8);
+}
+END_TEST
+
+START_TEST(test_reader_range_lz4)
+{
+    check_range(ZSEEK_LZ4, 0);
+    check_range(ZSEEK_LZ4, 8);
+}
+END_TEST
+
+static void check_mmap(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+
+    FILE *f = tmpfile();
+    ck_assert(f != NULL);
+    ck_assert_uint_eq(fwrite(mf.data, 1, mf.size, f), mf.size);
+    ck_assert(fflush(f) == 0);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_reader_param_t params[] = {
+        {.cache_size = 0},
+        {.cache_size = 8},
+        {.cache_size = 16, .readahead_max = 8},
+    };
+    for (size_t p = 0; p < sizeof(params) / sizeof(params[0]); p++) {
+        zseek_reader_t *reader = zseek_reader_open_mmap(f, &params[p], NULL,
+            errbuf);
+        ck_assert_msg(reader != NULL, "zseek_reader_open_mmap: %s", errbuf);
+        check_contents_shuffled(reader, data);
+
+        // Sequential, for readahead
+        uint8_t *out = malloc(DATA_SIZE);
+        ck_assert_msg(out != NULL, "failed to allocate output");
+        ssize_t n = zseek_pread_flags(reader, out, DATA_SIZE, 0,
+            ZSEEK_PREAD_FULL, NULL, errbuf);
+        ck_assert_msg(n == DATA_SIZE, "zseek_pread_flags: %s", errbuf);
+        ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+        free(out);
+
+        ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+            "zseek_reader_close: %s", errbuf);
+    }
+
+    fclose(f);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_mmap_zstd)
+{
+    check_mmap(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_reader_mmap_lz4)
+{
+    check_mmap(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_reader_mmap_empty)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    FILE *f = tmpfile();
+    ck_assert(f != NULL);
+    ck_assert(zseek_reader_open_mmap(f, NULL, NULL, errbuf) == NULL);
+    fclose(f);
+}
+END_TEST
+
+#define SUB_FRAME_SIZE (1 << 18)    // 256 KiB
+#define SUB_BLOCK_SIZE 4000
+
+/**
+ * Write @p data to @p mf in frames made of sub-blocks, in writes of @p chunk
+ * bytes, with @p nb_frame_workers
+ */
+static void sub_blocks_to(mem_file_t *mf, const uint8_t *data,
+    zseek_compression_type_t type, size_t chunk, int nb_frame_workers)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_compression_param_t param = {
+        .type = type,
+        .nb_frame_workers = nb_frame_workers,
+        .sub_block_size = SUB_BLOCK_SIZE,
+    };
+    if (type == ZSEEK_ZSTD)
+        param.params.zstd_params.compression_level = 3;
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param,
+        SUB_FRAME_SIZE, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    for (size_t off = 0; off < DATA_SIZE; off += chunk) {
+        ck_assert_msg(zseek_write(writer, data + off,
+            MIN(chunk, DATA_SIZE - off), NULL, errbuf),
+            "zseek_write: %s", errbuf);
+    }
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+}
+
+static void check_sub_blocks(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    // Buffered, directly compressed and frame-parallel
+    const struct {
+        size_t chunk;
+        int nb_frame_workers;
+    } modes[] = {{3000, 0}, {SUB_FRAME_SIZE, 0}, {3000, 2}};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        mem_file_t mf;
+        sub_blocks_to(&mf, data, type, modes[m].chunk,
+            modes[m].nb_frame_workers);
+
+        // Partial and whole frames
+        for (size_t cache_size = 0; cache_size <= 2; cache_size += 2) {
+            zseek_reader_t *reader = open_mem(&mf, cache_size);
+            uint8_t buf[2 * SUB_BLOCK_SIZE];
+            unsigned seed = 3;
+            for (int i = 0; i < 300; i++) {
+                size_t off = rand_r(&seed) % DATA_SIZE;
+                size_t count = MIN(1 + rand_r(&seed) % sizeof(buf),
+                    DATA_SIZE - off);
+                ck_assert_msg(zseek_pread_flags(reader, buf, count, off,
+                    ZSEEK_PREAD_FULL, NULL, errbuf) == (ssize_t)count,
+                    "zseek_pread_flags: %s", errbuf);
+                ck_assert(memcmp(buf, data + off, count) == 0);
+            }
+            ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+                "zseek_reader_close: %s", errbuf);
+        }
+
+        // Without a cache, the sub-blocks before the offset are not even
+        // decompressed (the magic number is only checked on open)
+        zseek_reader_t *reader = open_mem(&mf, 0);
+        memset(mf.data, 0, 4);
+        uint8_t buf[100];
+        size_t off = 3 * SUB_BLOCK_SIZE + 10;
+        ck_assert_msg(zseek_pread(reader, buf, sizeof(buf), off, NULL,
+            errbuf) == sizeof(buf), "zseek_pread: %s", errbuf);
+        ck_assert(memcmp(buf, data + off, sizeof(buf)) == 0);
+        ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+            "zseek_reader_close: %s", errbuf);
+
+        free(mf.data);
+    }
+
+    free(data);
+}
+
+START_TEST(test_reader_sub_blocks_zstd)
+{
+    check_sub_blocks(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_reader_sub_blocks_lz4)
+{
+    check_sub_blocks(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_reader_sub_blocks_misuse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_compression_param_t param = {
+        .type = ZSEEK_ZSTD,
+        .sub_block_size = SUB_BLOCK_SIZE,
+    };
+    param.params.zstd_params.nb_workers = 2;
+    ck_assert(zseek_writer_open_full(wf, &param, SUB_FRAME_SIZE, NULL,
+        errbuf) == NULL);
+    param.params.zstd_params.nb_workers = 0;
+    param.sub_block_size = (size_t)UINT32_MAX + 1;
+    ck_assert(zseek_writer_open_full(wf, &param, SUB_FRAME_SIZE, NULL,
+        errbuf) == NULL);
+}
+END_TEST
+
+/**
+ * An allocator counting the bytes it has out
+ */
+typedef struct {
+    atomic_size_t allocs;
+    atomic_size_t frees;
+    atomic_size_t bytes;
+} counting_t;
+
+static void *counting_alloc(size_t size, void *opaque)
+{
+    counting_t *c = opaque;
+    atomic_fetch_add(&c->allocs, 1);
+    atomic_fetch_add(&c->bytes, size);
+    return malloc(size);
+}
+
+static void counting_free(void *ptr, size_t size, void *opaque)
+{
+    counting_t *c = opaque;
+    atomic_fetch_add(&c->frees, 1);
+    atomic_fetch_sub(&c->bytes, size);
+    free(ptr);
+}
+
+START_TEST(test_reader_cache_bytes)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, ZSEEK_ZSTD);
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    counting_t c = {0};
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_param_t param = {
+        .cache_bytes = 4 * FRAME_SIZE,
+        .allocator = {counting_alloc, counting_free, &c},
+    };
+    zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+
+    // Cached within the budget
+    uint8_t buf[READ_SIZE];
+    unsigned seed = 7;
+    for (int i = 0; i < 500; i++) {
+        size_t off = rand_r(&seed) % (DATA_SIZE - READ_SIZE);
+        ck_assert_msg(zseek_pread_flags(reader, buf, READ_SIZE, off,
+            ZSEEK_PREAD_FULL, NULL, errbuf) == READ_SIZE,
+            "zseek_pread_flags: %s", errbuf);
+        ck_assert(memcmp(buf, data + off, READ_SIZE) == 0);
+    }
+    atomic_store(&mf.preads, 0);
+    ck_assert(zseek_pread(reader, buf, 10, 0, NULL, errbuf) == 10);
+    ck_assert(zseek_pread(reader, buf, 10, 5, NULL, errbuf) == 10);
+    ck_assert_uint_eq(atomic_load(&mf.preads), 1);
+
+    zseek_reader_stats_t stats;
+    ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+        "zseek_reader_stats: %s", errbuf);
+    ck_assert_uint_le(stats.cache_memory, 4 * FRAME_SIZE * 9 / 8 +
+        16 * FRAME_SIZE * 9 / 8 + 4096);
+    // Evicted buffers are recycled
+    ck_assert_uint_lt(atomic_load(&c.allocs), 250);
+    ck_assert_uint_gt(atomic_load(&c.bytes), 0);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    ck_assert_uint_eq(atomic_load(&c.allocs), atomic_load(&c.frees));
+    ck_assert_uint_eq(atomic_load(&c.bytes), 0);
+
+    // Both handlers are needed
+    param.allocator.free = NULL;
+    ck_assert(zseek_reader_open_param(rf, &param, NULL, errbuf) == NULL);
+
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+/**
+ * Events passed to an event handler, by type
+ */
+typedef struct {
+    atomic_size_t counts[ZSEEK_EVENT_COMPRESSED_EVICT + 1];
+    atomic_size_t bytes[ZSEEK_EVENT_COMPRESSED_EVICT + 1];
+} events_t;
+
+static void count_event(const zseek_reader_event_t *event, void *user_data)
+{
+    events_t *ev = user_data;
+    atomic_fetch_add(&ev->counts[event->type], 1);
+    atomic_fetch_add(&ev->bytes[event->type], event->size);
+}
+
+static uint64_t histogram_total(const zseek_histogram_t *h)
+{
+    uint64_t total = 0;
+    for (size_t b = 0; b < ZSEEK_HISTOGRAM_BUCKETS; b++)
+        total += h->buckets[b];
+    return total;
+}
+
+static void check_stats_ext(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    events_t ev = {0};
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_param_t param = {
+        .cache_size = 4,
+        .metrics = true,
+        .event_handler = count_event,
+        .event_data = &ev,
+    };
+    zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    size_t preads = atomic_load(&mf.preads);
+
+    // Twice in each frame, then all frames again
+    uint8_t buf[FRAME_SIZE * 2];
+    size_t nb_frames = 0;
+    for (size_t off = 0; off < DATA_SIZE; nb_frames++) {
+        ck_assert(zseek_pread(reader, buf, 1, off, NULL, errbuf) == 1);
+        ssize_t r = zseek_pread(reader, buf, sizeof(buf), off + 1, NULL,
+            errbuf);
+        ck_assert(r > 0);
+        off += 1 + r;
+    }
+    for (size_t off = 0; off < DATA_SIZE;) {
+        ssize_t r = zseek_pread(reader, buf, sizeof(buf), off, NULL, errbuf);
+        ck_assert(r > 0);
+        off += r;
+    }
+    zseek_reader_stats_ext_t stats;
+    ck_assert_msg(zseek_reader_stats_ext(reader, &stats, errbuf),
+        "zseek_reader_stats_ext: %s", errbuf);
+    ck_assert_uint_eq(stats.stats.frames, nb_frames);
+    ck_assert_uint_eq(stats.cache_hits, nb_frames);
+    ck_assert_uint_eq(stats.cache_misses, 2 * nb_frames);
+    ck_assert_uint_eq(stats.cache_evictions, 2 * nb_frames - 4);
+    ck_assert_uint_eq(stats.decompressed_bytes, 2 * DATA_SIZE);
+    ck_assert_uint_eq(stats.pread_calls, atomic_load(&mf.preads) - preads);
+    ck_assert_uint_eq(stats.pread_calls, 2 * nb_frames);
+    ck_assert_uint_lt(stats.compressed_bytes_read, 2 * mf.size);
+    ck_assert_uint_gt(stats.compressed_bytes_read, 0);
+    ck_assert_uint_eq(stats.fetch_ns.count, stats.pread_calls);
+    ck_assert_uint_eq(histogram_total(&stats.fetch_ns), stats.fetch_ns.count);
+    ck_assert_uint_eq(stats.decompress_ns.count, 2 * nb_frames);
+    ck_assert_uint_eq(histogram_total(&stats.decompress_ns),
+        stats.decompress_ns.count);
+    ck_assert_uint_gt(stats.decompress_ns.sum, 0);
+    ck_assert_uint_eq(stats.lock_wait_ns.count, stats.lock_waits);
+
+    // Same as the events
+    ck_assert_uint_eq(atomic_load(&ev.counts[ZSEEK_EVENT_CACHE_HIT]),
+        stats.cache_hits);
+    ck_assert_uint_eq(atomic_load(&ev.counts[ZSEEK_EVENT_CACHE_MISS]),
+        stats.cache_misses);
+    ck_assert_uint_eq(atomic_load(&ev.counts[ZSEEK_EVENT_CACHE_EVICT]),
+        stats.cache_evictions);
+    ck_assert_uint_eq(atomic_load(&ev.bytes[ZSEEK_EVENT_FETCH]),
+        stats.compressed_bytes_read);
+    ck_assert_uint_eq(atomic_load(&ev.bytes[ZSEEK_EVENT_DECOMPRESS]),
+        stats.decompressed_bytes);
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    // Not evicted on close
+    ck_assert_uint_eq(atomic_load(&ev.counts[ZSEEK_EVENT_CACHE_EVICT]),
+        stats.cache_evictions);
+
+    // Concurrently, without a cache
+    param.cache_size = 0;
+    param.event_handler = NULL;
+    reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    pthread_t threads[NB_THREADS];
+    concurrent_arg_t args[NB_THREADS];
+    for (int t = 0; t < NB_THREADS; t++) {
+        args[t] = (concurrent_arg_t){reader, data, t + 1, false};
+        ck_assert(pthread_create(&threads[t], NULL, concurrent_reader,
+            &args[t]) == 0);
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        ck_assert(pthread_join(threads[t], NULL) == 0);
+        ck_assert_msg(!args[t].failed, "thread %d read wrong data", t);
+    }
+    ck_assert(zseek_reader_stats_ext(reader, &stats, errbuf));
+    ck_assert_uint_eq(stats.cache_hits + stats.cache_misses, 0);
+    ck_assert_uint_ge(stats.pread_calls, NB_THREADS * READS_PER_THREAD);
+    ck_assert_uint_eq(stats.decompress_ns.count, stats.pread_calls);
+    ck_assert_uint_eq(stats.lock_wait_ns.count, stats.lock_waits);
+    ck_assert_uint_eq(histogram_total(&stats.lock_wait_ns), stats.lock_waits);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    // Nothing without metrics
+    reader = open_mem(&mf, 4);
+    ck_assert(zseek_pread(reader, buf, READ_SIZE, 0, NULL, errbuf) ==
+        READ_SIZE);
+    ck_assert(zseek_reader_stats_ext(reader, &stats, errbuf));
+    ck_assert_uint_eq(stats.stats.cached_frames, 1);
+    ck_assert_uint_eq(stats.cache_misses + stats.pread_calls +
+        stats.decompressed_bytes + stats.decompress_ns.count, 0);
+    ck_assert(!zseek_reader_stats_ext(reader, NULL, errbuf));
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_stats_ext_zstd)
+{
+    check_stats_ext(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_reader_stats_ext_lz4)
+{
+    check_stats_ext(ZSEEK_LZ4);
+}
+END_TEST
+
+#define NB_CURSORS 32   // More than the contexts of a reader
+
+typedef struct {
+    zseek_reader_t *reader;
+    const uint8_t *data;
+    size_t start;
+    bool failed;
+} cursor_arg_t;
+
+static void *cursor_reader(void *arg)
+{
+    cursor_arg_t *ca = arg;
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t buf[READ_SIZE];
+
+    zseek_cursor_t *cursor = zseek_cursor_open(ca->reader, errbuf);
+    if (!cursor) {
+        ca->failed = true;
+        return NULL;
+    }
+
+    // Sequential from start to EOF, with reads at other offsets in between
+    zseek_cursor_seek(cursor, ca->start);
+    size_t pos = ca->start;
+    unsigned seed = ca->start;
+    for (;;) {
+        ssize_t r = zseek_cursor_read(cursor, buf, READ_SIZE,
+            ZSEEK_PREAD_FULL, NULL, errbuf);
+        if (r < 0 || memcmp(buf, ca->data + pos, r) != 0) {
+            ca->failed = true;
+            break;
+        }
+        pos += r;
+        if (r < READ_SIZE)
+            break;
+
+        size_t offset = rand_r(&seed) % DATA_SIZE;
+        r = zseek_cursor_pread(cursor, buf, READ_SIZE, offset, 0, NULL,
+            errbuf);
+        if (r <= 0 || memcmp(buf, ca->data + offset, r) != 0) {
+            ca->failed = true;
+            break;
+        }
+    }
+    if (pos != DATA_SIZE || zseek_cursor_tell(cursor) != DATA_SIZE)
+        ca->failed = true;
+
+    if (!zseek_cursor_close(cursor, errbuf))
+        ca->failed = true;
+
+    return NULL;
+}
+
+static void check_cursors(zseek_compression_type_t type, size_t cache_size)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    zseek_reader_t *reader = open_mem(&mf, cache_size);
+
+    pthread_t threads[NB_CURSORS];
+    cursor_arg_t args[NB_CURSORS];
+    for (int t = 0; t < NB_CURSORS; t++) {
+        args[t] = (cursor_arg_t){reader, data,
+            (size_t)t * (DATA_SIZE / NB_CURSORS) + t, false};
+        ck_assert(pthread_create(&threads[t], NULL, cursor_reader,
+            &args[t]) == 0);
+    }
+    for (int t = 0; t < NB_CURSORS; t++) {
+        ck_assert(pthread_join(threads[t], NULL) == 0);
+        ck_assert_msg(!args[t].failed, "cursor %d read wrong data", t);
+    }
+
+    // Past EOF
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_cursor_t *cursor = zseek_cursor_open(reader, errbuf);
+    ck_assert_msg(cursor != NULL, "zseek_cursor_open: %s", errbuf);
+    zseek_cursor_seek(cursor, DATA_SIZE + 1);
+    uint8_t buf[1];
+    ck_assert(zseek_cursor_read(cursor, buf, 1, 0, NULL, errbuf) == 0);
+    ck_assert_uint_eq(zseek_cursor_tell(cursor), DATA_SIZE + 1);
+    ck_assert(zseek_cursor_close(cursor, errbuf));
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_cursors_zstd)
+{
+    check_cursors(ZSEEK_ZSTD, 4);
+    check_cursors(ZSEEK_ZSTD, 0);
+}
+END_TEST
+
+START_TEST(test_reader_cursors_lz4)
+{
+    check_cursors(ZSEEK_LZ4, 4);
+    check_cursors(ZSEEK_LZ4, 0);
+}
+END_TEST
+
+/**
+ * Wait for readahead to fill the cache of @p reader with @p nb_frames frames
+ */
+static void wait_cached(zseek_reader_t *reader, size_t nb_frames)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_reader_stats_t stats;
+    for (int i = 0; i < 5000; i++) {
+        ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+            "zseek_reader_stats: %s", errbuf);
+        if (stats.cached_frames >= nb_frames)
+            break;
+        usleep(1000);
+    }
+    ck_assert_uint_ge(stats.cached_frames, nb_frames);
+}
+
+/**
+ * Read the rest of the current frame of @p cursor, checking it against
+ * @p data, and return the number of preads it took
+ */
+static size_t cursor_read_frame(zseek_cursor_t *cursor, mem_file_t *mf,
+    const uint8_t *data, uint8_t *out)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    size_t offset = zseek_cursor_tell(cursor);
+    size_t preads = atomic_load(&mf->preads);
+    ssize_t r = zseek_cursor_read(cursor, out, DATA_SIZE, 0, NULL, errbuf);
+    ck_assert_msg(r > 0, "zseek_cursor_read: %s", errbuf);
+    ck_assert(memcmp(out, data + offset, r) == 0);
+    return atomic_load(&mf->preads) - preads;
+}
+
+START_TEST(test_reader_cursors_readahead)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, ZSEEK_ZSTD);
+    // A window of 4 frames, that does not grow
+    zseek_reader_t *reader = open_mem_readahead(&mf, 64, 4);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    zseek_cursor_t *cursors[2];
+    for (int c = 0; c < 2; c++) {
+        cursors[c] = zseek_cursor_open(reader, errbuf);
+        ck_assert_msg(cursors[c] != NULL, "zseek_cursor_open: %s", errbuf);
+    }
+    zseek_cursor_seek(cursors[1], DATA_SIZE / 2);
+
+    // Interleaved scans, each starting with two frames, then served from the
+    // window prefetched for it
+    for (int i = 0; i < 2; i++) {
+        cursor_read_frame(cursors[0], &mf, data, out);
+        cursor_read_frame(cursors[1], &mf, data, out);
+    }
+    wait_cached(reader, 2 * (2 + 4));
+    for (int i = 0; i < 4; i++) {
+        ck_assert_uint_eq(cursor_read_frame(cursors[0], &mf, data, out), 0);
+        ck_assert_uint_eq(cursor_read_frame(cursors[1], &mf, data, out), 0);
+    }
+
+    for (int c = 0; c < 2; c++)
+        ck_assert(zseek_cursor_close(cursors[c], errbuf));
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(out);
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+START_TEST(test_reader_cursors_misuse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    ck_assert(zseek_cursor_open(NULL, errbuf) == NULL);
+    ck_assert(zseek_cursor_close(NULL, errbuf));
+    uint8_t buf[1];
+    ck_assert(zseek_cursor_read(NULL, buf, 1, 0, NULL, errbuf) == -1);
+    ck_assert(zseek_cursor_pread(NULL, buf, 1, 0, 0, NULL, errbuf) == -1);
+}
+END_TEST
+
+/**
+ * Open a reader of @p mf with a cache of @p cache_size frames and a compressed
+ * cache of @p ccache_bytes bytes, with metrics
+ */
+static zseek_reader_t *open_mem_ccache(mem_file_t *mf, size_t cache_size,
+    size_t ccache_bytes, bool batch)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL,
+        batch ? mem_pread_batch : NULL};
+    zseek_reader_param_t param = {
+        .cache_size = cache_size,
+        .compressed_cache_bytes = ccache_bytes,
+        .metrics = true,
+    };
+    zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+    return reader;
+}
+
+/**
+ * Read a byte every FRAME_SIZE bytes of @p reader (thus from every frame),
+ * checking it against @p data
+ */
+static void read_each_frame(zseek_reader_t *reader, const uint8_t *data)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    for (size_t off = 0; off < DATA_SIZE; off += FRAME_SIZE) {
+        uint8_t b;
+        ck_assert_msg(zseek_pread(reader, &b, 1, off, NULL, errbuf) == 1,
+            "zseek_pread: %s", errbuf);
+        ck_assert_uint_eq(b, data[off]);
+    }
+}
+
+static void check_compressed_cache(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, type);
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    // Misses of a small cache (or without one) are served with no I/O
+    for (size_t cache_size = 0; cache_size <= 2; cache_size += 2) {
+        zseek_reader_t *reader = open_mem_ccache(&mf, cache_size, mf.size,
+            false);
+        size_t preads = atomic_load(&mf.preads);
+        read_each_frame(reader, data);
+        size_t nb_frames = atomic_load(&mf.preads) - preads;
+        read_each_frame(reader, data);
+        ck_assert_uint_eq(atomic_load(&mf.preads) - preads, nb_frames);
+
+        zseek_reader_stats_ext_t stats;
+        ck_assert(zseek_reader_stats_ext(reader, &stats, errbuf));
+        ck_assert_uint_eq(stats.compressed_cache_misses, nb_frames);
+        ck_assert_uint_ge(stats.compressed_cache_hits, nb_frames);
+        ck_assert_uint_eq(stats.compressed_cache_evictions, 0);
+        ck_assert_uint_eq(stats.stats.compressed_cached_frames, nb_frames);
+        ck_assert_uint_gt(stats.stats.compressed_cache_memory, 0);
+        ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    }
+
+    // Neighbouring frames of multi-frame reads are kept too
+    zseek_reader_t *reader = open_mem_ccache(&mf, 2, mf.size, false);
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    size_t preads = atomic_load(&mf.preads);
+    ck_assert_int_eq(zseek_pread_flags(reader, out, DATA_SIZE, 0,
+        ZSEEK_PREAD_FULL, NULL, errbuf), DATA_SIZE);
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+    size_t fetched = atomic_load(&mf.preads) - preads;
+    read_each_frame(reader, data);
+    ck_assert_uint_eq(atomic_load(&mf.preads) - preads, fetched);
+
+    // Including by batched vectored reads
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    reader = open_mem_ccache(&mf, 0, mf.size, true);
+    zseek_iovec_t reqs[] = {
+        {0, out, 100},
+        {DATA_SIZE / 2, out + 100, 100},
+        {DATA_SIZE - 100, out + 200, 100},
+    };
+    for (int pass = 0; pass < 2; pass++) {
+        preads = atomic_load(&mf.preads);
+        ck_assert_int_eq(zseek_preadv(reader, reqs, 3, NULL, errbuf), 300);
+        ck_assert_uint_eq(atomic_load(&mf.preads) - preads, pass ? 0 : 3);
+        ck_assert(memcmp(out, data, 100) == 0);
+        ck_assert(memcmp(out + 100, data + DATA_SIZE / 2, 100) == 0);
+        ck_assert(memcmp(out + 200, data + DATA_SIZE - 100, 100) == 0);
+    }
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    // Within its own budget
+    reader = open_mem_ccache(&mf, 2, mf.size / 4, false);
+    preads = atomic_load(&mf.preads);
+    read_each_frame(reader, data);
+    size_t nb_frames = atomic_load(&mf.preads) - preads;
+    zseek_reader_stats_ext_t stats;
+    ck_assert(zseek_reader_stats_ext(reader, &stats, errbuf));
+    ck_assert_uint_gt(stats.compressed_cache_evictions, 0);
+    ck_assert_uint_lt(stats.stats.compressed_cached_frames, nb_frames);
+    ck_assert_uint_eq(stats.compressed_cache_evictions +
+        stats.stats.compressed_cached_frames, nb_frames);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    // Not filled by bulk decompression
+    reader = open_mem_ccache(&mf, 0, mf.size, false);
+    ck_assert_int_eq(zseek_reader_decompress_range(reader, out, DATA_SIZE, 0,
+        NULL, NULL, NULL, errbuf), DATA_SIZE);
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+    ck_assert(zseek_reader_stats_ext(reader, &stats, errbuf));
+    ck_assert_uint_eq(stats.stats.compressed_cached_frames, 0);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    free(out);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_reader_compressed_cache_zstd)
+{
+    check_compressed_cache(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_reader_compressed_cache_lz4)
+{
+    check_compressed_cache(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_reader_cache_policy)
+{
+    uint8_t *data = test_data();
+    mem_file_t mf;
+    compress_to(&mf, data, ZSEEK_ZSTD);
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+
+    const zseek_cache_policy_t policies[] = {ZSEEK_CACHE_CLOCK,
+        ZSEEK_CACHE_2Q, ZSEEK_CACHE_TINYLFU};
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        zseek_reader_param_t param = {
+            .cache_size = 8,
+            .compressed_cache_bytes = mf.size,
+            .cache_policy = policies[p],
+        };
+        zseek_reader_t *reader = zseek_reader_open_param(rf, &param, NULL,
+            errbuf);
+        ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+
+        // Random reads
+        unsigned seed = 42;
+        for (int i = 0; i < 500; i++) {
+            size_t offset = rand_r(&seed) % DATA_SIZE;
+            size_t count = 1 + rand_r(&seed) % 4096;
+            count = MIN(count, DATA_SIZE - offset);
+            ck_assert_int_eq(zseek_pread_flags(reader, out, count, offset,
+                ZSEEK_PREAD_FULL, NULL, errbuf), count);
+            ck_assert(memcmp(out, data + offset, count) == 0);
+        }
+        ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+        // A scan bypassing the caches leaves them as they were
+        reader = zseek_reader_open_param(rf, &param, NULL, errbuf);
+        ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+        ck_assert_int_eq(zseek_pread(reader, out, 1, 0, NULL, errbuf), 1);
+        ck_assert_int_eq(zseek_pread_flags(reader, out, DATA_SIZE, 0,
+            ZSEEK_PREAD_FULL | ZSEEK_PREAD_NOCACHE, NULL, errbuf), DATA_SIZE);
+        ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+        zseek_reader_stats_t stats;
+        ck_assert(zseek_reader_stats(reader, &stats, errbuf));
+        ck_assert_uint_eq(stats.cached_frames, 1);
+        ck_assert_uint_eq(stats.compressed_cached_frames, 1);
+        ck_assert_int_eq(zseek_pread_flags(reader, out, 1000, 10,
+            ZSEEK_PREAD_NOCACHE, NULL, errbuf), 1000);
+        ck_assert(memcmp(out, data + 10, 1000) == 0);
+        ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    }
+
+    zseek_reader_param_t param = {
+        .cache_size = 8,
+        .cache_policy = (zseek_cache_policy_t)-1,
+    };
+    ck_assert(zseek_reader_open_param(rf, &param, NULL, errbuf) == NULL);
+
+    free(out);
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+Suite *reader_suite(void)
+{
+    Suite *s = suite_create("reader");
+    TCase *tc_core = tcase_create("Core");
+    tcase_set_timeout(tc_core, 60);
+
+    tcase_add_test(tc_core, test_reader_sequential_zstd);
+    tcase_add_test(tc_core, test_reader_sequential_lz4);
+    tcase_add_test(tc_core, test_reader_concurrent_zstd);
+    tcase_add_test(tc_core, test_reader_concurrent_lz4);
+    tcase_add_test(tc_core, test_reader_single_flight);
+    tcase_add_test(tc_core, test_reader_pread_full_zstd);
+    tcase_add_test(tc_core, test_reader_pread_full_lz4);
+    tcase_add_test(tc_core, test_reader_pread_ref_zstd);
+    tcase_add_test(tc_core, test_reader_pread_ref_lz4);
+    tcase_add_test(tc_core, test_reader_preadv_zstd);
+    tcase_add_test(tc_core, test_reader_preadv_lz4);
+    tcase_add_test(tc_core, test_reader_preadv_batch);
+    tcase_add_test(tc_core, test_reader_decompress_range_zstd);
+    tcase_add_test(tc_core, test_reader_decompress_range_lz4);
+    tcase_add_test(tc_core, test_reader_uring);
+    tcase_add_test(tc_core, test_reader_readahead_zstd);
+    tcase_add_test(tc_core, test_reader_readahead_lz4);
+    tcase_add_test(tc_core, test_reader_readahead_no_cache);
+    tcase_add_test(tc_core, test_reader_range_zstd);
+    tcase_add_test(tc_core, test_reader_range_lz4);
+    tcase_add_test(tc_core, test_reader_mmap_zstd);
+    tcase_add_test(tc_core, test_reader_mmap_lz4);
+    tcase_add_test(tc_core, test_reader_mmap_empty);
+    tcase_add_test(tc_core, test_reader_seek_table);
+    tcase_add_test(tc_core, test_reader_lazy_seek_table);
+    tcase_add_test(tc_core, test_reader_fixed_frame_size);
+    tcase_add_test(tc_core, test_reader_cache_bytes);
+    tcase_add_test(tc_core, test_reader_sub_blocks_zstd);
+    tcase_add_test(tc_core, test_reader_sub_blocks_lz4);
+    tcase_add_test(tc_core, test_reader_sub_blocks_misuse);
+    tcase_add_test(tc_core, test_reader_stats_ext_zstd);
+    tcase_add_test(tc_core, test_reader_stats_ext_lz4);
+    tcase_add_test(tc_core, test_reader_cursors_zstd);
+    tcase_add_test(tc_core, test_reader_cursors_lz4);
+    tcase_add_test(tc_core, test_reader_cursors_readahead);
+    tcase_add_test(tc_core, test_reader_cursors_misuse);
+    tcase_add_test(tc_core, test_reader_compressed_cache_zstd);
+    tcase_add_test(tc_core, test_reader_compressed_cache_lz4);
+    tcase_add_test(tc_core, test_reader_cache_policy);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    Suite *s = reader_suite();
+    SRunner *sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include <check.h>
+
+#include "../src/zseek.h"
+#include "../src/thread_pool.h"
+
+#define NB_WORKERS 4
+#define NB_JOBS 1000
+
+START_TEST(test_thread_pool_new_invalid)
+{
+    zseek_thread_pool_t *pool = zseek_thread_pool_new(0, 0, NULL, NULL);
+    ck_assert(pool == NULL);
+}
+END_TEST
+
+START_TEST(test_thread_pool_new)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_thread_pool_t *pool = zseek_thread_pool_new(NB_WORKERS, 0, NULL,
+        errbuf);
+    ck_assert_msg(pool != NULL, "zseek_thread_pool_new: %s", errbuf);
+    ck_assert_int_eq(zseek_thread_pool_workers(pool), NB_WORKERS);
+
+    zseek_thread_pool_free(pool);
+}
+END_TEST
+
+START_TEST(test_thread_pool_workers_null)
+{
+    ck_assert_int_eq(zseek_thread_pool_workers(NULL), 0);
+}
+END_TEST
+
+static void count_task(void *arg)
+{
+    atomic_int *count = arg;
+    atomic_fetch_add(count, 1);
+}
+
+START_TEST(test_thread_pool_submit)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_thread_pool_t *pool = zseek_thread_pool_new(NB_WORKERS, 0, NULL,
+        errbuf);
+    ck_assert_msg(pool != NULL, "zseek_thread_pool_new: %s", errbuf);
+
+    atomic_int count;
+    atomic_init(&count, 0);
+    zseek_task_t tasks[NB_JOBS];
+    for (int t = 0; t < NB_JOBS; t++) {
+        tasks[t] = (zseek_task_t){.fn = count_task, .arg = &count};
+        zseek_thread_pool_submit(pool, &tasks[t]);
+    }
+
+    // Queued tasks are run before the pool is freed
+    zseek_thread_pool_free(pool);
+    ck_assert_int_eq(atomic_load(&count), NB_JOBS);
+}
+END_TEST
+
+typedef struct {
+    atomic_int runs[NB_JOBS];
+} run_arg_t;
+
+static void run_job(void *arg, size_t job)
+{
+    run_arg_t *ra = arg;
+    atomic_fetch_add(&ra->runs[job], 1);
+}
+
+static void check_run(zseek_thread_pool_t *pool, size_t nb_jobs)
+{
+    run_arg_t ra;
+    for (int j = 0; j < NB_JOBS; j++)
+        atomic_init(&ra.runs[j], 0);
+
+    zseek_thread_pool_run(pool, nb_jobs, run_job, &ra);
+
+    // Each job run exactly once
+    for (size_t j = 0; j < NB_JOBS; j++)
+        ck_assert_int_eq(atomic_load(&ra.runs[j]), j < nb_jobs ? 1 : 0);
+}
+
+START_TEST(test_thread_pool_run)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_thread_pool_t *pool = zseek_thread_pool_new(NB_WORKERS, 0, NULL,
+        errbuf);
+    ck_assert_msg(pool != NULL, "zseek_thread_pool_new: %s", errbuf);
+
+    check_run(pool, 0);
+    check_run(pool, 1);
+    check_run(pool, 2);
+    check_run(pool, NB_JOBS);
+
+    zseek_thread_pool_free(pool);
+}
+END_TEST
+
+START_TEST(test_thread_pool_run_null)
+{
+    check_run(NULL, 0);
+    check_run(NULL, NB_JOBS);
+}
+END_TEST
+
+static void *concurrent_runner(void *arg)
+{
+    zseek_thread_pool_t *pool = arg;
+    run_arg_t *ra = malloc(sizeof(*ra));
+    if (!ra)
+        return arg;
+    for (int j = 0; j < NB_JOBS; j++)
+        atomic_init(&ra->runs[j], 0);
+
+    zseek_thread_pool_run(pool, NB_JOBS, run_job, ra);
+
+    void *ret = NULL;
+    for (int j = 0; j < NB_JOBS; j++)
+        if (atomic_load(&ra->runs[j]) != 1)
+            ret = arg;
+    free(ra);
+
+    return ret;
+}
+
+START_TEST(test_thread_pool_run_concurrent)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_thread_pool_t *pool = zseek_thread_pool_new(NB_WORKERS, 0, NULL,
+        errbuf);
+    ck_assert_msg(pool != NULL, "zseek_thread_pool_new: %s", errbuf);
+
+    pthread_t threads[NB_WORKERS];
+    for (int t = 0; t < NB_WORKERS; t++)
+        ck_assert(pthread_create(&threads[t], NULL, concurrent_runner,
+            pool) == 0);
+    for (int t = 0; t < NB_WORKERS; t++) {
+        void *ret;
+        ck_assert(pthread_join(threads[t], &ret) == 0);
+        ck_assert_msg(ret == NULL, "thread %d missed jobs", t);
+    }
+
+    zseek_thread_pool_free(pool);
+}
+END_TEST
+
+Suite *thread_pool_suite(void)
+{
+    Suite *s = suite_create("thread_pool");
+    TCase *tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_thread_pool_new_invalid);
+    tcase_add_test(tc_core, test_thread_pool_new);
+    tcase_add_test(tc_core, test_thread_pool_workers_null);
+    tcase_add_test(tc_core, test_thread_pool_submit);
+    tcase_add_test(tc_core, test_thread_pool_run);
+    tcase_add_test(tc_core, test_thread_pool_run_null);
+    tcase_add_test(tc_core, test_thread_pool_run_concurrent);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    Suite *s = thread_pool_suite();
+    SRunner *sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,1922 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "../src/zseek.h"
+
+#define DATA_SIZE (1 << 20)         // 1 MiB
+#define FRAME_SIZE (1 << 14)        // 16 KiB
+#define CHUNK_SIZE 3000
+#define RECORDS_SIZE (1 << 18)      // 256 KiB
+#define RECORD_FRAME_SIZE 512
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/**
+ * An in-memory compressed file
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    size_t writes;
+    size_t fail_after;  // Fail writes after that many (0 = never)
+} mem_file_t;
+
+static bool mem_write(const void *data, size_t size, void *user_data,
+    void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    if (mf->fail_after > 0 && mf->writes >= mf->fail_after)
+        return false;
+    mf->writes++;
+    if (size == 0)
+        return true;
+    if (mf->size + size > mf->capacity) {
+        size_t capacity = 2 * (mf->size + size);
+        uint8_t *new_data = realloc(mf->data, capacity);
+        if (!new_data)
+            return false;
+        mf->data = new_data;
+        mf->capacity = capacity;
+    }
+    memcpy(mf->data + mf->size, data, size);
+    mf->size += size;
+    return true;
+}
+
+static ssize_t mem_pread(void *data, size_t size, size_t offset,
+    void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    if (offset >= mf->size)
+        return 0;
+    if (size > mf->size - offset)
+        size = mf->size - offset;
+    memcpy(data, mf->data + offset, size);
+    return size;
+}
+
+static ssize_t mem_fsize(void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    return mf->size;
+}
+
+static uint8_t *test_data(void)
+{
+    // Compressible, but not trivially so
+    uint8_t *data = malloc(DATA_SIZE);
+    ck_assert_msg(data != NULL, "failed to allocate test data");
+    unsigned seed = 42;
+    for (size_t i = 0; i < DATA_SIZE; i++)
+        data[i] = (i % 7 == 0) ? (uint8_t)rand_r(&seed) : 'a' + i % 13;
+    return data;
+}
+
+static zseek_compression_param_t test_param(zseek_compression_type_t type,
+    int nb_frame_workers, int async_queue_depth)
+{
+    zseek_compression_param_t param = {
+        .type = type,
+        .nb_frame_workers = nb_frame_workers,
+        .async_queue_depth = async_queue_depth,
+    };
+    if (type == ZSEEK_ZSTD)
+        param.params.zstd_params.compression_level = 3;
+    return param;
+}
+
+static void compress_to(mem_file_t *mf, const uint8_t *data,
+    zseek_compression_param_t *param)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    // Write in odd-sized chunks, with a large one in the middle
+    size_t off = 0;
+    bool large = false;
+    while (off < DATA_SIZE) {
+        size_t len = CHUNK_SIZE;
+        if (!large && off >= DATA_SIZE / 2) {
+            len = 5 * FRAME_SIZE;
+            large = true;
+        }
+        if (len > DATA_SIZE - off)
+            len = DATA_SIZE - off;
+        ck_assert_msg(zseek_write(writer, data + off, len, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+        off += len;
+    }
+
+    zseek_writer_stats_t stats;
+    ck_assert_msg(zseek_writer_stats(writer, &stats, errbuf),
+        "zseek_writer_stats: %s", errbuf);
+    ck_assert(stats.frames > 0);
+
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+}
+
+/**
+ * Decompress all of @p mf and compare it to @p data. Returns the number of
+ * frames.
+ */
+static size_t check_contents_size(mem_file_t *mf, const uint8_t *data,
+    size_t size)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+
+    zseek_reader_stats_t stats;
+    ck_assert_msg(zseek_reader_stats(reader, &stats, errbuf),
+        "zseek_reader_stats: %s", errbuf);
+    ck_assert_uint_eq(stats.decompressed_size, size);
+
+    uint8_t *out = malloc(size);
+    ck_assert_msg(out != NULL, "failed to allocate output");
+    ssize_t r = zseek_pread_flags(reader, out, size, 0, ZSEEK_PREAD_FULL,
+        NULL, errbuf);
+    ck_assert_msg(r == (ssize_t)size, "zseek_pread_flags: %s", errbuf);
+    ck_assert(memcmp(out, data, size) == 0);
+
+    // Partial frames too
+    for (size_t off = 1; off < size; off += size / 7) {
+        size_t len = MIN(100, size - off);
+        r = zseek_pread_flags(reader, out, len, off, ZSEEK_PREAD_FULL, NULL,
+            errbuf);
+        ck_assert_msg(r == (ssize_t)len, "zseek_pread_flags: %s", errbuf);
+        ck_assert(memcmp(out, data + off, len) == 0);
+    }
+
+    ck_assert_msg(zseek_reader_close(reader, NULL, errbuf),
+        "zseek_reader_close: %s", errbuf);
+    free(out);
+
+    return stats.frames;
+}
+
+static size_t check_contents(mem_file_t *mf, const uint8_t *data)
+{
+    return check_contents_size(mf, data, DATA_SIZE);
+}
+
+static void check_frame_workers(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+
+    zseek_compression_param_t param = test_param(type, 0, 0);
+    mem_file_t serial;
+    compress_to(&serial, data, &param);
+    size_t serial_frames = check_contents(&serial, data);
+
+    // {nb_frame_workers, async_queue_depth}
+    int configs[][2] = {{1, 0}, {4, 0}, {0, 1}, {0, 3}, {2, 1}, {4, 8}};
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        param = test_param(type, configs[i][0], configs[i][1]);
+        mem_file_t mf;
+        compress_to(&mf, data, &param);
+        // Same frame boundaries
+        ck_assert_uint_eq(check_contents(&mf, data), serial_frames);
+        if (type == ZSEEK_ZSTD) {
+            // Same compressor, so same output
+            ck_assert_uint_eq(mf.size, serial.size);
+            ck_assert(memcmp(mf.data, serial.data, mf.size) == 0);
+        }
+        free(mf.data);
+    }
+
+    free(serial.data);
+    free(data);
+}
+
+START_TEST(test_writer_frame_workers_zstd)
+{
+    check_frame_workers(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_writer_frame_workers_lz4)
+{
+    check_frame_workers(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_writer_frame_workers_exclusive)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 2, 0);
+    param.params.zstd_params.nb_workers = 2;
+    ck_assert(zseek_writer_open_full(wf, &param, FRAME_SIZE, NULL,
+        errbuf) == NULL);
+    param = test_param(ZSEEK_ZSTD, 0, 2);
+    param.params.zstd_params.nb_workers = 2;
+    ck_assert(zseek_writer_open_full(wf, &param, FRAME_SIZE, NULL,
+        errbuf) == NULL);
+}
+END_TEST
+
+START_TEST(test_writer_frame_workers_empty)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_compression_param_t param = test_param(ZSEEK_LZ4, 2, 0);
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+
+    // Just the seek table
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    ck_assert(mf.size > 0);
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    if (reader)
+        zseek_reader_close(reader, NULL, NULL);
+    free(mf.data);
+}
+END_TEST
+
+static void check_flush(zseek_compression_param_t *param)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    // Partial frames are written out on flush
+    size_t off = 0;
+    for (int i = 0; i < 3; i++) {
+        ck_assert_msg(zseek_write(writer, data + off, CHUNK_SIZE, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+        off += CHUNK_SIZE;
+        ck_assert_msg(zseek_writer_flush(writer, NULL, errbuf),
+            "zseek_writer_flush: %s", errbuf);
+        ck_assert(mf.size > 0);
+        size_t size = mf.size;
+
+        zseek_writer_stats_t stats;
+        ck_assert(zseek_writer_stats(writer, &stats, errbuf));
+        ck_assert_uint_eq(stats.frames, (size_t)i + 1);
+        ck_assert_uint_eq(stats.compressed_size - stats.seek_table_size, size);
+
+        // Nothing more to flush
+        ck_assert(zseek_writer_flush(writer, NULL, errbuf));
+        ck_assert_uint_eq(mf.size, size);
+    }
+    ck_assert_msg(zseek_write(writer, data + off, DATA_SIZE - off, NULL,
+        errbuf), "zseek_write: %s", errbuf);
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+
+    check_contents(&mf, data);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_writer_flush)
+{
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    for (size_t t = 0; t < 2; t++) {
+        zseek_compression_param_t param = test_param(types[t], 0, 0);
+        check_flush(&param);
+        param = test_param(types[t], 2, 0);
+        check_flush(&param);
+        param = test_param(types[t], 2, 4);
+        check_flush(&param);
+    }
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.nb_workers = 2;
+    check_flush(&param);
+}
+END_TEST
+
+static void check_write_error(zseek_compression_param_t *param)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {.fail_after = 3};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    // Reported by a later write, at the latest at flush
+    bool ok = true;
+    for (size_t off = 0; ok && off < DATA_SIZE; off += CHUNK_SIZE) {
+        size_t len = CHUNK_SIZE < DATA_SIZE - off ? CHUNK_SIZE :
+            DATA_SIZE - off;
+        ok = zseek_write(writer, data + off, len, NULL, errbuf);
+    }
+    if (ok)
+        ok = zseek_writer_flush(writer, NULL, errbuf);
+    ck_assert(!ok);
+    // Sticky
+    ck_assert(!zseek_writer_flush(writer, NULL, errbuf));
+    ck_assert(!zseek_writer_close(writer, NULL, errbuf));
+
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_writer_async_error)
+{
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 2);
+    check_write_error(&param);
+    param = test_param(ZSEEK_LZ4, 4, 8);
+    check_write_error(&param);
+}
+END_TEST
+
+START_TEST(test_writer_large_write)
+{
+    // A whole-frame write after buffered data keeps the buffered data
+    uint8_t *data = test_data();
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    for (size_t t = 0; t < 2; t++) {
+        char errbuf[ZSEEK_ERRBUF_SIZE];
+        mem_file_t mf = {0};
+        zseek_write_file_t wf = {&mf, mem_write, NULL};
+        zseek_compression_param_t param = test_param(types[t], 0, 0);
+        zseek_writer_t *writer = zseek_writer_open_full(wf, &param,
+            FRAME_SIZE, NULL, errbuf);
+        ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+        ck_assert(zseek_write(writer, data, 100, NULL, errbuf));
+        ck_assert(zseek_write(writer, data + 100, DATA_SIZE - 100, NULL,
+            errbuf));
+        ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+            "zseek_writer_close: %s", errbuf);
+        check_contents(&mf, data);
+        free(mf.data);
+    }
+    free(data);
+}
+END_TEST
+
+static void check_reserve(zseek_compression_param_t *param)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    // Lease more than used, mixed with plain writes
+    size_t off = 0;
+    for (unsigned i = 0; off < DATA_SIZE; i++) {
+        size_t len = CHUNK_SIZE < DATA_SIZE - off ? CHUNK_SIZE :
+            DATA_SIZE - off;
+        if (i % 5 == 4) {
+            ck_assert_msg(zseek_write(writer, data + off, len, NULL, errbuf),
+                "zseek_write: %s", errbuf);
+        } else {
+            uint8_t *span = zseek_writer_reserve(writer, 2 * CHUNK_SIZE,
+                errbuf);
+            ck_assert_msg(span != NULL, "zseek_writer_reserve: %s", errbuf);
+            memcpy(span, data + off, len);
+            ck_assert_msg(zseek_writer_commit(writer, len, NULL, errbuf),
+                "zseek_writer_commit: %s", errbuf);
+        }
+        off += len;
+    }
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+
+    check_contents(&mf, data);
+    free(mf.data);
+    free(data);
+}
+
+START_TEST(test_writer_reserve)
+{
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    for (size_t t = 0; t < 2; t++) {
+        zseek_compression_param_t param = test_param(types[t], 0, 0);
+        check_reserve(&param);
+        param = test_param(types[t], 2, 0);
+        check_reserve(&param);
+        param = test_param(types[t], 2, 4);
+        check_reserve(&param);
+    }
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.nb_workers = 2;
+    check_reserve(&param);
+}
+END_TEST
+
+START_TEST(test_writer_reserve_misuse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    // No lease
+    ck_assert(!zseek_writer_commit(writer, 1, NULL, errbuf));
+    ck_assert(zseek_writer_commit(writer, 0, NULL, errbuf));
+
+    // More than leased
+    ck_assert(zseek_writer_reserve(writer, 10, errbuf) != NULL);
+    ck_assert(!zseek_writer_commit(writer, 11, NULL, errbuf));
+
+    // Dropped by other calls
+    uint8_t *span = zseek_writer_reserve(writer, 10, errbuf);
+    ck_assert(span != NULL);
+    memset(span, 'x', 10);
+    ck_assert(zseek_write(writer, "abc", 3, NULL, errbuf));
+    ck_assert(!zseek_writer_commit(writer, 10, NULL, errbuf));
+
+    ck_assert(zseek_writer_reserve(writer, 0, errbuf) != NULL);
+    ck_assert(zseek_writer_commit(writer, 0, NULL, errbuf));
+
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+
+    // Only the plain write made it
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+    char out[16];
+    ck_assert_int_eq(zseek_pread(reader, out, sizeof(out), 0, NULL, errbuf),
+        3);
+    ck_assert(memcmp(out, "abc", 3) == 0);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    free(mf.data);
+}
+END_TEST
+
+/**
+ * Check that all frames of @p mf but the last hold exactly FRAME_SIZE bytes
+ */
+static void check_fixed_frames(mem_file_t *mf, const uint8_t *data)
+{
+    size_t nb_frames = check_contents(mf, data);
+    ck_assert_uint_eq(nb_frames, (DATA_SIZE + FRAME_SIZE - 1) / FRAME_SIZE);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+    for (size_t off = 0; off < DATA_SIZE; off += FRAME_SIZE) {
+        zseek_frame_ref_t ref;
+        ck_assert_int_eq(zseek_pread_ref(reader, off, &ref, NULL, errbuf),
+            (ssize_t)MIN(FRAME_SIZE, DATA_SIZE - off));
+        ck_assert_uint_eq(ref.frame_idx, off / FRAME_SIZE);
+        zseek_frame_release(reader, &ref);
+    }
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+}
+
+START_TEST(test_writer_fixed_frame_size)
+{
+    uint8_t *data = test_data();
+
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    // {nb_frame_workers, async_queue_depth}
+    int configs[][2] = {{0, 0}, {2, 0}, {2, 4}};
+    for (size_t t = 0; t < 2; t++) {
+        for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+            zseek_compression_param_t param = test_param(types[t],
+                configs[i][0], configs[i][1]);
+            param.fixed_frame_size = true;
+            mem_file_t mf;
+            compress_to(&mf, data, &param);
+            check_fixed_frames(&mf, data);
+            free(mf.data);
+        }
+    }
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.nb_workers = 2;
+    param.fixed_frame_size = true;
+    mem_file_t mf;
+    compress_to(&mf, data, &param);
+    check_fixed_frames(&mf, data);
+    free(mf.data);
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_fixed_frame_size_misuse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_compression_param_t param = test_param(ZSEEK_LZ4, 0, 0);
+    param.fixed_frame_size = true;
+    ck_assert(zseek_writer_open_full(wf, &param, 0, NULL, errbuf) == NULL);
+
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, 10, NULL,
+        errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    // Only within the current frame
+    ck_assert(zseek_write(writer, "abc", 3, NULL, errbuf));
+    ck_assert(zseek_writer_reserve(writer, 8, errbuf) == NULL);
+    uint8_t *span = zseek_writer_reserve(writer, 7, errbuf);
+    ck_assert(span != NULL);
+    memcpy(span, "defghij", 7);
+    ck_assert(zseek_writer_commit(writer, 7, NULL, errbuf));
+
+    // Only on frame boundaries
+    ck_assert(zseek_writer_flush(writer, NULL, errbuf));
+    ck_assert(zseek_write(writer, "k", 1, NULL, errbuf));
+    ck_assert(!zseek_writer_flush(writer, NULL, errbuf));
+
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+    char out[16];
+    ck_assert_int_eq(zseek_pread_flags(reader, out, sizeof(out), 0,
+        ZSEEK_PREAD_FULL, NULL, errbuf), 11);
+    ck_assert(memcmp(out, "abcdefghijk", 11) == 0);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    free(mf.data);
+}
+END_TEST
+
+/**
+ * Small, similar records, which compress poorly one small frame at a time
+ */
+static uint8_t *test_records(void)
+{
+    static const char *statuses[] = {"active", "suspended", "deleted"};
+    uint8_t *data = malloc(RECORDS_SIZE);
+    ck_assert_msg(data != NULL, "failed to allocate test data");
+    unsigned seed = 42;
+    for (size_t off = 0; off < RECORDS_SIZE; ) {
+        char record[128];
+        int n = snprintf(record, sizeof(record),
+            "{\"id\": %d, \"user\": \"user%04d\", \"status\": \"%s\", "
+            "\"score\": %d}\n", rand_r(&seed), rand_r(&seed) % 10000,
+            statuses[rand_r(&seed) % 3], rand_r(&seed) % 100);
+        size_t len = MIN((size_t)n, RECORDS_SIZE - off);
+        memcpy(data + off, record, len);
+        off += len;
+    }
+    return data;
+}
+
+/**
+ * Compress @p data (test_records()) to @p mf one record at a time, flushing
+ * once with @p flush, and return the compressed size
+ */
+static size_t compress_records(mem_file_t *mf, const uint8_t *data,
+    zseek_compression_param_t *param, bool flush)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param,
+        RECORD_FRAME_SIZE, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    for (size_t off = 0; off < RECORDS_SIZE; ) {
+        const uint8_t *end = memchr(data + off, '\n', RECORDS_SIZE - off);
+        size_t len = end ? (size_t)(end - (data + off)) + 1 :
+            RECORDS_SIZE - off;
+        ck_assert_msg(zseek_write(writer, data + off, len, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+        off += len;
+        if (flush && off >= RECORDS_SIZE / 4) {
+            ck_assert_msg(zseek_writer_flush(writer, NULL, errbuf),
+                "zseek_writer_flush: %s", errbuf);
+            flush = false;
+        }
+    }
+
+    zseek_writer_stats_t stats;
+    ck_assert_msg(zseek_writer_stats(writer, &stats, errbuf),
+        "zseek_writer_stats: %s", errbuf);
+    ck_assert(stats.frames > 0);
+
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+    return mf->size;
+}
+
+/**
+ * Compress @p data (test_records()) to @p mf one record at a time, in two
+ * writes each, marking record ends
+ */
+static void compress_aligned_records(mem_file_t *mf, const uint8_t *data,
+    zseek_compression_param_t *param)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param,
+        RECORD_FRAME_SIZE, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    for (size_t off = 0; off < RECORDS_SIZE; ) {
+        const uint8_t *end = memchr(data + off, '\n', RECORDS_SIZE - off);
+        size_t len = end ? (size_t)(end - (data + off)) + 1 :
+            RECORDS_SIZE - off;
+        ck_assert_msg(zseek_write(writer, data + off, len / 2, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+        ck_assert_msg(zseek_write(writer, data + off + len / 2,
+            len - len / 2, NULL, errbuf), "zseek_write: %s", errbuf);
+        ck_assert_msg(zseek_writer_end_record(writer, NULL, errbuf),
+            "zseek_writer_end_record: %s", errbuf);
+        off += len;
+    }
+
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+}
+
+/**
+ * Check that every record of @p data (test_records()) is within a single
+ * frame of @p mf, and that frames but the last hold at least
+ * RECORD_FRAME_SIZE bytes, or with @p max_frame_size > 0, at most
+ * @p max_frame_size bytes and at least that less a record
+ */
+static void check_aligned_records(mem_file_t *mf, const uint8_t *data,
+    size_t max_frame_size)
+{
+    size_t nb_frames = check_contents_size(mf, data, RECORDS_SIZE);
+    // Records are at most 128 bytes long (test_records())
+    size_t min_fill = max_frame_size > 0 ? max_frame_size - 128 :
+        RECORD_FRAME_SIZE;
+    ck_assert_uint_le(nb_frames, RECORDS_SIZE / min_fill);
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+    for (size_t off = 0; off < RECORDS_SIZE; ) {
+        const uint8_t *end = memchr(data + off, '\n', RECORDS_SIZE - off);
+        size_t len = end ? (size_t)(end - (data + off)) + 1 :
+            RECORDS_SIZE - off;
+        zseek_frame_ref_t ref;
+        ssize_t r = zseek_pread_ref(reader, off, &ref, NULL, errbuf);
+        ck_assert_msg(r >= (ssize_t)len, "record at %zu straddles frames",
+            off);
+        if (max_frame_size > 0)
+            ck_assert_uint_le(r, max_frame_size);
+        zseek_frame_release(reader, &ref);
+        off += len;
+    }
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+}
+
+START_TEST(test_writer_record_aligned)
+{
+    uint8_t *data = test_records();
+
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    // {nb_frame_workers, async_queue_depth}
+    int configs[][2] = {{0, 0}, {2, 0}, {2, 4}};
+    for (size_t t = 0; t < 2; t++) {
+        for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+            zseek_compression_param_t param = test_param(types[t],
+                configs[i][0], configs[i][1]);
+            param.record_aligned = true;
+            mem_file_t mf;
+            compress_aligned_records(&mf, data, &param);
+            check_aligned_records(&mf, data, 0);
+            free(mf.data);
+        }
+    }
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.nb_workers = 2;
+    param.record_aligned = true;
+    mem_file_t mf;
+    compress_aligned_records(&mf, data, &param);
+    check_aligned_records(&mf, data, 0);
+    free(mf.data);
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_record_aligned_max)
+{
+    uint8_t *data = test_records();
+    // Less than a record over the minimum: frames often end before a record
+    // that would overflow them
+    const size_t max_frame_size = RECORD_FRAME_SIZE + 64;
+
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    // {nb_frame_workers, async_queue_depth}
+    int configs[][2] = {{0, 0}, {2, 0}, {2, 4}};
+    for (size_t t = 0; t < 2; t++) {
+        for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+            zseek_compression_param_t param = test_param(types[t],
+                configs[i][0], configs[i][1]);
+            param.record_aligned = true;
+            param.max_frame_size = max_frame_size;
+            mem_file_t mf;
+            compress_aligned_records(&mf, data, &param);
+            check_aligned_records(&mf, data, max_frame_size);
+            free(mf.data);
+        }
+    }
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.nb_workers = 2;
+    param.record_aligned = true;
+    param.max_frame_size = max_frame_size;
+    mem_file_t mf;
+    compress_aligned_records(&mf, data, &param);
+    check_aligned_records(&mf, data, max_frame_size);
+    free(mf.data);
+
+    // A record that fits a frame of its own starts one, even when reserved
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    memset(&mf, 0, sizeof(mf));
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    param = test_param(ZSEEK_LZ4, 0, 0);
+    param.record_aligned = true;
+    param.max_frame_size = 150;
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, 100, NULL,
+        errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    ck_assert(zseek_write(writer, data, 99, NULL, errbuf));
+    ck_assert(zseek_writer_end_record(writer, NULL, errbuf));
+    uint8_t *space = zseek_writer_reserve(writer, 100, errbuf);
+    ck_assert_msg(space != NULL, "zseek_writer_reserve: %s", errbuf);
+    memcpy(space, data + 99, 100);
+    ck_assert(zseek_writer_commit(writer, 100, NULL, errbuf));
+    ck_assert(zseek_writer_end_record(writer, NULL, errbuf));
+    // Longer than a frame: split
+    ck_assert(zseek_write(writer, data + 199, 301, NULL, errbuf));
+    ck_assert(zseek_writer_close(writer, NULL, errbuf));
+
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+    // {offset, frame bytes from it}
+    size_t frames[][2] = {{0, 99}, {99, 100}, {199, 150}, {349, 150},
+        {499, 1}};
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        zseek_frame_ref_t ref;
+        ssize_t r = zseek_pread_ref(reader, frames[i][0], &ref, NULL, errbuf);
+        ck_assert_int_eq(r, frames[i][1]);
+        ck_assert(memcmp(ref.data, data + frames[i][0], r) == 0);
+        zseek_frame_release(reader, &ref);
+    }
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    free(mf.data);
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_max_frame_size)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    const size_t max_frame_size = 2 * FRAME_SIZE - 1;
+
+    for (int aligned = 0; aligned < 2; aligned++) {
+        zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+        param.record_aligned = aligned;
+        param.max_frame_size = max_frame_size;
+        mem_file_t mf;
+        // A single record, with a large write
+        compress_to(&mf, data, &param);
+        size_t nb_frames = check_contents(&mf, data);
+        ck_assert_uint_ge(nb_frames,
+            (DATA_SIZE + max_frame_size - 1) / max_frame_size);
+
+        zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+        zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+        ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+        for (size_t off = 0; off < DATA_SIZE; ) {
+            zseek_frame_ref_t ref;
+            ssize_t r = zseek_pread_ref(reader, off, &ref, NULL, errbuf);
+            ck_assert_int_gt(r, 0);
+            ck_assert_uint_le(r, max_frame_size);
+            zseek_frame_release(reader, &ref);
+            off += r;
+        }
+        ck_assert(zseek_reader_close(reader, NULL, errbuf));
+        free(mf.data);
+    }
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_record_aligned_misuse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+
+    // Not record aligned
+    zseek_compression_param_t param = test_param(ZSEEK_LZ4, 0, 0);
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, 10, NULL,
+        errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    ck_assert(!zseek_writer_end_record(writer, NULL, errbuf));
+    ck_assert(zseek_writer_close(writer, NULL, errbuf));
+    ck_assert(!zseek_writer_end_record(NULL, NULL, errbuf));
+
+    param.max_frame_size = 9;
+    ck_assert(zseek_writer_open_full(wf, &param, 10, NULL, errbuf) == NULL);
+    param.max_frame_size = 10;
+    param.fixed_frame_size = true;
+    ck_assert(zseek_writer_open_full(wf, &param, 10, NULL, errbuf) == NULL);
+    param.max_frame_size = 0;
+    param.record_aligned = true;
+    ck_assert(zseek_writer_open_full(wf, &param, 10, NULL, errbuf) == NULL);
+    param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.record_aligned = true;
+    param.params.zstd_params.dict_train_frames = 4;
+    ck_assert(zseek_writer_open_full(wf, &param, 10, NULL, errbuf) == NULL);
+
+    // Reservations don't cross the maximum frame size
+    param = test_param(ZSEEK_LZ4, 0, 0);
+    param.record_aligned = true;
+    param.max_frame_size = 16;
+    writer = zseek_writer_open_full(wf, &param, 10, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    ck_assert(zseek_write(writer, "abcd", 4, NULL, errbuf));
+    ck_assert(zseek_writer_reserve(writer, 13, errbuf) == NULL);
+    ck_assert(zseek_writer_reserve(writer, 12, errbuf) != NULL);
+    ck_assert(zseek_writer_close(writer, NULL, errbuf));
+    free(mf.data);
+}
+END_TEST
+
+START_TEST(test_writer_dict_train)
+{
+    uint8_t *data = test_records();
+
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    mem_file_t plain;
+    size_t plain_size = compress_records(&plain, data, &param, false);
+    check_contents_size(&plain, data, RECORDS_SIZE);
+    free(plain.data);
+
+    // {nb_frame_workers, async_queue_depth, nb_workers}
+    int configs[][3] = {{0, 0, 0}, {2, 0, 0}, {2, 4, 0}, {0, 0, 2}};
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        for (int fixed = 0; fixed < 2; fixed++) {
+            param = test_param(ZSEEK_ZSTD, configs[i][0], configs[i][1]);
+            param.params.zstd_params.nb_workers = configs[i][2];
+            param.params.zstd_params.dict_train_frames = 100;
+            param.params.zstd_params.dict_max_size = 8 << 10;
+            param.fixed_frame_size = fixed;
+            mem_file_t mf;
+            size_t size = compress_records(&mf, data, &param, false);
+            // Even with the dictionary in the file
+            ck_assert_uint_lt(size, plain_size * 3 / 4);
+            check_contents_size(&mf, data, RECORDS_SIZE);
+            free(mf.data);
+        }
+    }
+
+    // Flushing ends training early
+    param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.dict_train_frames = 1000;
+    param.params.zstd_params.dict_max_size = 8 << 10;
+    mem_file_t mf;
+    ck_assert_uint_lt(compress_records(&mf, data, &param, true), plain_size);
+    check_contents_size(&mf, data, RECORDS_SIZE);
+    free(mf.data);
+
+    // Too little data to train on, no dictionary stored (frames are cut
+    // differently though)
+    param.params.zstd_params.dict_train_frames = 1;
+    ck_assert_uint_lt(compress_records(&mf, data, &param, false),
+        plain_size + 64);
+    check_contents_size(&mf, data, RECORDS_SIZE);
+    free(mf.data);
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_dict)
+{
+    uint8_t *data = test_records();
+
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    mem_file_t plain;
+    size_t plain_size = compress_records(&plain, data, &param, false);
+    free(plain.data);
+
+    // Raw content dictionary, from the same kind of records
+    param.params.zstd_params.dict = data + RECORDS_SIZE / 2;
+    param.params.zstd_params.dict_size = 4096;
+    for (int workers = 0; workers <= 2; workers += 2) {
+        param.nb_frame_workers = workers;
+        mem_file_t mf;
+        ck_assert_uint_lt(compress_records(&mf, data, &param, true),
+            plain_size);
+        check_contents_size(&mf, data, RECORDS_SIZE);
+
+        // Lazily loaded seek tables carry it too
+        char errbuf[ZSEEK_ERRBUF_SIZE];
+        zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+        zseek_reader_param_t rparam = {.lazy_seek_table = true};
+        zseek_reader_t *reader = zseek_reader_open_param(rf, &rparam, NULL,
+            errbuf);
+        ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+        uint8_t out[300];
+        ck_assert_int_eq(zseek_pread_flags(reader, out, sizeof(out), 12345,
+            ZSEEK_PREAD_FULL, NULL, errbuf), (ssize_t)sizeof(out));
+        ck_assert(memcmp(out, data + 12345, sizeof(out)) == 0);
+        ck_assert(zseek_reader_close(reader, NULL, errbuf));
+        free(mf.data);
+    }
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_dict_misuse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+
+    // A dictionary, or training, not both
+    param.params.zstd_params.dict = "abc";
+    param.params.zstd_params.dict_size = 3;
+    param.params.zstd_params.dict_train_frames = 10;
+    ck_assert(zseek_writer_open_full(wf, &param, 100, NULL, errbuf) == NULL);
+    param.params.zstd_params.dict_train_frames = 0;
+    param.params.zstd_params.dict_size = 0;
+    ck_assert(zseek_writer_open_full(wf, &param, 100, NULL, errbuf) == NULL);
+
+    // Training needs frames to train on
+    param.params.zstd_params.dict = NULL;
+    param.params.zstd_params.dict_train_frames = 10;
+    ck_assert(zseek_writer_open_full(wf, &param, 0, NULL, errbuf) == NULL);
+
+    // Leases work while training
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, 100, NULL,
+        errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    uint8_t *span = zseek_writer_reserve(writer, 3, errbuf);
+    ck_assert(span != NULL);
+    memcpy(span, "abc", 3);
+    ck_assert(zseek_writer_commit(writer, 3, NULL, errbuf));
+    ck_assert(zseek_write(writer, "def", 3, NULL, errbuf));
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_reader_t *reader = zseek_reader_open_full(rf, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open_full: %s", errbuf);
+    char out[8];
+    ck_assert_int_eq(zseek_pread_flags(reader, out, sizeof(out), 0,
+        ZSEEK_PREAD_FULL, NULL, errbuf), 6);
+    ck_assert(memcmp(out, "abcdef", 6) == 0);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+    free(mf.data);
+}
+END_TEST
+
+/**
+ * Compress test data to @p mf with @p param, in frames, returning the writer
+ * stats before close
+ */
+static zseek_writer_stats_t compress_adaptive(mem_file_t *mf,
+    const uint8_t *data, zseek_compression_param_t *param)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    for (size_t off = 0; off < DATA_SIZE; off += CHUNK_SIZE) {
+        size_t len = MIN(CHUNK_SIZE, DATA_SIZE - off);
+        ck_assert_msg(zseek_write(writer, data + off, len, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+    }
+    // Let in-flight frames be logged
+    ck_assert_msg(zseek_writer_flush(writer, NULL, errbuf),
+        "zseek_writer_flush: %s", errbuf);
+
+    zseek_writer_stats_t stats;
+    ck_assert_msg(zseek_writer_stats(writer, &stats, errbuf),
+        "zseek_writer_stats: %s", errbuf);
+
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+    return stats;
+}
+
+static void check_target_rate(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    int start = 3, min_level = 2, max_level = 5;
+
+    // {nb_frame_workers, async_queue_depth}
+    int configs[][2] = {{0, 0}, {2, 0}, {0, 2}};
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        zseek_compression_param_t param = test_param(type, configs[i][0],
+            configs[i][1]);
+        if (type == ZSEEK_ZSTD)
+            param.params.zstd_params.compression_level = start;
+        else
+            param.params.lz4_params.compression_level = start;
+        param.min_level = min_level;
+        param.max_level = max_level;
+
+        // Fixed level without a target
+        mem_file_t mf;
+        zseek_writer_stats_t stats = compress_adaptive(&mf, data, &param);
+        ck_assert_int_eq(stats.compression_level, start);
+        ck_assert_uint_eq(stats.level_changes, 0);
+        check_contents(&mf, data);
+        free(mf.data);
+
+        // Out of reach, down to the lowest level
+        param.target_rate = SIZE_MAX;
+        stats = compress_adaptive(&mf, data, &param);
+        ck_assert_int_eq(stats.compression_level, min_level);
+        ck_assert_uint_eq(stats.level_changes, (size_t)(start - min_level));
+        check_contents(&mf, data);
+        free(mf.data);
+
+        // Trivially kept up with, up to the highest level
+        param.target_rate = 1;
+        stats = compress_adaptive(&mf, data, &param);
+        if (configs[i][1] == 0) {
+            ck_assert_int_eq(stats.compression_level, max_level);
+            ck_assert_uint_eq(stats.level_changes, (size_t)(max_level - start));
+        } else {
+            // NOTE: A full queue lowers it however fast frames compress
+            ck_assert_int_ge(stats.compression_level, min_level);
+            ck_assert_int_le(stats.compression_level, max_level);
+        }
+        check_contents(&mf, data);
+        free(mf.data);
+    }
+
+    free(data);
+}
+
+START_TEST(test_writer_target_rate_zstd)
+{
+    check_target_rate(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_writer_target_rate_lz4)
+{
+    check_target_rate(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_writer_target_rate_dict)
+{
+    uint8_t *data = test_data();
+
+    // {nb_frame_workers, async_queue_depth}
+    int configs[][2] = {{0, 0}, {2, 0}, {0, 2}};
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        zseek_compression_param_t param = test_param(ZSEEK_ZSTD,
+            configs[i][0], configs[i][1]);
+        param.params.zstd_params.dict = data + DATA_SIZE / 2;
+        param.params.zstd_params.dict_size = 4096;
+        param.params.zstd_params.compression_level = 1;
+        mem_file_t mf;
+        compress_adaptive(&mf, data, &param);
+        size_t low_size = mf.size;
+        free(mf.data);
+        param.params.zstd_params.compression_level = 19;
+        compress_adaptive(&mf, data, &param);
+        size_t high_size = mf.size;
+        free(mf.data);
+        ck_assert_uint_lt(high_size, low_size);
+
+        // Bounds apply from the start, not only to the dictionary's level
+        param.target_rate = SIZE_MAX;
+        param.min_level = 1;
+        param.max_level = 1;
+        zseek_writer_stats_t stats = compress_adaptive(&mf, data, &param);
+        ck_assert_int_eq(stats.compression_level, 1);
+        ck_assert_uint_eq(mf.size, low_size);
+        check_contents(&mf, data);
+        free(mf.data);
+
+        // Lower levels take effect as they are adapted to
+        param.max_level = 19;
+        stats = compress_adaptive(&mf, data, &param);
+        ck_assert_uint_gt(stats.level_changes, 0);
+        ck_assert_uint_gt(mf.size, high_size);
+        check_contents(&mf, data);
+        free(mf.data);
+    }
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_target_rate_misuse)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.target_rate = 1 << 20;
+
+    // Bounds out of order
+    param.min_level = 5;
+    param.max_level = 2;
+    ck_assert(zseek_writer_open_full(wf, &param, 100, NULL, errbuf) == NULL);
+    param.type = ZSEEK_LZ4;
+    ck_assert(zseek_writer_open_full(wf, &param, 100, NULL, errbuf) == NULL);
+
+    // Not with zstd's own workers
+    param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.target_rate = 1 << 20;
+    param.params.zstd_params.nb_workers = 2;
+    ck_assert(zseek_writer_open_full(wf, &param, 100, NULL, errbuf) == NULL);
+
+    // Default bounds
+    param.params.zstd_params.nb_workers = 0;
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, 100, NULL,
+        errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    zseek_writer_stats_t stats;
+    ck_assert(zseek_writer_stats(writer, &stats, errbuf));
+    ck_assert_int_eq(stats.compression_level, 3);
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+    free(mf.data);
+}
+END_TEST
+
+static bool mem_truncate(size_t size, void *user_data, void *call_data)
+{
+    (void)call_data;
+
+    mem_file_t *mf = user_data;
+    if (size > mf->size)
+        return false;
+    mf->size = size;
+    return true;
+}
+
+/**
+ * Write the @p len bytes of @p data with @p writer, in odd-sized chunks, and
+ * close it
+ */
+static void write_all(zseek_writer_t *writer, const uint8_t *data, size_t len)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    for (size_t off = 0; off < len; off += CHUNK_SIZE) {
+        ck_assert_msg(zseek_write(writer, data + off,
+            MIN(CHUNK_SIZE, len - off), NULL, errbuf), "zseek_write: %s",
+            errbuf);
+    }
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+}
+
+/**
+ * Append the @p len bytes of @p data to @p mf, with @p param
+ */
+static void append_to(mem_file_t *mf, const uint8_t *data, size_t len,
+    zseek_compression_param_t *param, size_t min_frame_size)
+{
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_read_file_t rf = {mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_write_file_t wf = {mf, mem_write, mem_truncate};
+    zseek_writer_t *writer = zseek_writer_open_append_full(rf, wf, param,
+        min_frame_size, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_append_full: %s",
+        errbuf);
+    write_all(writer, data, len);
+}
+
+static void check_append(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    // {nb_frame_workers, async_queue_depth}
+    int configs[][2] = {{0, 0}, {2, 0}, {0, 2}};
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        zseek_compression_param_t param = test_param(type, configs[i][0],
+            configs[i][1]);
+
+        // Empty, then in 3 parts with a partial frame each
+        mem_file_t mf = {0};
+        zseek_write_file_t wf = {&mf, mem_write, NULL};
+        zseek_writer_t *writer = zseek_writer_open_full(wf, &param,
+            FRAME_SIZE, NULL, errbuf);
+        ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+        write_all(writer, data, 0);
+        size_t parts[] = {0, DATA_SIZE / 3, DATA_SIZE / 2, DATA_SIZE};
+        for (size_t p = 0; p < 3; p++)
+            append_to(&mf, data + parts[p], parts[p + 1] - parts[p], &param,
+                FRAME_SIZE);
+        check_contents(&mf, data);
+
+        // Writer stats cover the frames appended to
+        zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+        wf.truncate = mem_truncate;
+        size_t size = mf.size;
+        writer = zseek_writer_open_append_full(rf, wf, &param, FRAME_SIZE,
+            NULL, errbuf);
+        ck_assert_msg(writer != NULL, "zseek_writer_open_append_full: %s",
+            errbuf);
+        zseek_writer_stats_t stats;
+        ck_assert(zseek_writer_stats(writer, &stats, errbuf));
+        ck_assert_uint_eq(stats.compressed_size, size);
+        size_t frames = stats.frames;
+        ck_assert(zseek_writer_close(writer, NULL, errbuf));
+        ck_assert_uint_eq(mf.size, size);
+        ck_assert_uint_eq(check_contents(&mf, data), frames);
+
+        free(mf.data);
+    }
+
+    free(data);
+}
+
+START_TEST(test_writer_append_zstd)
+{
+    check_append(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_writer_append_lz4)
+{
+    check_append(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_writer_append_trailers)
+{
+    uint8_t *data = test_records();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    size_t half = RECORDS_SIZE / 2;
+
+    // The dictionary of the file goes on
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.dict = data + half;
+    param.params.zstd_params.dict_size = 4096;
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param,
+        RECORD_FRAME_SIZE, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    write_all(writer, data, half);
+    param = test_param(ZSEEK_ZSTD, 2, 0);
+    append_to(&mf, data + half, RECORDS_SIZE - half, &param,
+        RECORD_FRAME_SIZE);
+    check_contents_size(&mf, data, RECORDS_SIZE);
+    free(mf.data);
+
+    // Sub-blocks, indexed from the first append on
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    for (size_t t = 0; t < 2; t++) {
+        param = test_param(types[t], 0, 0);
+        memset(&mf, 0, sizeof(mf));
+        writer = zseek_writer_open_full(wf, &param, 4 * RECORD_FRAME_SIZE,
+            NULL, errbuf);
+        ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+        write_all(writer, data, half / 2);
+        param.sub_block_size = RECORD_FRAME_SIZE;
+        append_to(&mf, data + half / 2, half / 2, &param,
+            4 * RECORD_FRAME_SIZE);
+        append_to(&mf, data + half, RECORDS_SIZE - half, &param,
+            4 * RECORD_FRAME_SIZE);
+        check_contents_size(&mf, data, RECORDS_SIZE);
+
+        // NOTE: Only the same size goes on
+        param.sub_block_size = 2 * RECORD_FRAME_SIZE;
+        zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+        wf.truncate = mem_truncate;
+        ck_assert(zseek_writer_open_append_full(rf, wf, &param,
+            4 * RECORD_FRAME_SIZE, NULL, errbuf) == NULL);
+        wf.truncate = NULL;
+        free(mf.data);
+    }
+
+    // Fixed-size frames, from full frames only
+    param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.fixed_frame_size = true;
+    memset(&mf, 0, sizeof(mf));
+    writer = zseek_writer_open_full(wf, &param, RECORD_FRAME_SIZE, NULL,
+        errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    write_all(writer, data, 10 * RECORD_FRAME_SIZE);
+    append_to(&mf, data + 10 * RECORD_FRAME_SIZE,
+        RECORDS_SIZE - 10 * RECORD_FRAME_SIZE - 7, &param, RECORD_FRAME_SIZE);
+    check_contents_size(&mf, data, RECORDS_SIZE - 7);
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    wf.truncate = mem_truncate;
+    ck_assert(zseek_writer_open_append_full(rf, wf, &param, RECORD_FRAME_SIZE,
+        NULL, errbuf) == NULL);
+    // Without fixed-size frames from now on
+    param.fixed_frame_size = false;
+    append_to(&mf, data + RECORDS_SIZE - 7, 7, &param, RECORD_FRAME_SIZE);
+    check_contents_size(&mf, data, RECORDS_SIZE);
+    free(mf.data);
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_append_misuse)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    mem_file_t mf;
+    compress_to(&mf, data, &param);
+    uint8_t *orig = malloc(mf.size);
+    ck_assert(orig != NULL);
+    memcpy(orig, mf.data, mf.size);
+    size_t orig_size = mf.size;
+
+    zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+
+    // Needs a truncate handler
+    ck_assert(zseek_writer_open_append_full(rf, wf, &param, FRAME_SIZE, NULL,
+        errbuf) == NULL);
+    wf.truncate = mem_truncate;
+
+    // Same type
+    zseek_compression_param_t other = test_param(ZSEEK_LZ4, 0, 0);
+    ck_assert(zseek_writer_open_append_full(rf, wf, &other, FRAME_SIZE, NULL,
+        errbuf) == NULL);
+
+    // No dictionary for frames compressed without one
+    param.params.zstd_params.dict = data;
+    param.params.zstd_params.dict_size = 1000;
+    ck_assert(zseek_writer_open_append_full(rf, wf, &param, FRAME_SIZE, NULL,
+        errbuf) == NULL);
+    param.params.zstd_params.dict = NULL;
+    param.params.zstd_params.dict_size = 0;
+
+    // Fixed-size frames for a file without
+    param.fixed_frame_size = true;
+    ck_assert(zseek_writer_open_append_full(rf, wf, &param, FRAME_SIZE, NULL,
+        errbuf) == NULL);
+    param.fixed_frame_size = false;
+
+    // Left untouched
+    ck_assert_uint_eq(mf.size, orig_size);
+    ck_assert(memcmp(mf.data, orig, orig_size) == 0);
+
+    // Not a seekable file
+    mf.size -= 1;
+    ck_assert(zseek_writer_open_append_full(rf, wf, &param, FRAME_SIZE, NULL,
+        errbuf) == NULL);
+    ck_assert_uint_eq(mf.size, orig_size - 1);
+
+    free(orig);
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_append_file)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_compression_param_t param = test_param(ZSEEK_LZ4, 0, 0);
+
+    FILE *f = tmpfile();
+    ck_assert(f != NULL);
+    zseek_writer_t *writer = zseek_writer_open(f, &param, FRAME_SIZE, NULL,
+        errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open: %s", errbuf);
+    write_all(writer, data, DATA_SIZE / 2);
+    ck_assert(fflush(f) == 0);
+
+    writer = zseek_writer_open_append(f, &param, FRAME_SIZE, NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_append: %s", errbuf);
+    write_all(writer, data + DATA_SIZE / 2, DATA_SIZE - DATA_SIZE / 2);
+    ck_assert(fflush(f) == 0);
+
+    zseek_reader_t *reader = zseek_reader_open(f, 0, NULL, errbuf);
+    ck_assert_msg(reader != NULL, "zseek_reader_open: %s", errbuf);
+    uint8_t *out = malloc(DATA_SIZE);
+    ck_assert(out != NULL);
+    ck_assert_int_eq(zseek_pread_flags(reader, out, DATA_SIZE, 0,
+        ZSEEK_PREAD_FULL, NULL, errbuf), DATA_SIZE);
+    ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+    ck_assert(zseek_reader_close(reader, NULL, errbuf));
+
+    free(out);
+    fclose(f);
+    free(data);
+}
+END_TEST
+
+/**
+ * Compress the @p len bytes of @p data into a new @p mf, with @p param
+ */
+static void compress_part(mem_file_t *mf, const uint8_t *data, size_t len,
+    zseek_compression_param_t *param, size_t min_frame_size)
+{
+    memset(mf, 0, sizeof(*mf));
+
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_write_file_t wf = {mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param, min_frame_size,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    write_all(writer, data, len);
+}
+
+/**
+ * Concatenate the @p n files in @p parts into @p out. Returns false if it
+ * failed, leaving @p out empty.
+ */
+static bool concat_to(mem_file_t *out, mem_file_t *parts, size_t n)
+{
+    memset(out, 0, sizeof(*out));
+
+    zseek_read_file_t inputs[8];
+    ck_assert(n <= 8);
+    for (size_t i = 0; i < n; i++)
+        inputs[i] = (zseek_read_file_t){&parts[i], mem_pread, mem_fsize, NULL,
+            NULL};
+    zseek_write_file_t wf = {out, mem_write, NULL};
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    bool ok = zseek_concat_full(inputs, n, wf, NULL, errbuf);
+    if (!ok)
+        ck_assert_uint_eq(out->size, 0);
+    return ok;
+}
+
+static void check_concat(zseek_compression_type_t type)
+{
+    uint8_t *data = test_data();
+
+    // With an empty part, and partial frames
+    zseek_compression_param_t param = test_param(type, 0, 0);
+    size_t parts[] = {0, DATA_SIZE / 5, DATA_SIZE / 5, DATA_SIZE / 2,
+        DATA_SIZE};
+    mem_file_t mfs[4];
+    size_t frames = 0;
+    for (size_t p = 0; p < 4; p++) {
+        compress_part(&mfs[p], data + parts[p], parts[p + 1] - parts[p],
+            &param, FRAME_SIZE);
+        if (parts[p + 1] > parts[p])
+            frames += check_contents_size(&mfs[p], data + parts[p],
+                parts[p + 1] - parts[p]);
+    }
+    mem_file_t out;
+    ck_assert(concat_to(&out, mfs, 4));
+    ck_assert_uint_eq(check_contents(&out, data), frames);
+
+    // Frames copied as they are, with one seek table for all
+    size_t sizes = 0;
+    for (size_t p = 0; p < 4; p++)
+        sizes += mfs[p].size;
+    ck_assert_uint_lt(out.size, sizes);
+    ck_assert(memcmp(out.data, mfs[0].data, 1024) == 0);
+
+    // A concatenation goes on
+    mem_file_t twice[2] = {out, mfs[3]};
+    mem_file_t again;
+    ck_assert(concat_to(&again, twice, 2));
+    size_t tail = DATA_SIZE - parts[3];
+    uint8_t *expected = malloc(DATA_SIZE + tail);
+    ck_assert(expected != NULL);
+    memcpy(expected, data, DATA_SIZE);
+    memcpy(expected + DATA_SIZE, data + parts[3], tail);
+    check_contents_size(&again, expected, DATA_SIZE + tail);
+    free(expected);
+    free(again.data);
+
+    // Of nothing, as written by a writer
+    ck_assert(concat_to(&again, NULL, 0));
+    ck_assert_uint_eq(again.size, mfs[1].size);
+    ck_assert(memcmp(again.data, mfs[1].data, again.size) == 0);
+    free(again.data);
+
+    free(out.data);
+    for (size_t p = 0; p < 4; p++)
+        free(mfs[p].data);
+    free(data);
+}
+
+START_TEST(test_writer_concat_zstd)
+{
+    check_concat(ZSEEK_ZSTD);
+}
+END_TEST
+
+START_TEST(test_writer_concat_lz4)
+{
+    check_concat(ZSEEK_LZ4);
+}
+END_TEST
+
+START_TEST(test_writer_concat_trailers)
+{
+    uint8_t *data = test_records();
+    size_t half = RECORDS_SIZE / 2;
+    mem_file_t mfs[2], out;
+
+    // The same dictionary
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.dict = data + half;
+    param.params.zstd_params.dict_size = 4096;
+    compress_part(&mfs[0], data, half, &param, RECORD_FRAME_SIZE);
+    compress_part(&mfs[1], data + half, RECORDS_SIZE - half, &param,
+        RECORD_FRAME_SIZE);
+    ck_assert(concat_to(&out, mfs, 2));
+    check_contents_size(&out, data, RECORDS_SIZE);
+    free(out.data);
+
+    // Another dictionary, or none
+    free(mfs[1].data);
+    param.params.zstd_params.dict = data;
+    compress_part(&mfs[1], data + half, RECORDS_SIZE - half, &param,
+        RECORD_FRAME_SIZE);
+    ck_assert(!concat_to(&out, mfs, 2));
+    free(mfs[1].data);
+    param.params.zstd_params.dict = NULL;
+    param.params.zstd_params.dict_size = 0;
+    compress_part(&mfs[1], data + half, RECORDS_SIZE - half, &param,
+        RECORD_FRAME_SIZE);
+    ck_assert(!concat_to(&out, mfs, 2));
+    free(mfs[0].data);
+
+    // Another compression type
+    zseek_compression_param_t other = test_param(ZSEEK_LZ4, 0, 0);
+    compress_part(&mfs[0], data, half, &other, RECORD_FRAME_SIZE);
+    ck_assert(!concat_to(&out, mfs, 2));
+    free(mfs[0].data);
+    free(mfs[1].data);
+
+    // Sub-blocks, of the same size or not
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    for (size_t t = 0; t < 2; t++) {
+        for (size_t k = 1; k <= 2; k++) {
+            param = test_param(types[t], 0, 0);
+            param.sub_block_size = RECORD_FRAME_SIZE;
+            compress_part(&mfs[0], data, half, &param, 4 * RECORD_FRAME_SIZE);
+            param.sub_block_size = k * RECORD_FRAME_SIZE;
+            compress_part(&mfs[1], data + half, RECORDS_SIZE - half, &param,
+                4 * RECORD_FRAME_SIZE);
+            ck_assert(concat_to(&out, mfs, 2));
+            check_contents_size(&out, data, RECORDS_SIZE);
+            free(out.data);
+            free(mfs[0].data);
+            free(mfs[1].data);
+        }
+    }
+
+    // Fixed-size frames, with a partial frame in the middle or not
+    param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.fixed_frame_size = true;
+    size_t splits[] = {10 * RECORD_FRAME_SIZE, 10 * RECORD_FRAME_SIZE + 7};
+    for (size_t i = 0; i < 2; i++) {
+        compress_part(&mfs[0], data, splits[i], &param, RECORD_FRAME_SIZE);
+        compress_part(&mfs[1], data + splits[i], RECORDS_SIZE - splits[i],
+            &param, RECORD_FRAME_SIZE);
+        ck_assert(concat_to(&out, mfs, 2));
+        check_contents_size(&out, data, RECORDS_SIZE);
+        free(out.data);
+        free(mfs[0].data);
+        free(mfs[1].data);
+    }
+
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_concat_misuse)
+{
+    uint8_t *data = test_data();
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    mem_file_t mfs[2], out;
+    compress_to(&mfs[0], data, &param);
+    compress_to(&mfs[1], data, &param);
+
+    // Not a seekable file
+    mfs[1].size -= 1;
+    ck_assert(!concat_to(&out, mfs, 2));
+    mfs[1].size += 1;
+
+    // Failed writes
+    zseek_read_file_t inputs[2] = {
+        {&mfs[0], mem_pread, mem_fsize, NULL, NULL},
+        {&mfs[1], mem_pread, mem_fsize, NULL, NULL},
+    };
+    memset(&out, 0, sizeof(out));
+    out.fail_after = 1;
+    zseek_write_file_t wf = {&out, mem_write, NULL};
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    ck_assert(!zseek_concat_full(inputs, 2, wf, NULL, errbuf));
+    ck_assert(!zseek_concat_full(NULL, 2, wf, NULL, errbuf));
+    free(out.data);
+
+    free(mfs[0].data);
+    free(mfs[1].data);
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_concat_file)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+
+    FILE *inputs[3];
+    size_t parts[] = {0, DATA_SIZE / 3, DATA_SIZE / 2, DATA_SIZE};
+    for (size_t p = 0; p < 3; p++) {
+        inputs[p] = tmpfile();
+        ck_assert(inputs[p] != NULL);
+        zseek_writer_t *writer = zseek_writer_open(inputs[p], &param,
+            FRAME_SIZE, NULL, errbuf);
+        ck_assert_msg(writer != NULL, "zseek_writer_open: %s", errbuf);
+        write_all(writer, data + parts[p], parts[p + 1] - parts[p]);
+        ck_assert(fflush(inputs[p]) == 0);
+    }
+
+    // After some data of its own
+    FILE *f = tmpfile();
+    ck_assert(f != NULL);
+    ck_assert(fwrite("header", 1, 6, f) == 6);
+    ck_assert_msg(zseek_concat(inputs, 3, f, NULL, errbuf), "zseek_concat: %s",
+        errbuf);
+    ck_assert(fflush(f) == 0);
+    long end = ftell(f);
+    ck_assert(end > 6);
+    ck_assert(fseek(f, 0, SEEK_END) == 0);
+    ck_assert_int_eq(ftell(f), end);
+
+    // Read back without the leading data
+    uint8_t *cdata = malloc(end - 6);
+    ck_assert(cdata != NULL);
+    ck_assert(fseek(f, 6, SEEK_SET) == 0);
+    ck_assert(fread(cdata, 1, end - 6, f) == (size_t)(end - 6));
+    mem_file_t mf = {cdata, end - 6, end - 6, 0, 0};
+    check_contents(&mf, data);
+
+    free(cdata);
+    fclose(f);
+    for (size_t p = 0; p < 3; p++)
+        fclose(inputs[p]);
+    free(data);
+}
+END_TEST
+
+static uint64_t histogram_total(const zseek_histogram_t *h)
+{
+    uint64_t total = 0;
+    for (size_t b = 0; b < ZSEEK_HISTOGRAM_BUCKETS; b++)
+        total += h->buckets[b];
+    return total;
+}
+
+static void check_instrumentation(zseek_compression_param_t *param)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+    mem_file_t mf;
+    memset(&mf, 0, sizeof(mf));
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+
+    zseek_writer_stats_t stats;
+    ck_assert(zseek_writer_stats(writer, &stats, errbuf));
+    ck_assert_uint_eq(stats.compress_ns, 0);
+    ck_assert_uint_eq(stats.write_ns, 0);
+    ck_assert_uint_eq(stats.frame_size.count, 0);
+
+    for (size_t off = 0; off < DATA_SIZE; off += CHUNK_SIZE) {
+        size_t len = MIN(CHUNK_SIZE, DATA_SIZE - off);
+        ck_assert_msg(zseek_write(writer, data + off, len, NULL, errbuf),
+            "zseek_write: %s", errbuf);
+    }
+    ck_assert_msg(zseek_writer_flush(writer, NULL, errbuf),
+        "zseek_writer_flush: %s", errbuf);
+
+    ck_assert(zseek_writer_stats(writer, &stats, errbuf));
+    ck_assert_uint_gt(stats.compress_ns, 0);
+    ck_assert_uint_gt(stats.write_ns, 0);
+    if (param->type == ZSEEK_ZSTD &&
+        param->params.zstd_params.nb_workers > 0)
+        ck_assert_uint_gt(stats.flush_ns, 0);
+    else
+        ck_assert_uint_eq(stats.flush_ns, 0);
+
+    // All frames written out, flush ended the last one
+    ck_assert_uint_eq(stats.frame_size.count, stats.frames);
+    ck_assert_uint_eq(stats.frame_size.sum, DATA_SIZE);
+    ck_assert_uint_eq(histogram_total(&stats.frame_size), stats.frames);
+    ck_assert_uint_eq(stats.frame_compressed_size.count, stats.frames);
+    ck_assert_uint_eq(stats.frame_compressed_size.sum, mf.size);
+    ck_assert_uint_eq(stats.frame_ratio.count, stats.frames);
+    ck_assert_uint_eq(histogram_total(&stats.frame_ratio), stats.frames);
+    // Compressible data
+    ck_assert_uint_gt(stats.frame_ratio.sum, 100 * stats.frames);
+    // Frames of FRAME_SIZE bytes or more, but for the last one
+    size_t small = 0;
+    for (size_t b = 0; (1U << (b + 1)) <= FRAME_SIZE; b++)
+        small += stats.frame_size.buckets[b];
+    ck_assert_uint_le(small, 1);
+
+    ck_assert_msg(zseek_writer_close(writer, NULL, errbuf),
+        "zseek_writer_close: %s", errbuf);
+    check_contents(&mf, data);
+
+    free(mf.data);
+    free(data);
+}
+
+/**
+ * Return whether @p mf has an extended seek table (descriptor bit 6)
+ */
+static bool is_extended(const mem_file_t *mf)
+{
+    return mf->size >= 5 && (mf->data[mf->size - 5] & 0x40);
+}
+
+START_TEST(test_writer_extended_seek_table)
+{
+    uint8_t *data = test_data();
+    char errbuf[ZSEEK_ERRBUF_SIZE];
+
+    for (int fixed = 0; fixed < 2; fixed++) {
+        zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+        param.fixed_frame_size = fixed;
+        mem_file_t standard;
+        compress_to(&standard, data, &param);
+        ck_assert(!is_extended(&standard));
+
+        // Same frames, with a longer footer
+        param.extended_seek_table = true;
+        mem_file_t mf;
+        compress_to(&mf, data, &param);
+        ck_assert(is_extended(&mf));
+        ck_assert_uint_eq(mf.size, standard.size + 4);
+        size_t frames = check_contents(&mf, data);
+        ck_assert_uint_eq(check_contents(&standard, data), frames);
+
+        // Lazily loaded too
+        zseek_read_file_t rf = {&mf, mem_pread, mem_fsize, NULL, NULL};
+        zseek_reader_param_t rparam = {.lazy_seek_table = true};
+        zseek_reader_t *reader = zseek_reader_open_param(rf, &rparam, NULL,
+            errbuf);
+        ck_assert_msg(reader != NULL, "zseek_reader_open_param: %s", errbuf);
+        uint8_t *out = malloc(DATA_SIZE);
+        ck_assert_msg(out != NULL, "failed to allocate output");
+        ck_assert_int_eq(zseek_pread_flags(reader, out, DATA_SIZE, 0,
+            ZSEEK_PREAD_FULL, NULL, errbuf), DATA_SIZE);
+        ck_assert(memcmp(out, data, DATA_SIZE) == 0);
+        ck_assert(zseek_reader_close(reader, NULL, errbuf));
+        free(out);
+
+        free(standard.data);
+        free(mf.data);
+    }
+
+    // Appending keeps the format
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.extended_seek_table = true;
+    mem_file_t mf = {0};
+    zseek_write_file_t wf = {&mf, mem_write, NULL};
+    zseek_writer_t *writer = zseek_writer_open_full(wf, &param, FRAME_SIZE,
+        NULL, errbuf);
+    ck_assert_msg(writer != NULL, "zseek_writer_open_full: %s", errbuf);
+    write_all(writer, data, DATA_SIZE / 2);
+    ck_assert(is_extended(&mf));
+    param.extended_seek_table = false;
+    append_to(&mf, data + DATA_SIZE / 2, DATA_SIZE - DATA_SIZE / 2, &param,
+        FRAME_SIZE);
+    ck_assert(is_extended(&mf));
+    check_contents(&mf, data);
+
+    // So does concatenating with a standard file
+    mem_file_t parts[2];
+    compress_to(&parts[0], data, &param);
+    parts[1] = mf;
+    mem_file_t out;
+    ck_assert(concat_to(&out, parts, 2));
+    ck_assert(is_extended(&out));
+    free(out.data);
+    ck_assert(concat_to(&out, parts, 1));
+    ck_assert(!is_extended(&out));
+    free(out.data);
+
+    free(parts[0].data);
+    free(mf.data);
+    free(data);
+}
+END_TEST
+
+START_TEST(test_writer_instrumentation)
+{
+    zseek_compression_type_t types[] = {ZSEEK_ZSTD, ZSEEK_LZ4};
+    for (size_t t = 0; t < 2; t++) {
+        zseek_compression_param_t param = test_param(types[t], 0, 0);
+        check_instrumentation(&param);
+        param = test_param(types[t], 2, 0);
+        check_instrumentation(&param);
+        param = test_param(types[t], 2, 4);
+        check_instrumentation(&param);
+    }
+    zseek_compression_param_t param = test_param(ZSEEK_ZSTD, 0, 0);
+    param.params.zstd_params.nb_workers = 2;
+    check_instrumentation(&param);
+}
+END_TEST
+
+Suite *writer_suite(void)
+{
+    Suite *s = suite_create("writer");
+    TCase *tc_core = tcase_create("Core");
+    tcase_set_timeout(tc_core, 60);
+
+    tcase_add_test(tc_core, test_writer_frame_workers_zstd);
+    tcase_add_test(tc_core, test_writer_frame_workers_lz4);
+    tcase_add_test(tc_core, test_writer_frame_workers_exclusive);
+    tcase_add_test(tc_core, test_writer_frame_workers_empty);
+    tcase_add_test(tc_core, test_writer_flush);
+    tcase_add_test(tc_core, test_writer_async_error);
+    tcase_add_test(tc_core, test_writer_large_write);
+    tcase_add_test(tc_core, test_writer_reserve);
+    tcase_add_test(tc_core, test_writer_reserve_misuse);
+    tcase_add_test(tc_core, test_writer_fixed_frame_size);
+    tcase_add_test(tc_core, test_writer_fixed_frame_size_misuse);
+    tcase_add_test(tc_core, test_writer_dict_train);
+    tcase_add_test(tc_core, test_writer_dict);
+    tcase_add_test(tc_core, test_writer_dict_misuse);
+    tcase_add_test(tc_core, test_writer_target_rate_zstd);
+    tcase_add_test(tc_core, test_writer_target_rate_lz4);
+    tcase_add_test(tc_core, test_writer_target_rate_dict);
+    tcase_add_test(tc_core, test_writer_target_rate_misuse);
+    tcase_add_test(tc_core, test_writer_append_zstd);
+    tcase_add_test(tc_core, test_writer_append_lz4);
+    tcase_add_test(tc_core, test_writer_append_trailers);
+    tcase_add_test(tc_core, test_writer_append_misuse);
+    tcase_add_test(tc_core, test_writer_append_file);
+    tcase_add_test(tc_core, test_writer_concat_zstd);
+    tcase_add_test(tc_core, test_writer_concat_lz4);
+    tcase_add_test(tc_core, test_writer_concat_trailers);
+    tcase_add_test(tc_core, test_writer_concat_misuse);
+    tcase_add_test(tc_core, test_writer_concat_file);
+    tcase_add_test(tc_core, test_writer_record_aligned);
+    tcase_add_test(tc_core, test_writer_record_aligned_max);
+    tcase_add_test(tc_core, test_writer_max_frame_size);
+    tcase_add_test(tc_core, test_writer_record_aligned_misuse);
+    tcase_add_test(tc_core, test_writer_extended_seek_table);
+    tcase_add_test(tc_core, test_writer_instrumentation);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    Suite *s = writer_suite();
+    SRunner *sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}